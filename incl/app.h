@@ -1,11 +1,28 @@
 #pragma once
 
 #include "audio_device.h"
+#include "domain_models.h"
+#include "library_db.h"
+#include "library_graph.h"
+#include "metadata.h"
 #include "playlist.h"
+#include "scanner.h"
+#include "watcher.h"
 
 typedef struct app {
     audio_device_t audio_device;
     playlist_t playlist;
+    track_list_t* library; // the playlist's tracks with their tags
+    metadata_pool_t* metadata;
+    size_t metadata_next; // first library track not yet queued for tag reading
+    library_graph_t* graph; // albums, artists and genres of the library, NULL until its tags are read
+    library_db_t* library_db; // tags saved for library_path, NULL for single files
+    scanner_job_t* scan_job; // NULL when no folder scan is running
+    scanner_progress_t scan_progress;
+    char* library_path; // folder the playlist was scanned from, NULL for single files
+    watcher_t* watcher; // keeps the playlist in sync with library_path once scanned
+    char* resume_path; // track to keep current while a rescan refills the playlist
+    double rescan_retry_at; // GetTime() of the next try to rescan a folder that went away, 0 for none
     int w_width;
     int w_height;
 } app_t;
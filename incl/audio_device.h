@@ -2,24 +2,105 @@
 
 #include "miniaudio.h"
 #include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// tracks played one after another by a data source of the sound, see audio_device.c
+typedef struct audio_chain audio_chain_t;
+
+// where the engine's output goes
+typedef enum audio_device_output {
+    AUDIO_DEVICE_OUTPUT_DEFAULT, // the system's default sound card
+    AUDIO_DEVICE_OUTPUT_NULL,    // miniaudio's null backend, takes audio on a device clock without any hardware
+    AUDIO_DEVICE_OUTPUT_NONE     // no device, audio is pulled with audio_device_render as fast as the caller asks
+} audio_device_output_t;
+
+// settings fixed at init
+typedef struct audio_device_options {
+    unsigned int buffer_ms; // how far the decode thread reads ahead, covers stalls of the disk up to this long
+    bool map_files; // decode from memory mapped files, can be changed later with audio_device_set_map_files
+    audio_device_output_t output;
+    unsigned int sample_rate; // of the engine, 0 takes the device's rate, or 48000 without a device
+    float volume; // from 0.0f to 1.0f until audio_device_set_volume changes it
+    ma_engine_process_proc tap; // sees every period the engine mixes, on the audio thread with a device, NULL for none
+    void* tap_data;
+    unsigned int open_delay_ms; // every track open waits this long first like on a sleeping disk, for measuring, 0 for none
+} audio_device_options_t;
+
+// playback health since init
+typedef struct audio_device_stats {
+    size_t underruns; // reads the decode thread couldn't keep up with
+    size_t underrun_frames; // frames played as silence because of them
+    size_t buffered_frames; // frames decoded ahead right now
+    size_t buffer_frames; // frames the buffer holds when full
+    size_t reads; // reads of the audio thread
+    double read_seconds; // spent in them, waits for the decode thread included without a device
+    double read_seconds_max; // longest of them
+} audio_device_stats_t;
+
+// playback as the audio thread last left it, published after every read it does
+typedef struct audio_device_state {
+    float position; // seconds into the track being heard
+    float duration; // seconds, 0 if unknown
+    float volume;
+    bool paused;
+    bool loading; // the last played track isn't heard yet, position and duration are the previous one's
+} audio_device_state_t;
 
 // contains miniaudio engine, sound and some state variables
 typedef struct audio_device {
+    ma_context context; // only initialized for the null backend
     ma_engine engine;
-    ma_sound sound;
+    ma_sound sound; // plays the chain, stays around between tracks
+    audio_chain_t* chain;
     bool initialized;
+    bool owns_context;
+    audio_device_output_t output;
     bool sound_loaded;
     bool paused;
+    bool gapless; // open the queued track ahead of time and start it without a gap
+    float volume; // last volume sent to the audio thread
+    char* queued_path; // track queued to follow the current one, NULL if none
+    size_t playing_serial; // serial of the track the caller knows is playing
+    size_t queued_serial; // serial of the queued track
 } audio_device_t;
 
 // functions for initializing and uninitializing miniaudio members
-bool audio_device_init(audio_device_t* dev);
+// options can be NULL for the defaults
+audio_device_options_t audio_device_default_options(void);
+bool audio_device_init(audio_device_t* dev, const audio_device_options_t* options);
 void audio_device_free(audio_device_t* dev);
 
-// load a file and play it
+// opens a file on a loader thread and plays it once it's ready, the current track plays until then
+// a queued track with the same path is already open, so it starts right away
+// returns right away, a file that fails to open is noticed by audio_device_poll_transition
 bool audio_device_play_file(audio_device_t* dev, const char* path);
 
+// decodes tracks opened from now on straight from a memory mapping of the file instead of
+// stdio reads, files that can't be mapped still use stdio, it's on by default
+void audio_device_set_map_files(audio_device_t* dev, bool map_files);
+
+// gapless playback
+// ----------------
+// turns gapless playback on or off, it's on by default
+void audio_device_set_gapless(audio_device_t* dev, bool gapless);
+// overlaps the end of a track with the start of the queued one for seconds, 0 turns it off
+// tracks are faded with an equal-power curve and turn gapless playback on
+void audio_device_set_crossfade(audio_device_t* dev, float seconds);
+// mixes count frames of outgoing into incoming with that curve, done frames into a fade of total
+// frames, incoming plays alone past outgoing_count, used by the offline renderer as well
+void audio_device_mix_crossfade(float* incoming, const float* outgoing, uint64_t outgoing_count, uint64_t count,
+                                uint64_t done, uint64_t total, uint32_t channels);
+// opens a track in the background to follow the current one without a gap
+// replaces whatever was queued before, does nothing while gapless playback is off
+bool audio_device_queue_next(audio_device_t* dev, const char* path);
+// checks if the queued track took over since the last call, call it once per frame
+// the queue is empty afterwards, queue the track after it to keep going
+// also stops playback if the last played file couldn't be opened
+bool audio_device_poll_transition(audio_device_t* dev);
+
 // playback controls
+// these queue a command the audio thread applies at its next read, they never wait on it
 bool audio_device_stop(audio_device_t* dev);
 bool audio_device_pause(audio_device_t* dev);
 bool audio_device_resume(audio_device_t* dev);
@@ -30,6 +111,8 @@ bool audio_device_set_volume(audio_device_t* dev, float volume);
 float audio_device_get_volume(audio_device_t* dev);
 
 // sets playback progress from 0.0f to 1.0f
+// large mp3 files seek through an index of their frames, built on a loader the first time one
+// plays and kept in a sidecar file, seeks decode from the start of the file until it's ready
 bool audio_device_set_progress(audio_device_t* dev, float progress);
 // gets current playback progress from 0.0f to 1.0f
 float audio_device_get_progress(audio_device_t* dev);
@@ -41,7 +124,19 @@ float audio_device_get_position_seconds(audio_device_t* dev);
 
 // returns true if audio device is playing else false
 bool audio_device_is_playing(audio_device_t* dev);
-// returns true if audio device is paused else false
+// returns true if audio device is paused else false, as applied by the audio thread
 bool audio_device_is_paused(audio_device_t* dev);
 // checks if playback of current file is finished
 bool audio_device_is_finished(audio_device_t* dev);
+
+// gets position, duration, volume and pause together, so they always match each other
+audio_device_state_t audio_device_get_state(audio_device_t* dev);
+// gets underrun counters, read timings and how full the decode buffer is
+audio_device_stats_t audio_device_get_stats(audio_device_t* dev);
+
+// renders frame_count frames of the engine's output into out, only without a device
+// the mix goes through the same chain, sound and engine as on a device, reads wait for
+// the decode thread instead of playing silence, so nothing is dropped however fast it's called
+// returns the frames rendered, fewer than frame_count once the last track ran out and 0 after
+// that (the silence after it isn't counted) or on failure
+size_t audio_device_render(audio_device_t* dev, float* out, size_t frame_count);
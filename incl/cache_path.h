@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+// fnv-1a over a nul terminated string, used for cache file names and hash tables of paths
+uint64_t cache_path_hash(const char* s);
+
+// returns <cache dir>/sane-music-player/<name>-<hash of key><extension>, the cache dir is
+// $XDG_CACHE_HOME or ~/.cache, name may hold subdirectories like "seek/seek"
+// key is resolved with realpath first, so every spelling of one path gives the same file
+// returned string is dynamic (NULL on failure), caller must free
+char* cache_path_build(const char* name, const char* key, const char* extension);
+
+// creates every missing parent directory of path, path is restored afterwards
+bool cache_path_make_dirs(char* path);
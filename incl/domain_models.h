@@ -1,27 +1,66 @@
 #pragma once
 
+#include "handle_table.h"
+#include "string_arena.h"
 #include <stddef.h>
 #include <stdbool.h>
+#include <stdint.h>
 
 // ========================================================================
 // TRACKS
 // ========================================================================
 
+// artist, album and genre are interned in the string pool, so tracks share them
+// and they can be compared by pointer, tracks never free them
 typedef struct track {
     char* path; // identifier
     char* title;
-    char* artist;
-    char* album;
-    char* genre;
+    const char* artist;
+    const char* album;
+    const char* genre;
     int duration; // in seconds
     int year;
     int track_number;
+    int64_t file_mtime_sec; // identity of the file the tags were read from, 0 if never read
+    int64_t file_mtime_nsec;
+    uint64_t file_size;
 } track_t;
 
+// slot of the path index, position is the item index + 1 (0 marks an empty slot)
+typedef struct track_index_slot {
+    uint64_t hash;
+    size_t position;
+} track_index_slot_t;
+
+// refers to a track of a track list, stays valid while the list grows or shifts
+typedef handle_t track_handle_t;
+
+// numeric fields and tag ids of the tracks in a list, one contiguous array per field
+// lets filters and aggregates read only the fields they need
+typedef struct track_columns {
+    int32_t* duration;
+    int32_t* year;
+    int32_t* track_number;
+    uint32_t* artist; // string pool ids
+    uint32_t* album;
+    uint32_t* genre;
+    uint8_t* removed; // 1 marks a tombstone left by track_list_mark_removed
+} track_columns_t;
+
+// tracks plus an open addressing hash index over their paths
+// the index, handles and columns are kept up to date by append, remove and clear
+// path and title of listed tracks live in the list's arena, set titles through the list
+// tracks changed in place have to be refreshed to update the columns
 typedef struct track_list {
     track_t* items;
     size_t count;
     size_t capacity;
+    track_index_slot_t* index;
+    size_t index_capacity; // power of two, kept at most half full
+    handle_table_t handles;
+    string_arena_t strings;
+    track_columns_t columns; // capacity entries per column, like items
+    size_t removed_count; // tombstones waiting for a sweep
 } track_list_t;
 
 // track functions
@@ -39,59 +78,106 @@ track_t* track_copy(const track_t* track);
 track_list_t* track_list_create();
 // frees a list of tracks
 void track_list_free(track_list_t* list);
-// appends a track to a list of tracks
+// appends a copy of a track to a list of tracks, the caller still owns track
 bool track_list_append(track_list_t* list, track_t* track);
+// appends a placeholder track for each path, tags are filled in later
+bool track_list_append_paths(track_list_t* list, const char* const paths[], size_t count);
 // removes the track at the given index and shifts the rest down
+// compacts the list's strings once enough of them are removed
 bool track_list_remove(track_list_t* list, size_t index);
+// removes the track at the given index by moving the last track into its place
+// doesn't keep the order but only touches two tracks
+bool track_list_swap_remove(track_list_t* list, size_t index);
 // removes the track with the given path if it exists
 bool track_list_remove_by_path(track_list_t* list, const char* path);
+// marks the track at the given index as removed without moving anything
+// marked tracks stay in the list and indices stay valid until the next sweep
+bool track_list_mark_removed(track_list_t* list, size_t index);
+// checks if the track at the given index is marked as removed
+bool track_list_is_marked(const track_list_t* list, size_t index);
+// drops every marked track in a single pass and keeps the order of the rest
+// returns the amount of dropped tracks
+size_t track_list_sweep(track_list_t* list);
+// marks every track the predicate returns true for and sweeps once
+// returns the amount of dropped tracks, including ones marked before
+size_t track_list_remove_if(track_list_t* list, bool (*predicate)(const track_t* track, void* ctx), void* ctx);
 // clears the list of tracks (this does not free it)
+// the string memory is kept for the next tracks instead of being freed
 bool track_list_clear(track_list_t* list);
+// replaces the title of a track in the list
+bool track_list_set_title(track_list_t* list, track_t* track, const char* title);
+// copies the strings of every track into a fresh arena to give back removed space
+bool track_list_compact_strings(track_list_t* list);
+// copies the fields of a track in the list into the columns after changing it in place
+bool track_list_refresh(track_list_t* list, const track_t* track);
+// writes the indices of tracks with min_year <= year <= max_year to out in list order
+// out needs room for count indices, returns how many were written
+size_t track_list_filter_year(const track_list_t* list, int min_year, int max_year, size_t* out);
+// gets the total duration of every track in the list in seconds
+int64_t track_list_sum_duration(const track_list_t* list);
+// counts the tracks per genre, counts[id] for every genre string pool id below id_count
+// (string_pool_get_stats().strings + 1 covers every id), counts is zeroed first
+bool track_list_count_by_genre(const track_list_t* list, size_t* counts, size_t id_count);
 // gets the track at the provided index in a list of tracks
 track_t* track_list_get(track_list_t* list, size_t index);
 // gets the track with the provided path if it exists
 track_t* track_list_find_by_path(track_list_t* list, const char* path);
+// gets the index of the track with the provided path, SIZE_MAX if it doesn't exist
+size_t track_list_index_of_path(const track_list_t* list, const char* path);
 // checks if a list of tracks contains a track
 bool track_list_contains(track_list_t* list, const track_t* track);
 // gives back the index of a track if the track exists in the list
 size_t track_list_index_of(track_list_t* list, const track_t* track);
+// gets the handle of the track at the provided index
+track_handle_t track_list_handle_at(const track_list_t* list, size_t index);
+// gets the track a handle refers to, NULL if it was removed
+track_t* track_list_resolve(const track_list_t* list, track_handle_t handle);
 
 // ========================================================================
 // ALBUMS
 // ========================================================================
 
-// albums store pointers to tracks in the central track_list
+// albums store handles to tracks in the central track_list
 // they don't own the track data only reference it
 typedef struct album {
     char* title; // NOT unique
-    track_t** tracks; // array of pointers to tracks in central list
+    const track_list_t* source; // central list the handles resolve in
+    track_handle_t* tracks; // array of handles to tracks in central list
     size_t track_count;
     size_t track_capacity;
+    handle_set_t track_set; // finds handles in tracks once there are many
 } album_t;
 
+// refers to an album of an album list, stays valid while the list grows or shifts
+typedef handle_t album_handle_t;
+
 typedef struct album_list {
     album_t* items;
     size_t count;
     size_t capacity;
+    handle_table_t handles;
 } album_list_t;
 
 // album functions
 // ---------------
-// creates an album with only a title
-album_t* album_create(const char* title);
-// frees an album (does NOT free the tracks, only the pointer array)
+// creates an album with only a title, its tracks come from source
+album_t* album_create(const char* title, const track_list_t* source);
+// frees an album (does NOT free the tracks, only the handle array)
 void album_free(album_t* album);
-// adds a pointer to a track in the central list
-bool album_add_track(album_t* album, track_t* track);
-// removes a track pointer from an album
-bool album_remove_track(album_t* album, track_t* track);
-// checks if an album contains a pointer to this track
-bool album_has_track(album_t* album, const track_t* track);
+// adds a handle to a track in the central list
+bool album_add_track(album_t* album, track_handle_t track);
+// appends track handles without checking for duplicates or logging
+// for builders that already know every track is new to the album
+bool album_add_tracks(album_t* album, const track_handle_t tracks[], size_t count);
+// removes a track handle from an album, the last track takes its place
+bool album_remove_track(album_t* album, track_handle_t track);
+// checks if an album contains a handle to this track
+bool album_has_track(album_t* album, track_handle_t track);
 // gets the number of tracks in an album
 size_t album_get_track_count(const album_t* album);
 // gets the total duration of all tracks in an album
 int album_get_total_duration(const album_t* album);
-// gets a track pointer at the given index
+// gets the track at the given index, NULL if it was removed from the central list
 track_t* album_get_track(const album_t* album, size_t index);
 
 // album list functions
@@ -102,6 +188,8 @@ album_list_t* album_list_create();
 void album_list_free(album_list_t* list);
 // appends an album to a list of albums
 bool album_list_append(album_list_t* list, album_t* album);
+// appends several albums at once without logging each one
+bool album_list_append_many(album_list_t* list, const album_t albums[], size_t count);
 // removes the album at the given index and shifts the rest down
 bool album_list_remove(album_list_t* list, size_t index);
 // removes the album with the given title if it exists
@@ -114,41 +202,53 @@ album_t* album_list_get(album_list_t* list, size_t index);
 album_t* album_list_find_by_title(album_list_t* list, const char* title);
 // checks if a list of albums contains an album
 bool album_list_contains(album_list_t* list, const album_t* album);
+// gets the handle of the album at the provided index
+album_handle_t album_list_handle_at(const album_list_t* list, size_t index);
+// gets the album a handle refers to, NULL if it was removed
+album_t* album_list_resolve(const album_list_t* list, album_handle_t handle);
 
 // ========================================================================
 // GENRES
 // ========================================================================
 
-// genres store pointers to albums in the central album_list
+// genres store handles to albums in the central album_list
 // they don't own the album data, only reference it
 typedef struct genre {
     char* name; // unique but shouldn't be treated as such functionally
-    album_t** albums; // array of pointers to albums in central list
+    const album_list_t* source; // central list the handles resolve in
+    album_handle_t* albums; // array of handles to albums in central list
     size_t album_count;
     size_t album_capacity;
+    handle_set_t album_set; // finds handles in albums once there are many
 } genre_t;
 
+// refers to a genre of a genre list, stays valid while the list grows or shifts
+typedef handle_t genre_handle_t;
+
 typedef struct genre_list {
     genre_t* items;
     size_t count;
     size_t capacity;
+    handle_table_t handles;
 } genre_list_t;
 
 // genre functions
 // ---------------
-// creates a genre with only a name
-genre_t* genre_create(const char* name);
-// frees a genre (does NOT free the albums, only the pointer array)
+// creates a genre with only a name, its albums come from source
+genre_t* genre_create(const char* name, const album_list_t* source);
+// frees a genre (does NOT free the albums, only the handle array)
 void genre_free(genre_t* genre);
-// adds a pointer to an album in the central list
-bool genre_add_album(genre_t* genre, album_t* album);
-// removes an album pointer from a genre
-bool genre_remove_album(genre_t* genre, album_t* album);
-// checks if a genre contains a pointer to this album
-bool genre_has_album(genre_t* genre, const album_t* album);
+// adds a handle to an album in the central list
+bool genre_add_album(genre_t* genre, album_handle_t album);
+// appends album handles without checking for duplicates or logging
+bool genre_add_albums(genre_t* genre, const album_handle_t albums[], size_t count);
+// removes an album handle from a genre, the last album takes its place
+bool genre_remove_album(genre_t* genre, album_handle_t album);
+// checks if a genre contains a handle to this album
+bool genre_has_album(genre_t* genre, album_handle_t album);
 // gets the number of albums in a genre
 size_t genre_get_album_count(const genre_t* genre);
-// gets an album pointer at the given index
+// gets the album at the given index, NULL if it was removed from the central list
 album_t* genre_get_album(const genre_t* genre, size_t index);
 
 // genre list functions
@@ -159,6 +259,8 @@ genre_list_t* genre_list_create();
 void genre_list_free(genre_list_t* list);
 // appends a genre to a list of genres
 bool genre_list_append(genre_list_t* list, genre_t* genre);
+// appends several genres at once without logging each one
+bool genre_list_append_many(genre_list_t* list, const genre_t genres[], size_t count);
 // removes the genre at the given index and shifts the rest down
 bool genre_list_remove(genre_list_t* list, size_t index);
 // removes the genre with the given name if it exists
@@ -171,41 +273,53 @@ genre_t* genre_list_get(genre_list_t* list, size_t index);
 genre_t* genre_list_find_by_name(genre_list_t* list, const char* name);
 // checks if a list of genres contains a genre
 bool genre_list_contains(genre_list_t* list, const genre_t* genre);
+// gets the handle of the genre at the provided index
+genre_handle_t genre_list_handle_at(const genre_list_t* list, size_t index);
+// gets the genre a handle refers to, NULL if it was removed
+genre_t* genre_list_resolve(const genre_list_t* list, genre_handle_t handle);
 
 // ========================================================================
 // ARTISTS
 // ========================================================================
 
-// artists store pointers to albums in the central album_list
+// artists store handles to albums in the central album_list
 // they don't own the album data only reference it
 typedef struct artist {
     char* name; // NOT unique
-    album_t** albums; // array of pointers to albums in central list
+    const album_list_t* source; // central list the handles resolve in
+    album_handle_t* albums; // array of handles to albums in central list
     size_t album_count;
     size_t album_capacity;
+    handle_set_t album_set; // finds handles in albums once there are many
 } artist_t;
 
+// refers to an artist of an artist list, stays valid while the list grows or shifts
+typedef handle_t artist_handle_t;
+
 typedef struct artist_list {
     artist_t* items;
     size_t count;
     size_t capacity;
+    handle_table_t handles;
 } artist_list_t;
 
 // artist functions
 // ----------------
-// creates an artist with only a name
-artist_t* artist_create(const char* name);
-// frees an artist (does NOT free the albums, only the pointer array)
+// creates an artist with only a name, its albums come from source
+artist_t* artist_create(const char* name, const album_list_t* source);
+// frees an artist (does NOT free the albums, only the handle array)
 void artist_free(artist_t* artist);
-// adds a pointer to an album in the central list
-bool artist_add_album(artist_t* artist, album_t* album);
-// removes an album pointer from an artist
-bool artist_remove_album(artist_t* artist, album_t* album);
-// checks if an artist has a pointer to this album
-bool artist_has_album(artist_t* artist, const album_t* album);
+// adds a handle to an album in the central list
+bool artist_add_album(artist_t* artist, album_handle_t album);
+// appends album handles without checking for duplicates or logging
+bool artist_add_albums(artist_t* artist, const album_handle_t albums[], size_t count);
+// removes an album handle from an artist, the last album takes its place
+bool artist_remove_album(artist_t* artist, album_handle_t album);
+// checks if an artist has a handle to this album
+bool artist_has_album(artist_t* artist, album_handle_t album);
 // gets the number of albums by an artist
 size_t artist_get_album_count(const artist_t* artist);
-// gets an album pointer at the given index
+// gets the album at the given index, NULL if it was removed from the central list
 album_t* artist_get_album(const artist_t* artist, size_t index);
 
 // artist list functions
@@ -216,6 +330,8 @@ artist_list_t* artist_list_create();
 void artist_list_free(artist_list_t* list);
 // appends an artist to a list of artists
 bool artist_list_append(artist_list_t* list, artist_t* artist);
+// appends several artists at once without logging each one
+bool artist_list_append_many(artist_list_t* list, const artist_t artists[], size_t count);
 // removes the artist at the given index and shifts the rest down
 bool artist_list_remove(artist_list_t* list, size_t index);
 // removes the artist with the given name if it exists
@@ -228,3 +344,7 @@ artist_t* artist_list_get(artist_list_t* list, size_t index);
 artist_t* artist_list_find_by_name(artist_list_t* list, const char* name);
 // checks if a list of artists contains an artist
 bool artist_list_contains(artist_list_t* list, const artist_t* artist);
+// gets the handle of the artist at the provided index
+artist_handle_t artist_list_handle_at(const artist_list_t* list, size_t index);
+// gets the artist a handle refers to, NULL if it was removed
+artist_t* artist_list_resolve(const artist_list_t* list, artist_handle_t handle);
@@ -0,0 +1,26 @@
+#pragma once
+
+#include "domain_models.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// length of an audio file as its headers state it
+typedef struct duration_probe {
+    uint64_t frames; // at sample_rate
+    uint32_t sample_rate; // the file's own rate, or the media timescale for mp4
+} duration_probe_t;
+
+// reads the length of a file from its container headers without decoding any audio
+// knows flac streaminfo, mp3 xing, info and vbri headers (the frame size for plain cbr),
+// the last granule of ogg vorbis and opus, the mdhd box of mp4 and the data size of wav
+// returns false for other formats and for headers that don't state a length
+bool duration_probe_file(const char* path, duration_probe_t* out);
+// rounds a probed length to whole seconds
+int duration_probe_seconds(const duration_probe_t* probe);
+
+// probes every track of a list that has no duration yet, split over thread_count threads
+// (0 picks one per core), then fills in and refreshes the tracks it found a length for
+// indices of those tracks go to filled if it isn't NULL, it needs room for every track
+// returns how many tracks were filled in
+size_t duration_probe_list(track_list_t* list, size_t thread_count, size_t* filled);
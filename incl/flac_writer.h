@@ -0,0 +1,16 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// streams 16-bit pcm into a flac file, see flac_writer.c
+typedef struct flac_writer flac_writer_t;
+
+// creates the file for 1 to 8 channels, returns NULL on failure
+flac_writer_t* flac_writer_open(const char* path, uint32_t sample_rate, uint32_t channels);
+// encodes interleaved frames, any amount at a time, blocks are written once they're full
+bool flac_writer_write(flac_writer_t* writer, const int16_t* frames, size_t frame_count);
+// writes the last block and the final stream info, then frees the writer
+// returns false if anything couldn't be written, the file is incomplete then
+bool flac_writer_close(flac_writer_t* writer);
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// refers to an item of a list through a slot that follows the item when the list
+// grows or shifts, the generation tells a removed item apart from whatever reuses its slot
+// generation 0 is never handed out, so a zeroed handle refers to nothing
+typedef struct handle {
+    uint32_t slot;
+    uint32_t generation;
+} handle_t;
+
+#define HANDLE_NULL ((handle_t){ 0, 0 })
+
+// arrays of handles shorter than this are scanned instead of hashed
+#define HANDLE_SET_THRESHOLD 32
+
+// maps handles to positions in a list and back, freed slots are reused
+// build with -DHANDLE_DEBUG to abort on stale handles instead of treating them as missing
+typedef struct handle_table {
+    uint32_t* generations; // per slot, bumped when the slot is freed
+    size_t* positions; // per slot, position of its item or SIZE_MAX if free
+    size_t slot_count;
+    size_t slot_capacity;
+    uint32_t* free_slots; // stack of freed slots
+    size_t free_count;
+    uint32_t* slot_of; // per position, slot of the item there
+    size_t position_capacity;
+} handle_table_t;
+
+// finds handles in an array without scanning it, the array itself keeps its order
+// entries are positions in the array, so the array is passed to every call
+typedef struct handle_set {
+    uint32_t* slots; // open addressing, position + 1 or 0 when empty
+    size_t capacity; // 0 until built
+} handle_set_t;
+
+// handle functions
+// ----------------
+// checks if two handles refer to the same item
+bool handle_equals(handle_t a, handle_t b);
+// checks if a handle refers to nothing
+bool handle_is_null(handle_t handle);
+
+// handle table functions
+// ----------------------
+// hands out a handle for an item appended at position (the current item count)
+bool handle_table_push(handle_table_t* table, size_t position, handle_t* out);
+// gets the handle of the item at position
+handle_t handle_table_at(const handle_table_t* table, size_t position);
+// gets the position of the item a handle refers to, SIZE_MAX if it's null or stale
+size_t handle_table_resolve(const handle_table_t* table, handle_t handle);
+// frees the handle of the item at position, items after it moved one down
+// count is the amount of items before the removal
+void handle_table_remove(handle_table_t* table, size_t position, size_t count);
+// frees the handle of the item at position, the last item moved into its place
+void handle_table_swap_remove(handle_table_t* table, size_t position, size_t count);
+// frees the handles of the items flagged in removed, the rest moved down in order
+void handle_table_remove_flagged(handle_table_t* table, const uint8_t* removed, size_t count);
+// frees the handles of the first count items, handles to them become stale
+void handle_table_clear(handle_table_t* table, size_t count);
+// frees the memory of a table (this does not free the table itself)
+void handle_table_free(handle_table_t* table);
+
+// handle set functions
+// --------------------
+// hashes the first count handles of items, replacing whatever the set held
+bool handle_set_build(handle_set_t* set, const handle_t* items, size_t count);
+// gets the position of handle in items, SIZE_MAX if it's not there or the set isn't built
+size_t handle_set_find(const handle_set_t* set, const handle_t* items, handle_t handle);
+// adds items[position] once it's been appended, does nothing while the set isn't built
+bool handle_set_insert(handle_set_t* set, const handle_t* items, size_t position);
+// drops items[position] and points the last handle at position, call before moving it there
+// count is the amount of items before the removal
+void handle_set_swap_remove(handle_set_t* set, const handle_t* items, size_t position, size_t count);
+// frees the memory of a set (this does not free the set itself)
+void handle_set_free(handle_set_t* set);
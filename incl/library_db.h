@@ -0,0 +1,54 @@
+#pragma once
+
+#include "domain_models.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// a track as stored in the library database
+// strings point into the database, valid until the next put, remove, poll or close
+typedef struct library_db_track {
+    const char* path;
+    const char* title;
+    const char* artist;
+    const char* album;
+    const char* genre;
+    int duration; // in seconds
+    int year;
+    int track_number;
+    int64_t file_mtime_sec;
+    int64_t file_mtime_nsec;
+    uint64_t file_size;
+} library_db_track_t;
+
+// tags of every known track of a folder, memory mapped read only
+// changes go to an append only log and get compacted in the background
+typedef struct library_db library_db_t;
+
+// returns the default database file for a folder
+// returned string is dynamic (NULL on failure), caller must free
+char* library_db_default_path(const char* dir_path);
+
+// maps a database file and replays its change log, a missing file gives an empty database
+library_db_t* library_db_open(const char* db_path);
+// waits for a running compaction and closes the database
+void library_db_close(library_db_t* db);
+
+// gets the amount of tracks in the database
+size_t library_db_count(const library_db_t* db);
+// looks up a track by path, returns false if it isn't in the database
+bool library_db_find(const library_db_t* db, const char* path, library_db_track_t* out);
+// copies the stored tags of a track into a track of a list
+bool library_db_fill_track(const library_db_track_t* stored, track_list_t* list, track_t* track);
+
+// stores the tags of a track, replacing what was stored for its path
+bool library_db_put(library_db_t* db, const track_t* track);
+// removes a track from the database
+bool library_db_remove(library_db_t* db, const char* path);
+
+// starts compacting in the background once enough changes are logged
+// returns true if a compaction was started
+bool library_db_compact(library_db_t* db);
+// finishes a compaction that's done running without blocking
+// returns true if the database was swapped for the compacted one
+bool library_db_poll(library_db_t* db);
@@ -0,0 +1,31 @@
+#pragma once
+
+#include "domain_models.h"
+#include <stdbool.h>
+#include <stddef.h>
+
+// albums, artists and genres grouped from the tags of a track list
+// an album is one album title by one artist, it's filed under the genre of its first track
+// artists and genres hold the albums, albums hold the tracks, all through handles
+typedef struct library_graph library_graph_t;
+
+// groups every track of a list in one pass, split over thread_count threads (0 picks one per core)
+// the list must not change while this runs, afterwards keep the graph in sync with the functions below
+library_graph_t* library_graph_build(const track_list_t* tracks, size_t thread_count);
+// frees the graph and its albums, artists and genres
+void library_graph_free(library_graph_t* graph);
+
+// files tracks first to first + count - 1 of the list under their albums
+bool library_graph_add_tracks(library_graph_t* graph, size_t first, size_t count);
+// takes the track at index out of its album before it's removed from the list
+// albums, artists and genres left empty are removed as well
+bool library_graph_remove_track(library_graph_t* graph, size_t index);
+// moves the track at index to the album its current tags point to
+bool library_graph_update_track(library_graph_t* graph, size_t index);
+
+// gets the grouped albums, artists and genres, owned by the graph
+const album_list_t* library_graph_albums(const library_graph_t* graph);
+const artist_list_t* library_graph_artists(const library_graph_t* graph);
+const genre_list_t* library_graph_genres(const library_graph_t* graph);
+// gets the album a track is filed under, a null handle if it isn't in the graph
+album_handle_t library_graph_album_of(const library_graph_t* graph, track_handle_t track);
@@ -2,8 +2,15 @@
 
 #include <stdio.h>
 
+// builds whose stdout is for data, like the headless tool, send info to stderr with the rest
+#ifdef LOG_INFO_STDERR
+#define LOG_INFO_STREAM stderr
+#else
+#define LOG_INFO_STREAM stdout
+#endif
+
 #define LOG_INFO(fmt, ...)  \
-    fprintf(stdout, "[INFO] [%s:%d] " fmt "\n", __FILE__, __LINE__, ##__VA_ARGS__)
+    fprintf(LOG_INFO_STREAM, "[INFO] [%s:%d] " fmt "\n", __FILE__, __LINE__, ##__VA_ARGS__)
 
 #define LOG_WARN(fmt, ...)  \
     fprintf(stderr, "[WARN] [%s:%d] " fmt "\n", __FILE__, __LINE__, ##__VA_ARGS__)
@@ -0,0 +1,73 @@
+#pragma once
+
+#include "domain_models.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// tags read from one audio file
+// strings are NULL when the file doesn't have that tag
+typedef struct metadata_record {
+    char* path;
+    char* title;
+    char* artist;
+    char* album;
+    char* genre;
+    int duration; // in seconds
+    int year;
+    int track_number;
+    int64_t file_mtime_sec;
+    int64_t file_mtime_nsec;
+    uint64_t file_size;
+    size_t index; // where the track was in the list when it was submitted
+} metadata_record_t;
+
+typedef struct metadata_options {
+    size_t thread_count; // 0 picks the default, keep it low for spinning disks
+    size_t queue_capacity; // maximum amount of files waiting to be read
+} metadata_options_t;
+
+// throughput counters of a metadata pool
+typedef struct metadata_stats {
+    size_t submitted;
+    size_t completed;
+    size_t failed; // files taglib couldn't open
+    size_t unchanged; // files skipped because their tags were read before
+    size_t threads;
+    double elapsed_seconds; // time spent with work in the pool
+    double tracks_per_second;
+} metadata_stats_t;
+
+// reads tags on a bounded pool of worker threads
+typedef struct metadata_pool metadata_pool_t;
+
+// returns the default metadata options
+metadata_options_t metadata_default_options();
+
+// reads the tags of a single file on the calling thread
+// a file taglib can't read still gets its duration if the container headers state one
+// returns false if neither worked, out is left empty then
+bool metadata_read(const char* path, metadata_record_t* out);
+// frees the strings of a record (this does not free the record itself)
+void metadata_record_free(metadata_record_t* record);
+// copies the tags of a record into the matching track of a list
+// missing tags keep the track's current values, returns NULL if the track is gone
+track_t* metadata_apply(track_list_t* list, metadata_record_t* record);
+
+// starts the worker threads of a metadata pool
+metadata_pool_t* metadata_pool_create(const metadata_options_t* options);
+// queues tracks first to first + count - 1 of a list without blocking
+// tracks whose file still matches their file_mtime_sec, file_mtime_nsec and file_size are only stat'ed
+// returns how many were queued, the rest should be submitted again later
+size_t metadata_pool_submit(metadata_pool_t* pool, const track_list_t* list, size_t first, size_t count);
+// moves up to max finished records into out without blocking
+// returns the amount of records moved, the caller frees them
+size_t metadata_pool_poll(metadata_pool_t* pool, metadata_record_t* out, size_t max);
+// drops queued files and throws away results of files being read right now
+void metadata_pool_clear(metadata_pool_t* pool);
+// returns true if nothing is queued, being read or waiting to be polled
+bool metadata_pool_is_idle(metadata_pool_t* pool);
+// gets the throughput counters of the pool
+metadata_stats_t metadata_pool_get_stats(metadata_pool_t* pool);
+// stops the worker threads and frees the pool
+void metadata_pool_free(metadata_pool_t* pool);
@@ -0,0 +1,46 @@
+#pragma once
+
+#include "playlist.h"
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// file a render is written as, both hold 16-bit samples
+typedef enum offline_render_format {
+    OFFLINE_RENDER_WAV,
+    OFFLINE_RENDER_FLAC
+} offline_render_format_t;
+
+// settings of a render
+typedef struct offline_render_options {
+    offline_render_format_t format;
+    unsigned int sample_rate; // of the engine the tracks play through, 0 for 48000
+    float volume; // from 0.0f to 1.0f
+    float crossfade; // seconds tracks overlap for, 0 plays them gapless
+    size_t thread_count; // tracks rendered at once, 0 picks one per core
+    bool map_files; // decode from memory mapped files
+} offline_render_options_t;
+
+// what a render did
+typedef struct offline_render_stats {
+    size_t tracks; // rendered into the file
+    size_t failed; // couldn't be opened, they're left out
+    uint64_t frames; // written to the file
+    unsigned int sample_rate;
+    size_t threads;
+    double seconds; // from start to the finished file
+    double render_seconds; // the threads spent rendering, summed up
+} offline_render_stats_t;
+
+offline_render_options_t offline_render_default_options(void);
+
+// picks the format from the extension of path, wav for anything but .flac
+offline_render_format_t offline_render_format_for_path(const char* path);
+
+// renders count tracks of a playlist from first on into a file, as they'd be heard played one
+// after another with gapless playback, or with the crossfade if it's set
+// every track plays through its own audio device without an output, so the same decoder,
+// volume and chain as playback, just pulled as fast as the cpu goes
+// tracks render in parallel and are stitched together in order, stats can be NULL
+bool offline_render_playlist(const playlist_t* list, size_t first, size_t count, const char* path,
+                             const offline_render_options_t* options, offline_render_stats_t* stats);
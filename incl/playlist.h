@@ -1,13 +1,15 @@
 #pragma once
 
 #include "audio_device.h"
+#include "string_arena.h"
 #include <limits.h>
 
-// dynamic array of strings
+// dynamic array of strings, the strings live in the arena
 typedef struct tracks {
     char** items;
     size_t count;
     size_t capacity;
+    string_arena_t strings;
 } tracks_t;
 
 // contains a dynamic array of strings and the current track index
@@ -17,7 +19,7 @@ typedef struct playlist {
 } playlist_t;
 
 // functions for editing the items of a tracks instance
-// note: clearing tracks does NOT free it
+// note: clearing tracks does NOT free it, the string memory is kept for reuse
 bool tracks_append(tracks_t* tracks, const char* path);
 bool tracks_remove(tracks_t* tracks, size_t index);
 bool tracks_clear(tracks_t* tracks);
@@ -41,6 +43,14 @@ bool playlist_remove(playlist_t* list, size_t index);
 bool playlist_clear(playlist_t* list);
 // recursively scans the provided folder path and adds audio files to playlist
 void playlist_scan_dir_recursive(playlist_t* list, const char* dir_path);
+// inserts tracks into a playlist kept in folder scan order in a single pass
+// paths already in the playlist are skipped, the current track stays the same
+bool playlist_merge_sorted(playlist_t* list, const char* paths[], size_t count);
+// removes every track the predicate returns true for in a single pass
+// returns the amount of removed tracks, the current index follows its track
+size_t playlist_remove_if(playlist_t* list, bool (*predicate)(const char* path, void* ctx), void* ctx);
+// compares two paths in folder scan order (alphabetical per directory, depth first)
+int playlist_compare_paths(const char* a, const char* b);
 
 // plays the current track on the provided audio device
 bool playlist_play_current(playlist_t* list, audio_device_t* dev);
@@ -51,8 +61,10 @@ bool playlist_play_previous(playlist_t* list, audio_device_t* dev);
 
 // gets the index of the current track
 size_t playlist_get_current_track(const playlist_t* list);
-// gets the path of the current track (pointer to playlist member, NOT valid after free)
+// gets the path of the current track (pointer to playlist member, NOT valid after removing tracks or free)
 char* playlist_get_current_track_path(const playlist_t* list);
+// gets the path of the track that plays after the current one (will wrap around, same lifetime as above)
+char* playlist_get_next_track_path(const playlist_t* list);
 // sets the current track to the provided index
 bool playlist_set_current_track(playlist_t* list, size_t index);
 // resets the playlist index back to zero
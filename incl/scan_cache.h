@@ -0,0 +1,52 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// one entry of a cached directory, either an audio file or a subdirectory
+typedef struct scan_cache_entry {
+    const char* name;
+    bool is_dir;
+} scan_cache_entry_t;
+
+// a directory as it looked the last time it was read
+// entries are sorted by name and only contain audio files and subdirectories
+typedef struct scan_cache_dir {
+    const char* rel_path; // relative to the scan root, "" for the root itself
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    scan_cache_entry_t* entries;
+    size_t entry_count;
+} scan_cache_dir_t;
+
+// read only view of a cache file, safe to share between threads
+typedef struct scan_cache scan_cache_t;
+
+// builds a new cache file, written atomically on commit
+typedef struct scan_cache_writer scan_cache_writer_t;
+
+// returns the default cache file for a scan root
+// returned string is dynamic (NULL on failure), caller must free
+char* scan_cache_default_path(const char* dir_path);
+
+// loads a cache file, returns NULL if it doesn't exist or is invalid
+scan_cache_t* scan_cache_load(const char* cache_path);
+// frees a loaded cache
+void scan_cache_free(scan_cache_t* cache);
+// gets the cached directory with the given relative path if it exists
+const scan_cache_dir_t* scan_cache_find(const scan_cache_t* cache, const char* rel_path);
+// gets the number of cached directories
+size_t scan_cache_dir_count(const scan_cache_t* cache);
+// gets the cached directory at the given index
+const scan_cache_dir_t* scan_cache_get(const scan_cache_t* cache, size_t index);
+
+// starts writing a cache file
+scan_cache_writer_t* scan_cache_writer_open(const char* cache_path);
+// adds a directory to the cache being written
+bool scan_cache_writer_add(scan_cache_writer_t* writer, const scan_cache_dir_t* dir);
+// moves the written cache into place and frees the writer
+bool scan_cache_writer_commit(scan_cache_writer_t* writer);
+// throws the written cache away and frees the writer
+void scan_cache_writer_abort(scan_cache_writer_t* writer);
@@ -0,0 +1,79 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+// options for a directory scan
+typedef struct scanner_options {
+    size_t thread_count; // 0 picks the number of online cpus
+    bool trust_d_type; // classify entries by dirent d_type instead of stat'ing each one
+    bool use_cache; // skip directories whose mtime matches the on disk scan cache
+} scanner_options_t;
+
+// counters collected during a scan
+typedef struct scanner_stats {
+    size_t dirs_visited;
+    size_t files_matched;
+    size_t stat_calls;
+    size_t stat_calls_saved; // entries classified by extension and d_type alone
+    size_t bytes_read; // directory entry data returned by readdir
+    size_t cache_hits; // directories taken from the scan cache without reading
+    size_t steals; // directories taken from another worker's deque
+    size_t threads;
+    double elapsed_seconds;
+} scanner_stats_t;
+
+// result of a scan
+// paths are in the same order a sorted depth first walk would produce
+typedef struct scanner_result {
+    char** paths;
+    size_t count;
+    scanner_stats_t stats;
+} scanner_result_t;
+
+// returns the default scan options
+scanner_options_t scanner_default_options();
+
+// scans dir_path recursively for audio files using a pool of worker threads
+// subdirectories are shared between workers through work stealing deques
+// the result is sorted alphabetically per directory like the old recursive walk
+bool scanner_scan(const char* dir_path, const scanner_options_t* options, scanner_result_t* out);
+// frees the paths of a scan result (this does not free the result itself)
+void scanner_result_free(scanner_result_t* result);
+
+// progress of a background scan, filled from atomic counters
+typedef struct scanner_progress {
+    size_t dirs_visited;
+    size_t files_matched;
+    size_t bytes_read;
+    double bytes_per_second;
+    double elapsed_seconds;
+    bool done; // finished and every batch has been polled
+} scanner_progress_t;
+
+// a batch of paths in final playlist order
+typedef struct scanner_batch {
+    char** paths;
+    size_t count;
+} scanner_batch_t;
+
+// a scan running on its own thread
+typedef struct scanner_job scanner_job_t;
+
+// starts scanning dir_path in the background
+// batches come out in the same order scanner_scan would return the paths
+scanner_job_t* scanner_job_start(const char* dir_path, const scanner_options_t* options);
+// moves the next finished batch into out without blocking
+// returns false if no batch is ready yet, the caller frees the batch
+bool scanner_job_poll(scanner_job_t* job, scanner_batch_t* out);
+// frees the paths of a batch (this does not free the batch itself)
+void scanner_batch_free(scanner_batch_t* batch);
+// gets the current progress counters without blocking
+scanner_progress_t scanner_job_get_progress(scanner_job_t* job);
+// returns true once the scan is finished and every batch has been polled
+bool scanner_job_is_done(scanner_job_t* job);
+// cancels the scan if it's still running, waits for it and frees the job
+void scanner_job_free(scanner_job_t* job);
+
+// helper to check if a file is an audio file
+bool is_audio_file(const char* path);
@@ -0,0 +1,34 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// a place in a file decoding can restart from without reading what comes before it
+typedef struct seek_point {
+    uint64_t byte_offset; // where decoding restarts
+    uint64_t frame; // first frame of the point, at the file's own sample rate
+    uint16_t discard_packets; // packets decoded and thrown away first, they refill the decoder's history
+    uint16_t discard_frames; // frames of the last of them that come before frame
+} seek_point_t;
+
+// seek points of one file, only valid while its size and modification time match
+typedef struct seek_index {
+    uint64_t file_size;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+    seek_point_t* points; // sorted by frame
+    size_t count;
+} seek_index_t;
+
+// returns the default sidecar file for an audio file
+// returned string is dynamic (NULL on failure), caller must free
+char* seek_index_default_path(const char* file_path);
+
+// loads a sidecar file, returns NULL if it doesn't exist, is invalid or was built
+// for a different version of the file than the given size and modification time
+seek_index_t* seek_index_load(const char* index_path, uint64_t file_size, int64_t mtime_sec, int64_t mtime_nsec);
+// writes a sidecar file atomically, so a reader never sees half of it
+bool seek_index_save(const char* index_path, const seek_index_t* index);
+// frees a loaded or built index and its points
+void seek_index_free(seek_index_t* index);
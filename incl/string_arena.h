@@ -0,0 +1,28 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef struct string_arena_chunk string_arena_chunk_t;
+
+// copies strings into large chunks owned by one container
+// strings can't be freed one by one, released ones only count as dead space
+// until the owner compacts by copying its live strings into a fresh arena
+typedef struct string_arena {
+    string_arena_chunk_t* first;
+    string_arena_chunk_t* current; // chunk new strings go into, later ones are spare
+    size_t chunk_count;
+    size_t live_bytes;
+    size_t dead_bytes; // released but not reclaimed
+} string_arena_t;
+
+// copies a string into the arena, returns NULL on failure
+char* string_arena_copy(string_arena_t* arena, const char* s);
+// marks a string of the arena as unused
+void string_arena_release(string_arena_t* arena, const char* s);
+// returns true when enough space is dead that compacting is worth it
+bool string_arena_wants_compaction(const string_arena_t* arena);
+// drops every string but keeps the chunks for reuse (this does not free it)
+void string_arena_reset(string_arena_t* arena);
+// frees every chunk of the arena (this does not free the arena itself)
+void string_arena_free(string_arena_t* arena);
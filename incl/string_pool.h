@@ -0,0 +1,29 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// counters of the global string pool
+typedef struct string_pool_stats {
+    size_t strings; // distinct strings stored, ids go from 1 up to this
+    size_t bytes; // bytes used by those strings
+    size_t lookups; // calls to string_pool_intern
+    size_t hits; // lookups that found an existing string
+} string_pool_stats_t;
+
+// returns the shared copy of s, adding it on first use (NULL on failure)
+// interned strings are immutable, live until string_pool_clear and
+// two of them are equal exactly when their pointers are
+const char* string_pool_intern(const char* s);
+// gets the id of an interned string, 0 for NULL
+// ids are small and dense, which makes them usable as array indices
+uint32_t string_pool_id(const char* interned);
+// gets the interned string with an id, NULL if there is none
+const char* string_pool_get(uint32_t id);
+// gets the counters of the pool
+string_pool_stats_t string_pool_get_stats();
+// logs the counters of the pool
+void string_pool_log_stats();
+// frees every interned string, nothing may point at them afterwards
+void string_pool_clear();
@@ -0,0 +1,47 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+
+typedef enum watcher_op_kind {
+    WATCHER_ADD,        // an audio file appeared or was rewritten
+    WATCHER_REMOVE,     // an audio file disappeared
+    WATCHER_REMOVE_DIR, // a directory disappeared, drop everything below it
+    WATCHER_RESCAN      // events were lost, the whole folder needs a rescan
+} watcher_op_kind_t;
+
+typedef struct watcher_op {
+    watcher_op_kind_t kind;
+    char* path;
+} watcher_op_t;
+
+// a coalesced batch of changes
+// removals come first, additions after them sorted by path
+typedef struct watcher_batch {
+    watcher_op_t* ops;
+    size_t count;
+} watcher_batch_t;
+
+typedef struct watcher_options {
+    size_t max_watches; // 0 uses half of the kernel's max_user_watches
+    int debounce_ms; // quiet time before pending changes are handed out
+    int max_latency_ms; // upper bound on how long a change can be held back
+} watcher_options_t;
+
+// watches a folder on its own thread
+typedef struct watcher watcher_t;
+
+// returns the default watcher options
+watcher_options_t watcher_default_options();
+
+// starts watching dir_path and all its subdirectories with inotify
+// directories are taken from the scan cache when there is one,
+// so nothing is read again after a folder scan
+watcher_t* watcher_start(const char* dir_path, const watcher_options_t* options);
+// moves the next batch of changes into out without blocking
+// returns false if no batch is ready yet, the caller frees the batch
+bool watcher_poll(watcher_t* watcher, watcher_batch_t* out);
+// frees the ops of a batch (this does not free the batch itself)
+void watcher_batch_free(watcher_batch_t* batch);
+// stops the watcher thread and frees the watcher
+void watcher_free(watcher_t* watcher);
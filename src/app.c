@@ -2,15 +2,29 @@
 #include "file_dialog.h"
 #include "logger.h"
 #include "raylib.h"
+#include "string_pool.h"
 #include <stdlib.h>
+#include <string.h>
+
+// seconds between attempts to rescan a folder that went away, until it's back
+#define RESCAN_RETRY_SECONDS 5.0
 
 void handle_input(app_t* app);
 void update(app_t* app);
 void render(app_t* app);
+void start_scan(app_t* app, const char* folder_path);
+void stop_scan(app_t* app);
+void clear_library(app_t* app);
+void add_to_library(app_t* app, const char* const paths[], size_t count);
+void apply_library_changes(app_t* app, const watcher_batch_t* batch);
+bool rescan_library(app_t* app);
 
 void app_init(app_t* app) {
-    audio_device_init(&app->audio_device);
+    audio_device_init(&app->audio_device, NULL);
     playlist_init(&app->playlist);
+    app->library = track_list_create();
+    metadata_options_t metadata_options = metadata_default_options();
+    app->metadata = metadata_pool_create(&metadata_options);
 
     app->w_width = 800;
     app->w_height = 450;
@@ -26,8 +40,14 @@ void app_init(app_t* app) {
 }
 
 void app_free(app_t* app) {
+    stop_scan(app);
+    if (app->metadata) metadata_pool_free(app->metadata);
+    if (app->graph) library_graph_free(app->graph);
     audio_device_free(&app->audio_device);
     playlist_free(&app->playlist);
+    if (app->library) track_list_free(app->library);
+    string_pool_log_stats();
+    string_pool_clear();
     CloseWindow();
 
     LOG_INFO("App deinitialized successfully.");
@@ -74,20 +94,19 @@ void handle_input(app_t* app) {
         IsKeyPressed(KEY_O)) {
         char* folder_path = file_dialog_open_folder();
         if (folder_path) {
-            playlist_clear(&app->playlist);
-            LOG_INFO("Scanning folder: %s", folder_path);
-            playlist_scan_dir_recursive(&app->playlist, folder_path);
-            size_t track_count = playlist_count(&app->playlist);
-            LOG_INFO("Added %zu tracks from folder.", track_count);
-            playlist_play_current(&app->playlist, &app->audio_device);
+            stop_scan(app);
+            clear_library(app);
+            start_scan(app, folder_path);
             free(folder_path);
         }
     } else if (IsKeyDown(KEY_LEFT_CONTROL) &&
                IsKeyPressed(KEY_O)) {
         char* path = file_dialog_open_file("mp3,flac,wav,ogg,m4a");
         if (path) {
-            playlist_clear(&app->playlist);
+            stop_scan(app);
+            clear_library(app);
             playlist_append(&app->playlist, path);
+            add_to_library(app, (const char* const*)&path, 1);
             playlist_play_current(&app->playlist, &app->audio_device);
             free(path);
         }
@@ -98,6 +117,120 @@ void update(app_t* app) {
     app->w_height = GetScreenHeight();
     app->w_width = GetScreenWidth();
 
+    // move tracks found by a running folder scan into the playlist
+    if (app->scan_job) {
+        bool was_empty = playlist_is_empty(&app->playlist);
+
+        scanner_batch_t batch;
+        while (scanner_job_poll(app->scan_job, &batch)) {
+            for (size_t i = 0; i < batch.count; i++) {
+                playlist_append(&app->playlist, batch.paths[i]);
+            }
+            add_to_library(app, (const char* const*)batch.paths, batch.count);
+            scanner_batch_free(&batch);
+        }
+        app->scan_progress = scanner_job_get_progress(app->scan_job);
+
+        // start playing as soon as the first track shows up
+        // (a rescan leaves the track that's already playing alone)
+        if (was_empty && !app->resume_path && !playlist_is_empty(&app->playlist)) {
+            playlist_play_current(&app->playlist, &app->audio_device);
+        }
+
+        if (app->scan_progress.done) {
+            size_t track_count = playlist_count(&app->playlist);
+            LOG_INFO("Added %zu tracks from folder.", track_count);
+            string_pool_log_stats();
+            scanner_job_free(app->scan_job);
+            app->scan_job = NULL;
+
+            if (app->resume_path) {
+                for (size_t i = 0; i < track_count; i++) {
+                    if (strcmp(app->playlist.tracks->items[i], app->resume_path) == 0) {
+                        playlist_set_current_track(&app->playlist, i);
+                        break;
+                    }
+                }
+                free(app->resume_path);
+                app->resume_path = NULL;
+            }
+
+            // the scan just wrote its cache, so the watcher starts without reading the tree again
+            watcher_options_t options = watcher_default_options();
+            app->watcher = watcher_start(app->library_path, &options);
+        }
+    }
+
+    // a folder that was deleted or unmounted is tried again until it's back
+    if (app->rescan_retry_at > 0.0 && GetTime() >= app->rescan_retry_at) {
+        rescan_library(app);
+    }
+
+    // apply changes made to the folder on disk since it was scanned
+    if (app->watcher) {
+        watcher_batch_t batch;
+        while (app->watcher && watcher_poll(app->watcher, &batch)) {
+            apply_library_changes(app, &batch);
+            watcher_batch_free(&batch);
+        }
+    }
+
+    // queue tracks for tag reading and fill in whatever finished since last frame
+    if (app->metadata && app->library) {
+        if (app->metadata_next < app->library->count) {
+            app->metadata_next += metadata_pool_submit(
+                app->metadata, app->library,
+                app->metadata_next, app->library->count - app->metadata_next
+            );
+        }
+
+        metadata_record_t records[256];
+        size_t count = metadata_pool_poll(app->metadata, records, 256);
+        for (size_t i = 0; i < count; i++) {
+            track_t* track = metadata_apply(app->library, &records[i]);
+            if (track && app->library_db) library_db_put(app->library_db, track);
+            if (track && app->graph) library_graph_update_track(app->graph, (size_t)(track - app->library->items));
+            metadata_record_free(&records[i]);
+        }
+
+        // group the library once every tag is in, from then on it's kept up to date
+        if (!app->graph && !app->scan_job && app->library->count > 0
+            && app->metadata_next == app->library->count && metadata_pool_is_idle(app->metadata)) {
+            app->graph = library_graph_build(app->library, 0);
+        }
+    }
+
+    // fold saved tags into the database file once enough of them piled up
+    if (app->library_db) {
+        library_db_poll(app->library_db);
+        library_db_compact(app->library_db);
+    }
+
+    // while a rescan refills the playlist its current track is meaningless, so nothing is
+    // queued or played next until the scan finds the track to resume, a track queued before
+    // the rescan that starts meanwhile becomes the one to resume
+    if (app->resume_path) {
+        char* queued = app->audio_device.queued_path ? strdup(app->audio_device.queued_path) : NULL;
+        if (audio_device_poll_transition(&app->audio_device) && queued) {
+            free(app->resume_path);
+            app->resume_path = queued;
+            queued = NULL;
+        }
+        free(queued);
+        return;
+    }
+
+    // the queued track started without a gap, catch the playlist up and queue the one after it
+    if (audio_device_poll_transition(&app->audio_device)) {
+        size_t current = playlist_get_current_track(&app->playlist);
+        playlist_set_current_track(&app->playlist, playlist_has_next(&app->playlist) ? current + 1 : 0);
+    }
+    if (audio_device_is_playing(&app->audio_device) && !playlist_is_empty(&app->playlist)) {
+        const char* next = playlist_get_next_track_path(&app->playlist);
+        const char* queued = app->audio_device.queued_path;
+        if (!queued || strcmp(queued, next) != 0) audio_device_queue_next(&app->audio_device, next);
+    }
+
     if (audio_device_is_finished(&app->audio_device)) {
         playlist_play_next(&app->playlist, &app->audio_device);
     }
@@ -107,5 +240,220 @@ void render(app_t* app) {
     BeginDrawing();
     ClearBackground(BLACK);
 
+    if (app->scan_job) {
+        DrawText(
+            TextFormat(
+                "Scanning... %zu folders, %zu tracks, %.1f KB/s",
+                app->scan_progress.dirs_visited,
+                app->scan_progress.files_matched,
+                app->scan_progress.bytes_per_second / 1024.0
+            ),
+            10, 10, 20, RAYWHITE
+        );
+    }
+
+    // read from the snapshot the audio thread publishes, drawing never waits on it
+    if (app->audio_device.sound_loaded) {
+        audio_device_state_t state = audio_device_get_state(&app->audio_device);
+        int position = (int)state.position;
+        int duration = (int)state.duration;
+        DrawText(
+            TextFormat(
+                "%s %d:%02d / %d:%02d",
+                state.paused ? "Paused" : "Playing",
+                position / 60, position % 60,
+                duration / 60, duration % 60
+            ),
+            10, 40, 20, RAYWHITE
+        );
+    }
+
     EndDrawing();
 }
+
+void start_scan(app_t* app, const char* folder_path) {
+    LOG_INFO("Scanning folder: %s", folder_path);
+    // tracks are picked up in update() as the scan finds them
+    scanner_options_t options = scanner_default_options();
+    app->scan_job = scanner_job_start(folder_path, &options);
+
+    if (app->library_path != folder_path) {
+        free(app->library_path);
+        app->library_path = app->scan_job ? strdup(folder_path) : NULL;
+
+        // tags saved from an earlier run are used right away, no file is read for them
+        if (app->library_db) library_db_close(app->library_db);
+        char* db_path = app->library_path ? library_db_default_path(app->library_path) : NULL;
+        app->library_db = db_path ? library_db_open(db_path) : NULL;
+        free(db_path);
+    }
+}
+
+// stops the folder scan and the watcher, the playlist is left as is
+void stop_scan(app_t* app) {
+    if (app->scan_job) {
+        scanner_job_free(app->scan_job);
+        app->scan_job = NULL;
+    }
+    if (app->watcher) {
+        watcher_free(app->watcher);
+        app->watcher = NULL;
+    }
+    free(app->library_path);
+    app->library_path = NULL;
+    if (app->library_db) {
+        library_db_close(app->library_db);
+        app->library_db = NULL;
+    }
+    free(app->resume_path);
+    app->resume_path = NULL;
+    app->rescan_retry_at = 0.0;
+}
+
+// scans library_path again and swaps the library for what it finds, the current track keeps playing
+// the library is only cleared once the scan runs, a folder that can't be scanned keeps it and is
+// tried again later, returns false then
+bool rescan_library(app_t* app) {
+    app->rescan_retry_at = 0.0;
+    if (!app->library_path) return false;
+
+    scanner_options_t options = scanner_default_options();
+    scanner_job_t* job = scanner_job_start(app->library_path, &options);
+    if (!job) {
+        LOG_WARN("Couldn't rescan folder, keeping the library and trying again later: %s", app->library_path);
+        app->rescan_retry_at = GetTime() + RESCAN_RETRY_SECONDS;
+        return false;
+    }
+
+    LOG_INFO("Rescanning folder: %s", app->library_path);
+    char* current = playlist_get_current_track_path(&app->playlist);
+    char* resume_path = current ? strdup(current) : NULL;
+    clear_library(app);
+    app->scan_job = job;
+    free(app->resume_path);
+    app->resume_path = resume_path;
+    return true;
+}
+
+// clears the playlist and the library, tags still being read are dropped
+void clear_library(app_t* app) {
+    playlist_clear(&app->playlist);
+    if (app->library) track_list_clear(app->library);
+    if (app->metadata) metadata_pool_clear(app->metadata);
+    app->metadata_next = 0;
+    if (app->graph) {
+        library_graph_free(app->graph);
+        app->graph = NULL;
+    }
+    // the tracks and the graph were the only holders of interned strings and their ids, so
+    // the next folder starts with an empty pool instead of keeping every tag of the last one
+    string_pool_clear();
+}
+
+// adds tracks to the library, their tags are read in the background from update()
+void add_to_library(app_t* app, const char* const paths[], size_t count) {
+    if (!app->library) return;
+
+    size_t first = app->library->count;
+    track_list_append_paths(app->library, paths, count);
+    if (app->graph) library_graph_add_tracks(app->graph, first, app->library->count - first);
+    if (!app->library_db) return;
+
+    // the pool still stats these, so files changed since the last run get read again
+    for (size_t i = first; i < app->library->count; i++) {
+        library_db_track_t stored;
+        if (library_db_find(app->library_db, app->library->items[i].path, &stored)) {
+            library_db_fill_track(&stored, app->library, &app->library->items[i]);
+        }
+    }
+}
+
+typedef struct removal_set {
+    const char** files; // sorted with strcmp
+    size_t file_count;
+    const char** dirs;
+    size_t dir_count;
+} removal_set_t;
+
+static int compare_strings(const void* a, const void* b) {
+    return strcmp(*(const char* const*)a, *(const char* const*)b);
+}
+
+static bool is_removed(const char* path, void* ctx) {
+    const removal_set_t* set = ctx;
+
+    if (bsearch(&path, set->files, set->file_count, sizeof(char*), compare_strings)) return true;
+    for (size_t i = 0; i < set->dir_count; i++) {
+        size_t len = strlen(set->dirs[i]);
+        if (strncmp(path, set->dirs[i], len) == 0 && path[len] == '/') return true;
+    }
+    return false;
+}
+
+void apply_library_changes(app_t* app, const watcher_batch_t* batch) {
+    if (batch->count == 0) return;
+
+    // events were lost or the folder went away, fall back to a scan which only rereads changed folders
+    if (batch->ops[0].kind == WATCHER_RESCAN) {
+        watcher_free(app->watcher);
+        app->watcher = NULL;
+        rescan_library(app);
+        return;
+    }
+
+    const char** files = malloc(batch->count * sizeof(char*));
+    const char** dirs = malloc(batch->count * sizeof(char*));
+    const char** added = malloc(batch->count * sizeof(char*));
+    if (!files || !dirs || !added) {
+        LOG_ERROR("Memory allocation failed; couldn't apply library changes.");
+        free(files);
+        free(dirs);
+        free(added);
+        return;
+    }
+
+    removal_set_t removals = { files, 0, dirs, 0 };
+    size_t added_count = 0;
+    for (size_t i = 0; i < batch->count; i++) {
+        const watcher_op_t* op = &batch->ops[i];
+        if (op->kind == WATCHER_REMOVE) files[removals.file_count++] = op->path;
+        else if (op->kind == WATCHER_REMOVE_DIR) dirs[removals.dir_count++] = op->path;
+        else if (op->kind == WATCHER_ADD) added[added_count++] = op->path;
+    }
+    qsort(files, removals.file_count, sizeof(char*), compare_strings);
+
+    size_t removed = 0;
+    if (removals.file_count > 0 || removals.dir_count > 0) {
+        removed = playlist_remove_if(&app->playlist, is_removed, &removals);
+
+        // mark first and sweep once, removing one by one shifts the list per track
+        size_t below_next = 0;
+        for (size_t i = 0; i < app->library->count; i++) {
+            if (!is_removed(app->library->items[i].path, &removals)) continue;
+            if (app->library_db) library_db_remove(app->library_db, app->library->items[i].path);
+            if (app->graph) library_graph_remove_track(app->graph, i);
+            track_list_mark_removed(app->library, i);
+            if (i < app->metadata_next) below_next++;
+        }
+        track_list_sweep(app->library);
+        app->metadata_next -= below_next;
+    }
+    size_t before = playlist_count(&app->playlist);
+    playlist_merge_sorted(&app->playlist, added, added_count);
+    size_t inserted = playlist_count(&app->playlist) - before;
+
+    // rewritten files are already in the library, their tags get read again
+    for (size_t i = 0; i < added_count; i++) {
+        size_t index = track_list_index_of_path(app->library, added[i]);
+        if (index != SIZE_MAX) {
+            if (app->metadata) metadata_pool_submit(app->metadata, app->library, index, 1);
+        } else {
+            add_to_library(app, &added[i], 1);
+        }
+    }
+
+    LOG_INFO("Library updated; %zu tracks added, %zu removed.", inserted, removed);
+    free(files);
+    free(dirs);
+    free(added);
+}
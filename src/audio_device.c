@@ -1,6 +1,46 @@
+#define _GNU_SOURCE
 #define MINIAUDIO_IMPLEMENTATION
 #include "audio_device.h"
 #include "logger.h"
+#include "seek_index.h"
+#include <fcntl.h>
+#include <math.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// frames the loader decodes up front, so the first read of a queued track doesn't touch the file
+#define PRIME_FRAMES 4096
+// frames of the outgoing track decoded at a time during a crossfade
+#define FADE_CHUNK_FRAMES 1024
+// track starts the decode thread can be ahead of the audio thread by
+#define MARKER_COUNT 16
+// commands the ui can send before the audio thread gets to them
+#define COMMAND_COUNT 64
+// bytes at the start of a mapped file the kernel is asked to read ahead right away
+#define MAP_READAHEAD_BYTES (1 << 20)
+// threads opening files at most, more are started while every one is stuck on a slow open
+#define LOADER_MAX 8
+// mp3 files this large get a seek index, smaller ones seek from their start fast enough
+#define SEEK_INDEX_MIN_BYTES (4 << 20)
+// bytes of mp3 between two seek points, about a second at 128 kbps
+#define SEEK_INDEX_SPACING_BYTES (16 << 10)
+// a seek target holds the frame in its low bits and the low bits of the serial of the track
+// it was computed for above them, 2^48 frames are thousands of years at any sample rate
+#define SEEK_FRAME_BITS 48
+#define SEEK_FRAME_MASK ((1ULL << SEEK_FRAME_BITS) - 1)
+
+// tags a seek with the track it's for, the decode thread may have moved on to the next one
+static ma_uint64 seek_target_pack(size_t serial, ma_uint64 frame) {
+    if (frame >= SEEK_FRAME_MASK) frame = SEEK_FRAME_MASK - 1; // never UINT64_MAX
+    return ((ma_uint64)serial << SEEK_FRAME_BITS) | frame;
+}
 
 // helper function for clamping into a 0.0f to 1.0f range
 static inline float clamp01(float x) {
@@ -9,28 +49,1122 @@ static inline float clamp01(float x) {
     return x;
 }
 
-bool audio_device_init(audio_device_t* dev) {
-   ma_result result = ma_engine_init(nullptr, &dev->engine);
+// playback chain
+// --------------
+
+// a track of the chain, decoded to the engine's format so tracks can follow each other directly
+typedef struct chain_track {
+    ma_decoder decoder;
+    void* mapping; // the file mapped into memory, NULL when it's read through stdio
+    size_t mapping_size;
+    char* path;
+    size_t serial; // serial of the play or queue call that opened it
+    ma_uint64 length; // in engine frames, 0 if unknown
+    float* primed; // first frames, decoded by the loader
+    ma_uint64 primed_count;
+    ma_uint64 primed_read;
+    ma_dr_mp3_seek_point* seek_points; // bound to the mp3 decoder, NULL while seeks decode from the start
+    bool wants_index; // a large mp3 without a seek index yet, the loader builds one after handing it over
+} chain_track_t;
+
+// seek points a loader built for a file, bound to the track playing it by the decode thread
+typedef struct chain_index {
+    char* path;
+    ma_dr_mp3_seek_point* points;
+    ma_uint32 count;
+} chain_index_t;
+
+// where a track starts in the stream of frames the decoder writes to the ring
+typedef struct chain_marker {
+    ma_uint64 frame; // index in the stream
+    ma_uint64 offset; // track frame it starts at, past 0 after a seek
+    ma_uint64 length;
+    size_t serial;
+} chain_marker_t;
+
+// transport and volume changes, applied by the audio thread at the start of a read
+typedef enum chain_command_type {
+    CHAIN_PLAY,      // leaves pause and stop once the track with the serial is heard
+    CHAIN_PAUSE,     // also holds through a track still opening
+    CHAIN_RESUME,
+    CHAIN_STOP,
+    CHAIN_SET_VOLUME
+} chain_command_type_t;
+
+typedef struct chain_command {
+    chain_command_type_t type;
+    float volume;
+    size_t serial;
+} chain_command_t;
+
+// the decode thread owns the tracks and writes ahead into the ring, the audio thread only
+// copies out of it, other threads hand tracks over with atomic exchanges and whoever
+// takes a pointer out owns it
+struct audio_chain {
+    ma_data_source_base base;
+    ma_uint32 channels;
+    ma_uint32 sample_rate;
+    atomic_bool map_files; // decode from a mapping of the file instead of stdio reads
+    bool pull; // no device, reads wait for the decode thread instead of playing silence
+    ma_uint32 open_delay_ms; // slept before every open, see audio_device_options_t
+
+    ma_pcm_rb ring;
+    ma_uint32 ring_frames;
+    chain_marker_t markers[MARKER_COUNT]; // single producer, single consumer
+    atomic_size_t marker_head; // written by the decode thread
+    atomic_size_t marker_tail; // written by the audio thread
+
+    // decode thread only
+    pthread_t decoder;
+    bool decoder_started;
+    chain_track_t* current;
+    ma_uint64 cursor;
+    chain_track_t* outgoing; // track fading out under the current one
+    ma_uint64 fade_done; // frames of the crossfade played so far
+    ma_uint64 fade_total; // frames the crossfade lasts
+    float* fade_buffer; // the outgoing track's frames of one chunk, reused for every fade
+    ma_uint64 written; // frames written to the ring so far
+    bool refilling; // flushed and waiting for the audio thread to skip the stale frames
+    chain_index_t* waiting_index; // built for a track that hasn't started yet
+
+    // audio thread only
+    ma_uint64 consumed; // frames read from the ring so far
+    ma_uint64 copied; // of them played, frames skipped by a flush aren't counted
+    chain_marker_t playing; // marker of the track being heard
+    bool paused;
+    bool stopped;
+    bool ended; // the last track played out, cleared when another one starts
+    size_t play_serial; // track that ends pause and stop when it starts
+    float volume;
+    float gain; // volume reached at the end of the last read, ramps toward volume or 0
+
+    chain_command_t commands[COMMAND_COUNT]; // single producer, single consumer
+    atomic_size_t command_head; // written by the ui thread
+    atomic_size_t command_tail; // written by the audio thread
+
+    _Atomic(chain_track_t*) pending; // replaces the current track
+    _Atomic(chain_track_t*) next; // takes over when the current track runs out
+    _Atomic(ma_uint64) seek_target; // made by seek_target_pack, UINT64_MAX when no seek is waiting
+    _Atomic(ma_uint64) fade_frames; // crossfade length, 0 for gapless
+    _Atomic(ma_uint64) flush_to; // frames before this are stale, the audio thread skips them
+    _Atomic(ma_uint64) end_frame; // stream index where the last track ends, UINT64_MAX while playing
+    _Atomic(chain_index_t*) built_index; // seek points a loader finished, taken by the decode thread
+
+    // published by the audio thread after every read, the fields change together under the sequence
+    atomic_uint snapshot_sequence; // odd while a write is in progress
+    _Atomic(ma_uint64) position;
+    _Atomic(ma_uint64) length;
+    atomic_size_t current_serial;
+    atomic_bool snapshot_paused;
+    atomic_bool snapshot_ended;
+    _Atomic(float) snapshot_volume;
+    atomic_size_t underruns;
+    atomic_size_t underrun_frames;
+    atomic_size_t reads;
+    _Atomic(ma_uint64) read_ns; // spent in reads
+    _Atomic(ma_uint64) read_ns_max;
+
+    // loaders open played and queued tracks off the ui and decode threads, a file can take
+    // hundreds of milliseconds to open on a sleeping disk or a network share
+    pthread_t loaders[LOADER_MAX];
+    size_t loader_count; // loaders that started, only grows on the ui thread
+    size_t idle_loaders; // loaders waiting for a path
+    pthread_mutex_t lock;
+    pthread_cond_t wake; // wakes the loaders
+    pthread_cond_t decode_wake; // wakes the decode thread
+    pthread_cond_t read_wake; // wakes a pulling read once frames were decoded
+    bool wanted; // a pulling read waits for frames, the decode thread doesn't sleep then
+    size_t opening; // opens in progress on the loaders
+    char* play_path; // waiting to be opened to replace the current track
+    char* queue_path; // waiting to be opened to follow the current track
+    size_t request_serial; // bumped by every queue, play and stop call
+    size_t play_request; // serial of the last play, an older play being opened is dropped
+    atomic_bool play_opening; // the last play is still on a loader, a queued track waits for it
+    size_t queue_request; // serial of the last queue call, 0 once a play or stop dropped it
+    atomic_size_t failed_serial; // last play whose file couldn't be opened
+    bool stopping;
+};
+
+// maps a local file read only, so the decoder reads straight from the page cache without copies
+// false if it can't be mapped, the caller falls back to stdio then
+static bool track_map(chain_track_t* track, const char* path) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat info;
+    if (fstat(fd, &info) != 0 || !S_ISREG(info.st_mode) || info.st_size == 0) {
+        close(fd);
+        return false;
+    }
+
+    // the mapping keeps the file open, a file replaced by rename stays readable until it's unmapped
+    // but one truncated in place faults where a read would have failed, stdio is safer for those
+    void* mapping = mmap(NULL, (size_t)info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (mapping == MAP_FAILED) return false;
+
+    // tracks are mostly read front to back, so pages behind can go and pages ahead come early
+    madvise(mapping, (size_t)info.st_size, MADV_SEQUENTIAL);
+    size_t readahead = (size_t)info.st_size < MAP_READAHEAD_BYTES ? (size_t)info.st_size : MAP_READAHEAD_BYTES;
+    madvise(mapping, readahead, MADV_WILLNEED);
+
+    track->mapping = mapping;
+    track->mapping_size = (size_t)info.st_size;
+    return true;
+}
+
+static bool track_is_mp3(const chain_track_t* track) {
+    return track->decoder.pBackendVTable == &g_ma_decoding_backend_vtable_mp3;
+}
+
+// hands seek points to the mp3 decoder, a seek then jumps to the closest point before the
+// target and decodes from there instead of from the start of the file, the track owns them after
+static void track_bind_index(chain_track_t* track, ma_dr_mp3_seek_point* points, ma_uint32 count) {
+    ma_dr_mp3* mp3 = &((ma_mp3*)track->decoder.pBackend)->dr;
+    if (!ma_dr_mp3_bind_seek_table(mp3, count, points)) {
+        free(points);
+        return;
+    }
+    free(track->seek_points);
+    track->seek_points = points;
+}
+
+// binds the seek index saved for a large mp3, or marks the track so a loader builds one
+static void track_load_index(chain_track_t* track, const char* path) {
+    struct stat info;
+    if (!track_is_mp3(track) || stat(path, &info) != 0 || info.st_size < SEEK_INDEX_MIN_BYTES) return;
+
+    char* index_path = seek_index_default_path(path);
+    seek_index_t* index = index_path
+        ? seek_index_load(index_path, (uint64_t)info.st_size, info.st_mtim.tv_sec, info.st_mtim.tv_nsec)
+        : NULL;
+    free(index_path);
+    ma_dr_mp3_seek_point* points = index && index->count <= UINT32_MAX
+        ? malloc(index->count * sizeof(ma_dr_mp3_seek_point))
+        : NULL;
+    if (!points) {
+        seek_index_free(index);
+        track->wants_index = true;
+        return;
+    }
+
+    for (size_t i = 0; i < index->count; i++) {
+        points[i] = (ma_dr_mp3_seek_point){
+            index->points[i].byte_offset,
+            index->points[i].frame,
+            index->points[i].discard_packets,
+            index->points[i].discard_frames
+        };
+    }
+    track_bind_index(track, points, (ma_uint32)index->count);
+    seek_index_free(index);
+}
+
+static chain_track_t* track_open(audio_chain_t* chain, const char* path, size_t serial, bool prime) {
+    if (chain->open_delay_ms > 0) {
+        struct timespec delay = { chain->open_delay_ms / 1000, (long)(chain->open_delay_ms % 1000) * 1000000L };
+        nanosleep(&delay, nullptr);
+    }
+
+    chain_track_t* track = calloc(1, sizeof(chain_track_t));
+    if (!track) {
+        LOG_ERROR("Memory allocation failed; couldn't open track.");
+        return NULL;
+    }
+
+    ma_decoder_config config = ma_decoder_config_init(ma_format_f32, chain->channels, chain->sample_rate);
+    ma_result result;
+    if (atomic_load(&chain->map_files) && track_map(track, path)) {
+        result = ma_decoder_init_memory(track->mapping, track->mapping_size, &config, &track->decoder);
+    } else {
+        result = ma_decoder_init_file(path, &config, &track->decoder);
+    }
+    if (result != MA_SUCCESS) {
+        LOG_ERROR(
+            "Failed to load sound; %s",
+            ma_result_description(result)
+        );
+        if (track->mapping) munmap(track->mapping, track->mapping_size);
+        free(track);
+        return NULL;
+    }
+
+    track->path = strdup(path);
+    track->serial = serial;
+    if (ma_decoder_get_length_in_pcm_frames(&track->decoder, &track->length) != MA_SUCCESS) {
+        track->length = 0;
+    }
+    track_load_index(track, path);
+    // a resampled track starts with the resampler's latency, frames interpolated up from
+    // silence that would be heard as a dip between gapless tracks, so they're skipped
+    ma_uint64 latency = ma_data_converter_get_output_latency(&track->decoder.converter);
+    if (latency > 0) {
+        ma_decoder_read_pcm_frames(&track->decoder, nullptr, latency, nullptr);
+        track->length = track->length > latency ? track->length - latency : 0;
+    }
+    if (prime) {
+        track->primed = malloc(PRIME_FRAMES * chain->channels * sizeof(float));
+        if (track->primed) {
+            ma_decoder_read_pcm_frames(&track->decoder, track->primed, PRIME_FRAMES, &track->primed_count);
+        }
+    }
+    return track;
+}
+
+static void track_free(chain_track_t* track) {
+    ma_decoder_uninit(&track->decoder);
+    if (track->mapping) munmap(track->mapping, track->mapping_size);
+    free(track->path);
+    free(track->primed);
+    free(track->seek_points);
+    free(track);
+}
+
+// reads primed frames first and decodes the rest, 0 means the track ran out
+static ma_uint64 track_read(chain_track_t* track, float* out, ma_uint64 count, ma_uint32 channels) {
+    ma_uint64 done = 0;
+    if (track->primed_read < track->primed_count) {
+        done = track->primed_count - track->primed_read;
+        if (done > count) done = count;
+        memcpy(out, track->primed + track->primed_read * channels, done * channels * sizeof(float));
+        track->primed_read += done;
+    }
+    if (done < count) {
+        ma_uint64 decoded = 0;
+        ma_decoder_read_pcm_frames(&track->decoder, out + done * channels, count - done, &decoded);
+        done += decoded;
+    }
+    return done;
+}
+
+// decode thread
+// -------------
+
+// tells the audio thread where a track starts, false while the queue is full
+static bool chain_push_marker(audio_chain_t* chain, ma_uint64 offset) {
+    size_t head = atomic_load(&chain->marker_head);
+    if (head - atomic_load(&chain->marker_tail) >= MARKER_COUNT) return false;
+
+    chain->markers[head % MARKER_COUNT] = (chain_marker_t){
+        chain->written, offset, chain->current->length, chain->current->serial
+    };
+    atomic_store(&chain->marker_head, head + 1);
+    return true;
+}
+
+static void chain_index_free(chain_index_t* index) {
+    free(index->path);
+    free(index->points);
+    free(index);
+}
+
+// binds the waiting seek index if the track plays the file it was built for
+static void chain_bind_waiting(audio_chain_t* chain, chain_track_t* track) {
+    chain_index_t* index = chain->waiting_index;
+    if (!index || !track || !track_is_mp3(track) || strcmp(index->path, track->path) != 0) return;
+
+    if (!track->seek_points) {
+        track_bind_index(track, index->points, index->count);
+        index->points = NULL;
+    }
+    chain_index_free(index);
+    chain->waiting_index = NULL;
+}
+
+static void chain_start(audio_chain_t* chain, chain_track_t* track) {
+    chain->current = track;
+    chain->cursor = 0;
+    atomic_store(&chain->end_frame, UINT64_MAX);
+    chain_push_marker(chain, 0);
+    chain_bind_waiting(chain, track);
+}
+
+// drops whatever the ring holds, the audio thread skips it at its next read
+static void chain_flush(audio_chain_t* chain) {
+    atomic_store(&chain->flush_to, chain->written);
+    chain->refilling = true;
+    if (chain->outgoing) {
+        track_free(chain->outgoing);
+        chain->outgoing = NULL;
+    }
+}
+
+// starts fading the current track out under the queued one once it's within the fade of its end
+static void chain_begin_fade(audio_chain_t* chain) {
+    ma_uint64 fade = atomic_load(&chain->fade_frames);
+    ma_uint64 length = chain->current->length;
+    if (chain->outgoing || fade == 0 || length == 0 || chain->cursor + fade < length) return;
+
+    chain_track_t* next = atomic_exchange(&chain->next, NULL);
+    if (!next) return;
+
+    // a queued track shorter than the fade would end under the outgoing one
+    chain->fade_total = length > chain->cursor ? length - chain->cursor : 1;
+    if (next->length > 0 && next->length < chain->fade_total) chain->fade_total = next->length;
+    chain->fade_done = 0;
+    chain->outgoing = chain->current;
+    chain_start(chain, next);
+}
+
+// mixes the outgoing track into frames as its fade goes on
+static void chain_mix_fade(audio_chain_t* chain, float* frames, ma_uint64 count) {
+    ma_uint64 faded = track_read(chain->outgoing, chain->fade_buffer, count, chain->channels);
+    audio_device_mix_crossfade(frames, chain->fade_buffer, faded, count, chain->fade_done, chain->fade_total,
+                               chain->channels);
+
+    chain->fade_done += count;
+    if (faded < count || chain->fade_done >= chain->fade_total) {
+        track_free(chain->outgoing);
+        chain->outgoing = NULL;
+    }
+}
+
+// decodes up to count frames, moving on to the next track so no frame is lost between them
+static ma_uint64 chain_decode(audio_chain_t* chain, float* frames, ma_uint64 count) {
+    ma_uint64 total = 0;
+    while (total < count && chain->current) {
+        // markers are the only way to tell the audio thread about a new track, wait for room
+        if (atomic_load(&chain->marker_head) - atomic_load(&chain->marker_tail) >= MARKER_COUNT) break;
+        chain_begin_fade(chain);
+
+        // both tracks decode a chunk at a time while they overlap
+        ma_uint64 wanted = count - total;
+        if (chain->outgoing && wanted > FADE_CHUNK_FRAMES) wanted = FADE_CHUNK_FRAMES;
+        ma_uint64 decoded = track_read(chain->current, frames + total * chain->channels, wanted, chain->channels);
+        if (chain->outgoing && decoded > 0) chain_mix_fade(chain, frames + total * chain->channels, decoded);
+        total += decoded;
+        chain->cursor += decoded;
+        chain->written += decoded;
+        if (decoded > 0) continue;
+
+        if (chain->outgoing) {
+            track_free(chain->outgoing);
+            chain->outgoing = NULL;
+        }
+        track_free(chain->current);
+        chain->current = NULL;
+        chain_track_t* next = atomic_exchange(&chain->next, NULL);
+        if (next) chain_start(chain, next);
+    }
+    return total;
+}
+
+// applies whatever the other threads asked for since the last pass
+static void chain_take_requests(audio_chain_t* chain) {
+    // every request starts a track or a seek, which needs a marker
+    if (atomic_load(&chain->marker_head) - atomic_load(&chain->marker_tail) >= MARKER_COUNT) return;
+
+    // the audio thread checks pending before the end, so it can't see the old end without it
+    if (atomic_load(&chain->pending)) atomic_store(&chain->end_frame, UINT64_MAX);
+    chain_track_t* pending = atomic_exchange(&chain->pending, NULL);
+    if (pending) {
+        chain_flush(chain);
+        if (chain->current) track_free(chain->current);
+        chain_start(chain, pending);
+    }
+
+    // seek points are built while their track plays, or before a queued one starts
+    chain_index_t* built = atomic_exchange(&chain->built_index, NULL);
+    if (built) {
+        if (chain->waiting_index) chain_index_free(chain->waiting_index);
+        chain->waiting_index = built;
+        chain_bind_waiting(chain, chain->current);
+    }
+
+    // a seek for a track that was already decoded to its end, or replaced by a play, is dropped,
+    // its frame was computed from that track's length and means nothing in the current one
+    ma_uint64 seek = atomic_exchange(&chain->seek_target, UINT64_MAX);
+    ma_uint64 seek_frame = seek & SEEK_FRAME_MASK;
+    bool seek_current = seek != UINT64_MAX && chain->current &&
+                        seek >> SEEK_FRAME_BITS == seek_target_pack(chain->current->serial, 0) >> SEEK_FRAME_BITS;
+    if (seek_current && !(seek_frame == 0 && chain->cursor == 0)) {
+        chain_track_t* track = chain->current;
+        if (ma_decoder_seek_to_pcm_frame(&track->decoder, seek_frame) == MA_SUCCESS) {
+            chain_flush(chain);
+            track->primed_read = track->primed_count;
+            chain->cursor = seek_frame;
+            chain_push_marker(chain, seek_frame);
+        }
+    }
+
+    // a track queued after the current one was decoded to the end can still follow it,
+    // but not one queued after a play that's still opening, it has to wait its turn
+    if (!chain->current && !atomic_load(&chain->play_opening) && !atomic_load(&chain->pending)) {
+        chain_track_t* next = atomic_exchange(&chain->next, NULL);
+        if (next) chain_start(chain, next);
+    }
+}
+
+// keeps the ring topped up, sleeping while it's full enough
+static void* chain_decode_run(void* arg) {
+    audio_chain_t* chain = arg;
+    ma_uint32 refill = chain->ring_frames / 4; // decode in larger steps instead of a few frames per wakeup
+
+    pthread_mutex_lock(&chain->lock);
+    while (!chain->stopping) {
+        chain->wanted = false;
+        pthread_mutex_unlock(&chain->lock);
+        chain_take_requests(chain);
+
+        bool wrote = false;
+        while (chain->current && ma_pcm_rb_available_write(&chain->ring) >= refill) {
+            ma_uint32 frames = refill;
+            void* buffer;
+            if (ma_pcm_rb_acquire_write(&chain->ring, &frames, &buffer) != MA_SUCCESS || frames == 0) break;
+            ma_uint64 decoded = chain_decode(chain, buffer, frames);
+            ma_pcm_rb_commit_write(&chain->ring, (ma_uint32)decoded);
+            wrote = decoded > 0;
+            if (wrote) chain->refilling = false;
+            if (!chain->current) atomic_store(&chain->end_frame, chain->written);
+            if (chain->pull) {
+                pthread_mutex_lock(&chain->lock);
+                pthread_cond_broadcast(&chain->read_wake);
+                pthread_mutex_unlock(&chain->lock);
+            }
+            if (decoded < frames) break;
+            chain_take_requests(chain);
+        }
+
+        pthread_mutex_lock(&chain->lock);
+        if (!chain->stopping && !wrote && !chain->wanted &&
+            !atomic_load(&chain->pending) && atomic_load(&chain->seek_target) == UINT64_MAX) {
+            // the audio thread can't signal without risking a stall, so this polls while playing
+            // and polls fast after a flush, so a seek or a new track isn't heard late
+            struct timespec until;
+            clock_gettime(CLOCK_REALTIME, &until);
+            long wait_ns = chain->refilling ? 1000000L : (long)refill * 1000000000L / chain->sample_rate / 2;
+            until.tv_nsec += wait_ns;
+            until.tv_sec += until.tv_nsec / 1000000000L;
+            until.tv_nsec %= 1000000000L;
+            pthread_cond_timedwait(&chain->decode_wake, &chain->lock, &until);
+        }
+    }
+    pthread_mutex_unlock(&chain->lock);
+    return NULL;
+}
+
+static void chain_wake_decoder(audio_chain_t* chain) {
+    pthread_mutex_lock(&chain->lock);
+    pthread_cond_signal(&chain->decode_wake);
+    pthread_mutex_unlock(&chain->lock);
+}
+
+// audio thread
+// ------------
+
+// applies the markers the audio thread has played past
+static void chain_take_markers(audio_chain_t* chain) {
+    size_t tail = atomic_load(&chain->marker_tail);
+    size_t head = atomic_load(&chain->marker_head);
+    bool changed = false;
+    while (tail != head && chain->markers[tail % MARKER_COUNT].frame <= chain->consumed) {
+        chain->playing = chain->markers[tail % MARKER_COUNT];
+        tail++;
+        changed = true;
+    }
+    if (!changed) return;
+
+    atomic_store(&chain->marker_tail, tail);
+    chain->ended = false;
+    if (chain->playing.serial == chain->play_serial) {
+        chain->paused = false;
+        chain->stopped = false;
+    }
+}
+
+static void chain_apply_commands(audio_chain_t* chain) {
+    size_t tail = atomic_load(&chain->command_tail);
+    size_t head = atomic_load(&chain->command_head);
+    for (; tail != head; tail++) {
+        chain_command_t command = chain->commands[tail % COMMAND_COUNT];
+        switch (command.type) {
+            case CHAIN_PLAY: chain->play_serial = command.serial; break;
+            case CHAIN_PAUSE: chain->paused = true; chain->play_serial = 0; break;
+            case CHAIN_RESUME: chain->paused = false; break;
+            case CHAIN_STOP: chain->stopped = true; chain->play_serial = 0; break;
+            case CHAIN_SET_VOLUME: chain->volume = command.volume; break;
+        }
+    }
+    atomic_store(&chain->command_tail, tail);
+}
+
+// scales frames by the gain, ramping it to target over the read so changes don't click
+static void chain_apply_gain(audio_chain_t* chain, float* frames, ma_uint64 count, float target) {
+    if ((chain->gain == target && target == 1.0f) || count == 0) return;
+
+    float step = (target - chain->gain) / (float)count;
+    for (ma_uint64 i = 0; i < count; i++) {
+        float gain = chain->gain + step * (float)(i + 1);
+        for (ma_uint32 c = 0; c < chain->channels; c++) frames[i * chain->channels + c] *= gain;
+    }
+    chain->gain = target;
+}
+
+static void chain_publish(audio_chain_t* chain) {
+    unsigned int sequence = atomic_load_explicit(&chain->snapshot_sequence, memory_order_relaxed);
+    atomic_store_explicit(&chain->snapshot_sequence, sequence + 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+
+    ma_uint64 position = chain->playing.offset + (chain->consumed - chain->playing.frame);
+    atomic_store_explicit(&chain->position, position, memory_order_relaxed);
+    atomic_store_explicit(&chain->length, chain->playing.length, memory_order_relaxed);
+    atomic_store_explicit(&chain->current_serial, chain->playing.serial, memory_order_relaxed);
+    atomic_store_explicit(&chain->snapshot_paused, chain->paused, memory_order_relaxed);
+    atomic_store_explicit(&chain->snapshot_ended, chain->ended, memory_order_relaxed);
+    atomic_store_explicit(&chain->snapshot_volume, chain->volume, memory_order_relaxed);
+
+    atomic_store_explicit(&chain->snapshot_sequence, sequence + 2, memory_order_release);
+}
+
+// a consistent copy of what the audio thread last published
+typedef struct chain_snapshot {
+    ma_uint64 position;
+    ma_uint64 length;
+    size_t serial;
+    bool paused;
+    bool ended;
+    float volume;
+} chain_snapshot_t;
+
+static chain_snapshot_t chain_load_snapshot(audio_chain_t* chain) {
+    chain_snapshot_t snapshot;
+    unsigned int before, after;
+    do {
+        before = atomic_load_explicit(&chain->snapshot_sequence, memory_order_acquire);
+        snapshot.position = atomic_load_explicit(&chain->position, memory_order_relaxed);
+        snapshot.length = atomic_load_explicit(&chain->length, memory_order_relaxed);
+        snapshot.serial = atomic_load_explicit(&chain->current_serial, memory_order_relaxed);
+        snapshot.paused = atomic_load_explicit(&chain->snapshot_paused, memory_order_relaxed);
+        snapshot.ended = atomic_load_explicit(&chain->snapshot_ended, memory_order_relaxed);
+        snapshot.volume = atomic_load_explicit(&chain->snapshot_volume, memory_order_relaxed);
+        atomic_thread_fence(memory_order_acquire);
+        after = atomic_load_explicit(&chain->snapshot_sequence, memory_order_relaxed);
+    } while (before != after || (before & 1));
+    return snapshot;
+}
+
+// without a device a read waits for the decode thread, false once nothing more is coming
+static bool chain_wait_decoded(audio_chain_t* chain) {
+    pthread_mutex_lock(&chain->lock);
+    bool coming = chain->consumed < atomic_load(&chain->end_frame) ||
+                  atomic_load(&chain->pending) || atomic_load(&chain->next) ||
+                  chain->play_path || chain->queue_path || chain->opening > 0;
+    // frames committed since the ring was seen empty were signalled before this took the lock
+    if (coming && ma_pcm_rb_available_read(&chain->ring) == 0) {
+        // timed, so a stop or a missed wakeup can't hold it up for long
+        chain->wanted = true;
+        pthread_cond_signal(&chain->decode_wake);
+        struct timespec until;
+        clock_gettime(CLOCK_REALTIME, &until);
+        until.tv_nsec += 10000000L;
+        until.tv_sec += until.tv_nsec / 1000000000L;
+        until.tv_nsec %= 1000000000L;
+        pthread_cond_timedwait(&chain->read_wake, &chain->lock, &until);
+    }
+    pthread_mutex_unlock(&chain->lock);
+    return coming;
+}
+
+// copies decoded frames out of the ring, this never touches a file or a decoder
+// and only waits without a device
+static ma_result chain_fill(audio_chain_t* chain, float* frames, ma_uint64 frame_count, ma_uint64* frames_read) {
+    ma_uint32 channels = chain->channels;
+    chain_apply_commands(chain);
+
+    // skip frames a seek or a new track made stale
+    ma_uint64 flush_to = atomic_load(&chain->flush_to);
+    while (chain->consumed < flush_to) {
+        ma_uint32 skipped = (ma_uint32)(flush_to - chain->consumed < UINT32_MAX ? flush_to - chain->consumed : UINT32_MAX);
+        void* buffer;
+        if (ma_pcm_rb_acquire_read(&chain->ring, &skipped, &buffer) != MA_SUCCESS || skipped == 0) break;
+        ma_pcm_rb_commit_read(&chain->ring, skipped);
+        chain->consumed += skipped;
+    }
+
+    // a pause or stop fades out over one read, then plays silence without using up the ring
+    float target = chain->paused || chain->stopped ? 0.0f : chain->volume;
+    if (target == 0.0f && chain->gain == 0.0f && (chain->paused || chain->stopped)) {
+        chain_take_markers(chain);
+        chain_publish(chain);
+        memset(frames, 0, frame_count * channels * sizeof(float));
+        *frames_read = frame_count;
+        return MA_SUCCESS;
+    }
+
+    ma_uint64 total = 0;
+    while (total < frame_count && chain->consumed >= flush_to) {
+        chain_take_markers(chain);
+        ma_uint32 count = (ma_uint32)(frame_count - total);
+        void* buffer;
+        if (ma_pcm_rb_acquire_read(&chain->ring, &count, &buffer) != MA_SUCCESS) break;
+        if (count == 0) {
+            if (chain->pull && chain_wait_decoded(chain)) continue;
+            break;
+        }
+        memcpy(frames + total * channels, buffer, count * channels * sizeof(float));
+        ma_pcm_rb_commit_read(&chain->ring, count);
+        total += count;
+        chain->consumed += count;
+        chain->copied += count;
+    }
+    chain_take_markers(chain);
+    chain_apply_gain(chain, frames, total, target);
+
+    // the sound never ends, it plays silence between tracks so nothing has to restart it
+    *frames_read = frame_count;
+    if (total < frame_count) {
+        memset(frames + total * channels, 0, (frame_count - total) * channels * sizeof(float));
+        bool starting = atomic_load(&chain->pending) != NULL;
+        if (!starting && chain->consumed >= atomic_load(&chain->end_frame)) {
+            chain->ended = true;
+        } else if (!starting && !chain->ended && chain->consumed >= flush_to) {
+            // the decoder fell behind
+            atomic_fetch_add(&chain->underruns, 1);
+            atomic_fetch_add(&chain->underrun_frames, frame_count - total);
+        }
+    }
+    chain_publish(chain);
+    return MA_SUCCESS;
+}
+
+// times every read, one close to a device period long would be an underrun on real hardware
+static ma_result chain_read(ma_data_source* source, void* out, ma_uint64 frame_count, ma_uint64* frames_read) {
+    audio_chain_t* chain = (audio_chain_t*)source;
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    ma_result result = chain_fill(chain, out, frame_count, frames_read);
+    clock_gettime(CLOCK_MONOTONIC, &end);
+
+    ma_uint64 ns = (ma_uint64)(end.tv_sec - start.tv_sec) * 1000000000ULL + (ma_uint64)end.tv_nsec - (ma_uint64)start.tv_nsec;
+    atomic_fetch_add_explicit(&chain->reads, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&chain->read_ns, ns, memory_order_relaxed);
+    if (ns > atomic_load_explicit(&chain->read_ns_max, memory_order_relaxed)) {
+        atomic_store_explicit(&chain->read_ns_max, ns, memory_order_relaxed);
+    }
+    return result;
+}
+
+// the decode thread picks the seek up at its next poll, this may run on the audio thread
+static ma_result chain_seek(ma_data_source* source, ma_uint64 frame) {
+    audio_chain_t* chain = (audio_chain_t*)source;
+    size_t serial = atomic_load_explicit(&chain->current_serial, memory_order_relaxed);
+    atomic_store(&chain->seek_target, seek_target_pack(serial, frame));
+    return MA_SUCCESS;
+}
+
+static ma_result chain_get_format(ma_data_source* source, ma_format* format, ma_uint32* channels, ma_uint32* sample_rate, ma_channel* channel_map, size_t channel_map_cap) {
+    audio_chain_t* chain = (audio_chain_t*)source;
+    *format = ma_format_f32;
+    *channels = chain->channels;
+    *sample_rate = chain->sample_rate;
+    ma_channel_map_init_standard(ma_standard_channel_map_default, channel_map, channel_map_cap, chain->channels);
+    return MA_SUCCESS;
+}
+
+static ma_result chain_get_cursor(ma_data_source* source, ma_uint64* cursor) {
+    *cursor = chain_load_snapshot((audio_chain_t*)source).position;
+    return MA_SUCCESS;
+}
+
+static ma_result chain_get_length(ma_data_source* source, ma_uint64* length) {
+    *length = chain_load_snapshot((audio_chain_t*)source).length;
+    return MA_SUCCESS;
+}
+
+static ma_data_source_vtable chain_vtable = {
+    chain_read,
+    chain_seek,
+    chain_get_format,
+    chain_get_cursor,
+    chain_get_length,
+    nullptr,
+    0
+};
+
+// loader
+// ------
+
+// scans the frame headers of an mp3 once for seek points and saves them in a sidecar file,
+// takes a few hundred milliseconds for a two hour mix, so it runs after the track was handed over
+static chain_index_t* chain_build_index(const char* path) {
+    struct stat info;
+    ma_dr_mp3 mp3;
+    if (stat(path, &info) != 0 || !ma_dr_mp3_init_file(&mp3, path, nullptr)) return nullptr;
+
+    ma_uint64 wanted = (ma_uint64)info.st_size / SEEK_INDEX_SPACING_BYTES;
+    ma_uint32 count = wanted < 16 ? 16 : wanted > UINT16_MAX ? UINT16_MAX : (ma_uint32)wanted;
+    chain_index_t* built = calloc(1, sizeof(chain_index_t));
+    if (built) {
+        built->path = strdup(path);
+        built->points = malloc(count * sizeof(ma_dr_mp3_seek_point));
+    }
+    bool success = built && built->path && built->points &&
+                   ma_dr_mp3_calculate_seek_points(&mp3, &count, built->points) && count > 0;
+    ma_dr_mp3_uninit(&mp3);
+    if (!success) {
+        LOG_WARN("Couldn't build seek index: %s", path);
+        if (built) chain_index_free(built);
+        return nullptr;
+    }
+    built->count = count;
+
+    seek_index_t index = {
+        .file_size = (uint64_t)info.st_size,
+        .mtime_sec = info.st_mtim.tv_sec,
+        .mtime_nsec = info.st_mtim.tv_nsec,
+        .points = malloc(count * sizeof(seek_point_t)),
+        .count = count
+    };
+    char* index_path = seek_index_default_path(path);
+    if (index.points && index_path) {
+        for (ma_uint32 i = 0; i < count; i++) {
+            index.points[i] = (seek_point_t){
+                built->points[i].seekPosInBytes,
+                built->points[i].pcmFrameIndex,
+                built->points[i].mp3FramesToDiscard,
+                built->points[i].pcmFramesToDiscard
+            };
+        }
+        if (seek_index_save(index_path, &index)) LOG_INFO("Seek index built: %s (%u points)", path, count);
+    }
+    free(index.points);
+    free(index_path);
+    return built;
+}
+
+// opens played and queued tracks, a newer queue or play call makes the one being opened stale
+// an open can't be interrupted, so a stale one finishes and is dropped while other loaders go on
+static void* chain_loader_run(void* arg) {
+    audio_chain_t* chain = arg;
+
+    pthread_mutex_lock(&chain->lock);
+    while (!chain->stopping) {
+        if (!chain->play_path && !chain->queue_path) {
+            chain->idle_loaders++;
+            pthread_cond_wait(&chain->wake, &chain->lock);
+            chain->idle_loaders--;
+            continue;
+        }
+        bool play = chain->play_path != NULL;
+        char* path = play ? chain->play_path : chain->queue_path;
+        size_t serial = play ? chain->play_request : chain->queue_request;
+        if (play) chain->play_path = NULL; else chain->queue_path = NULL;
+        chain->opening++;
+        pthread_mutex_unlock(&chain->lock);
+
+        chain_track_t* track = track_open(chain, path, serial, true);
+        bool wants_index = track && track->wants_index;
+        bool handed = false;
+
+        pthread_mutex_lock(&chain->lock);
+        chain->opening--;
+        if (serial == (play ? chain->play_request : chain->queue_request)) {
+            if (!track && play) atomic_store(&chain->failed_serial, serial);
+            // the decode thread swaps a played track in and flushes the ring, or
+            // picks a queued one up when the current track runs out, which it may have already
+            if (track) {
+                track = atomic_exchange(play ? &chain->pending : &chain->next, track);
+                handed = true;
+            }
+            // stored after pending, so the decode thread never sees neither
+            if (play) atomic_store(&chain->play_opening, false);
+            pthread_cond_signal(&chain->decode_wake);
+            if (chain->pull) pthread_cond_broadcast(&chain->read_wake); // a failed open ends a wait too
+        }
+        if (track) track_free(track);
+
+        // the track plays meanwhile, seeks decode from its start until the decode thread binds this
+        if (handed && wants_index) {
+            pthread_mutex_unlock(&chain->lock);
+            chain_index_t* built = chain_build_index(path);
+            if (built) built = atomic_exchange(&chain->built_index, built);
+            if (built) chain_index_free(built);
+            pthread_mutex_lock(&chain->lock);
+        }
+        free(path);
+    }
+    pthread_mutex_unlock(&chain->lock);
+    return NULL;
+}
+
+static audio_chain_t* chain_create(ma_engine* engine, ma_uint32 buffer_ms, bool map_files, bool pull, ma_uint32 open_delay_ms) {
+    audio_chain_t* chain = calloc(1, sizeof(audio_chain_t));
+    if (!chain) {
+        LOG_ERROR("Memory allocation failed; couldn't create playback chain.");
+        return NULL;
+    }
+
+    chain->channels = ma_engine_get_channels(engine);
+    chain->sample_rate = ma_engine_get_sample_rate(engine);
+    chain->ring_frames = (ma_uint32)((ma_uint64)chain->sample_rate * buffer_ms / 1000);
+    if (chain->ring_frames < 4 * FADE_CHUNK_FRAMES) chain->ring_frames = 4 * FADE_CHUNK_FRAMES;
+    atomic_init(&chain->seek_target, UINT64_MAX);
+    atomic_init(&chain->end_frame, 0);
+    atomic_init(&chain->snapshot_volume, 1.0f);
+    atomic_init(&chain->map_files, map_files);
+    chain->pull = pull;
+    chain->open_delay_ms = open_delay_ms;
+    chain->volume = 1.0f;
+    chain->gain = 1.0f;
+
+    chain->fade_buffer = malloc(FADE_CHUNK_FRAMES * chain->channels * sizeof(float));
+    if (!chain->fade_buffer) {
+        LOG_ERROR("Memory allocation failed; couldn't create playback chain.");
+        free(chain);
+        return NULL;
+    }
+
+    ma_result result = ma_pcm_rb_init(ma_format_f32, chain->channels, chain->ring_frames, nullptr, nullptr, &chain->ring);
+    if (result != MA_SUCCESS) {
+        LOG_ERROR(
+            "Failed to initialize playback buffer; %s",
+            ma_result_description(result)
+        );
+        free(chain->fade_buffer);
+        free(chain);
+        return NULL;
+    }
+
+    ma_data_source_config config = ma_data_source_config_init();
+    config.vtable = &chain_vtable;
+    result = ma_data_source_init(&config, &chain->base);
+    if (result != MA_SUCCESS) {
+        LOG_ERROR(
+            "Failed to initialize playback chain; %s",
+            ma_result_description(result)
+        );
+        ma_pcm_rb_uninit(&chain->ring);
+        free(chain->fade_buffer);
+        free(chain);
+        return NULL;
+    }
+
+    pthread_mutex_init(&chain->lock, NULL);
+    pthread_cond_init(&chain->wake, NULL);
+    pthread_cond_init(&chain->decode_wake, NULL);
+    pthread_cond_init(&chain->read_wake, NULL);
+    chain->decoder_started = pthread_create(&chain->decoder, NULL, chain_decode_run, chain) == 0;
+    if (!chain->decoder_started) {
+        LOG_ERROR("Couldn't start decode thread.");
+        ma_data_source_uninit(&chain->base);
+        ma_pcm_rb_uninit(&chain->ring);
+        pthread_mutex_destroy(&chain->lock);
+        pthread_cond_destroy(&chain->wake);
+        pthread_cond_destroy(&chain->decode_wake);
+        pthread_cond_destroy(&chain->read_wake);
+        free(chain->fade_buffer);
+        free(chain);
+        return NULL;
+    }
+    if (pthread_create(&chain->loaders[0], NULL, chain_loader_run, chain) == 0) {
+        chain->loader_count = 1;
+    } else {
+        LOG_WARN("Couldn't start track loader; tracks will be opened on the calling thread.");
+    }
+    return chain;
+}
+
+// frees the chain once nothing reads from it anymore
+static void chain_free(audio_chain_t* chain) {
+    pthread_mutex_lock(&chain->lock);
+    chain->stopping = true;
+    pthread_cond_broadcast(&chain->wake);
+    pthread_cond_signal(&chain->decode_wake);
+    pthread_mutex_unlock(&chain->lock);
+    for (size_t i = 0; i < chain->loader_count; i++) pthread_join(chain->loaders[i], NULL);
+    pthread_join(chain->decoder, NULL);
+
+    chain_track_t* tracks[] = {
+        chain->current,
+        chain->outgoing,
+        atomic_exchange(&chain->pending, NULL),
+        atomic_exchange(&chain->next, NULL)
+    };
+    for (size_t i = 0; i < sizeof(tracks) / sizeof(tracks[0]); i++) {
+        if (tracks[i]) track_free(tracks[i]);
+    }
+    chain_index_t* built = atomic_exchange(&chain->built_index, NULL);
+    if (built) chain_index_free(built);
+    if (chain->waiting_index) chain_index_free(chain->waiting_index);
+
+    free(chain->play_path);
+    free(chain->queue_path);
+    free(chain->fade_buffer);
+    ma_pcm_rb_uninit(&chain->ring);
+    ma_data_source_uninit(&chain->base);
+    pthread_mutex_destroy(&chain->lock);
+    pthread_cond_destroy(&chain->wake);
+    pthread_cond_destroy(&chain->decode_wake);
+    pthread_cond_destroy(&chain->read_wake);
+    free(chain);
+}
+
+// hands a command to the audio thread, false while the queue is full
+static bool chain_push_command(audio_chain_t* chain, chain_command_t command) {
+    size_t head = atomic_load(&chain->command_head);
+    if (head - atomic_load(&chain->command_tail) >= COMMAND_COUNT) {
+        LOG_WARN("Couldn't send playback command; the audio thread isn't keeping up.");
+        return false;
+    }
+
+    chain->commands[head % COMMAND_COUNT] = command;
+    atomic_store(&chain->command_head, head + 1);
+    return true;
+}
+
+// wakes a loader for a new request, called with the lock held
+// stale opens can't be interrupted and indexes take a while to build, so the request
+// gets a loader of its own if they're all busy
+static void chain_wake_loader(audio_chain_t* chain) {
+    pthread_cond_signal(&chain->wake);
+    if (chain->idle_loaders == 0 && chain->loader_count < LOADER_MAX &&
+        pthread_create(&chain->loaders[chain->loader_count], NULL, chain_loader_run, chain) == 0) {
+        chain->loader_count++;
+    }
+}
+
+// takes a new serial and drops the queued open, and with drop_play the play still opening
+static size_t chain_next_serial(audio_chain_t* chain, bool drop_play) {
+    pthread_mutex_lock(&chain->lock);
+    size_t serial = ++chain->request_serial;
+    free(chain->queue_path);
+    chain->queue_path = NULL;
+    chain->queue_request = 0;
+    if (drop_play) {
+        free(chain->play_path);
+        chain->play_path = NULL;
+        chain->play_request = 0;
+        atomic_store(&chain->play_opening, false);
+    }
+    pthread_mutex_unlock(&chain->lock);
+    return serial;
+}
+
+audio_device_options_t audio_device_default_options(void) {
+    return (audio_device_options_t){ .buffer_ms = 400, .map_files = true, .volume = 1.0f };
+}
+
+bool audio_device_init(audio_device_t* dev, const audio_device_options_t* options) {
+   audio_device_options_t defaults = audio_device_default_options();
+   if (!options) options = &defaults;
+
+   ma_engine_config config = ma_engine_config_init();
+   if (options->sample_rate > 0) config.sampleRate = options->sample_rate;
+   config.onProcess = options->tap;
+   config.pProcessUserData = options->tap_data;
+   dev->owns_context = false;
+   dev->output = options->output;
+
+   ma_result result = MA_SUCCESS;
+   if (options->output == AUDIO_DEVICE_OUTPUT_NULL) {
+       // a device with a clock but no hardware, for runs on machines without a sound card
+       ma_backend backend = ma_backend_null;
+       result = ma_context_init(&backend, 1, nullptr, &dev->context);
+       if (result != MA_SUCCESS) {
+           LOG_ERROR(
+               "Failed to initialize null audio backend; %s",
+               ma_result_description(result)
+           );
+           return false;
+       }
+       dev->owns_context = true;
+       config.pContext = &dev->context;
+   } else if (options->output == AUDIO_DEVICE_OUTPUT_NONE) {
+       config.noDevice = MA_TRUE;
+       config.channels = 2;
+       if (config.sampleRate == 0) config.sampleRate = 48000;
+   }
+
+   result = ma_engine_init(&config, &dev->engine);
    
    if (result != MA_SUCCESS) {
        LOG_ERROR(
            "Failed to initialize audio device; %s",
            ma_result_description(result)
        );
+       if (dev->owns_context) ma_context_uninit(&dev->context);
+       dev->owns_context = false;
+       return false;
+   }
+
+   dev->chain = chain_create(
+       &dev->engine,
+       options->buffer_ms,
+       options->map_files,
+       options->output == AUDIO_DEVICE_OUTPUT_NONE,
+       options->open_delay_ms
+   );
+   if (!dev->chain) {
+       ma_engine_uninit(&dev->engine);
+       if (dev->owns_context) ma_context_uninit(&dev->context);
+       dev->owns_context = false;
+       return false;
+   }
+   // set before the sound starts, so the first track doesn't ramp up to it
+   float volume = clamp01(options->volume);
+   dev->chain->volume = volume;
+   dev->chain->gain = volume;
+   // decoders already output the engine's rate, the sound's own resampler would only delay it a frame
+   result = ma_sound_init_from_data_source(
+       &dev->engine,
+       dev->chain,
+       MA_SOUND_FLAG_NO_SPATIALIZATION | MA_SOUND_FLAG_NO_PITCH,
+       nullptr,
+       &dev->sound
+   );
+   if (result != MA_SUCCESS) {
+       LOG_ERROR(
+           "Failed to initialize sound; %s",
+           ma_result_description(result)
+       );
+       chain_free(dev->chain);
+       dev->chain = nullptr;
+       ma_engine_uninit(&dev->engine);
+       if (dev->owns_context) ma_context_uninit(&dev->context);
+       dev->owns_context = false;
+       return false;
+   }
+
+   // started once, tracks, pauses and stops are all handled by the chain
+   result = ma_sound_start(&dev->sound);
+   if (result != MA_SUCCESS) {
+       LOG_ERROR(
+           "Failed to start sound; %s",
+           ma_result_description(result)
+       );
+       ma_sound_uninit(&dev->sound);
+       chain_free(dev->chain);
+       dev->chain = nullptr;
+       ma_engine_uninit(&dev->engine);
+       if (dev->owns_context) ma_context_uninit(&dev->context);
+       dev->owns_context = false;
        return false;
    }
 
    dev->initialized = true;
    dev->sound_loaded = false;
    dev->paused = false;
+   dev->gapless = true;
+   dev->volume = volume;
+   dev->queued_path = nullptr;
+   dev->playing_serial = 0;
+   dev->queued_serial = 0;
    
    LOG_INFO("Audio device initialized successfully.");
    return true;
 }
 
 void audio_device_free(audio_device_t* dev) {
-    if (dev->sound_loaded) ma_sound_uninit(&dev->sound);
-    ma_engine_uninit(&dev->engine);
+    if (dev->initialized) {
+        ma_sound_uninit(&dev->sound);
+        ma_engine_uninit(&dev->engine);
+        chain_free(dev->chain);
+        if (dev->owns_context) ma_context_uninit(&dev->context);
+    }
+    dev->chain = nullptr;
+    dev->owns_context = false;
+    free(dev->queued_path);
+    dev->queued_path = nullptr;
     dev->initialized = false;
     dev->sound_loaded = false;
     dev->paused = false;
@@ -46,50 +1180,184 @@ bool audio_device_play_file(audio_device_t* dev, const char* path) {
         LOG_ERROR("Failed to play file; given path is NULL.");
         return false;
     }
-    
-    float volume;
-    if (dev->sound_loaded) {
-        volume = audio_device_get_volume(dev);
-        ma_sound_uninit(&dev->sound);
-    } else {
-        volume = 1.0f;
+    if (!dev->initialized) {
+        LOG_ERROR("Failed to play file; audio device is uninitialized.");
+        return false;
     }
 
-    ma_result result = ma_sound_init_from_file(
-        &dev->engine,
-        path,
-        MA_SOUND_FLAG_STREAM,
-        nullptr,
-        nullptr,
-        &dev->sound
-    );
+    // the queued track was opened for this, anything else queued or opening is dropped
+    audio_chain_t* chain = dev->chain;
+    size_t serial = chain_next_serial(chain, true);
+    chain_track_t* track = atomic_exchange(&chain->next, nullptr);
+    if (track && strcmp(track->path, path) != 0) {
+        track_free(track);
+        track = nullptr;
+    }
+    free(dev->queued_path);
+    dev->queued_path = nullptr;
 
-    if (result != MA_SUCCESS) {
-        LOG_ERROR(
-            "Failed to load sound; %s",
-            ma_result_description(result)
-        );
-        dev->sound_loaded = false;
-        dev->paused = false;
+    // pause and stop hold until the new track is heard, the old one keeps going while it opens
+    if (!chain_push_command(chain, (chain_command_t){ .type = CHAIN_PLAY, .serial = serial })) {
+        if (track) track_free(track);
         return false;
     }
 
+    if (track) {
+        track->serial = serial;
+    } else if (chain->loader_count > 0) {
+        // opened in the background, audio_device_poll_transition notices if it fails
+        char* request = strdup(path);
+        if (!request) {
+            LOG_ERROR("Memory allocation failed; couldn't play file.");
+            return false;
+        }
+        pthread_mutex_lock(&chain->lock);
+        free(chain->play_path);
+        chain->play_path = request;
+        chain->play_request = serial;
+        atomic_store(&chain->play_opening, true);
+        chain_wake_loader(chain);
+        pthread_mutex_unlock(&chain->lock);
+    } else {
+        track = track_open(chain, path, serial, false);
+        if (!track) {
+            dev->sound_loaded = false;
+            dev->paused = false;
+            return false;
+        }
+    }
+
+    // the decode thread swaps it in and flushes the ring
+    if (track) {
+        chain_track_t* replaced = atomic_exchange(&chain->pending, track);
+        if (replaced) track_free(replaced);
+        chain_wake_decoder(chain);
+    }
+    dev->playing_serial = serial;
+    dev->queued_serial = 0;
     dev->sound_loaded = true;
-    result = ma_sound_start(&dev->sound);
+    dev->paused = false;
+    LOG_INFO("Playing file: %s", path);
+    return true;
+}
 
-    if (result != MA_SUCCESS) {
-        LOG_ERROR(
-            "Failed to start sound; %s",
-            ma_result_description(result)
-        );
-        ma_sound_uninit(&dev->sound);
+// drops the queued track and any open still running for it
+static void drop_queued(audio_device_t* dev) {
+    chain_next_serial(dev->chain, false);
+    chain_track_t* track = atomic_exchange(&dev->chain->next, nullptr);
+    if (track) track_free(track);
+    free(dev->queued_path);
+    dev->queued_path = nullptr;
+    dev->queued_serial = 0;
+}
+
+void audio_device_set_gapless(audio_device_t* dev, bool gapless) {
+    if (!dev) {
+        LOG_ERROR("Couldn't set gapless playback; audio device is NULL.");
+        return;
+    }
+
+    dev->gapless = gapless;
+    if (!gapless && dev->initialized) drop_queued(dev);
+    LOG_INFO("Gapless playback %s.", gapless ? "enabled" : "disabled");
+}
+
+void audio_device_set_map_files(audio_device_t* dev, bool map_files) {
+    if (!dev || !dev->initialized) {
+        LOG_ERROR("Couldn't set file mapping; audio device is NULL or uninitialized.");
+        return;
+    }
+
+    atomic_store(&dev->chain->map_files, map_files);
+    LOG_INFO("Decoding from %s.", map_files ? "mapped files" : "stdio reads");
+}
+
+void audio_device_set_crossfade(audio_device_t* dev, float seconds) {
+    if (!dev || !dev->initialized) {
+        LOG_ERROR("Couldn't set crossfade; audio device is NULL or uninitialized.");
+        return;
+    }
+
+    if (seconds < 0.0f) seconds = 0.0f;
+    ma_uint64 frames = (ma_uint64)(seconds * ma_engine_get_sample_rate(&dev->engine));
+    atomic_store(&dev->chain->fade_frames, frames);
+    if (frames > 0 && !dev->gapless) audio_device_set_gapless(dev, true);
+    LOG_INFO("Crossfade set to %.2f seconds.", seconds);
+}
+
+// an equal-power curve, so the sum keeps its loudness through the fade
+void audio_device_mix_crossfade(float* incoming, const float* outgoing, uint64_t outgoing_count, uint64_t count,
+                                uint64_t done, uint64_t total, uint32_t channels) {
+    for (uint64_t i = 0; i < count; i++) {
+        float x = total > 0 ? (float)(done + i) / (float)total : 1.0f;
+        if (x > 1.0f) x = 1.0f;
+        float in = sinf(x * (float)M_PI_2);
+        float out = i < outgoing_count ? cosf(x * (float)M_PI_2) : 0.0f;
+        for (uint32_t c = 0; c < channels; c++) {
+            float faded = i < outgoing_count ? outgoing[i * channels + c] * out : 0.0f;
+            incoming[i * channels + c] = incoming[i * channels + c] * in + faded;
+        }
+    }
+}
+
+bool audio_device_queue_next(audio_device_t* dev, const char* path) {
+    if (!dev || !path) {
+        LOG_ERROR("Couldn't queue next track; audio device or path is NULL.");
+        return false;
+    } else if (!dev->initialized || !dev->gapless || dev->chain->loader_count == 0) {
+        return false;
+    }
+
+    char* copy = strdup(path);
+    char* request = strdup(path);
+    if (!copy || !request) {
+        LOG_ERROR("Memory allocation failed; couldn't queue next track.");
+        free(copy);
+        free(request);
+        return false;
+    }
+
+    // a track queued earlier must not start in its place
+    audio_chain_t* chain = dev->chain;
+    chain_track_t* track = atomic_exchange(&chain->next, nullptr);
+    if (track) track_free(track);
+
+    pthread_mutex_lock(&chain->lock);
+    dev->queued_serial = ++chain->request_serial;
+    free(chain->queue_path);
+    chain->queue_path = request;
+    chain->queue_request = dev->queued_serial;
+    chain_wake_loader(chain);
+    pthread_mutex_unlock(&chain->lock);
+
+    free(dev->queued_path);
+    dev->queued_path = copy;
+    return true;
+}
+
+bool audio_device_poll_transition(audio_device_t* dev) {
+    if (!dev) {
+        LOG_ERROR("Couldn't poll track transition; audio device is NULL.");
+        return false;
+    } else if (!dev->initialized) {
+        return false;
+    }
+
+    if (dev->sound_loaded && atomic_load(&dev->chain->failed_serial) == dev->playing_serial) {
+        LOG_ERROR("Couldn't play file; it failed to open.");
         dev->sound_loaded = false;
         dev->paused = false;
         return false;
     }
 
-    audio_device_set_volume(dev, volume);
-    LOG_INFO("Playing file: %s", path);
+    size_t serial = chain_load_snapshot(dev->chain).serial;
+    if (dev->queued_serial == 0 || serial != dev->queued_serial) return false;
+
+    LOG_INFO("Playing queued file: %s", dev->queued_path);
+    dev->playing_serial = serial;
+    dev->queued_serial = 0;
+    free(dev->queued_path);
+    dev->queued_path = nullptr;
     return true;
 }
 
@@ -102,8 +1370,10 @@ bool audio_device_stop(audio_device_t* dev) {
         return false;
     }
 
-    ma_sound_stop(&dev->sound);
-    ma_sound_uninit(&dev->sound);
+    // the audio thread fades out and plays silence, the next play swaps the stopped track out
+    if (!chain_push_command(dev->chain, (chain_command_t){ .type = CHAIN_STOP })) return false;
+    chain_next_serial(dev->chain, true);
+    drop_queued(dev);
     dev->sound_loaded = false;
     dev->paused = false;
 
@@ -123,7 +1393,8 @@ bool audio_device_pause(audio_device_t* dev) {
         return false;
     }
 
-    ma_sound_stop(&dev->sound);
+    // the sound keeps running and the audio thread plays silence in its place
+    if (!chain_push_command(dev->chain, (chain_command_t){ .type = CHAIN_PAUSE })) return false;
     dev->paused = true;
 
     LOG_INFO("Playback paused.");
@@ -142,15 +1413,7 @@ bool audio_device_resume(audio_device_t* dev) {
         return false;
     }
 
-    ma_result result = ma_sound_start(&dev->sound);
-    if (result != MA_SUCCESS) {
-        LOG_ERROR(
-            "Failed to resume sound; %s",
-            ma_result_description(result)
-        );
-        return false;
-    }
-
+    if (!chain_push_command(dev->chain, (chain_command_t){ .type = CHAIN_RESUME })) return false;
     dev->paused = false;
     LOG_INFO("Playback resumed.");
     return true;
@@ -165,7 +1428,8 @@ bool audio_device_set_volume(audio_device_t* dev, float volume) {
     }
 
     volume = clamp01(volume);
-    ma_sound_set_volume(&dev->sound, volume);
+    if (!chain_push_command(dev->chain, (chain_command_t){ .type = CHAIN_SET_VOLUME, .volume = volume })) return false;
+    dev->volume = volume;
 
     LOG_INFO("Volume set to %.2f", volume);
     return true;
@@ -179,7 +1443,8 @@ float audio_device_get_volume(audio_device_t* dev) {
     
     if (!dev->sound_loaded) return 0.0f;
 
-    return ma_sound_get_volume(&dev->sound);
+    // the last volume asked for, so repeated changes add up before the audio thread applies them
+    return dev->volume;
 }
 
 bool audio_device_set_progress(audio_device_t* dev, float progress) {
@@ -193,29 +1458,17 @@ bool audio_device_set_progress(audio_device_t* dev, float progress) {
 
     progress = clamp01(progress);
 
-    ma_uint64 length_in_frames;
-    ma_result result = ma_sound_get_length_in_pcm_frames(
-        &dev->sound, &length_in_frames
-    );
-
-    if (result != MA_SUCCESS) {
-        LOG_ERROR(
-            "Failed to get sound length; %s",
-            ma_result_description(result)
-        );
+    chain_snapshot_t snapshot = chain_load_snapshot(dev->chain);
+    if (snapshot.length == 0) {
+        LOG_ERROR("Failed to get sound length; the length of the track is unknown.");
         return false;
     }
 
-    ma_uint64 target_frame = (ma_uint64)(progress * length_in_frames);
-    result = ma_sound_seek_to_pcm_frame(&dev->sound, target_frame);
-
-    if (result != MA_SUCCESS) {
-        LOG_ERROR(
-            "Failed to seek; %s",
-            ma_result_description(result)
-        );
-        return false;
-    }
+    // seeks go straight to the decode thread, which owns the tracks
+    // the target is in the heard track, the decode thread may be ahead in the next one
+    ma_uint64 target_frame = (ma_uint64)(progress * snapshot.length);
+    atomic_store(&dev->chain->seek_target, seek_target_pack(snapshot.serial, target_frame));
+    chain_wake_decoder(dev->chain);
 
     LOG_INFO("Seeked to progress: %.2f%%", progress * 100.0f);
     return true;
@@ -229,14 +1482,10 @@ float audio_device_get_progress(audio_device_t* dev) {
     
     if (!dev->sound_loaded) return 0.0f;
 
-    ma_uint64 cursor, length;
-    if (ma_sound_get_cursor_in_pcm_frames(&dev->sound, &cursor) != MA_SUCCESS ||
-        ma_sound_get_length_in_pcm_frames(&dev->sound, &length) != MA_SUCCESS ||
-        length == 0) {
-        return 0.0f;
-    }
+    chain_snapshot_t snapshot = chain_load_snapshot(dev->chain);
+    if (snapshot.length == 0) return 0.0f;
 
-    return (float)cursor / (float)length;
+    return (float)snapshot.position / (float)snapshot.length;
 }
 
 float audio_device_get_duration_seconds(audio_device_t* dev) {
@@ -247,26 +1496,20 @@ float audio_device_get_duration_seconds(audio_device_t* dev) {
     
     if (!dev->sound_loaded) return 0.0f;
 
-    ma_uint64 frames;
-    if (ma_sound_get_length_in_pcm_frames(&dev->sound, &frames) != MA_SUCCESS) {
-        return 0.0f;
-    }
-
+    // tracks are decoded at the engine's rate, so its frames are the track's frames
+    ma_uint64 frames = chain_load_snapshot(dev->chain).length;
     return (float)frames / ma_engine_get_sample_rate(&dev->engine);
 }
 
 float audio_device_get_position_seconds(audio_device_t* dev) {
     if (!dev) {
         LOG_ERROR("Couldn't get position in seconds; audio device is NULL.");
+        return -1.0f;
     }
     
     if (!dev->sound_loaded) return 0.0f;
 
-    ma_uint64 frames;
-    if (ma_sound_get_cursor_in_pcm_frames(&dev->sound, &frames) != MA_SUCCESS) {
-        return 0.0f;
-    }
-
+    ma_uint64 frames = chain_load_snapshot(dev->chain).position;
     return (float)frames / ma_engine_get_sample_rate(&dev->engine);
 }
 
@@ -276,15 +1519,18 @@ bool audio_device_is_playing(audio_device_t* dev) {
         return false;
     }
     
-    return dev->sound_loaded && ma_sound_is_playing(&dev->sound);
+    return dev->sound_loaded && !dev->paused && !audio_device_is_finished(dev);
 }
 
 bool audio_device_is_paused(audio_device_t* dev) {
     if (!dev) {
         LOG_ERROR("Couldn't see if audio device is paused; audio device is NULL");
+        return false;
     }
     
-    return dev->paused;
+    // what the audio thread has applied, a pause sent this frame shows up after its next read
+    if (!dev->initialized) return false;
+    return chain_load_snapshot(dev->chain).paused;
 }
 
 bool audio_device_is_finished(audio_device_t* dev) {
@@ -295,6 +1541,68 @@ bool audio_device_is_finished(audio_device_t* dev) {
     
     if (!dev->sound_loaded) return false;
     
-    // Check if sound is at the end and not playing
-    return ma_sound_at_end(&dev->sound);
+    // the end of a track played before doesn't count
+    chain_snapshot_t snapshot = chain_load_snapshot(dev->chain);
+    return snapshot.ended && snapshot.serial == dev->playing_serial;
+}
+
+audio_device_state_t audio_device_get_state(audio_device_t* dev) {
+    if (!dev || !dev->initialized) {
+        LOG_ERROR("Couldn't get state; audio device is NULL or uninitialized.");
+        return (audio_device_state_t){0};
+    }
+
+    chain_snapshot_t snapshot = chain_load_snapshot(dev->chain);
+    float rate = (float)dev->chain->sample_rate;
+    return (audio_device_state_t){
+        .position = (float)snapshot.position / rate,
+        .duration = (float)snapshot.length / rate,
+        .volume = snapshot.volume,
+        .paused = snapshot.paused,
+        // a queued track taking over is heard right away, poll_transition only catches up with it
+        .loading = dev->sound_loaded && snapshot.serial != dev->playing_serial &&
+                   (dev->queued_serial == 0 || snapshot.serial != dev->queued_serial)
+    };
+}
+
+audio_device_stats_t audio_device_get_stats(audio_device_t* dev) {
+    if (!dev || !dev->initialized) {
+        LOG_ERROR("Couldn't get stats; audio device is NULL or uninitialized.");
+        return (audio_device_stats_t){0};
+    }
+
+    audio_chain_t* chain = dev->chain;
+    return (audio_device_stats_t){
+        .underruns = atomic_load(&chain->underruns),
+        .underrun_frames = atomic_load(&chain->underrun_frames),
+        .buffered_frames = ma_pcm_rb_available_read(&chain->ring),
+        .buffer_frames = chain->ring_frames,
+        .reads = atomic_load(&chain->reads),
+        .read_seconds = (double)atomic_load(&chain->read_ns) / 1e9,
+        .read_seconds_max = (double)atomic_load(&chain->read_ns_max) / 1e9
+    };
+}
+
+size_t audio_device_render(audio_device_t* dev, float* out, size_t frame_count) {
+    if (!dev || !dev->initialized || !out) {
+        LOG_ERROR("Couldn't render audio; audio device is NULL or uninitialized, or output is NULL.");
+        return 0;
+    }
+    if (dev->output != AUDIO_DEVICE_OUTPUT_NONE) {
+        LOG_ERROR("Couldn't render audio; the engine plays on a device.");
+        return 0;
+    }
+
+    // the engine reads the chain on this thread, so its audio thread fields can be read here
+    audio_chain_t* chain = dev->chain;
+    ma_uint64 copied = chain->copied;
+    ma_uint64 rendered = 0;
+    ma_result result = ma_engine_read_pcm_frames(&dev->engine, out, frame_count, &rendered);
+    if (result != MA_SUCCESS && result != MA_AT_END) {
+        LOG_ERROR("Couldn't render audio; %s", ma_result_description(result));
+        return 0;
+    }
+    // the sound plays silence once the last track ran out, it isn't part of the render
+    if (chain->ended && chain->copied - copied < rendered) rendered = chain->copied - copied;
+    return (size_t)rendered;
 }
@@ -0,0 +1,62 @@
+#define _GNU_SOURCE
+#include "cache_path.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/stat.h>
+
+uint64_t cache_path_hash(const char* s) {
+    uint64_t hash = 1469598103934665603ULL;
+    for (; *s; s++) {
+        hash ^= (unsigned char)*s;
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+char* cache_path_build(const char* name, const char* key, const char* extension) {
+    if (!name || !key || !extension) {
+        LOG_ERROR("Couldn't get cache path; name, key or extension is NULL.");
+        return NULL;
+    }
+
+    const char* base = getenv("XDG_CACHE_HOME");
+    const char* suffix = "";
+    if (!base || base[0] == '\0') {
+        base = getenv("HOME");
+        suffix = "/.cache";
+        if (!base || base[0] == '\0') {
+            LOG_WARN("Couldn't get cache path; neither XDG_CACHE_HOME nor HOME is set.");
+            return NULL;
+        }
+    }
+
+    // a folder opened as ./music, with a trailing slash or through a symlink shares one file
+    // a key that can't be resolved, like a file that is gone, is hashed as given
+    char* resolved = realpath(key, NULL);
+    uint64_t hash = cache_path_hash(resolved ? resolved : key);
+    free(resolved);
+
+    size_t size = strlen(base) + strlen(suffix) + strlen(name) + strlen(extension) + 64;
+    char* path = malloc(size);
+    if (!path) {
+        LOG_ERROR("Memory allocation failed; couldn't build cache path.");
+        return NULL;
+    }
+    snprintf(path, size, "%s%s/sane-music-player/%s-%016llx%s",
+             base, suffix, name, (unsigned long long)hash, extension);
+    return path;
+}
+
+bool cache_path_make_dirs(char* path) {
+    for (char* p = path + 1; *p; p++) {
+        if (*p != '/') continue;
+        *p = '\0';
+        bool ok = mkdir(path, 0755) == 0 || errno == EEXIST;
+        *p = '/';
+        if (!ok) return false;
+    }
+    return true;
+}
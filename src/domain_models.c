@@ -1,5 +1,7 @@
 #include "domain_models.h"
+#include "cache_path.h"
 #include "logger.h"
+#include "string_pool.h"
 #include <stdlib.h>
 #include <string.h>
 #include <stdint.h>
@@ -22,9 +24,9 @@ track_t* track_create(const char* path) {
     
     track->path = strdup(path);
     track->title = strdup("Unknown");
-    track->artist = strdup("Unknown Artist");
-    track->album = strdup("Unknown Album");
-    track->genre = strdup("Unknown");
+    track->artist = string_pool_intern("Unknown Artist");
+    track->album = string_pool_intern("Unknown Album");
+    track->genre = string_pool_intern("Unknown");
     track->duration = 0;
     track->year = 0;
     track->track_number = 0;
@@ -41,9 +43,6 @@ void track_free(track_t* track) {
     
     free(track->path);
     free(track->title);
-    free(track->artist);
-    free(track->album);
-    free(track->genre);
     free(track);
     
     LOG_INFO("Track freed successfully.");
@@ -63,12 +62,15 @@ track_t* track_copy(const track_t* track) {
     
     copy->path = strdup(track->path);
     copy->title = strdup(track->title);
-    copy->artist = strdup(track->artist);
-    copy->album = strdup(track->album);
-    copy->genre = strdup(track->genre);
+    copy->artist = track->artist;
+    copy->album = track->album;
+    copy->genre = track->genre;
     copy->duration = track->duration;
     copy->year = track->year;
     copy->track_number = track->track_number;
+    copy->file_mtime_sec = track->file_mtime_sec;
+    copy->file_mtime_nsec = track->file_mtime_nsec;
+    copy->file_size = track->file_size;
     
     LOG_INFO("Track copied: %s", track->path);
     return copy;
@@ -76,6 +78,175 @@ track_t* track_copy(const track_t* track) {
 
 // track list implementation
 
+// adds the item at position to the index, the first of two equal paths wins
+static void index_insert(track_list_t* list, size_t position) {
+    const char* path = list->items[position].path;
+    uint64_t hash = cache_path_hash(path);
+    size_t mask = list->index_capacity - 1;
+
+    size_t i = hash & mask;
+    for (; list->index[i].position != 0; i = (i + 1) & mask) {
+        const track_index_slot_t* slot = &list->index[i];
+        if (slot->hash == hash && strcmp(list->items[slot->position - 1].path, path) == 0) return;
+    }
+    list->index[i] = (track_index_slot_t){ hash, position + 1 };
+}
+
+// rebuilds the index for at least min_count items
+static bool index_rebuild(track_list_t* list, size_t min_count) {
+    size_t capacity = list->index_capacity == 0 ? 64 : list->index_capacity;
+    while (capacity < min_count * 2) capacity *= 2;
+
+    if (capacity != list->index_capacity) {
+        track_index_slot_t* tmp = realloc(list->index, capacity * sizeof(track_index_slot_t));
+        if (!tmp) return false;
+        list->index = tmp;
+        list->index_capacity = capacity;
+    }
+
+    memset(list->index, 0, list->index_capacity * sizeof(track_index_slot_t));
+    for (size_t i = 0; i < list->count; i++) {
+        index_insert(list, i);
+    }
+    return true;
+}
+
+// makes room in the index for count more items
+static bool index_reserve(track_list_t* list, size_t count) {
+    if ((list->count + count) * 2 <= list->index_capacity) return true;
+    return index_rebuild(list, list->count + count);
+}
+
+// grows every column to capacity entries
+static bool columns_reserve(track_list_t* list, size_t capacity) {
+    track_columns_t* c = &list->columns;
+    int32_t* duration = realloc(c->duration, capacity * sizeof(int32_t));
+    if (duration) c->duration = duration;
+    int32_t* year = realloc(c->year, capacity * sizeof(int32_t));
+    if (year) c->year = year;
+    int32_t* track_number = realloc(c->track_number, capacity * sizeof(int32_t));
+    if (track_number) c->track_number = track_number;
+    uint32_t* artist = realloc(c->artist, capacity * sizeof(uint32_t));
+    if (artist) c->artist = artist;
+    uint32_t* album = realloc(c->album, capacity * sizeof(uint32_t));
+    if (album) c->album = album;
+    uint32_t* genre = realloc(c->genre, capacity * sizeof(uint32_t));
+    if (genre) c->genre = genre;
+    uint8_t* removed = realloc(c->removed, capacity * sizeof(uint8_t));
+    if (removed) c->removed = removed;
+    return duration && year && track_number && artist && album && genre && removed;
+}
+
+// copies the fields of the item at position into the columns
+static void columns_store(track_list_t* list, size_t position) {
+    const track_t* track = &list->items[position];
+    track_columns_t* c = &list->columns;
+    c->duration[position] = track->duration;
+    c->year[position] = track->year;
+    c->track_number[position] = track->track_number;
+    c->artist[position] = string_pool_id(track->artist);
+    c->album[position] = string_pool_id(track->album);
+    c->genre[position] = string_pool_id(track->genre);
+}
+
+// moves the column entries after position one down
+static void columns_remove(track_list_t* list, size_t position) {
+    track_columns_t* c = &list->columns;
+    size_t tail = list->count - position - 1;
+    memmove(&c->duration[position], &c->duration[position + 1], tail * sizeof(int32_t));
+    memmove(&c->year[position], &c->year[position + 1], tail * sizeof(int32_t));
+    memmove(&c->track_number[position], &c->track_number[position + 1], tail * sizeof(int32_t));
+    memmove(&c->artist[position], &c->artist[position + 1], tail * sizeof(uint32_t));
+    memmove(&c->album[position], &c->album[position + 1], tail * sizeof(uint32_t));
+    memmove(&c->genre[position], &c->genre[position + 1], tail * sizeof(uint32_t));
+    memmove(&c->removed[position], &c->removed[position + 1], tail * sizeof(uint8_t));
+}
+
+// copies the column entries of one position to another
+static void columns_copy(track_list_t* list, size_t from, size_t to) {
+    track_columns_t* c = &list->columns;
+    c->duration[to] = c->duration[from];
+    c->year[to] = c->year[from];
+    c->track_number[to] = c->track_number[from];
+    c->artist[to] = c->artist[from];
+    c->album[to] = c->album[from];
+    c->genre[to] = c->genre[from];
+    c->removed[to] = c->removed[from];
+}
+
+// finds the index slot pointing at position, the index only holds the first of equal paths
+static size_t index_find(const track_list_t* list, size_t position) {
+    uint64_t hash = cache_path_hash(list->items[position].path);
+    size_t mask = list->index_capacity - 1;
+    for (size_t i = hash & mask; list->index[i].position != 0; i = (i + 1) & mask) {
+        if (list->index[i].position == position + 1) return i;
+    }
+    return SIZE_MAX;
+}
+
+// takes the item at position out of the index without a rebuild
+static void index_erase(track_list_t* list, size_t position) {
+    size_t i = index_find(list, position);
+    if (i == SIZE_MAX) return;
+
+    // backward shift deletion, so no probe sequence ends early
+    size_t mask = list->index_capacity - 1;
+    for (size_t j = (i + 1) & mask; list->index[j].position != 0; j = (j + 1) & mask) {
+        size_t home = list->index[j].hash & mask;
+        bool movable = i <= j ? (home <= i || home > j) : (home <= i && home > j);
+        if (movable) {
+            list->index[i] = list->index[j];
+            i = j;
+        }
+    }
+    list->index[i] = (track_index_slot_t){0};
+}
+
+// drops the tracks flagged in the removed column in one pass
+static size_t sweep_flagged(track_list_t* list) {
+    track_columns_t* c = &list->columns;
+    handle_table_remove_flagged(&list->handles, c->removed, list->count);
+
+    size_t kept = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        if (c->removed[i]) {
+            string_arena_release(&list->strings, list->items[i].path);
+            string_arena_release(&list->strings, list->items[i].title);
+            continue;
+        }
+        if (kept != i) {
+            list->items[kept] = list->items[i];
+            columns_copy(list, i, kept);
+        }
+        kept++;
+    }
+
+    size_t removed = list->count - kept;
+    list->count = kept;
+    list->removed_count = 0;
+    index_rebuild(list, list->count);
+    if (string_arena_wants_compaction(&list->strings)) track_list_compact_strings(list);
+    return removed;
+}
+
+size_t track_list_index_of_path(const track_list_t* list, const char* path) {
+    if (!list || !path) {
+        LOG_ERROR("Couldn't look up track path; list or path is NULL.");
+        return SIZE_MAX;
+    }
+    if (list->index_capacity == 0) return SIZE_MAX;
+
+    uint64_t hash = cache_path_hash(path);
+    size_t mask = list->index_capacity - 1;
+    for (size_t i = hash & mask; list->index[i].position != 0; i = (i + 1) & mask) {
+        const track_index_slot_t* slot = &list->index[i];
+        if (slot->hash == hash && strcmp(list->items[slot->position - 1].path, path) == 0) {
+            return slot->position - 1;
+        }
+    }
+    return SIZE_MAX;
+}
+
 track_list_t* track_list_create() {
     track_list_t* list = calloc(1, sizeof(track_list_t));
     if (!list) {
@@ -95,6 +266,16 @@ void track_list_free(track_list_t* list) {
     
     track_list_clear(list);
     free(list->items);
+    free(list->index);
+    handle_table_free(&list->handles);
+    string_arena_free(&list->strings);
+    free(list->columns.duration);
+    free(list->columns.year);
+    free(list->columns.track_number);
+    free(list->columns.artist);
+    free(list->columns.album);
+    free(list->columns.genre);
+    free(list->columns.removed);
     free(list);
     
     LOG_INFO("Track list freed successfully.");
@@ -114,52 +295,154 @@ bool track_list_append(track_list_t* list, track_t* track) {
             return false;
         }
         list->items = tmp;
+        if (!columns_reserve(list, new_capacity)) {
+            LOG_ERROR("Memory allocation failed; couldn't append track to list.");
+            return false;
+        }
         list->capacity = new_capacity;
     }
+    if (!index_reserve(list, 1)) {
+        LOG_ERROR("Memory allocation failed; couldn't index track path.");
+        return false;
+    }
+    char* path = string_arena_copy(&list->strings, track->path);
+    char* title = string_arena_copy(&list->strings, track->title ? track->title : "Unknown");
+    track_handle_t handle;
+    if (!path || !title || !handle_table_push(&list->handles, list->count, &handle)) {
+        string_arena_release(&list->strings, path);
+        string_arena_release(&list->strings, title);
+        return false;
+    }
     
-    // copy the track data
+    // copy the track data, the strings go into the list's arena
     list->items[list->count] = *track;
+    list->items[list->count].path = path;
+    list->items[list->count].title = title;
+    columns_store(list, list->count);
+    list->columns.removed[list->count] = 0;
+    index_insert(list, list->count);
     list->count++;
     
     LOG_INFO("Track appended to list: %s", track->path);
     return true;
 }
 
+bool track_list_append_paths(track_list_t* list, const char* const paths[], size_t count) {
+    if (!list || (!paths && count > 0)) {
+        LOG_ERROR("Couldn't append paths to list; list or paths is NULL.");
+        return false;
+    }
+
+    if (list->count + count > list->capacity) {
+        size_t new_capacity = list->capacity == 0 ? 16 : list->capacity;
+        while (new_capacity < list->count + count) new_capacity *= 2;
+        track_t* tmp = realloc(list->items, new_capacity * sizeof(track_t));
+        if (!tmp) {
+            LOG_ERROR("Memory allocation failed; couldn't append paths to list.");
+            return false;
+        }
+        list->items = tmp;
+        if (!columns_reserve(list, new_capacity)) {
+            LOG_ERROR("Memory allocation failed; couldn't append paths to list.");
+            return false;
+        }
+        list->capacity = new_capacity;
+    }
+    if (!index_reserve(list, count)) {
+        LOG_ERROR("Memory allocation failed; couldn't index track paths.");
+        return false;
+    }
+
+    // same placeholders as track_create, without a log line per track
+    for (size_t i = 0; i < count; i++) {
+        track_t* track = &list->items[list->count];
+        *track = (track_t){0};
+        track->path = string_arena_copy(&list->strings, paths[i]);
+        track->title = string_arena_copy(&list->strings, "Unknown");
+        track->artist = string_pool_intern("Unknown Artist");
+        track->album = string_pool_intern("Unknown Album");
+        track->genre = string_pool_intern("Unknown");
+        track_handle_t handle;
+        if (!track->path || !track->title || !track->artist || !track->album || !track->genre
+            || !handle_table_push(&list->handles, list->count, &handle)) {
+            LOG_ERROR("Memory allocation failed; couldn't append path to list.");
+            string_arena_release(&list->strings, track->path);
+            string_arena_release(&list->strings, track->title);
+            return false;
+        }
+        columns_store(list, list->count);
+        list->columns.removed[list->count] = 0;
+        index_insert(list, list->count);
+        list->count++;
+    }
+
+    return true;
+}
+
 bool track_list_remove(track_list_t* list, size_t index) {
     if (!list || index >= list->count) {
         LOG_ERROR("Couldn't remove track from list; list is NULL or index out of bounds.");
         return false;
     }
     
-    // free the track's strings
+    // the track's strings become dead space in the arena
     track_t* t = &list->items[index];
-    free(t->path);
-    free(t->title);
-    free(t->artist);
-    free(t->album);
-    free(t->genre);
-    
-    // shift remaining items
-    for (size_t i = index; i < list->count - 1; i++) {
-        list->items[i] = list->items[i + 1];
-    }
+    string_arena_release(&list->strings, t->path);
+    string_arena_release(&list->strings, t->title);
+    if (list->columns.removed[index]) list->removed_count--;
+    
+    // shift remaining items, their handles follow them
+    memmove(&list->items[index], &list->items[index + 1], (list->count - index - 1) * sizeof(track_t));
+    columns_remove(list, index);
+    handle_table_remove(&list->handles, index, list->count);
     list->count--;
+
+    // every later position moved, which costs the same as rebuilding the index
+    index_rebuild(list, list->count);
+    if (string_arena_wants_compaction(&list->strings)) track_list_compact_strings(list);
     
     LOG_INFO("Track removed from list at index %zu.", index);
     return true;
 }
 
+bool track_list_swap_remove(track_list_t* list, size_t index) {
+    if (!list || index >= list->count) {
+        LOG_ERROR("Couldn't remove track from list; list is NULL or index out of bounds.");
+        return false;
+    }
+
+    track_t* t = &list->items[index];
+    string_arena_release(&list->strings, t->path);
+    string_arena_release(&list->strings, t->title);
+    if (list->columns.removed[index]) list->removed_count--;
+    index_erase(list, index);
+
+    // the last track moves into the gap, only its index slot needs fixing
+    size_t last = list->count - 1;
+    if (index != last) {
+        size_t slot = index_find(list, last);
+        if (slot != SIZE_MAX) list->index[slot].position = index + 1;
+        list->items[index] = list->items[last];
+        columns_copy(list, last, index);
+    }
+    handle_table_swap_remove(&list->handles, index, list->count);
+    list->count--;
+    if (string_arena_wants_compaction(&list->strings)) track_list_compact_strings(list);
+
+    LOG_INFO("Track swap removed from list at index %zu.", index);
+    return true;
+}
+
 bool track_list_remove_by_path(track_list_t* list, const char* path) {
     if (!list || !path) {
         LOG_ERROR("Couldn't remove track by path; list or path is NULL.");
         return false;
     }
     
-    for (size_t i = 0; i < list->count; i++) {
-        if (strcmp(list->items[i].path, path) == 0) {
-            LOG_INFO("Track found and removing: %s", path);
-            return track_list_remove(list, i);
-        }
+    size_t index = track_list_index_of_path(list, path);
+    if (index != SIZE_MAX) {
+        LOG_INFO("Track found and removing: %s", path);
+        return track_list_remove(list, index);
     }
     
     LOG_WARN("Track not found in list: %s", path);
@@ -172,20 +455,171 @@ bool track_list_clear(track_list_t* list) {
         return false;
     }
     
-    for (size_t i = 0; i < list->count; i++) {
-        track_t* t = &list->items[i];
-        free(t->path);
-        free(t->title);
-        free(t->artist);
-        free(t->album);
-        free(t->genre);
-    }
-    
+    // the strings all live in the arena, so there's nothing to free per track
+    string_arena_reset(&list->strings);
+    handle_table_clear(&list->handles, list->count);
     list->count = 0;
+    list->removed_count = 0;
+    if (list->index) memset(list->index, 0, list->index_capacity * sizeof(track_index_slot_t));
     LOG_INFO("Track list cleared successfully.");
     return true;
 }
 
+bool track_list_mark_removed(track_list_t* list, size_t index) {
+    if (!list || index >= list->count) {
+        LOG_ERROR("Couldn't mark track as removed; list is NULL or index out of bounds.");
+        return false;
+    }
+
+    if (!list->columns.removed[index]) {
+        list->columns.removed[index] = 1;
+        list->removed_count++;
+    }
+    return true;
+}
+
+bool track_list_is_marked(const track_list_t* list, size_t index) {
+    if (!list || index >= list->count) {
+        LOG_ERROR("Couldn't check if track is marked; list is NULL or index out of bounds.");
+        return false;
+    }
+    return list->columns.removed[index] != 0;
+}
+
+size_t track_list_sweep(track_list_t* list) {
+    if (!list) {
+        LOG_ERROR("Couldn't sweep track list; list is NULL.");
+        return 0;
+    }
+    if (list->removed_count == 0) return 0;
+
+    size_t removed = sweep_flagged(list);
+    LOG_INFO("%zu tracks removed from list.", removed);
+    return removed;
+}
+
+size_t track_list_remove_if(track_list_t* list, bool (*predicate)(const track_t* track, void* ctx), void* ctx) {
+    if (!list || !predicate) {
+        LOG_ERROR("Couldn't remove tracks from list; list or predicate is NULL.");
+        return 0;
+    }
+
+    for (size_t i = 0; i < list->count; i++) {
+        if (!list->columns.removed[i] && predicate(&list->items[i], ctx)) {
+            list->columns.removed[i] = 1;
+            list->removed_count++;
+        }
+    }
+    return track_list_sweep(list);
+}
+
+bool track_list_set_title(track_list_t* list, track_t* track, const char* title) {
+    if (!list || !track || !title) {
+        LOG_ERROR("Couldn't set track title; list, track or title is NULL.");
+        return false;
+    }
+
+    char* copy = string_arena_copy(&list->strings, title);
+    if (!copy) return false;
+    string_arena_release(&list->strings, track->title);
+    track->title = copy;
+    return true;
+}
+
+bool track_list_compact_strings(track_list_t* list) {
+    if (!list) {
+        LOG_ERROR("Couldn't compact track strings; list is NULL.");
+        return false;
+    }
+    if (list->count == 0) {
+        string_arena_reset(&list->strings);
+        return true;
+    }
+
+    string_arena_t fresh = {0};
+    char** titles = malloc(list->count * sizeof(char*));
+    char** paths = malloc(list->count * sizeof(char*));
+    bool ok = titles && paths;
+    for (size_t i = 0; ok && i < list->count; i++) {
+        paths[i] = string_arena_copy(&fresh, list->items[i].path);
+        titles[i] = string_arena_copy(&fresh, list->items[i].title);
+        ok = paths[i] && titles[i];
+    }
+    if (!ok) {
+        LOG_ERROR("Memory allocation failed; couldn't compact track strings.");
+        string_arena_free(&fresh);
+        free(titles);
+        free(paths);
+        return false;
+    }
+
+    for (size_t i = 0; i < list->count; i++) {
+        list->items[i].path = paths[i];
+        list->items[i].title = titles[i];
+    }
+    string_arena_free(&list->strings);
+    list->strings = fresh;
+    free(titles);
+    free(paths);
+    return true;
+}
+
+bool track_list_refresh(track_list_t* list, const track_t* track) {
+    if (!list || !track || track < list->items || track >= list->items + list->count) {
+        LOG_ERROR("Couldn't refresh track; list or track is NULL or track isn't in the list.");
+        return false;
+    }
+
+    columns_store(list, (size_t)(track - list->items));
+    return true;
+}
+
+size_t track_list_filter_year(const track_list_t* list, int min_year, int max_year, size_t* out) {
+    if (!list || !out) {
+        LOG_ERROR("Couldn't filter tracks by year; list or out is NULL.");
+        return 0;
+    }
+    if (min_year > max_year) return 0;
+
+    // one unsigned compare per track and no branch, so the loop vectorizes
+    const int32_t* year = list->columns.year;
+    uint32_t span = (uint32_t)max_year - (uint32_t)min_year;
+    size_t found = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        out[found] = i;
+        found += (uint32_t)year[i] - (uint32_t)min_year <= span;
+    }
+    return found;
+}
+
+int64_t track_list_sum_duration(const track_list_t* list) {
+    if (!list) {
+        LOG_ERROR("Couldn't sum track durations; list is NULL.");
+        return 0;
+    }
+
+    const int32_t* duration = list->columns.duration;
+    int64_t total = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        total += duration[i];
+    }
+    return total;
+}
+
+bool track_list_count_by_genre(const track_list_t* list, size_t* counts, size_t id_count) {
+    if (!list || !counts) {
+        LOG_ERROR("Couldn't count tracks by genre; list or counts is NULL.");
+        return false;
+    }
+
+    memset(counts, 0, id_count * sizeof(size_t));
+    const uint32_t* genre = list->columns.genre;
+    for (size_t i = 0; i < list->count; i++) {
+        if (genre[i] < id_count) counts[genre[i]]++;
+    }
+    return true;
+}
+
 track_t* track_list_get(track_list_t* list, size_t index) {
     if (!list || index >= list->count) {
         LOG_ERROR("Couldn't get track from list; list is NULL or index out of bounds.");
@@ -200,11 +634,10 @@ track_t* track_list_find_by_path(track_list_t* list, const char* path) {
         return NULL;
     }
     
-    for (size_t i = 0; i < list->count; i++) {
-        if (strcmp(list->items[i].path, path) == 0) {
-            LOG_INFO("Track found in list: %s", path);
-            return &list->items[i];
-        }
+    size_t index = track_list_index_of_path(list, path);
+    if (index != SIZE_MAX) {
+        LOG_INFO("Track found in list: %s", path);
+        return &list->items[index];
     }
     
     LOG_WARN("Track not found in list: %s", path);
@@ -217,7 +650,8 @@ bool track_list_contains(track_list_t* list, const track_t* track) {
         return false;
     }
     
-    return track_list_find_by_path(list, track->path) != NULL;
+    // a miss is a normal answer here, so unlike find_by_path this doesn't log
+    return track_list_index_of_path(list, track->path) != SIZE_MAX;
 }
 
 size_t track_list_index_of(track_list_t* list, const track_t* track) {
@@ -226,24 +660,73 @@ size_t track_list_index_of(track_list_t* list, const track_t* track) {
         return SIZE_MAX;
     }
     
-    for (size_t i = 0; i < list->count; i++) {
-        if (strcmp(list->items[i].path, track->path) == 0) {
-            LOG_INFO("Track found at index %zu: %s", i, track->path);
-            return i;
-        }
+    size_t index = track_list_index_of_path(list, track->path);
+    if (index != SIZE_MAX) {
+        LOG_INFO("Track found at index %zu: %s", index, track->path);
+        return index;
     }
     
     LOG_WARN("Track not found in list: %s", track->path);
     return SIZE_MAX;
 }
 
+track_handle_t track_list_handle_at(const track_list_t* list, size_t index) {
+    if (!list || index >= list->count) {
+        LOG_ERROR("Couldn't get track handle; list is NULL or index out of bounds.");
+        return HANDLE_NULL;
+    }
+    return handle_table_at(&list->handles, index);
+}
+
+track_t* track_list_resolve(const track_list_t* list, track_handle_t handle) {
+    if (!list) {
+        LOG_ERROR("Couldn't resolve track handle; list is NULL.");
+        return NULL;
+    }
+
+    size_t index = handle_table_resolve(&list->handles, handle);
+    return index == SIZE_MAX ? NULL : &list->items[index];
+}
+
 // =============================================================================
 // ALBUM IMPLEMENTATION
 // =============================================================================
 
-album_t* album_create(const char* title) {
-    if (!title) {
-        LOG_ERROR("Couldn't create album; title is NULL.");
+// membership
+// ----------
+
+// finds a handle in the handles of an album, artist or genre
+// short arrays are scanned, longer ones get a hashed set on first lookup
+static size_t membership_find(handle_set_t* set, const handle_t* items, size_t count, handle_t handle) {
+    if (set->capacity == 0 && count >= HANDLE_SET_THRESHOLD) handle_set_build(set, items, count);
+    if (set->capacity != 0) return handle_set_find(set, items, handle);
+
+    for (size_t i = 0; i < count; i++) {
+        if (handle_equals(items[i], handle)) return i;
+    }
+    return SIZE_MAX;
+}
+
+// membership is a set, so the last handle can fill the gap
+static bool membership_remove(handle_set_t* set, handle_t* items, size_t* count, handle_t handle) {
+    size_t i = membership_find(set, items, *count, handle);
+    if (i == SIZE_MAX) return false;
+
+    handle_set_swap_remove(set, items, i, *count);
+    items[i] = items[--*count];
+    return true;
+}
+
+// hashes handles appended after first, if the set was built already
+static void membership_insert(handle_set_t* set, const handle_t* items, size_t first, size_t count) {
+    for (size_t i = first; i < count && set->capacity != 0; i++) {
+        if (!handle_set_insert(set, items, i)) handle_set_free(set); // lookups fall back to scanning
+    }
+}
+
+album_t* album_create(const char* title, const track_list_t* source) {
+    if (!title || !source) {
+        LOG_ERROR("Couldn't create album; title or source is NULL.");
         return NULL;
     }
     
@@ -254,6 +737,7 @@ album_t* album_create(const char* title) {
     }
     
     album->title = strdup(title);
+    album->source = source;
     album->tracks = NULL;
     album->track_count = 0;
     album->track_capacity = 0;
@@ -269,29 +753,34 @@ void album_free(album_t* album) {
     }
     
     free(album->title);
-    free(album->tracks); // ONLY free the pointer, not the tracks themselves
+    free(album->tracks); // ONLY free the handles, not the tracks themselves
+    handle_set_free(&album->track_set);
     free(album);
     
     LOG_INFO("Album freed successfully.");
 }
 
-bool album_add_track(album_t* album, track_t* track) {
-    if (!album || !track) {
-        LOG_ERROR("Couldn't add track to album; album or track is NULL.");
+bool album_add_track(album_t* album, track_handle_t track) {
+    if (!album) {
+        LOG_ERROR("Couldn't add track to album; album is NULL.");
+        return false;
+    }
+
+    const track_t* resolved = track_list_resolve(album->source, track);
+    if (!resolved) {
+        LOG_ERROR("Couldn't add track to album; track handle is stale.");
         return false;
     }
 
     // first check if track already exists
-    for (size_t i = 0; i < album->track_count; i++) {
-        if (album->tracks[i] == track) {
-            LOG_WARN("Track already exists in album: %s", track->path);
-            return false; // track already exists
-        }
+    if (membership_find(&album->track_set, album->tracks, album->track_count, track) != SIZE_MAX) {
+        LOG_WARN("Track already exists in album: %s", resolved->path);
+        return false; // track already exists
     }
     
     if (album->track_count >= album->track_capacity) {
         size_t new_capacity = album->track_capacity == 0 ? 8 : album->track_capacity * 2;
-        track_t** tmp = realloc(album->tracks, new_capacity * sizeof(track_t*));
+        track_handle_t* tmp = realloc(album->tracks, new_capacity * sizeof(track_handle_t));
         if (!tmp) {
             LOG_ERROR("Memory allocation failed; couldn't add track to album.");
             return false;
@@ -301,47 +790,60 @@ bool album_add_track(album_t* album, track_t* track) {
     }
     
     album->tracks[album->track_count++] = track;
-    LOG_INFO("Track added to album '%s': %s", album->title, track->path);
+    membership_insert(&album->track_set, album->tracks, album->track_count - 1, album->track_count);
+    LOG_INFO("Track added to album '%s': %s", album->title, resolved->path);
     return true;
 }
 
-bool album_remove_track(album_t* album, track_t* track) {
-    if (!album || !track) {
-        LOG_ERROR("Couldn't remove track from album; album or track is NULL.");
+bool album_add_tracks(album_t* album, const track_handle_t tracks[], size_t count) {
+    if (!album || (!tracks && count > 0)) {
+        LOG_ERROR("Couldn't add tracks to album; album or tracks is NULL.");
         return false;
     }
-    
-    for (size_t i = 0; i < album->track_count; i++) {
-        if (album->tracks[i] == track) {
-            // shift remaining pointers down by one
-            for (size_t j = i; j < album->track_count - 1; j++) {
-                album->tracks[j] = album->tracks[j + 1];
-            }
-            album->track_count--;
-            LOG_INFO("Track removed from album '%s': %s", album->title, track->path);
-            return true;
+
+    if (album->track_count + count > album->track_capacity) {
+        size_t new_capacity = album->track_capacity == 0 ? 8 : album->track_capacity;
+        while (new_capacity < album->track_count + count) new_capacity *= 2;
+        track_handle_t* tmp = realloc(album->tracks, new_capacity * sizeof(track_handle_t));
+        if (!tmp) {
+            LOG_ERROR("Memory allocation failed; couldn't add tracks to album.");
+            return false;
         }
+        album->tracks = tmp;
+        album->track_capacity = new_capacity;
     }
-    
-    LOG_WARN("Track not found in album '%s': %s", album->title, track->path);
-    return false;
+
+    memcpy(&album->tracks[album->track_count], tracks, count * sizeof(track_handle_t));
+    album->track_count += count;
+    membership_insert(&album->track_set, album->tracks, album->track_count - count, album->track_count);
+    return true;
 }
 
-bool album_has_track(album_t* album, const track_t* track) {
-    if (!album || !track) {
-        LOG_ERROR("Couldn't check if album has track; album or track is NULL.");
+bool album_remove_track(album_t* album, track_handle_t track) {
+    if (!album) {
+        LOG_ERROR("Couldn't remove track from album; album is NULL.");
         return false;
     }
     
-    for (size_t i = 0; i < album->track_count; i++) {
-        if (album->tracks[i] == track) {
-            return true;
-        }
+    // a stale handle can still be removed, it just can't be named anymore
+    if (membership_remove(&album->track_set, album->tracks, &album->track_count, track)) {
+        LOG_INFO("Track removed from album '%s'.", album->title);
+        return true;
     }
     
+    LOG_WARN("Track not found in album '%s'.", album->title);
     return false;
 }
 
+bool album_has_track(album_t* album, track_handle_t track) {
+    if (!album) {
+        LOG_ERROR("Couldn't check if album has track; album is NULL.");
+        return false;
+    }
+    
+    return membership_find(&album->track_set, album->tracks, album->track_count, track) != SIZE_MAX;
+}
+
 size_t album_get_track_count(const album_t* album) {
     if (!album) {
         LOG_ERROR("Couldn't get track count; album is NULL.");
@@ -356,9 +858,12 @@ int album_get_total_duration(const album_t* album) {
         return 0;
     }
     
+    // tracks removed from the central list don't count
+    const track_list_t* source = album->source;
     int total = 0;
     for (size_t i = 0; i < album->track_count; i++) {
-        total += album->tracks[i]->duration;
+        size_t index = handle_table_resolve(&source->handles, album->tracks[i]);
+        if (index != SIZE_MAX) total += source->columns.duration[index];
     }
     
     LOG_INFO("Album '%s' total duration: %d seconds", album->title, total);
@@ -370,7 +875,7 @@ track_t* album_get_track(const album_t* album, size_t index) {
         LOG_ERROR("Couldn't get track from album; album is NULL or index out of bounds.");
         return NULL;
     }
-    return album->tracks[index];
+    return track_list_resolve(album->source, album->tracks[index]);
 }
 
 // album list implementation
@@ -394,6 +899,7 @@ void album_list_free(album_list_t* list) {
     
     album_list_clear(list);
     free(list->items);
+    handle_table_free(&list->handles);
     free(list);
     
     LOG_INFO("Album list freed successfully.");
@@ -415,6 +921,8 @@ bool album_list_append(album_list_t* list, album_t* album) {
         list->items = tmp;
         list->capacity = new_capacity;
     }
+    album_handle_t handle;
+    if (!handle_table_push(&list->handles, list->count, &handle)) return false;
     
     list->items[list->count] = *album;
     list->count++;
@@ -423,6 +931,32 @@ bool album_list_append(album_list_t* list, album_t* album) {
     return true;
 }
 
+bool album_list_append_many(album_list_t* list, const album_t albums[], size_t count) {
+    if (!list || (!albums && count > 0)) {
+        LOG_ERROR("Couldn't append albums to list; list or albums is NULL.");
+        return false;
+    }
+
+    if (list->count + count > list->capacity) {
+        size_t new_capacity = list->capacity == 0 ? 16 : list->capacity;
+        while (new_capacity < list->count + count) new_capacity *= 2;
+        album_t* tmp = realloc(list->items, new_capacity * sizeof(album_t));
+        if (!tmp) {
+            LOG_ERROR("Memory allocation failed; couldn't append albums to list.");
+            return false;
+        }
+        list->items = tmp;
+        list->capacity = new_capacity;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        album_handle_t handle;
+        if (!handle_table_push(&list->handles, list->count, &handle)) return false;
+        list->items[list->count++] = albums[i];
+    }
+    return true;
+}
+
 bool album_list_remove(album_list_t* list, size_t index) {
     if (!list || index >= list->count) {
         LOG_ERROR("Couldn't remove album from list; list is NULL or index out of bounds.");
@@ -433,11 +967,13 @@ bool album_list_remove(album_list_t* list, size_t index) {
     album_t* a = &list->items[index];
     free(a->title);
     free(a->tracks); // ONLY free the pointer, not the tracks themselves
+    handle_set_free(&a->track_set);
     
-    // shift remaining items
+    // shift remaining items, their handles follow them
     for (size_t i = index; i < list->count - 1; i++) {
         list->items[i] = list->items[i + 1];
     }
+    handle_table_remove(&list->handles, index, list->count);
     list->count--;
     
     LOG_INFO("Album removed from list at index %zu.", index);
@@ -471,8 +1007,10 @@ bool album_list_clear(album_list_t* list) {
         album_t* a = &list->items[i];
         free(a->title);
         free(a->tracks);
+        handle_set_free(&a->track_set);
     }
     
+    handle_table_clear(&list->handles, list->count);
     list->count = 0;
     LOG_INFO("Album list cleared successfully.");
     return true;
@@ -512,13 +1050,31 @@ bool album_list_contains(album_list_t* list, const album_t* album) {
     return album_list_find_by_title(list, album->title) != NULL;
 }
 
+album_handle_t album_list_handle_at(const album_list_t* list, size_t index) {
+    if (!list || index >= list->count) {
+        LOG_ERROR("Couldn't get album handle; list is NULL or index out of bounds.");
+        return HANDLE_NULL;
+    }
+    return handle_table_at(&list->handles, index);
+}
+
+album_t* album_list_resolve(const album_list_t* list, album_handle_t handle) {
+    if (!list) {
+        LOG_ERROR("Couldn't resolve album handle; list is NULL.");
+        return NULL;
+    }
+
+    size_t index = handle_table_resolve(&list->handles, handle);
+    return index == SIZE_MAX ? NULL : &list->items[index];
+}
+
 // =============================================================================
 // ARTIST IMPLEMENTATION
 // =============================================================================
 
-artist_t* artist_create(const char* name) {
-    if (!name) {
-        LOG_ERROR("Couldn't create artist; name is NULL.");
+artist_t* artist_create(const char* name, const album_list_t* source) {
+    if (!name || !source) {
+        LOG_ERROR("Couldn't create artist; name or source is NULL.");
         return NULL;
     }
     
@@ -529,6 +1085,7 @@ artist_t* artist_create(const char* name) {
     }
     
     artist->name = strdup(name);
+    artist->source = source;
     artist->albums = NULL;
     artist->album_count = 0;
     artist->album_capacity = 0;
@@ -544,29 +1101,34 @@ void artist_free(artist_t* artist) {
     }
     
     free(artist->name);
-    free(artist->albums); // ONLY free the pointer, not the albums themselves
+    free(artist->albums); // ONLY free the handles, not the albums themselves
+    handle_set_free(&artist->album_set);
     free(artist);
     
     LOG_INFO("Artist freed successfully.");
 }
 
-bool artist_add_album(artist_t* artist, album_t* album) {
-    if (!artist || !album) {
-        LOG_ERROR("Couldn't add album to artist; artist or album is NULL.");
+bool artist_add_album(artist_t* artist, album_handle_t album) {
+    if (!artist) {
+        LOG_ERROR("Couldn't add album to artist; artist is NULL.");
+        return false;
+    }
+
+    const album_t* resolved = album_list_resolve(artist->source, album);
+    if (!resolved) {
+        LOG_ERROR("Couldn't add album to artist; album handle is stale.");
         return false;
     }
     
     // Check if already contains this album
-    for (size_t i = 0; i < artist->album_count; i++) {
-        if (artist->albums[i] == album) {
-            LOG_WARN("Album already exists for artist '%s': %s", artist->name, album->title);
-            return false; // Already exists
-        }
+    if (membership_find(&artist->album_set, artist->albums, artist->album_count, album) != SIZE_MAX) {
+        LOG_WARN("Album already exists for artist '%s': %s", artist->name, resolved->title);
+        return false; // Already exists
     }
     
     if (artist->album_count >= artist->album_capacity) {
         size_t new_capacity = artist->album_capacity == 0 ? 8 : artist->album_capacity * 2;
-        album_t** tmp = realloc(artist->albums, new_capacity * sizeof(album_t*));
+        album_handle_t* tmp = realloc(artist->albums, new_capacity * sizeof(album_handle_t));
         if (!tmp) {
             LOG_ERROR("Memory allocation failed; couldn't add album to artist.");
             return false;
@@ -576,47 +1138,59 @@ bool artist_add_album(artist_t* artist, album_t* album) {
     }
     
     artist->albums[artist->album_count++] = album;
-    LOG_INFO("Album added to artist '%s': %s", artist->name, album->title);
+    membership_insert(&artist->album_set, artist->albums, artist->album_count - 1, artist->album_count);
+    LOG_INFO("Album added to artist '%s': %s", artist->name, resolved->title);
     return true;
 }
 
-bool artist_remove_album(artist_t* artist, album_t* album) {
-    if (!artist || !album) {
-        LOG_ERROR("Couldn't remove album from artist; artist or album is NULL.");
+bool artist_add_albums(artist_t* artist, const album_handle_t albums[], size_t count) {
+    if (!artist || (!albums && count > 0)) {
+        LOG_ERROR("Couldn't add albums to artist; artist or albums is NULL.");
         return false;
     }
-    
-    for (size_t i = 0; i < artist->album_count; i++) {
-        if (artist->albums[i] == album) {
-            // shift remaining pointers
-            for (size_t j = i; j < artist->album_count - 1; j++) {
-                artist->albums[j] = artist->albums[j + 1];
-            }
-            artist->album_count--;
-            LOG_INFO("Album removed from artist '%s': %s", artist->name, album->title);
-            return true;
+
+    if (artist->album_count + count > artist->album_capacity) {
+        size_t new_capacity = artist->album_capacity == 0 ? 8 : artist->album_capacity;
+        while (new_capacity < artist->album_count + count) new_capacity *= 2;
+        album_handle_t* tmp = realloc(artist->albums, new_capacity * sizeof(album_handle_t));
+        if (!tmp) {
+            LOG_ERROR("Memory allocation failed; couldn't add albums to artist.");
+            return false;
         }
+        artist->albums = tmp;
+        artist->album_capacity = new_capacity;
     }
-    
-    LOG_WARN("Album not found for artist '%s': %s", artist->name, album->title);
-    return false;
+
+    memcpy(&artist->albums[artist->album_count], albums, count * sizeof(album_handle_t));
+    artist->album_count += count;
+    membership_insert(&artist->album_set, artist->albums, artist->album_count - count, artist->album_count);
+    return true;
 }
 
-bool artist_has_album(artist_t* artist, const album_t* album) {
-    if (!artist || !album) {
-        LOG_ERROR("Couldn't check if artist has album; artist or album is NULL.");
+bool artist_remove_album(artist_t* artist, album_handle_t album) {
+    if (!artist) {
+        LOG_ERROR("Couldn't remove album from artist; artist is NULL.");
         return false;
     }
     
-    for (size_t i = 0; i < artist->album_count; i++) {
-        if (artist->albums[i] == album) {
-            return true;
-        }
+    if (membership_remove(&artist->album_set, artist->albums, &artist->album_count, album)) {
+        LOG_INFO("Album removed from artist '%s'.", artist->name);
+        return true;
     }
     
+    LOG_WARN("Album not found for artist '%s'.", artist->name);
     return false;
 }
 
+bool artist_has_album(artist_t* artist, album_handle_t album) {
+    if (!artist) {
+        LOG_ERROR("Couldn't check if artist has album; artist is NULL.");
+        return false;
+    }
+    
+    return membership_find(&artist->album_set, artist->albums, artist->album_count, album) != SIZE_MAX;
+}
+
 size_t artist_get_album_count(const artist_t* artist) {
     if (!artist) {
         LOG_ERROR("Couldn't get album count; artist is NULL.");
@@ -630,7 +1204,7 @@ album_t* artist_get_album(const artist_t* artist, size_t index) {
         LOG_ERROR("Couldn't get album from artist; artist is NULL or index out of bounds.");
         return NULL;
     }
-    return artist->albums[index];
+    return album_list_resolve(artist->source, artist->albums[index]);
 }
 
 // artist list implementation
@@ -654,6 +1228,7 @@ void artist_list_free(artist_list_t* list) {
     
     artist_list_clear(list);
     free(list->items);
+    handle_table_free(&list->handles);
     free(list);
     
     LOG_INFO("Artist list freed successfully.");
@@ -675,6 +1250,8 @@ bool artist_list_append(artist_list_t* list, artist_t* artist) {
         list->items = tmp;
         list->capacity = new_capacity;
     }
+    artist_handle_t handle;
+    if (!handle_table_push(&list->handles, list->count, &handle)) return false;
     
     list->items[list->count] = *artist;
     list->count++;
@@ -683,6 +1260,32 @@ bool artist_list_append(artist_list_t* list, artist_t* artist) {
     return true;
 }
 
+bool artist_list_append_many(artist_list_t* list, const artist_t artists[], size_t count) {
+    if (!list || (!artists && count > 0)) {
+        LOG_ERROR("Couldn't append artists to list; list or artists is NULL.");
+        return false;
+    }
+
+    if (list->count + count > list->capacity) {
+        size_t new_capacity = list->capacity == 0 ? 16 : list->capacity;
+        while (new_capacity < list->count + count) new_capacity *= 2;
+        artist_t* tmp = realloc(list->items, new_capacity * sizeof(artist_t));
+        if (!tmp) {
+            LOG_ERROR("Memory allocation failed; couldn't append artists to list.");
+            return false;
+        }
+        list->items = tmp;
+        list->capacity = new_capacity;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        artist_handle_t handle;
+        if (!handle_table_push(&list->handles, list->count, &handle)) return false;
+        list->items[list->count++] = artists[i];
+    }
+    return true;
+}
+
 bool artist_list_remove(artist_list_t* list, size_t index) {
     if (!list || index >= list->count) {
         LOG_ERROR("Couldn't remove artist from list; list is NULL or index out of bounds.");
@@ -693,11 +1296,13 @@ bool artist_list_remove(artist_list_t* list, size_t index) {
     artist_t* a = &list->items[index];
     free(a->name);
     free(a->albums); // ONLY free the pointer, not the albums themselves
+    handle_set_free(&a->album_set);
     
-    // shift remaining items
+    // shift remaining items, their handles follow them
     for (size_t i = index; i < list->count - 1; i++) {
         list->items[i] = list->items[i + 1];
     }
+    handle_table_remove(&list->handles, index, list->count);
     list->count--;
     
     LOG_INFO("Artist removed from list at index %zu.", index);
@@ -731,8 +1336,10 @@ bool artist_list_clear(artist_list_t* list) {
         artist_t* a = &list->items[i];
         free(a->name);
         free(a->albums);
+        handle_set_free(&a->album_set);
     }
     
+    handle_table_clear(&list->handles, list->count);
     list->count = 0;
     LOG_INFO("Artist list cleared successfully.");
     return true;
@@ -772,13 +1379,31 @@ bool artist_list_contains(artist_list_t* list, const artist_t* artist) {
     return artist_list_find_by_name(list, artist->name) != NULL;
 }
 
+artist_handle_t artist_list_handle_at(const artist_list_t* list, size_t index) {
+    if (!list || index >= list->count) {
+        LOG_ERROR("Couldn't get artist handle; list is NULL or index out of bounds.");
+        return HANDLE_NULL;
+    }
+    return handle_table_at(&list->handles, index);
+}
+
+artist_t* artist_list_resolve(const artist_list_t* list, artist_handle_t handle) {
+    if (!list) {
+        LOG_ERROR("Couldn't resolve artist handle; list is NULL.");
+        return NULL;
+    }
+
+    size_t index = handle_table_resolve(&list->handles, handle);
+    return index == SIZE_MAX ? NULL : &list->items[index];
+}
+
 // =============================================================================
 // GENRE IMPLEMENTATION
 // =============================================================================
 
-genre_t* genre_create(const char* name) {
-    if (!name) {
-        LOG_ERROR("Couldn't create genre; name is NULL.");
+genre_t* genre_create(const char* name, const album_list_t* source) {
+    if (!name || !source) {
+        LOG_ERROR("Couldn't create genre; name or source is NULL.");
         return NULL;
     }
     
@@ -789,6 +1414,7 @@ genre_t* genre_create(const char* name) {
     }
     
     genre->name = strdup(name);
+    genre->source = source;
     genre->albums = NULL;
     genre->album_count = 0;
     genre->album_capacity = 0;
@@ -804,29 +1430,34 @@ void genre_free(genre_t* genre) {
     }
     
     free(genre->name);
-    free(genre->albums); // ONLY free the pointer, not the albums themselves
+    free(genre->albums); // ONLY free the handles, not the albums themselves
+    handle_set_free(&genre->album_set);
     free(genre);
     
     LOG_INFO("Genre freed successfully.");
 }
 
-bool genre_add_album(genre_t* genre, album_t* album) {
-    if (!genre || !album) {
-        LOG_ERROR("Couldn't add album to genre; genre or album is NULL.");
+bool genre_add_album(genre_t* genre, album_handle_t album) {
+    if (!genre) {
+        LOG_ERROR("Couldn't add album to genre; genre is NULL.");
+        return false;
+    }
+
+    const album_t* resolved = album_list_resolve(genre->source, album);
+    if (!resolved) {
+        LOG_ERROR("Couldn't add album to genre; album handle is stale.");
         return false;
     }
     
     // check if the genre already contains this album
-    for (size_t i = 0; i < genre->album_count; i++) {
-        if (genre->albums[i] == album) {
-            LOG_WARN("Album already exists in genre '%s': %s", genre->name, album->title);
-            return false; // already exists
-        }
+    if (membership_find(&genre->album_set, genre->albums, genre->album_count, album) != SIZE_MAX) {
+        LOG_WARN("Album already exists in genre '%s': %s", genre->name, resolved->title);
+        return false; // already exists
     }
     
     if (genre->album_count >= genre->album_capacity) {
         size_t new_capacity = genre->album_capacity == 0 ? 8 : genre->album_capacity * 2;
-        album_t** tmp = realloc(genre->albums, new_capacity * sizeof(album_t*));
+        album_handle_t* tmp = realloc(genre->albums, new_capacity * sizeof(album_handle_t));
         if (!tmp) {
             LOG_ERROR("Memory allocation failed; couldn't add album to genre.");
             return false;
@@ -836,47 +1467,59 @@ bool genre_add_album(genre_t* genre, album_t* album) {
     }
     
     genre->albums[genre->album_count++] = album;
-    LOG_INFO("Album added to genre '%s': %s", genre->name, album->title);
+    membership_insert(&genre->album_set, genre->albums, genre->album_count - 1, genre->album_count);
+    LOG_INFO("Album added to genre '%s': %s", genre->name, resolved->title);
     return true;
 }
 
-bool genre_remove_album(genre_t* genre, album_t* album) {
-    if (!genre || !album) {
-        LOG_ERROR("Couldn't remove album from genre; genre or album is NULL.");
+bool genre_add_albums(genre_t* genre, const album_handle_t albums[], size_t count) {
+    if (!genre || (!albums && count > 0)) {
+        LOG_ERROR("Couldn't add albums to genre; genre or albums is NULL.");
         return false;
     }
-    
-    for (size_t i = 0; i < genre->album_count; i++) {
-        if (genre->albums[i] == album) {
-            // shift remaining pointers
-            for (size_t j = i; j < genre->album_count - 1; j++) {
-                genre->albums[j] = genre->albums[j + 1];
-            }
-            genre->album_count--;
-            LOG_INFO("Album removed from genre '%s': %s", genre->name, album->title);
-            return true;
+
+    if (genre->album_count + count > genre->album_capacity) {
+        size_t new_capacity = genre->album_capacity == 0 ? 8 : genre->album_capacity;
+        while (new_capacity < genre->album_count + count) new_capacity *= 2;
+        album_handle_t* tmp = realloc(genre->albums, new_capacity * sizeof(album_handle_t));
+        if (!tmp) {
+            LOG_ERROR("Memory allocation failed; couldn't add albums to genre.");
+            return false;
         }
+        genre->albums = tmp;
+        genre->album_capacity = new_capacity;
     }
-    
-    LOG_WARN("Album not found in genre '%s': %s", genre->name, album->title);
-    return false;
+
+    memcpy(&genre->albums[genre->album_count], albums, count * sizeof(album_handle_t));
+    genre->album_count += count;
+    membership_insert(&genre->album_set, genre->albums, genre->album_count - count, genre->album_count);
+    return true;
 }
 
-bool genre_has_album(genre_t* genre, const album_t* album) {
-    if (!genre || !album) {
-        LOG_ERROR("Couldn't check if genre has album; genre or album is NULL.");
+bool genre_remove_album(genre_t* genre, album_handle_t album) {
+    if (!genre) {
+        LOG_ERROR("Couldn't remove album from genre; genre is NULL.");
         return false;
     }
     
-    for (size_t i = 0; i < genre->album_count; i++) {
-        if (genre->albums[i] == album) {
-            return true;
-        }
+    if (membership_remove(&genre->album_set, genre->albums, &genre->album_count, album)) {
+        LOG_INFO("Album removed from genre '%s'.", genre->name);
+        return true;
     }
     
+    LOG_WARN("Album not found in genre '%s'.", genre->name);
     return false;
 }
 
+bool genre_has_album(genre_t* genre, album_handle_t album) {
+    if (!genre) {
+        LOG_ERROR("Couldn't check if genre has album; genre is NULL.");
+        return false;
+    }
+    
+    return membership_find(&genre->album_set, genre->albums, genre->album_count, album) != SIZE_MAX;
+}
+
 size_t genre_get_album_count(const genre_t* genre) {
     if (!genre) {
         LOG_ERROR("Couldn't get album count; genre is NULL.");
@@ -890,7 +1533,7 @@ album_t* genre_get_album(const genre_t* genre, size_t index) {
         LOG_ERROR("Couldn't get album from genre; genre is NULL or index out of bounds.");
         return NULL;
     }
-    return genre->albums[index];
+    return album_list_resolve(genre->source, genre->albums[index]);
 }
 
 // genre list implementation
@@ -914,6 +1557,7 @@ void genre_list_free(genre_list_t* list) {
     
     genre_list_clear(list);
     free(list->items);
+    handle_table_free(&list->handles);
     free(list);
     
     LOG_INFO("Genre list freed successfully.");
@@ -935,6 +1579,8 @@ bool genre_list_append(genre_list_t* list, genre_t* genre) {
         list->items = tmp;
         list->capacity = new_capacity;
     }
+    genre_handle_t handle;
+    if (!handle_table_push(&list->handles, list->count, &handle)) return false;
     
     list->items[list->count] = *genre;
     list->count++;
@@ -943,6 +1589,32 @@ bool genre_list_append(genre_list_t* list, genre_t* genre) {
     return true;
 }
 
+bool genre_list_append_many(genre_list_t* list, const genre_t genres[], size_t count) {
+    if (!list || (!genres && count > 0)) {
+        LOG_ERROR("Couldn't append genres to list; list or genres is NULL.");
+        return false;
+    }
+
+    if (list->count + count > list->capacity) {
+        size_t new_capacity = list->capacity == 0 ? 16 : list->capacity;
+        while (new_capacity < list->count + count) new_capacity *= 2;
+        genre_t* tmp = realloc(list->items, new_capacity * sizeof(genre_t));
+        if (!tmp) {
+            LOG_ERROR("Memory allocation failed; couldn't append genres to list.");
+            return false;
+        }
+        list->items = tmp;
+        list->capacity = new_capacity;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        genre_handle_t handle;
+        if (!handle_table_push(&list->handles, list->count, &handle)) return false;
+        list->items[list->count++] = genres[i];
+    }
+    return true;
+}
+
 bool genre_list_remove(genre_list_t* list, size_t index) {
     if (!list || index >= list->count) {
         LOG_ERROR("Couldn't remove genre from list; list is NULL or index out of bounds.");
@@ -953,11 +1625,13 @@ bool genre_list_remove(genre_list_t* list, size_t index) {
     genre_t* g = &list->items[index];
     free(g->name);
     free(g->albums); // ONLY free the pointer, not the albums themselves
+    handle_set_free(&g->album_set);
     
-    // shift remaining items
+    // shift remaining items, their handles follow them
     for (size_t i = index; i < list->count - 1; i++) {
         list->items[i] = list->items[i + 1];
     }
+    handle_table_remove(&list->handles, index, list->count);
     list->count--;
     
     LOG_INFO("Genre removed from list at index %zu.", index);
@@ -991,8 +1665,10 @@ bool genre_list_clear(genre_list_t* list) {
         genre_t* g = &list->items[i];
         free(g->name);
         free(g->albums);
+        handle_set_free(&g->album_set);
     }
     
+    handle_table_clear(&list->handles, list->count);
     list->count = 0;
     LOG_INFO("Genre list cleared successfully.");
     return true;
@@ -1031,3 +1707,21 @@ bool genre_list_contains(genre_list_t* list, const genre_t* genre) {
     
     return genre_list_find_by_name(list, genre->name) != NULL;
 }
+
+genre_handle_t genre_list_handle_at(const genre_list_t* list, size_t index) {
+    if (!list || index >= list->count) {
+        LOG_ERROR("Couldn't get genre handle; list is NULL or index out of bounds.");
+        return HANDLE_NULL;
+    }
+    return handle_table_at(&list->handles, index);
+}
+
+genre_t* genre_list_resolve(const genre_list_t* list, genre_handle_t handle) {
+    if (!list) {
+        LOG_ERROR("Couldn't resolve genre handle; list is NULL.");
+        return NULL;
+    }
+
+    size_t index = handle_table_resolve(&list->handles, handle);
+    return index == SIZE_MAX ? NULL : &list->items[index];
+}
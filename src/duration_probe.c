@@ -0,0 +1,425 @@
+#define _GNU_SOURCE
+#include "duration_probe.h"
+#include "logger.h"
+#include <fcntl.h>
+#include <pthread.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// bytes read from where the audio starts, enough for the headers of every format but mp4
+#define PROBE_HEAD_BYTES 4096
+// bytes read from the end of an ogg file, an ogg page is never longer than 65307 bytes
+#define PROBE_TAIL_BYTES 65536
+#define PROBE_MAX_THREADS 64
+// files per thread at least, fewer cost more in threads than they save
+#define PROBE_MIN_SHARD 256
+
+// an open file and the first bytes of its audio, past any id3v2 tag
+typedef struct probe_file {
+    int fd;
+    uint64_t size;
+    uint64_t head_offset; // where in the file head starts
+    size_t head_size;
+    uint8_t head[PROBE_HEAD_BYTES];
+} probe_file_t;
+
+static uint32_t be32(const uint8_t* p) { return (uint32_t)p[0] << 24 | (uint32_t)p[1] << 16 | (uint32_t)p[2] << 8 | p[3]; }
+static uint64_t be64(const uint8_t* p) { return (uint64_t)be32(p) << 32 | be32(p + 4); }
+static uint16_t le16(const uint8_t* p) { return (uint16_t)(p[0] | p[1] << 8); }
+static uint32_t le32(const uint8_t* p) { return (uint32_t)p[0] | (uint32_t)p[1] << 8 | (uint32_t)p[2] << 16 | (uint32_t)p[3] << 24; }
+static uint64_t le64(const uint8_t* p) { return (uint64_t)le32(p) | (uint64_t)le32(p + 4) << 32; }
+
+// reads exactly n bytes at offset
+static bool read_at(const probe_file_t* file, uint64_t offset, void* out, size_t n) {
+    return offset + n <= file->size && pread(file->fd, out, n, (off_t)offset) == (ssize_t)n;
+}
+
+static bool read_head(probe_file_t* file, uint64_t offset) {
+    if (offset >= file->size) return false;
+    uint64_t left = file->size - offset;
+    file->head_offset = offset;
+    file->head_size = left < PROBE_HEAD_BYTES ? (size_t)left : PROBE_HEAD_BYTES;
+    return read_at(file, offset, file->head, file->head_size);
+}
+
+// flac
+// ----
+
+// streaminfo is always the first metadata block, right after the magic
+static bool probe_flac(const probe_file_t* file, duration_probe_t* out) {
+    if (8 + 18 > file->head_size || (file->head[4] & 0x7F) != 0) return false;
+
+    // 20 bits sample rate, 3 bits channels, 5 bits sample size, 36 bits total samples
+    const uint8_t* info = file->head + 8 + 10;
+    out->sample_rate = (uint32_t)info[0] << 12 | (uint32_t)info[1] << 4 | info[2] >> 4;
+    out->frames = (uint64_t)(info[3] & 0x0F) << 32 | be32(info + 4);
+    return out->sample_rate > 0 && out->frames > 0;
+}
+
+// mp3
+// ---
+
+typedef struct mp3_frame {
+    uint32_t sample_rate;
+    uint32_t bitrate; // in bits per second
+    uint32_t samples; // per frame
+    uint32_t size; // in bytes
+    size_t side_info; // bytes between the header and the xing tag
+} mp3_frame_t;
+
+static bool mp3_parse(const uint8_t* h, mp3_frame_t* out) {
+    static const uint16_t bitrates[2][3][15] = {
+        { // mpeg 1, layers I, II and III
+            { 0, 32, 64, 96, 128, 160, 192, 224, 256, 288, 320, 352, 384, 416, 448 },
+            { 0, 32, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384 },
+            { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 }
+        },
+        { // mpeg 2 and 2.5
+            { 0, 32, 48, 56, 64, 80, 96, 112, 128, 144, 160, 176, 192, 224, 256 },
+            { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 },
+            { 0, 8, 16, 24, 32, 40, 48, 56, 64, 80, 96, 112, 128, 144, 160 }
+        }
+    };
+    static const uint32_t rates[3] = { 44100, 48000, 32000 };
+
+    if (h[0] != 0xFF || (h[1] & 0xE0) != 0xE0) return false;
+    int version = (h[1] >> 3) & 3; // 0 is mpeg 2.5, 2 mpeg 2, 3 mpeg 1
+    int layer = 4 - ((h[1] >> 1) & 3); // 1 to 3, 4 is reserved
+    int bitrate_index = h[2] >> 4;
+    int rate_index = (h[2] >> 2) & 3;
+    if (version == 1 || layer == 4 || bitrate_index == 0 || bitrate_index == 15 || rate_index == 3) return false;
+
+    bool mpeg1 = version == 3;
+    bool mono = (h[3] >> 6) == 3;
+    uint32_t padding = (h[2] >> 1) & 1;
+    out->sample_rate = rates[rate_index] >> (mpeg1 ? 0 : version == 2 ? 1 : 2);
+    out->bitrate = bitrates[mpeg1 ? 0 : 1][layer - 1][bitrate_index] * 1000u;
+    out->samples = layer == 1 ? 384 : layer == 2 || mpeg1 ? 1152 : 576;
+    out->size = layer == 1
+        ? (12 * out->bitrate / out->sample_rate + padding) * 4
+        : out->samples / 8 * out->bitrate / out->sample_rate + padding;
+    out->side_info = (h[1] & 1 ? 0 : 2) + (layer != 3 ? 0 : mpeg1 ? (mono ? 17 : 32) : (mono ? 9 : 17));
+    return true;
+}
+
+// finds the first frame whose successor starts right after it, so a stray sync word isn't taken
+static bool mp3_first_frame(const probe_file_t* file, size_t* offset, mp3_frame_t* frame) {
+    for (size_t i = 0; i + 4 <= file->head_size; i++) {
+        if (!mp3_parse(file->head + i, frame)) continue;
+        size_t next = i + frame->size;
+        mp3_frame_t second;
+        if (next + 4 <= file->head_size && !mp3_parse(file->head + next, &second)) continue;
+        *offset = i;
+        return true;
+    }
+    return false;
+}
+
+static bool probe_mp3(const probe_file_t* file, duration_probe_t* out) {
+    size_t offset;
+    mp3_frame_t frame;
+    if (!mp3_first_frame(file, &offset, &frame)) return false;
+    out->sample_rate = frame.sample_rate;
+
+    // xing or info tag, its frame is silent and not counted, lame adds the encoder delay and padding
+    // the decoder trims them the same way, so the length matches what's played to the sample
+    const uint8_t* tag = file->head + offset + 4 + frame.side_info;
+    const uint8_t* end = file->head + file->head_size;
+    if (tag + 8 <= end && (memcmp(tag, "Xing", 4) == 0 || memcmp(tag, "Info", 4) == 0)) {
+        uint32_t flags = be32(tag + 4);
+        const uint8_t* p = tag + 8;
+        if (!(flags & 1) || p + 4 > end) return false;
+        uint64_t frames = (uint64_t)be32(p) * frame.samples;
+        p += 4 + (flags & 2 ? 4 : 0) + (flags & 4 ? 100 : 0) + (flags & 8 ? 4 : 0);
+        if (p + 24 <= end && p[0] != 0) {
+            int64_t delay = (p[21] << 4 | p[22] >> 4) + 529;
+            int64_t padding = ((p[22] & 0x0F) << 8 | p[23]) - 529;
+            if (padding < 0) padding = 0;
+            frames = (uint64_t)delay + (uint64_t)padding < frames ? frames - (uint64_t)delay - (uint64_t)padding : 0;
+        }
+        out->frames = frames;
+        return frames > 0;
+    }
+
+    // vbri tag, always 32 bytes past the header
+    const uint8_t* vbri = file->head + offset + 4 + 32;
+    if (vbri + 18 <= end && memcmp(vbri, "VBRI", 4) == 0) {
+        out->frames = (uint64_t)be32(vbri + 14) * frame.samples;
+        return out->frames > 0;
+    }
+
+    // no tag, assume constant bitrate over everything up to an id3v1 tag
+    uint64_t audio_end = file->size;
+    uint8_t id3v1[3];
+    if (file->size >= 128 && read_at(file, file->size - 128, id3v1, 3) && memcmp(id3v1, "TAG", 3) == 0) audio_end -= 128;
+    uint64_t start = file->head_offset + offset;
+    if (audio_end <= start) return false;
+    out->frames = (audio_end - start) * 8 * frame.sample_rate / frame.bitrate;
+    return out->frames > 0;
+}
+
+// ogg
+// ---
+
+// the first page holds the codec's id header, the last page's granule position is the length
+static bool probe_ogg(const probe_file_t* file, duration_probe_t* out) {
+    if (file->head_size < 28) return false;
+    uint32_t serial = le32(file->head + 14);
+    size_t packet = 27 + (size_t)file->head[26];
+    if (packet + 19 > file->head_size) return false;
+
+    const uint8_t* id = file->head + packet;
+    uint64_t pre_skip = 0;
+    if (memcmp(id, "\x01vorbis", 7) == 0) {
+        out->sample_rate = le32(id + 12);
+    } else if (memcmp(id, "OpusHead", 8) == 0) {
+        out->sample_rate = 48000; // opus granules count 48 kHz samples whatever the input rate was
+        pre_skip = le16(id + 10);
+    } else {
+        return false;
+    }
+
+    static _Thread_local uint8_t tail[PROBE_TAIL_BYTES];
+    size_t tail_size = file->size < PROBE_TAIL_BYTES ? (size_t)file->size : PROBE_TAIL_BYTES;
+    if (!read_at(file, file->size - tail_size, tail, tail_size)) return false;
+
+    for (size_t i = tail_size >= 27 ? tail_size - 27 : 0; i-- > 0;) {
+        if (memcmp(tail + i, "OggS", 4) != 0 || tail[i + 4] != 0 || le32(tail + i + 14) != serial) continue;
+        uint64_t granule = le64(tail + i + 6);
+        if (granule == UINT64_MAX) continue; // no packet ends on this page
+        out->frames = granule > pre_skip ? granule - pre_skip : 0;
+        return out->sample_rate > 0 && out->frames > 0;
+    }
+    return false;
+}
+
+// mp4
+// ---
+
+// finds the next box of a type between start and end, only box headers are read
+static bool mp4_find(const probe_file_t* file, uint64_t start, uint64_t end, const char* type,
+                     uint64_t* body, uint64_t* box_end) {
+    while (start + 8 <= end) {
+        uint8_t header[16];
+        size_t header_size = 8;
+        if (!read_at(file, start, header, 8)) return false;
+        uint64_t size = be32(header);
+        if (size == 1) {
+            if (!read_at(file, start + 8, header + 8, 8)) return false;
+            size = be64(header + 8);
+            header_size = 16;
+        } else if (size == 0) {
+            size = end - start; // runs to the end of its parent
+        }
+        if (size < header_size || size > end - start) return false;
+
+        if (memcmp(header + 4, type, 4) == 0) {
+            *body = start + header_size;
+            *box_end = start + size;
+            return true;
+        }
+        start += size;
+    }
+    return false;
+}
+
+// the length of the first sound track, in the timescale of its media header
+static bool probe_mp4(const probe_file_t* file, duration_probe_t* out) {
+    uint64_t moov, moov_end;
+    if (!mp4_find(file, 0, file->size, "moov", &moov, &moov_end)) return false;
+
+    uint64_t trak, trak_end;
+    for (uint64_t next = moov; mp4_find(file, next, moov_end, "trak", &trak, &trak_end); next = trak_end) {
+        uint64_t mdia, mdia_end, box, box_end;
+        uint8_t handler[12];
+        if (!mp4_find(file, trak, trak_end, "mdia", &mdia, &mdia_end) ||
+            !mp4_find(file, mdia, mdia_end, "hdlr", &box, &box_end) ||
+            box_end - box < sizeof(handler) ||
+            !read_at(file, box, handler, sizeof(handler)) ||
+            memcmp(handler + 8, "soun", 4) != 0 ||
+            !mp4_find(file, mdia, mdia_end, "mdhd", &box, &box_end)) {
+            continue;
+        }
+
+        // version 1 headers have 64 bit times, a duration of all ones means it's unknown
+        uint8_t header[32];
+        if (box_end - box < 20 || !read_at(file, box, header, 20)) return false;
+        if (header[0] == 1) {
+            if (box_end - box < 32 || !read_at(file, box, header, 32)) return false;
+            out->sample_rate = be32(header + 20);
+            out->frames = be64(header + 24);
+            if (out->frames == UINT64_MAX) return false;
+        } else {
+            out->sample_rate = be32(header + 12);
+            out->frames = be32(header + 16);
+            if (out->frames == UINT32_MAX) return false;
+        }
+        return out->sample_rate > 0 && out->frames > 0;
+    }
+    return false;
+}
+
+// wav
+// ---
+
+static bool probe_wav(const probe_file_t* file, duration_probe_t* out) {
+    uint32_t block_align = 0;
+    uint8_t chunk[16];
+    for (uint64_t offset = 12; read_at(file, offset, chunk, 8);) {
+        uint64_t size = le32(chunk + 4);
+        uint64_t body = offset + 8;
+        if (memcmp(chunk, "fmt ", 4) == 0) {
+            if (size < 16 || !read_at(file, body, chunk, 16)) return false;
+            out->sample_rate = le32(chunk + 4);
+            block_align = le16(chunk + 12);
+        } else if (memcmp(chunk, "data", 4) == 0) {
+            // streamed files leave the size at 0 or the maximum, the data runs to the end then
+            if (size == 0 || size > file->size - body) size = file->size - body;
+            if (block_align == 0) return false;
+            out->frames = size / block_align;
+            return out->sample_rate > 0 && out->frames > 0;
+        }
+        offset = body + size + (size & 1); // chunks are padded to an even size
+    }
+    return false;
+}
+
+// single files
+// ------------
+
+static bool probe_header(probe_file_t* file, duration_probe_t* out) {
+    const uint8_t* h = file->head;
+    if (file->head_size >= 12 && memcmp(h, "RIFF", 4) == 0 && memcmp(h + 8, "WAVE", 4) == 0) return probe_wav(file, out);
+    if (file->head_size >= 8 && memcmp(h + 4, "ftyp", 4) == 0) return probe_mp4(file, out);
+    if (file->head_size >= 4 && memcmp(h, "OggS", 4) == 0) return probe_ogg(file, out);
+
+    // an id3v2 tag can sit in front of flac and mp3 and hold cover art far longer than the head
+    if (file->head_size >= 10 && memcmp(h, "ID3", 3) == 0) {
+        uint64_t size = (uint64_t)(h[6] & 0x7F) << 21 | (h[7] & 0x7F) << 14 | (h[8] & 0x7F) << 7 | (h[9] & 0x7F);
+        if (!read_head(file, 10 + size + (h[5] & 0x10 ? 10 : 0))) return false;
+    }
+    if (file->head_size >= 4 && memcmp(file->head, "fLaC", 4) == 0) return probe_flac(file, out);
+    return probe_mp3(file, out);
+}
+
+bool duration_probe_file(const char* path, duration_probe_t* out) {
+    if (!path || !out) {
+        LOG_ERROR("Couldn't probe duration; path or out is NULL.");
+        return false;
+    }
+    *out = (duration_probe_t){0};
+
+    probe_file_t file;
+    file.fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (file.fd < 0) return false;
+
+    struct stat info;
+    bool found = false;
+    if (fstat(file.fd, &info) == 0 && S_ISREG(info.st_mode)) {
+        file.size = (uint64_t)info.st_size;
+        found = read_head(&file, 0) && probe_header(&file, out);
+    }
+    close(file.fd);
+
+    if (!found) *out = (duration_probe_t){0};
+    return found;
+}
+
+int duration_probe_seconds(const duration_probe_t* probe) {
+    if (!probe || probe->sample_rate == 0) return 0;
+    return (int)((probe->frames + probe->sample_rate / 2) / probe->sample_rate);
+}
+
+// lists
+// -----
+
+typedef struct probe_shard {
+    const track_list_t* list;
+    size_t first;
+    size_t last;
+    int32_t* seconds; // one per track of the list, 0 where nothing was found
+    size_t probed;
+} probe_shard_t;
+
+// only reads the list, the tracks are filled in on the calling thread afterwards
+static void* probe_shard_run(void* arg) {
+    probe_shard_t* shard = arg;
+    const track_columns_t* columns = &shard->list->columns;
+
+    for (size_t i = shard->first; i < shard->last; i++) {
+        if (columns->duration[i] > 0 || columns->removed[i]) continue;
+        duration_probe_t probe;
+        if (duration_probe_file(shard->list->items[i].path, &probe)) shard->seconds[i] = duration_probe_seconds(&probe);
+        shard->probed++;
+    }
+    return NULL;
+}
+
+// runs every shard on its own thread, the first one on the calling thread
+static void run_shards(probe_shard_t* shards, size_t count) {
+    pthread_t threads[PROBE_MAX_THREADS];
+    bool started[PROBE_MAX_THREADS] = {0};
+
+    for (size_t s = 1; s < count; s++) {
+        started[s] = pthread_create(&threads[s], NULL, probe_shard_run, &shards[s]) == 0;
+        if (!started[s]) probe_shard_run(&shards[s]);
+    }
+    probe_shard_run(&shards[0]);
+    for (size_t s = 1; s < count; s++) {
+        if (started[s]) pthread_join(threads[s], NULL);
+    }
+}
+
+size_t duration_probe_list(track_list_t* list, size_t thread_count, size_t* filled) {
+    if (!list) {
+        LOG_ERROR("Couldn't probe durations; list is NULL.");
+        return 0;
+    }
+    if (list->count == 0) return 0;
+
+    if (thread_count == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cpus > 0 ? (size_t)cpus : 1;
+    }
+    if (thread_count > PROBE_MAX_THREADS) thread_count = PROBE_MAX_THREADS;
+    if (list->count / thread_count < PROBE_MIN_SHARD) {
+        thread_count = list->count / PROBE_MIN_SHARD > 0 ? list->count / PROBE_MIN_SHARD : 1;
+    }
+
+    int32_t* seconds = calloc(list->count, sizeof(int32_t));
+    if (!seconds) {
+        LOG_ERROR("Memory allocation failed; couldn't probe durations.");
+        return 0;
+    }
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    probe_shard_t shards[PROBE_MAX_THREADS] = {0};
+    for (size_t s = 0; s < thread_count; s++) {
+        shards[s].list = list;
+        shards[s].first = list->count * s / thread_count;
+        shards[s].last = list->count * (s + 1) / thread_count;
+        shards[s].seconds = seconds;
+    }
+    run_shards(shards, thread_count);
+
+    size_t probed = 0, found = 0;
+    for (size_t s = 0; s < thread_count; s++) probed += shards[s].probed;
+    for (size_t i = 0; i < list->count; i++) {
+        if (seconds[i] <= 0) continue;
+        list->items[i].duration = seconds[i];
+        track_list_refresh(list, &list->items[i]);
+        if (filled) filled[found] = i;
+        found++;
+    }
+    free(seconds);
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    double ms = (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6;
+    LOG_INFO("Probed durations of %zu tracks in %.1f ms (%.0f files/s, %zu threads), found %zu.",
+             probed, ms, ms > 0.0 ? probed * 1000.0 / ms : 0.0, thread_count, found);
+    return found;
+}
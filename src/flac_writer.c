@@ -0,0 +1,511 @@
+#include "flac_writer.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+// frames are fixed size blocks, each channel is coded on its own or as a stereo pair
+// with a fixed polynomial predictor and a partitioned rice code of its residual
+// the stream info's md5 is left zero, which flac readers take as not computed
+#define FLAC_BLOCK_FRAMES 4096
+#define FLAC_MAX_CHANNELS 8
+#define FLAC_MAX_ORDER 4
+#define FLAC_MAX_PARTITION_ORDER 8
+#define FLAC_MAX_RICE_PARAMETER 14 // 15 escapes to unencoded residuals
+#define FLAC_STREAMINFO_SIZE 34
+
+typedef enum subframe_type {
+    SUBFRAME_CONSTANT,
+    SUBFRAME_VERBATIM,
+    SUBFRAME_FIXED
+} subframe_type_t;
+
+// how one channel of a block is coded and what it costs
+typedef struct subframe_plan {
+    subframe_type_t type;
+    unsigned int order;
+    unsigned int partition_order;
+    uint8_t parameters[1 << FLAC_MAX_PARTITION_ORDER];
+    uint64_t bits; // upper bound, the rice cost is estimated from partition sums
+} subframe_plan_t;
+
+typedef struct bit_writer {
+    uint8_t* data;
+    size_t bytes;
+    uint64_t pending; // bits not yet written out, the low ones count
+    unsigned int pending_bits;
+} bit_writer_t;
+
+struct flac_writer {
+    FILE* file;
+    uint32_t sample_rate;
+    uint32_t channels;
+    int16_t* block; // interleaved frames of the block being filled
+    size_t buffered;
+    int32_t* samples[FLAC_MAX_CHANNELS];
+    int32_t* mid;
+    int32_t* side;
+    uint32_t* residual; // zigzag coded residual of the subframe being planned or written
+    uint8_t* frame;
+    uint64_t total_frames;
+    uint32_t frame_number;
+    uint32_t min_frame_bytes;
+    uint32_t max_frame_bytes;
+    uint16_t crc16_table[256];
+    bool failed;
+};
+
+// bits
+// ----
+
+static void put_bits(bit_writer_t* writer, uint32_t value, unsigned int count) {
+    // at most 7 bits wait in pending, so up to 32 more always fit
+    writer->pending = (writer->pending << count) | (value & (((uint64_t)1 << count) - 1));
+    writer->pending_bits += count;
+    while (writer->pending_bits >= 8) {
+        writer->pending_bits -= 8;
+        writer->data[writer->bytes++] = (uint8_t)(writer->pending >> writer->pending_bits);
+    }
+}
+
+static void put_signed(bit_writer_t* writer, int32_t value, unsigned int count) {
+    put_bits(writer, (uint32_t)value, count);
+}
+
+static void align_bits(bit_writer_t* writer) {
+    if (writer->pending_bits > 0) put_bits(writer, 0, 8 - writer->pending_bits);
+}
+
+static uint8_t crc8(const uint8_t* data, size_t size) {
+    uint8_t crc = 0;
+    for (size_t i = 0; i < size; i++) {
+        crc ^= data[i];
+        for (int bit = 0; bit < 8; bit++) crc = crc & 0x80 ? (uint8_t)((crc << 1) ^ 0x07) : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+static uint16_t crc16(const uint16_t* table, const uint8_t* data, size_t size) {
+    uint16_t crc = 0;
+    for (size_t i = 0; i < size; i++) crc = (uint16_t)((crc << 8) ^ table[(crc >> 8) ^ data[i]]);
+    return crc;
+}
+
+// planning
+// --------
+
+// residual of a fixed predictor of the given order, samples before order aren't predicted
+static void fixed_residual(const int32_t* samples, size_t count, unsigned int order, uint32_t* out) {
+    for (size_t i = order; i < count; i++) {
+        const int32_t* x = &samples[i];
+        int32_t e;
+        switch (order) {
+            case 0: e = x[0]; break;
+            case 1: e = x[0] - x[-1]; break;
+            case 2: e = x[0] - 2 * x[-1] + x[-2]; break;
+            case 3: e = x[0] - 3 * x[-1] + 3 * x[-2] - x[-3]; break;
+            default: e = x[0] - 4 * x[-1] + 6 * x[-2] - 4 * x[-3] + x[-4]; break;
+        }
+        out[i] = ((uint32_t)e << 1) ^ (uint32_t)(e >> 31);
+    }
+}
+
+// picks the order with the smallest sum of residual magnitudes, all of them in one pass
+static unsigned int best_fixed_order(const int32_t* samples, size_t count) {
+    uint64_t sums[FLAC_MAX_ORDER + 1] = {0};
+    for (size_t i = FLAC_MAX_ORDER; i < count; i++) {
+        int64_t e0 = samples[i];
+        int64_t e1 = e0 - samples[i - 1];
+        int64_t e2 = e1 - (samples[i - 1] - samples[i - 2]);
+        int64_t e3 = e2 - (samples[i - 1] - 2 * (int64_t)samples[i - 2] + samples[i - 3]);
+        int64_t e4 = e3 - (samples[i - 1] - 3 * (int64_t)samples[i - 2] + 3 * (int64_t)samples[i - 3] - samples[i - 4]);
+        sums[0] += (uint64_t)(e0 < 0 ? -e0 : e0);
+        sums[1] += (uint64_t)(e1 < 0 ? -e1 : e1);
+        sums[2] += (uint64_t)(e2 < 0 ? -e2 : e2);
+        sums[3] += (uint64_t)(e3 < 0 ? -e3 : e3);
+        sums[4] += (uint64_t)(e4 < 0 ? -e4 : e4);
+    }
+    unsigned int best = 0;
+    for (unsigned int order = 1; order <= FLAC_MAX_ORDER; order++) {
+        if (sums[order] < sums[best]) best = order;
+    }
+    return best;
+}
+
+static uint64_t rice_bits(uint64_t sum, size_t count, unsigned int parameter) {
+    return (uint64_t)count * (parameter + 1) + (sum >> parameter);
+}
+
+static unsigned int best_rice_parameter(uint64_t sum, size_t count, uint64_t* bits) {
+    unsigned int guess = 0;
+    while (guess < FLAC_MAX_RICE_PARAMETER && ((uint64_t)count << (guess + 1)) < sum) guess++;
+
+    // the guess is off by one at times, its neighbours are cheap to check
+    unsigned int best = guess;
+    *bits = rice_bits(sum, count, guess);
+    if (guess > 0 && rice_bits(sum, count, guess - 1) < *bits) {
+        best = guess - 1;
+        *bits = rice_bits(sum, count, best);
+    }
+    if (guess < FLAC_MAX_RICE_PARAMETER && rice_bits(sum, count, guess + 1) < *bits) {
+        best = guess + 1;
+        *bits = rice_bits(sum, count, best);
+    }
+    return best;
+}
+
+// finds the partition order and rice parameters for a residual, sums of the finest
+// partitions are merged pairwise for every coarser order
+static void plan_partitions(const uint32_t* residual, size_t count, unsigned int order, subframe_plan_t* plan) {
+    unsigned int max_order = 0;
+    while (max_order < FLAC_MAX_PARTITION_ORDER && count % ((size_t)2 << max_order) == 0 &&
+           (count >> (max_order + 1)) > order) {
+        max_order++;
+    }
+
+    uint64_t sums[1 << FLAC_MAX_PARTITION_ORDER];
+    size_t partitions = (size_t)1 << max_order;
+    size_t length = count >> max_order;
+    for (size_t p = 0; p < partitions; p++) {
+        uint64_t sum = 0;
+        for (size_t i = p == 0 ? order : p * length; i < (p + 1) * length; i++) sum += residual[i];
+        sums[p] = sum;
+    }
+
+    uint64_t best_bits = UINT64_MAX;
+    for (int partition_order = (int)max_order; partition_order >= 0; partition_order--) {
+        partitions = (size_t)1 << partition_order;
+        length = count >> partition_order;
+        uint64_t bits = 0;
+        uint8_t parameters[1 << FLAC_MAX_PARTITION_ORDER];
+        for (size_t p = 0; p < partitions; p++) {
+            uint64_t partition_bits;
+            parameters[p] = (uint8_t)best_rice_parameter(sums[p], p == 0 ? length - order : length, &partition_bits);
+            bits += 4 + partition_bits;
+        }
+        if (bits < best_bits) {
+            best_bits = bits;
+            plan->partition_order = (unsigned int)partition_order;
+            memcpy(plan->parameters, parameters, partitions);
+        }
+        // merge for the next coarser order
+        for (size_t p = 0; p < partitions / 2; p++) sums[p] = sums[2 * p] + sums[2 * p + 1];
+    }
+    plan->bits += 2 + 4 + best_bits;
+}
+
+static void plan_subframe(flac_writer_t* writer, const int32_t* samples, size_t count, unsigned int bits_per_sample, subframe_plan_t* plan) {
+    plan->bits = 8; // subframe header
+    bool constant = true;
+    for (size_t i = 1; i < count && constant; i++) constant = samples[i] == samples[0];
+    if (constant) {
+        plan->type = SUBFRAME_CONSTANT;
+        plan->bits += bits_per_sample;
+        return;
+    }
+
+    uint64_t verbatim_bits = plan->bits + (uint64_t)count * bits_per_sample;
+    if (count <= FLAC_MAX_ORDER) {
+        plan->type = SUBFRAME_VERBATIM;
+        plan->bits = verbatim_bits;
+        return;
+    }
+
+    plan->type = SUBFRAME_FIXED;
+    plan->order = best_fixed_order(samples, count);
+    plan->bits += (uint64_t)plan->order * bits_per_sample;
+    fixed_residual(samples, count, plan->order, writer->residual);
+    plan_partitions(writer->residual, count, plan->order, plan);
+
+    // noise doesn't predict, it's stored as is then
+    if (plan->bits >= verbatim_bits) {
+        plan->type = SUBFRAME_VERBATIM;
+        plan->bits = verbatim_bits;
+    }
+}
+
+// writing
+// -------
+
+static void write_subframe(flac_writer_t* writer, bit_writer_t* bits, const int32_t* samples, size_t count,
+                           unsigned int bits_per_sample, const subframe_plan_t* plan) {
+    switch (plan->type) {
+        case SUBFRAME_CONSTANT:
+            put_bits(bits, 0x00, 8);
+            put_signed(bits, samples[0], bits_per_sample);
+            return;
+        case SUBFRAME_VERBATIM:
+            put_bits(bits, 0x02, 8);
+            for (size_t i = 0; i < count; i++) put_signed(bits, samples[i], bits_per_sample);
+            return;
+        case SUBFRAME_FIXED:
+            break;
+    }
+
+    put_bits(bits, (0x08 | plan->order) << 1, 8);
+    for (unsigned int i = 0; i < plan->order; i++) put_signed(bits, samples[i], bits_per_sample);
+
+    fixed_residual(samples, count, plan->order, writer->residual);
+    put_bits(bits, 0, 2); // rice coding with 4-bit parameters
+    put_bits(bits, plan->partition_order, 4);
+    size_t partitions = (size_t)1 << plan->partition_order;
+    size_t length = count >> plan->partition_order;
+    for (size_t p = 0; p < partitions; p++) {
+        unsigned int k = plan->parameters[p];
+        uint32_t low_mask = (1u << k) - 1;
+        put_bits(bits, k, 4);
+        for (size_t i = p == 0 ? plan->order : p * length; i < (p + 1) * length; i++) {
+            uint32_t value = writer->residual[i];
+            uint32_t quotient = value >> k;
+            // unary quotient, a stop bit and the low bits, in one go when they fit
+            if (quotient + 1 + k <= 32) {
+                put_bits(bits, (1u << k) | (value & low_mask), quotient + 1 + k);
+                continue;
+            }
+            for (; quotient >= 32; quotient -= 32) put_bits(bits, 0, 32);
+            put_bits(bits, 1, quotient + 1);
+            if (k > 0) put_bits(bits, value & low_mask, k);
+        }
+    }
+}
+
+static uint32_t sample_rate_code(uint32_t sample_rate) {
+    switch (sample_rate) {
+        case 88200: return 1;
+        case 176400: return 2;
+        case 192000: return 3;
+        case 8000: return 4;
+        case 16000: return 5;
+        case 22050: return 6;
+        case 24000: return 7;
+        case 32000: return 8;
+        case 44100: return 9;
+        case 48000: return 10;
+        case 96000: return 11;
+        default: return 0; // taken from the stream info
+    }
+}
+
+static void put_frame_number(bit_writer_t* bits, uint32_t number) {
+    // the utf-8 scheme, extended to 31 bits
+    if (number < 0x80) {
+        put_bits(bits, number, 8);
+        return;
+    }
+    unsigned int extra = number < 0x800 ? 1 : number < 0x10000 ? 2 : number < 0x200000 ? 3 : number < 0x4000000 ? 4 : 5;
+    uint32_t lead = (0xFF00u >> (extra + 1)) & 0xFF;
+    put_bits(bits, lead | (number >> (6 * extra)), 8);
+    for (int i = (int)extra - 1; i >= 0; i--) put_bits(bits, 0x80 | ((number >> (6 * i)) & 0x3F), 8);
+}
+
+// encodes the buffered frames as one flac frame
+static bool write_frame(flac_writer_t* writer) {
+    size_t count = writer->buffered;
+    uint32_t channels = writer->channels;
+    for (uint32_t c = 0; c < channels; c++) {
+        for (size_t i = 0; i < count; i++) writer->samples[c][i] = writer->block[i * channels + c];
+    }
+
+    // a stereo pair is coded as whichever two of left, right, mid and side are smallest
+    subframe_plan_t plans[4];
+    const int32_t* sources[2] = {0};
+    unsigned int depths[2] = {16, 16};
+    const subframe_plan_t* chosen[2] = {0};
+    uint32_t assignment = channels - 1;
+    if (channels == 2) {
+        int32_t* left = writer->samples[0];
+        int32_t* right = writer->samples[1];
+        for (size_t i = 0; i < count; i++) {
+            writer->side[i] = left[i] - right[i];
+            writer->mid[i] = (left[i] + right[i]) >> 1;
+        }
+        plan_subframe(writer, left, count, 16, &plans[0]);
+        plan_subframe(writer, right, count, 16, &plans[1]);
+        plan_subframe(writer, writer->mid, count, 16, &plans[2]);
+        plan_subframe(writer, writer->side, count, 17, &plans[3]);
+
+        uint64_t independent = plans[0].bits + plans[1].bits;
+        uint64_t left_side = plans[0].bits + plans[3].bits;
+        uint64_t side_right = plans[3].bits + plans[1].bits;
+        uint64_t mid_side = plans[2].bits + plans[3].bits;
+        assignment = 1;
+        sources[0] = left; sources[1] = right; depths[0] = 16; depths[1] = 16;
+        chosen[0] = &plans[0]; chosen[1] = &plans[1];
+        uint64_t best = independent;
+        if (left_side < best) {
+            best = left_side; assignment = 8;
+            sources[1] = writer->side; depths[1] = 17; chosen[1] = &plans[3];
+        }
+        if (side_right < best) {
+            best = side_right; assignment = 9;
+            sources[0] = writer->side; depths[0] = 17; chosen[0] = &plans[3];
+            sources[1] = right; depths[1] = 16; chosen[1] = &plans[1];
+        }
+        if (mid_side < best) {
+            assignment = 10;
+            sources[0] = writer->mid; depths[0] = 16; chosen[0] = &plans[2];
+            sources[1] = writer->side; depths[1] = 17; chosen[1] = &plans[3];
+        }
+    }
+
+    bit_writer_t bits = { .data = writer->frame };
+    put_bits(&bits, 0xFFF8, 16); // sync code, fixed block size
+    uint32_t size_code = count == FLAC_BLOCK_FRAMES ? 12 : count <= 256 ? 6 : 7;
+    put_bits(&bits, size_code, 4);
+    put_bits(&bits, sample_rate_code(writer->sample_rate), 4);
+    put_bits(&bits, assignment, 4);
+    put_bits(&bits, 4, 3); // 16 bits per sample
+    put_bits(&bits, 0, 1);
+    put_frame_number(&bits, writer->frame_number);
+    if (size_code == 6) put_bits(&bits, (uint32_t)count - 1, 8);
+    if (size_code == 7) put_bits(&bits, (uint32_t)count - 1, 16);
+    put_bits(&bits, crc8(bits.data, bits.bytes), 8);
+
+    if (channels == 2) {
+        for (int c = 0; c < 2; c++) write_subframe(writer, &bits, sources[c], count, depths[c], chosen[c]);
+    } else {
+        for (uint32_t c = 0; c < channels; c++) {
+            plan_subframe(writer, writer->samples[c], count, 16, &plans[0]);
+            write_subframe(writer, &bits, writer->samples[c], count, 16, &plans[0]);
+        }
+    }
+    align_bits(&bits);
+    uint16_t crc = crc16(writer->crc16_table, bits.data, bits.bytes);
+    put_bits(&bits, crc, 16);
+
+    writer->buffered = 0;
+    writer->total_frames += count;
+    writer->frame_number++;
+    uint32_t size = (uint32_t)bits.bytes;
+    if (writer->min_frame_bytes == 0 || size < writer->min_frame_bytes) writer->min_frame_bytes = size;
+    if (size > writer->max_frame_bytes) writer->max_frame_bytes = size;
+    // a failed flush drops the buffer, later small writes still look complete
+    return fwrite(bits.data, 1, bits.bytes, writer->file) == bits.bytes && !ferror(writer->file);
+}
+
+static void write_streaminfo(flac_writer_t* writer, uint8_t* out) {
+    // every block but the last has the full size, a stream of one block has just that one
+    uint32_t block_size = writer->frame_number <= 1 && writer->total_frames > 0
+        ? (uint32_t)writer->total_frames : FLAC_BLOCK_FRAMES;
+    bit_writer_t bits = { .data = out };
+    put_bits(&bits, block_size, 16);
+    put_bits(&bits, block_size, 16);
+    put_bits(&bits, writer->min_frame_bytes, 24);
+    put_bits(&bits, writer->max_frame_bytes, 24);
+    put_bits(&bits, writer->sample_rate, 20);
+    put_bits(&bits, writer->channels - 1, 3);
+    put_bits(&bits, 15, 5); // 16 bits per sample
+    put_bits(&bits, (uint32_t)(writer->total_frames >> 32) & 0xF, 4);
+    put_bits(&bits, (uint32_t)writer->total_frames, 32);
+    memset(out + bits.bytes, 0, 16); // md5
+}
+
+// public
+// ------
+
+static void writer_free(flac_writer_t* writer) {
+    for (uint32_t c = 0; c < FLAC_MAX_CHANNELS; c++) free(writer->samples[c]);
+    free(writer->mid);
+    free(writer->side);
+    free(writer->residual);
+    free(writer->block);
+    free(writer->frame);
+    free(writer);
+}
+
+flac_writer_t* flac_writer_open(const char* path, uint32_t sample_rate, uint32_t channels) {
+    if (!path) {
+        LOG_ERROR("Couldn't open flac writer; path is NULL.");
+        return NULL;
+    }
+    if (channels == 0 || channels > FLAC_MAX_CHANNELS || sample_rate == 0 || sample_rate > 655350) {
+        LOG_ERROR("Couldn't open flac writer; %u channels at %u Hz can't be stored.", channels, sample_rate);
+        return NULL;
+    }
+
+    flac_writer_t* writer = calloc(1, sizeof(flac_writer_t));
+    if (!writer) {
+        LOG_ERROR("Memory allocation failed; couldn't open flac writer.");
+        return NULL;
+    }
+    writer->sample_rate = sample_rate;
+    writer->channels = channels;
+
+    // a frame never gets larger than its samples stored verbatim, side channels take 17 bits
+    size_t frame_capacity = 32 + (size_t)channels * (FLAC_BLOCK_FRAMES * 17 / 8 + 16);
+    bool allocated = (writer->block = malloc(FLAC_BLOCK_FRAMES * channels * sizeof(int16_t))) &&
+                     (writer->mid = malloc(FLAC_BLOCK_FRAMES * sizeof(int32_t))) &&
+                     (writer->side = malloc(FLAC_BLOCK_FRAMES * sizeof(int32_t))) &&
+                     (writer->residual = malloc(FLAC_BLOCK_FRAMES * sizeof(uint32_t))) &&
+                     (writer->frame = malloc(frame_capacity));
+    for (uint32_t c = 0; allocated && c < channels; c++) {
+        allocated = (writer->samples[c] = malloc(FLAC_BLOCK_FRAMES * sizeof(int32_t))) != NULL;
+    }
+    if (!allocated) {
+        LOG_ERROR("Memory allocation failed; couldn't open flac writer.");
+        writer_free(writer);
+        return NULL;
+    }
+
+    for (int i = 0; i < 256; i++) {
+        uint16_t crc = (uint16_t)(i << 8);
+        for (int bit = 0; bit < 8; bit++) crc = crc & 0x8000 ? (uint16_t)((crc << 1) ^ 0x8005) : (uint16_t)(crc << 1);
+        writer->crc16_table[i] = crc;
+    }
+
+    writer->file = fopen(path, "wb");
+    if (!writer->file) {
+        LOG_ERROR("Couldn't create flac file: %s", path);
+        writer_free(writer);
+        return NULL;
+    }
+
+    // the stream info is written again with the final lengths on close
+    uint8_t header[8 + FLAC_STREAMINFO_SIZE] = { 'f', 'L', 'a', 'C', 0x80, 0, 0, FLAC_STREAMINFO_SIZE };
+    write_streaminfo(writer, header + 8);
+    if (fwrite(header, 1, sizeof(header), writer->file) != sizeof(header)) {
+        LOG_ERROR("Couldn't write flac file: %s", path);
+        fclose(writer->file);
+        writer_free(writer);
+        return NULL;
+    }
+    return writer;
+}
+
+bool flac_writer_write(flac_writer_t* writer, const int16_t* frames, size_t frame_count) {
+    if (!writer || (!frames && frame_count > 0)) {
+        LOG_ERROR("Couldn't write flac frames; writer or frames is NULL.");
+        return false;
+    }
+
+    while (frame_count > 0 && !writer->failed) {
+        size_t count = FLAC_BLOCK_FRAMES - writer->buffered;
+        if (count > frame_count) count = frame_count;
+        memcpy(writer->block + writer->buffered * writer->channels, frames, count * writer->channels * sizeof(int16_t));
+        writer->buffered += count;
+        frames += count * writer->channels;
+        frame_count -= count;
+        if (writer->buffered == FLAC_BLOCK_FRAMES && !write_frame(writer)) writer->failed = true;
+    }
+    return !writer->failed;
+}
+
+bool flac_writer_close(flac_writer_t* writer) {
+    if (!writer) {
+        LOG_ERROR("Couldn't close flac writer; writer is NULL.");
+        return false;
+    }
+
+    bool success = !writer->failed;
+    if (success && writer->buffered > 0) success = write_frame(writer);
+
+    uint8_t streaminfo[FLAC_STREAMINFO_SIZE];
+    write_streaminfo(writer, streaminfo);
+    success = success && fseek(writer->file, 8, SEEK_SET) == 0 &&
+              fwrite(streaminfo, 1, sizeof(streaminfo), writer->file) == sizeof(streaminfo);
+    success = fclose(writer->file) == 0 && success;
+    if (!success) LOG_ERROR("Couldn't finish flac file; it's incomplete.");
+
+    writer_free(writer);
+    return success;
+}
@@ -0,0 +1,261 @@
+#include "handle_table.h"
+#include "logger.h"
+#include <stdlib.h>
+
+bool handle_equals(handle_t a, handle_t b) {
+    return a.slot == b.slot && a.generation == b.generation;
+}
+
+bool handle_is_null(handle_t handle) {
+    return handle.generation == 0;
+}
+
+// marks a slot free so every handle to it goes stale
+static void release_slot(handle_table_t* table, uint32_t slot) {
+    table->positions[slot] = SIZE_MAX;
+    if (++table->generations[slot] == 0) table->generations[slot] = 1;
+    table->free_slots[table->free_count++] = slot;
+}
+
+bool handle_table_push(handle_table_t* table, size_t position, handle_t* out) {
+    if (!table || !out) {
+        LOG_ERROR("Couldn't push handle; table or out is NULL.");
+        return false;
+    }
+
+    if (position >= table->position_capacity) {
+        size_t new_capacity = table->position_capacity == 0 ? 16 : table->position_capacity;
+        while (new_capacity <= position) new_capacity *= 2;
+        uint32_t* tmp = realloc(table->slot_of, new_capacity * sizeof(uint32_t));
+        if (!tmp) {
+            LOG_ERROR("Memory allocation failed; couldn't push handle.");
+            return false;
+        }
+        table->slot_of = tmp;
+        table->position_capacity = new_capacity;
+    }
+
+    uint32_t slot;
+    if (table->free_count > 0) {
+        slot = table->free_slots[--table->free_count];
+    } else {
+        if (table->slot_count >= UINT32_MAX) {
+            LOG_ERROR("Couldn't push handle; out of slots.");
+            return false;
+        }
+        if (table->slot_count >= table->slot_capacity) {
+            size_t new_capacity = table->slot_capacity == 0 ? 16 : table->slot_capacity * 2;
+            uint32_t* generations = realloc(table->generations, new_capacity * sizeof(uint32_t));
+            if (generations) table->generations = generations;
+            size_t* positions = realloc(table->positions, new_capacity * sizeof(size_t));
+            if (positions) table->positions = positions;
+            uint32_t* free_slots = realloc(table->free_slots, new_capacity * sizeof(uint32_t));
+            if (free_slots) table->free_slots = free_slots;
+            if (!generations || !positions || !free_slots) {
+                LOG_ERROR("Memory allocation failed; couldn't push handle.");
+                return false;
+            }
+            table->slot_capacity = new_capacity;
+        }
+        slot = (uint32_t)table->slot_count++;
+        table->generations[slot] = 1;
+    }
+
+    table->positions[slot] = position;
+    table->slot_of[position] = slot;
+    *out = (handle_t){ slot, table->generations[slot] };
+    return true;
+}
+
+handle_t handle_table_at(const handle_table_t* table, size_t position) {
+    if (!table || position >= table->position_capacity) {
+        LOG_ERROR("Couldn't get handle; table is NULL or position out of bounds.");
+        return HANDLE_NULL;
+    }
+
+    uint32_t slot = table->slot_of[position];
+    return (handle_t){ slot, table->generations[slot] };
+}
+
+size_t handle_table_resolve(const handle_table_t* table, handle_t handle) {
+    if (!table) {
+        LOG_ERROR("Couldn't resolve handle; table is NULL.");
+        return SIZE_MAX;
+    }
+    if (handle_is_null(handle)) return SIZE_MAX;
+
+    if (handle.slot < table->slot_count && table->generations[handle.slot] == handle.generation) {
+        return table->positions[handle.slot];
+    }
+
+#ifdef HANDLE_DEBUG
+    LOG_ERROR("Stale handle resolved; slot %u generation %u is gone.", handle.slot, handle.generation);
+    abort();
+#endif
+    return SIZE_MAX;
+}
+
+void handle_table_remove(handle_table_t* table, size_t position, size_t count) {
+    if (!table || position >= count) {
+        LOG_ERROR("Couldn't remove handle; table is NULL or position out of bounds.");
+        return;
+    }
+
+    release_slot(table, table->slot_of[position]);
+    for (size_t i = position; i < count - 1; i++) {
+        table->slot_of[i] = table->slot_of[i + 1];
+        table->positions[table->slot_of[i]] = i;
+    }
+}
+
+void handle_table_swap_remove(handle_table_t* table, size_t position, size_t count) {
+    if (!table || position >= count) {
+        LOG_ERROR("Couldn't remove handle; table is NULL or position out of bounds.");
+        return;
+    }
+
+    release_slot(table, table->slot_of[position]);
+    if (position != count - 1) {
+        table->slot_of[position] = table->slot_of[count - 1];
+        table->positions[table->slot_of[position]] = position;
+    }
+}
+
+void handle_table_remove_flagged(handle_table_t* table, const uint8_t* removed, size_t count) {
+    if (!table || !removed) {
+        LOG_ERROR("Couldn't remove handles; table or flags is NULL.");
+        return;
+    }
+
+    size_t kept = 0;
+    for (size_t i = 0; i < count; i++) {
+        if (removed[i]) {
+            release_slot(table, table->slot_of[i]);
+            continue;
+        }
+        table->slot_of[kept] = table->slot_of[i];
+        table->positions[table->slot_of[kept]] = kept;
+        kept++;
+    }
+}
+
+void handle_table_clear(handle_table_t* table, size_t count) {
+    if (!table) {
+        LOG_ERROR("Couldn't clear handles; table is NULL.");
+        return;
+    }
+
+    for (size_t i = 0; i < count; i++) {
+        release_slot(table, table->slot_of[i]);
+    }
+}
+
+void handle_table_free(handle_table_t* table) {
+    if (!table) {
+        LOG_ERROR("Couldn't free handle table; table is NULL.");
+        return;
+    }
+
+    free(table->generations);
+    free(table->positions);
+    free(table->free_slots);
+    free(table->slot_of);
+    *table = (handle_table_t){0};
+}
+
+// handle set
+// ----------
+
+static size_t hash_handle(handle_t handle) {
+    uint64_t key = (uint64_t)handle.generation << 32 | handle.slot;
+    key *= 0x9E3779B97F4A7C15ULL;
+    return (size_t)(key ^ key >> 32);
+}
+
+// finds the entry holding handle, or the empty entry it would go in
+static size_t set_probe(const handle_set_t* set, const handle_t* items, handle_t handle) {
+    size_t mask = set->capacity - 1;
+    size_t i = hash_handle(handle) & mask;
+    while (set->slots[i] != 0 && !handle_equals(items[set->slots[i] - 1], handle)) i = (i + 1) & mask;
+    return i;
+}
+
+bool handle_set_build(handle_set_t* set, const handle_t* items, size_t count) {
+    if (!set || (!items && count > 0)) {
+        LOG_ERROR("Couldn't build handle set; set or items is NULL.");
+        return false;
+    }
+    if (count >= UINT32_MAX) {
+        LOG_ERROR("Couldn't build handle set; too many handles.");
+        return false;
+    }
+
+    // kept at most half full so probes stay short
+    size_t capacity = 64;
+    while (capacity < count * 2) capacity *= 2;
+    uint32_t* slots = calloc(capacity, sizeof(uint32_t));
+    if (!slots) {
+        LOG_ERROR("Memory allocation failed; couldn't build handle set.");
+        return false;
+    }
+
+    free(set->slots);
+    set->slots = slots;
+    set->capacity = capacity;
+    for (size_t i = 0; i < count; i++) {
+        set->slots[set_probe(set, items, items[i])] = (uint32_t)i + 1;
+    }
+    return true;
+}
+
+size_t handle_set_find(const handle_set_t* set, const handle_t* items, handle_t handle) {
+    if (!set || set->capacity == 0) return SIZE_MAX;
+
+    size_t i = set_probe(set, items, handle);
+    return set->slots[i] != 0 ? set->slots[i] - 1 : SIZE_MAX;
+}
+
+bool handle_set_insert(handle_set_t* set, const handle_t* items, size_t position) {
+    if (!set || !items) {
+        LOG_ERROR("Couldn't insert into handle set; set or items is NULL.");
+        return false;
+    }
+    if (set->capacity == 0) return true;
+
+    if ((position + 1) * 2 > set->capacity) return handle_set_build(set, items, position + 1);
+    set->slots[set_probe(set, items, items[position])] = (uint32_t)position + 1;
+    return true;
+}
+
+void handle_set_swap_remove(handle_set_t* set, const handle_t* items, size_t position, size_t count) {
+    if (!set || !items || position >= count) {
+        LOG_ERROR("Couldn't remove from handle set; set or items is NULL or position out of bounds.");
+        return;
+    }
+    if (set->capacity == 0) return;
+
+    // backward shift deletion, entries after the hole move up if their home allows it
+    size_t mask = set->capacity - 1;
+    size_t hole = set_probe(set, items, items[position]);
+    if (set->slots[hole] == 0) return;
+    for (size_t i = (hole + 1) & mask; set->slots[i] != 0; i = (i + 1) & mask) {
+        size_t home = hash_handle(items[set->slots[i] - 1]) & mask;
+        if (((i - home) & mask) >= ((i - hole) & mask)) {
+            set->slots[hole] = set->slots[i];
+            hole = i;
+        }
+    }
+    set->slots[hole] = 0;
+
+    if (position != count - 1) set->slots[set_probe(set, items, items[count - 1])] = (uint32_t)position + 1;
+}
+
+void handle_set_free(handle_set_t* set) {
+    if (!set) {
+        LOG_ERROR("Couldn't free handle set; set is NULL.");
+        return;
+    }
+
+    free(set->slots);
+    *set = (handle_set_t){0};
+}
@@ -0,0 +1,880 @@
+#define _GNU_SOURCE
+#include "library_db.h"
+#include "cache_path.h"
+#include "logger.h"
+#include "string_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+// file layout, all numbers in host byte order:
+//   header
+//   track_count records sorted by path
+//   string blob, every string NUL terminated and referenced by offset
+#define LIBRARY_DB_MAGIC "SMPLIBDB"
+#define LIBRARY_DB_VERSION 2 // 2 stores mtimes with nanoseconds
+#define LIBRARY_DB_MIN_COMPACT 1024 // logged changes before a compaction is worth it
+
+#define LOG_OP_PUT 3 // 1 was a put of version 1, its entries are dropped on replay
+#define LOG_OP_REMOVE 2
+
+typedef struct db_header {
+    char magic[8];
+    uint32_t version;
+    uint32_t record_size;
+    uint64_t track_count;
+    uint64_t strings_offset;
+    uint64_t strings_size;
+} db_header_t;
+
+typedef struct db_record {
+    uint32_t path; // offsets into the string blob
+    uint32_t title;
+    uint32_t artist;
+    uint32_t album;
+    uint32_t genre;
+    int32_t duration;
+    int32_t year;
+    int32_t track_number;
+    int64_t file_mtime_sec;
+    int64_t file_mtime_nsec;
+    uint64_t file_size;
+} db_record_t;
+
+// a read only mapping of a database file
+typedef struct db_map {
+    void* data;
+    size_t size;
+    const db_record_t* records;
+    size_t count;
+    const char* strings;
+    size_t strings_size;
+} db_map_t;
+
+// a change that isn't compacted into the mapped file yet
+typedef struct db_change {
+    char* path;
+    char* title;
+    char* artist;
+    char* album;
+    char* genre;
+    int duration;
+    int year;
+    int track_number;
+    int64_t file_mtime_sec;
+    int64_t file_mtime_nsec;
+    uint64_t file_size;
+    bool removed;
+} db_change_t;
+
+// changes keyed by path, the last change to a path replaces earlier ones
+typedef struct change_set {
+    db_change_t* items;
+    size_t count;
+    size_t capacity;
+    size_t* slots; // open addressing, index + 1 into items, 0 when empty
+    size_t slot_count;
+} change_set_t;
+
+struct library_db {
+    char* path;
+    char* log_path;
+    db_map_t map;
+    FILE* log;
+
+    change_set_t changes; // logged since the last compaction started
+    change_set_t frozen; // being written into a new file by the compaction thread
+    uint64_t frozen_log_size; // log bytes covered by the frozen changes
+
+    pthread_t thread;
+    bool compacting;
+    bool compact_ok;
+    atomic_bool compact_done;
+};
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static char* concat(const char* a, const char* b) {
+    size_t a_len = strlen(a);
+    size_t b_len = strlen(b);
+    char* s = malloc(a_len + b_len + 1);
+    if (!s) return NULL;
+    memcpy(s, a, a_len);
+    memcpy(s + a_len, b, b_len + 1);
+    return s;
+}
+
+char* library_db_default_path(const char* dir_path) {
+    if (!dir_path) {
+        LOG_ERROR("Couldn't get library database path; directory path is NULL.");
+        return NULL;
+    }
+
+    return cache_path_build("library", dir_path, ".db");
+}
+
+// mapping
+// -------
+
+static void map_close(db_map_t* map) {
+    if (map->data) munmap(map->data, map->size);
+    memset(map, 0, sizeof(*map));
+}
+
+// maps a database file, only the header is checked up front
+// records are checked as they're read, so opening never touches the whole file
+static bool map_open(const char* path, db_map_t* out) {
+    memset(out, 0, sizeof(*out));
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return false;
+
+    struct stat file_stat;
+    if (fstat(fd, &file_stat) != 0 || (size_t)file_stat.st_size < sizeof(db_header_t)) {
+        close(fd);
+        return false;
+    }
+
+    size_t size = (size_t)file_stat.st_size;
+    void* data = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) return false;
+
+    const db_header_t* header = data;
+    bool valid = memcmp(header->magic, LIBRARY_DB_MAGIC, 8) == 0 &&
+                 header->version == LIBRARY_DB_VERSION &&
+                 header->record_size == sizeof(db_record_t) &&
+                 header->track_count <= (size - sizeof(db_header_t)) / sizeof(db_record_t) &&
+                 header->strings_offset >= sizeof(db_header_t) + header->track_count * sizeof(db_record_t) &&
+                 header->strings_offset <= size &&
+                 header->strings_size <= size - header->strings_offset &&
+                 header->strings_size > 0;
+
+    const char* strings = (const char*)data + (valid ? header->strings_offset : 0);
+    valid = valid && strings[header->strings_size - 1] == '\0';
+
+    const db_record_t* records = (const db_record_t*)((const char*)data + sizeof(db_header_t));
+    if (!valid) {
+        LOG_WARN("Library database is invalid, ignoring it: %s", path);
+        munmap(data, size);
+        return false;
+    }
+
+    out->data = data;
+    out->size = size;
+    out->records = records;
+    out->count = header->track_count;
+    out->strings = strings;
+    out->strings_size = header->strings_size;
+    return true;
+}
+
+// the blob ends with a NUL, so any offset inside it is a valid string
+static const char* map_string(const db_map_t* map, uint32_t offset) {
+    return offset < map->strings_size ? map->strings + offset : "";
+}
+
+static void record_to_track(const db_map_t* map, const db_record_t* r, library_db_track_t* out) {
+    out->path = map_string(map, r->path);
+    out->title = map_string(map, r->title);
+    out->artist = map_string(map, r->artist);
+    out->album = map_string(map, r->album);
+    out->genre = map_string(map, r->genre);
+    out->duration = r->duration;
+    out->year = r->year;
+    out->track_number = r->track_number;
+    out->file_mtime_sec = r->file_mtime_sec;
+    out->file_mtime_nsec = r->file_mtime_nsec;
+    out->file_size = r->file_size;
+}
+
+static const db_record_t* map_find(const db_map_t* map, const char* path) {
+    size_t low = 0, high = map->count;
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        int cmp = strcmp(map_string(map, map->records[mid].path), path);
+        if (cmp == 0) return &map->records[mid];
+        if (cmp < 0) low = mid + 1;
+        else high = mid;
+    }
+    return NULL;
+}
+
+// change sets
+// -----------
+
+static void change_free(db_change_t* change) {
+    free(change->path);
+    free(change->title);
+    free(change->artist);
+    free(change->album);
+    free(change->genre);
+}
+
+static void change_set_free(change_set_t* set) {
+    for (size_t i = 0; i < set->count; i++) {
+        change_free(&set->items[i]);
+    }
+    free(set->items);
+    free(set->slots);
+    memset(set, 0, sizeof(*set));
+}
+
+static const db_change_t* change_set_find(const change_set_t* set, const char* path) {
+    if (set->slot_count == 0) return NULL;
+
+    size_t mask = set->slot_count - 1;
+    for (size_t i = cache_path_hash(path) & mask;; i = (i + 1) & mask) {
+        size_t slot = set->slots[i];
+        if (slot == 0) return NULL;
+        if (strcmp(set->items[slot - 1].path, path) == 0) return &set->items[slot - 1];
+    }
+}
+
+static bool change_set_grow(change_set_t* set) {
+    size_t slot_count = set->slot_count == 0 ? 256 : set->slot_count * 2;
+    size_t* slots = calloc(slot_count, sizeof(size_t));
+    if (!slots) return false;
+
+    size_t mask = slot_count - 1;
+    for (size_t n = 0; n < set->count; n++) {
+        size_t i = cache_path_hash(set->items[n].path) & mask;
+        while (slots[i] != 0) i = (i + 1) & mask;
+        slots[i] = n + 1;
+    }
+    free(set->slots);
+    set->slots = slots;
+    set->slot_count = slot_count;
+    return true;
+}
+
+// takes ownership of the change's strings, even on failure
+static bool change_set_put(change_set_t* set, db_change_t* change) {
+    // keep the table at most half full
+    if ((set->count + 1) * 2 > set->slot_count && !change_set_grow(set)) {
+        change_free(change);
+        return false;
+    }
+
+    size_t mask = set->slot_count - 1;
+    size_t i = cache_path_hash(change->path) & mask;
+    for (; set->slots[i] != 0; i = (i + 1) & mask) {
+        db_change_t* existing = &set->items[set->slots[i] - 1];
+        if (strcmp(existing->path, change->path) == 0) {
+            change_free(existing);
+            *existing = *change;
+            return true;
+        }
+    }
+
+    if (set->count >= set->capacity) {
+        size_t new_capacity = set->capacity == 0 ? 64 : set->capacity * 2;
+        db_change_t* tmp = realloc(set->items, new_capacity * sizeof(db_change_t));
+        if (!tmp) {
+            change_free(change);
+            return false;
+        }
+        set->items = tmp;
+        set->capacity = new_capacity;
+    }
+    set->items[set->count] = *change;
+    set->slots[i] = ++set->count;
+    return true;
+}
+
+static void change_to_track(const db_change_t* c, library_db_track_t* out) {
+    out->path = c->path;
+    out->title = c->title;
+    out->artist = c->artist;
+    out->album = c->album;
+    out->genre = c->genre;
+    out->duration = c->duration;
+    out->year = c->year;
+    out->track_number = c->track_number;
+    out->file_mtime_sec = c->file_mtime_sec;
+    out->file_mtime_nsec = c->file_mtime_nsec;
+    out->file_size = c->file_size;
+}
+
+// change log
+// ----------
+
+static bool write_u32(FILE* f, uint32_t v) { return fwrite(&v, sizeof(v), 1, f) == 1; }
+static bool write_i32(FILE* f, int32_t v) { return fwrite(&v, sizeof(v), 1, f) == 1; }
+static bool write_i64(FILE* f, int64_t v) { return fwrite(&v, sizeof(v), 1, f) == 1; }
+static bool write_u64(FILE* f, uint64_t v) { return fwrite(&v, sizeof(v), 1, f) == 1; }
+
+static bool write_string(FILE* f, const char* s) {
+    uint32_t len = (uint32_t)strlen(s);
+    return write_u32(f, len) && fwrite(s, 1, len, f) == len;
+}
+
+static bool log_append(library_db_t* db, const db_change_t* c) {
+    if (!db->log) return false;
+
+    uint8_t op = c->removed ? LOG_OP_REMOVE : LOG_OP_PUT;
+    bool ok = fwrite(&op, 1, 1, db->log) == 1 && write_string(db->log, c->path);
+    if (ok && !c->removed) {
+        ok = write_string(db->log, c->title) && write_string(db->log, c->artist) &&
+             write_string(db->log, c->album) && write_string(db->log, c->genre) &&
+             write_i32(db->log, c->duration) && write_i32(db->log, c->year) &&
+             write_i32(db->log, c->track_number) && write_i64(db->log, c->file_mtime_sec) &&
+             write_i64(db->log, c->file_mtime_nsec) && write_u64(db->log, c->file_size);
+    }
+    return fflush(db->log) == 0 && ok;
+}
+
+typedef struct reader {
+    const char* data;
+    size_t size;
+    size_t pos;
+} reader_t;
+
+static bool read_bytes(reader_t* r, void* out, size_t n) {
+    if (r->size - r->pos < n) return false;
+    memcpy(out, r->data + r->pos, n);
+    r->pos += n;
+    return true;
+}
+
+static char* read_string(reader_t* r) {
+    uint32_t len;
+    if (!read_bytes(r, &len, sizeof(len)) || r->size - r->pos < len) return NULL;
+
+    char* s = malloc(len + 1);
+    if (!s) return NULL;
+    memcpy(s, r->data + r->pos, len);
+    s[len] = '\0';
+    r->pos += len;
+    return s;
+}
+
+static bool read_change(reader_t* r, db_change_t* c) {
+    memset(c, 0, sizeof(*c));
+
+    uint8_t op;
+    if (!read_bytes(r, &op, 1) || (op != LOG_OP_PUT && op != LOG_OP_REMOVE)) return false;
+    c->removed = op == LOG_OP_REMOVE;
+    c->path = read_string(r);
+    if (!c->path) return false;
+    if (c->removed) return true;
+
+    int32_t duration, year, track_number;
+    c->title = read_string(r);
+    c->artist = read_string(r);
+    c->album = read_string(r);
+    c->genre = read_string(r);
+    bool ok = c->title && c->artist && c->album && c->genre &&
+              read_bytes(r, &duration, sizeof(duration)) &&
+              read_bytes(r, &year, sizeof(year)) &&
+              read_bytes(r, &track_number, sizeof(track_number)) &&
+              read_bytes(r, &c->file_mtime_sec, sizeof(c->file_mtime_sec)) &&
+              read_bytes(r, &c->file_mtime_nsec, sizeof(c->file_mtime_nsec)) &&
+              read_bytes(r, &c->file_size, sizeof(c->file_size));
+    if (!ok) {
+        change_free(c);
+        return false;
+    }
+    c->duration = duration;
+    c->year = year;
+    c->track_number = track_number;
+    return true;
+}
+
+// reads the whole log into the change set
+// the log is cut off at a torn or older version entry, appends after it would never be read
+static size_t log_replay(library_db_t* db) {
+    FILE* file = fopen(db->log_path, "rb");
+    if (!file) return 0;
+
+    size_t replayed = 0;
+    char* data = NULL;
+    long size = 0;
+    if (fseek(file, 0, SEEK_END) == 0 && (size = ftell(file)) > 0 && fseek(file, 0, SEEK_SET) == 0) {
+        data = malloc((size_t)size);
+        if (data && fread(data, 1, (size_t)size, file) == (size_t)size) {
+            reader_t r = { data, (size_t)size, 0 };
+            db_change_t change;
+            size_t valid = 0;
+            while (read_change(&r, &change)) {
+                if (change_set_put(&db->changes, &change)) replayed++;
+                valid = r.pos;
+            }
+            if (valid < (size_t)size) {
+                LOG_WARN("Dropping torn or outdated library database log entries: %s", db->log_path);
+                if (truncate(db->log_path, (off_t)valid) != 0) {
+                    LOG_WARN("Couldn't truncate library database log: %s", db->log_path);
+                }
+            }
+        }
+    }
+
+    free(data);
+    fclose(file);
+    return replayed;
+}
+
+// compaction
+// ----------
+
+typedef struct blob_writer {
+    char* data;
+    size_t size;
+    size_t capacity;
+    uint32_t* slots; // dedupe table, offset + 1 of each stored string
+    size_t slot_count;
+    size_t string_count;
+    bool failed;
+} blob_writer_t;
+
+static bool blob_grow_slots(blob_writer_t* b) {
+    size_t slot_count = b->slot_count == 0 ? 1024 : b->slot_count * 2;
+    uint32_t* slots = calloc(slot_count, sizeof(uint32_t));
+    if (!slots) return false;
+
+    size_t mask = slot_count - 1;
+    for (size_t n = 0; n < b->slot_count; n++) {
+        if (b->slots[n] == 0) continue;
+        size_t i = cache_path_hash(b->data + b->slots[n] - 1) & mask;
+        while (slots[i] != 0) i = (i + 1) & mask;
+        slots[i] = b->slots[n];
+    }
+    free(b->slots);
+    b->slots = slots;
+    b->slot_count = slot_count;
+    return true;
+}
+
+// adds a string to the blob once, artists, albums and genres repeat a lot
+static uint32_t blob_add(blob_writer_t* b, const char* s) {
+    if (b->failed) return 0;
+    if ((b->string_count + 1) * 2 > b->slot_count && !blob_grow_slots(b)) {
+        b->failed = true;
+        return 0;
+    }
+
+    size_t mask = b->slot_count - 1;
+    size_t i = cache_path_hash(s) & mask;
+    for (; b->slots[i] != 0; i = (i + 1) & mask) {
+        if (strcmp(b->data + b->slots[i] - 1, s) == 0) return b->slots[i] - 1;
+    }
+
+    size_t len = strlen(s) + 1;
+    if (b->size + len >= UINT32_MAX) {
+        b->failed = true;
+        return 0;
+    }
+    if (b->size + len > b->capacity) {
+        size_t new_capacity = b->capacity == 0 ? 65536 : b->capacity;
+        while (new_capacity < b->size + len) new_capacity *= 2;
+        char* tmp = realloc(b->data, new_capacity);
+        if (!tmp) {
+            b->failed = true;
+            return 0;
+        }
+        b->data = tmp;
+        b->capacity = new_capacity;
+    }
+
+    uint32_t offset = (uint32_t)b->size;
+    memcpy(b->data + b->size, s, len);
+    b->size += len;
+    b->slots[i] = offset + 1;
+    b->string_count++;
+    return offset;
+}
+
+static void blob_add_track(blob_writer_t* b, const library_db_track_t* t, db_record_t* r) {
+    r->path = blob_add(b, t->path);
+    r->title = blob_add(b, t->title);
+    r->artist = blob_add(b, t->artist);
+    r->album = blob_add(b, t->album);
+    r->genre = blob_add(b, t->genre);
+    r->duration = t->duration;
+    r->year = t->year;
+    r->track_number = t->track_number;
+    r->file_mtime_sec = t->file_mtime_sec;
+    r->file_mtime_nsec = t->file_mtime_nsec;
+    r->file_size = t->file_size;
+}
+
+static int compare_changes(const void* a, const void* b) {
+    return strcmp((*(const db_change_t* const*)a)->path, (*(const db_change_t* const*)b)->path);
+}
+
+// merges the mapped records and the frozen changes into a new file
+// runs on its own thread, both inputs are left untouched by the owner meanwhile
+static bool write_compacted(library_db_t* db) {
+    const change_set_t* frozen = &db->frozen;
+    const db_change_t** order = malloc((frozen->count ? frozen->count : 1) * sizeof(*order));
+    db_record_t* records = malloc((db->map.count + frozen->count + 1) * sizeof(db_record_t));
+    blob_writer_t blob = {0};
+    bool ok = order && records;
+
+    if (ok) {
+        for (size_t i = 0; i < frozen->count; i++) order[i] = &frozen->items[i];
+        qsort(order, frozen->count, sizeof(*order), compare_changes);
+        blob_add(&blob, ""); // offset 0 is always the empty string
+    }
+
+    size_t count = 0, m = 0, c = 0;
+    while (ok && (m < db->map.count || c < frozen->count)) {
+        const db_record_t* mapped = m < db->map.count ? &db->map.records[m] : NULL;
+        const db_change_t* change = c < frozen->count ? order[c] : NULL;
+
+        int cmp = !mapped ? 1 : !change ? -1 : strcmp(map_string(&db->map, mapped->path), change->path);
+        library_db_track_t track;
+        if (cmp < 0) {
+            record_to_track(&db->map, mapped, &track);
+            m++;
+        } else {
+            if (cmp == 0) m++; // the change replaces the mapped record
+            c++;
+            if (change->removed) continue;
+            change_to_track(change, &track);
+        }
+        blob_add_track(&blob, &track, &records[count++]);
+        ok = !blob.failed;
+    }
+
+    char* tmp_path = concat(db->path, ".tmp");
+    FILE* file = ok && tmp_path ? fopen(tmp_path, "wb") : NULL;
+    if (file) {
+        db_header_t header = {0};
+        memcpy(header.magic, LIBRARY_DB_MAGIC, 8);
+        header.version = LIBRARY_DB_VERSION;
+        header.record_size = sizeof(db_record_t);
+        header.track_count = count;
+        header.strings_offset = sizeof(db_header_t) + count * sizeof(db_record_t);
+        header.strings_size = blob.size;
+
+        ok = fwrite(&header, sizeof(header), 1, file) == 1 &&
+             fwrite(records, sizeof(db_record_t), count, file) == count &&
+             fwrite(blob.data, 1, blob.size, file) == blob.size &&
+             fflush(file) == 0 && fsync(fileno(file)) == 0;
+        ok = fclose(file) == 0 && ok;
+        ok = ok && rename(tmp_path, db->path) == 0;
+        if (!ok) unlink(tmp_path);
+    } else {
+        ok = false;
+    }
+
+    if (ok) {
+        LOG_INFO("Library database compacted: %zu tracks, %zu bytes of strings.", count, blob.size);
+    } else {
+        LOG_ERROR("Couldn't compact library database: %s", db->path);
+    }
+
+    free(tmp_path);
+    free(order);
+    free(records);
+    free(blob.data);
+    free(blob.slots);
+    return ok;
+}
+
+static void* compact_run(void* arg) {
+    library_db_t* db = arg;
+    db->compact_ok = write_compacted(db);
+    atomic_store(&db->compact_done, true);
+    return NULL;
+}
+
+// puts the frozen changes back underneath anything logged since
+static void unfreeze(library_db_t* db) {
+    change_set_t newer = db->changes;
+    db->changes = db->frozen;
+    memset(&db->frozen, 0, sizeof(db->frozen));
+    for (size_t i = 0; i < newer.count; i++) {
+        change_set_put(&db->changes, &newer.items[i]);
+    }
+    newer.count = 0;
+    change_set_free(&newer);
+}
+
+// keeps the log entries written after the compaction started
+static bool rewrite_log_tail(library_db_t* db) {
+    if (db->log) fclose(db->log);
+    db->log = NULL;
+
+    char* tmp_path = concat(db->log_path, ".tmp");
+    FILE* in = fopen(db->log_path, "rb");
+    FILE* out = tmp_path ? fopen(tmp_path, "wb") : NULL;
+    bool ok = in && out && fseek(in, (long)db->frozen_log_size, SEEK_SET) == 0;
+
+    char buffer[65536];
+    size_t n;
+    while (ok && (n = fread(buffer, 1, sizeof(buffer), in)) > 0) {
+        ok = fwrite(buffer, 1, n, out) == n;
+    }
+    if (in) fclose(in);
+    if (out) ok = fclose(out) == 0 && ok;
+    ok = ok && rename(tmp_path, db->log_path) == 0;
+    if (!ok && tmp_path) unlink(tmp_path);
+    free(tmp_path);
+
+    db->log = fopen(db->log_path, "ab");
+    return ok && db->log;
+}
+
+// swaps in the compacted file once the compaction thread has been joined
+static bool finish_compaction(library_db_t* db) {
+    db->compacting = false;
+
+    // on failure keep serving the frozen changes, they're still in the log
+    db_map_t map;
+    if (!db->compact_ok) {
+        unfreeze(db);
+        return false;
+    }
+    if (!map_open(db->path, &map)) {
+        LOG_ERROR("Couldn't map compacted library database: %s", db->path);
+        unfreeze(db);
+        return false;
+    }
+    map_close(&db->map);
+    db->map = map;
+    change_set_free(&db->frozen);
+
+    if (!rewrite_log_tail(db)) {
+        LOG_WARN("Couldn't trim library database log: %s", db->log_path);
+    }
+    return true;
+}
+
+// public api
+// ----------
+
+library_db_t* library_db_open(const char* db_path) {
+    if (!db_path) {
+        LOG_ERROR("Couldn't open library database; path is NULL.");
+        return NULL;
+    }
+
+    double start = now_seconds();
+    library_db_t* db = calloc(1, sizeof(library_db_t));
+    if (!db) {
+        LOG_ERROR("Memory allocation failed; couldn't open library database.");
+        return NULL;
+    }
+    atomic_init(&db->compact_done, false);
+
+    db->path = strdup(db_path);
+    db->log_path = db->path ? concat(db->path, ".log") : NULL;
+    if (!db->path || !db->log_path || !cache_path_make_dirs(db->path)) {
+        LOG_ERROR("Couldn't open library database: %s", db_path);
+        library_db_close(db);
+        return NULL;
+    }
+
+    map_open(db->path, &db->map); // a missing or broken file just means no tracks yet
+    size_t replayed = log_replay(db);
+    db->log = fopen(db->log_path, "ab");
+    if (!db->log) {
+        LOG_WARN("Couldn't open library database log, changes won't be saved: %s", db->log_path);
+    }
+
+    LOG_INFO("Library database opened in %.2fms: %zu tracks, %zu logged changes.",
+             (now_seconds() - start) * 1000.0, db->map.count, replayed);
+    return db;
+}
+
+void library_db_close(library_db_t* db) {
+    if (!db) {
+        LOG_ERROR("Couldn't close library database; database is NULL.");
+        return;
+    }
+
+    if (db->compacting) {
+        pthread_join(db->thread, NULL);
+        finish_compaction(db);
+    }
+
+    if (db->log) fclose(db->log);
+    map_close(&db->map);
+    change_set_free(&db->changes);
+    change_set_free(&db->frozen);
+    free(db->path);
+    free(db->log_path);
+    free(db);
+}
+
+size_t library_db_count(const library_db_t* db) {
+    if (!db) {
+        LOG_ERROR("Couldn't count library database tracks; database is NULL.");
+        return 0;
+    }
+
+    // changes either add to the mapped tracks, replace one or remove one
+    size_t count = db->map.count;
+    for (size_t i = 0; i < db->frozen.count; i++) {
+        const db_change_t* c = &db->frozen.items[i];
+        if (change_set_find(&db->changes, c->path)) continue; // counted below
+
+        bool existed = map_find(&db->map, c->path) != NULL;
+        if (c->removed && existed) count--;
+        else if (!c->removed && !existed) count++;
+    }
+    for (size_t i = 0; i < db->changes.count; i++) {
+        const db_change_t* c = &db->changes.items[i];
+        const db_change_t* older = change_set_find(&db->frozen, c->path);
+
+        bool existed = older ? !older->removed : map_find(&db->map, c->path) != NULL;
+        if (c->removed && existed) count--;
+        else if (!c->removed && !existed) count++;
+    }
+    return count;
+}
+
+bool library_db_find(const library_db_t* db, const char* path, library_db_track_t* out) {
+    if (!db || !path || !out) {
+        LOG_ERROR("Couldn't find track in library database; database, path or output is NULL.");
+        return false;
+    }
+
+    const db_change_t* change = change_set_find(&db->changes, path);
+    if (!change) change = change_set_find(&db->frozen, path);
+    if (change) {
+        if (change->removed) return false;
+        change_to_track(change, out);
+        return true;
+    }
+
+    const db_record_t* record = map_find(&db->map, path);
+    if (!record) return false;
+    record_to_track(&db->map, record, out);
+    return true;
+}
+
+static bool replace_interned(const char** field, const char* value) {
+    const char* shared = string_pool_intern(value);
+    if (!shared) return false;
+    *field = shared;
+    return true;
+}
+
+bool library_db_fill_track(const library_db_track_t* stored, track_list_t* list, track_t* track) {
+    if (!stored || !list || !track) {
+        LOG_ERROR("Couldn't fill track from library database; stored track, list or track is NULL.");
+        return false;
+    }
+
+    bool ok = track_list_set_title(list, track, stored->title) &&
+              replace_interned(&track->artist, stored->artist) &&
+              replace_interned(&track->album, stored->album) &&
+              replace_interned(&track->genre, stored->genre);
+    track->duration = stored->duration;
+    track->year = stored->year;
+    track->track_number = stored->track_number;
+    track->file_mtime_sec = stored->file_mtime_sec;
+    track->file_mtime_nsec = stored->file_mtime_nsec;
+    track->file_size = stored->file_size;
+    return track_list_refresh(list, track) && ok;
+}
+
+bool library_db_put(library_db_t* db, const track_t* track) {
+    if (!db || !track || !track->path) {
+        LOG_ERROR("Couldn't store track in library database; database or track is NULL.");
+        return false;
+    }
+
+    db_change_t change = {0};
+    change.path = strdup(track->path);
+    change.title = strdup(track->title ? track->title : "");
+    change.artist = strdup(track->artist ? track->artist : "");
+    change.album = strdup(track->album ? track->album : "");
+    change.genre = strdup(track->genre ? track->genre : "");
+    change.duration = track->duration;
+    change.year = track->year;
+    change.track_number = track->track_number;
+    change.file_mtime_sec = track->file_mtime_sec;
+    change.file_mtime_nsec = track->file_mtime_nsec;
+    change.file_size = track->file_size;
+    if (!change.path || !change.title || !change.artist || !change.album || !change.genre) {
+        LOG_ERROR("Memory allocation failed; couldn't store track in library database.");
+        change_free(&change);
+        return false;
+    }
+
+    if (!log_append(db, &change)) {
+        LOG_WARN("Couldn't log library database change: %s", track->path);
+    }
+    return change_set_put(&db->changes, &change);
+}
+
+bool library_db_remove(library_db_t* db, const char* path) {
+    if (!db || !path) {
+        LOG_ERROR("Couldn't remove track from library database; database or path is NULL.");
+        return false;
+    }
+
+    library_db_track_t existing;
+    if (!library_db_find(db, path, &existing)) return true;
+
+    db_change_t change = {0};
+    change.path = strdup(path);
+    change.removed = true;
+    if (!change.path) {
+        LOG_ERROR("Memory allocation failed; couldn't remove track from library database.");
+        return false;
+    }
+
+    if (!log_append(db, &change)) {
+        LOG_WARN("Couldn't log library database change: %s", path);
+    }
+    return change_set_put(&db->changes, &change);
+}
+
+bool library_db_compact(library_db_t* db) {
+    if (!db) {
+        LOG_ERROR("Couldn't compact library database; database is NULL.");
+        return false;
+    }
+    if (db->compacting || db->changes.count == 0) return false;
+
+    // small logs replay quickly, only rewrite the file once they add up
+    size_t threshold = db->map.count / 8;
+    if (threshold < LIBRARY_DB_MIN_COMPACT) threshold = LIBRARY_DB_MIN_COMPACT;
+    if (db->changes.count < threshold) return false;
+
+    if (db->log && fflush(db->log) != 0) return false;
+    long log_size = db->log ? ftell(db->log) : 0;
+    if (log_size < 0) return false;
+
+    // freeze the current changes, new ones go into a fresh set meanwhile
+    db->frozen = db->changes;
+    memset(&db->changes, 0, sizeof(db->changes));
+    db->frozen_log_size = (uint64_t)log_size;
+    atomic_store(&db->compact_done, false);
+
+    if (pthread_create(&db->thread, NULL, compact_run, db) != 0) {
+        LOG_ERROR("Couldn't start library database compaction thread.");
+        unfreeze(db);
+        return false;
+    }
+
+    db->compacting = true;
+    return true;
+}
+
+bool library_db_poll(library_db_t* db) {
+    if (!db) {
+        LOG_ERROR("Couldn't poll library database; database is NULL.");
+        return false;
+    }
+    if (!db->compacting || !atomic_load(&db->compact_done)) return false;
+
+    pthread_join(db->thread, NULL);
+    return finish_compaction(db);
+}
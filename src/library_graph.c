@@ -0,0 +1,677 @@
+#define _GNU_SOURCE
+#include "library_graph.h"
+#include "logger.h"
+#include "string_pool.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+#include <time.h>
+#include <unistd.h>
+
+#define GRAPH_MAX_THREADS 32
+
+// what the graph remembers about an album, indexed by the album's handle slot
+typedef struct album_info {
+    uint64_t key;
+    uint32_t genre_id;
+    artist_handle_t artist;
+    genre_handle_t genre;
+} album_info_t;
+
+// album key to album, a null album marks a key whose album was removed
+typedef struct album_slot {
+    uint64_t key;
+    album_handle_t album;
+    bool used;
+} album_slot_t;
+
+struct library_graph {
+    const track_list_t* tracks;
+    album_list_t* albums;
+    artist_list_t* artists;
+    genre_list_t* genres;
+
+    album_slot_t* album_map; // open addressing, kept at most half full
+    size_t album_map_capacity;
+    size_t album_map_used;
+    artist_handle_t* artist_by_id; // by string pool id
+    genre_handle_t* genre_by_id;
+    size_t id_capacity;
+    album_handle_t* album_of; // by track handle slot
+    size_t album_of_capacity;
+    album_info_t* info; // by album handle slot
+    size_t info_capacity;
+};
+
+// one artist and album title make an album, so "Greatest Hits" by two artists are two albums
+static uint64_t album_key(const track_list_t* tracks, size_t index) {
+    return (uint64_t)tracks->columns.artist[index] << 32 | tracks->columns.album[index];
+}
+
+// mixes both halves of the key into the low bits, the tables mask those
+static size_t hash_key(uint64_t key) {
+    key ^= key >> 30;
+    key *= 0xBF58476D1CE4E5B9ULL;
+    key ^= key >> 27;
+    key *= 0x94D049BB133111EBULL;
+    return (size_t)(key ^ key >> 31);
+}
+
+// grows a zeroed array of handles or infos to hold index
+static bool grow_zeroed(void** items, size_t* capacity, size_t index, size_t size) {
+    if (index < *capacity) return true;
+
+    size_t new_capacity = *capacity == 0 ? 64 : *capacity;
+    while (new_capacity <= index) new_capacity *= 2;
+    unsigned char* tmp = realloc(*items, new_capacity * size);
+    if (!tmp) return false;
+    memset(tmp + *capacity * size, 0, (new_capacity - *capacity) * size);
+    *items = tmp;
+    *capacity = new_capacity;
+    return true;
+}
+
+// album map
+// ---------
+
+static bool map_grow(library_graph_t* graph) {
+    size_t new_capacity = graph->album_map_capacity == 0 ? 1024 : graph->album_map_capacity * 2;
+    album_slot_t* slots = calloc(new_capacity, sizeof(album_slot_t));
+    if (!slots) return false;
+
+    size_t mask = new_capacity - 1;
+    for (size_t n = 0; n < graph->album_map_capacity; n++) {
+        if (!graph->album_map[n].used) continue;
+        size_t i = hash_key(graph->album_map[n].key) & mask;
+        while (slots[i].used) i = (i + 1) & mask;
+        slots[i] = graph->album_map[n];
+    }
+    free(graph->album_map);
+    graph->album_map = slots;
+    graph->album_map_capacity = new_capacity;
+    return true;
+}
+
+// finds the slot of an album key, adding an empty one if it isn't there
+static album_slot_t* map_slot(library_graph_t* graph, uint64_t key) {
+    if ((graph->album_map_used + 1) * 2 > graph->album_map_capacity && !map_grow(graph)) return NULL;
+
+    size_t mask = graph->album_map_capacity - 1;
+    size_t i = hash_key(key) & mask;
+    for (; graph->album_map[i].used; i = (i + 1) & mask) {
+        if (graph->album_map[i].key == key) return &graph->album_map[i];
+    }
+    graph->album_map[i] = (album_slot_t){ key, HANDLE_NULL, true };
+    graph->album_map_used++;
+    return &graph->album_map[i];
+}
+
+// shards
+// ------
+
+// tracks of one shard grouped by album key
+typedef struct shard_group {
+    uint64_t key;
+    uint32_t genre_id; // genre of the first track
+    size_t count;
+    size_t album; // position in the album list, set by the merge
+    size_t offset; // where the next track goes in that album, set by the merge
+} shard_group_t;
+
+typedef struct graph_shard {
+    const track_list_t* tracks;
+    size_t first;
+    size_t last;
+    uint32_t* group_of; // per track of the whole list, shards only touch their own range
+    shard_group_t* groups;
+    size_t group_count;
+    size_t group_capacity;
+    uint32_t* slots; // open addressing, group index + 1 (0 is empty)
+    size_t slot_capacity;
+    album_t* albums; // items of the album list while filling
+    bool failed;
+} graph_shard_t;
+
+static bool shard_grow_slots(graph_shard_t* shard) {
+    size_t new_capacity = shard->slot_capacity == 0 ? 256 : shard->slot_capacity * 2;
+    uint32_t* slots = calloc(new_capacity, sizeof(uint32_t));
+    if (!slots) return false;
+
+    size_t mask = new_capacity - 1;
+    for (size_t g = 0; g < shard->group_count; g++) {
+        size_t i = hash_key(shard->groups[g].key) & mask;
+        while (slots[i] != 0) i = (i + 1) & mask;
+        slots[i] = (uint32_t)g + 1;
+    }
+    free(shard->slots);
+    shard->slots = slots;
+    shard->slot_capacity = new_capacity;
+    return true;
+}
+
+// finds the group of an album key, adding it for the track at index if it's new
+static size_t shard_group(graph_shard_t* shard, uint64_t key, size_t index) {
+    if ((shard->group_count + 1) * 2 > shard->slot_capacity && !shard_grow_slots(shard)) return SIZE_MAX;
+
+    size_t mask = shard->slot_capacity - 1;
+    size_t i = hash_key(key) & mask;
+    for (; shard->slots[i] != 0; i = (i + 1) & mask) {
+        if (shard->groups[shard->slots[i] - 1].key == key) return shard->slots[i] - 1;
+    }
+
+    if (shard->group_count >= shard->group_capacity) {
+        size_t new_capacity = shard->group_capacity == 0 ? 256 : shard->group_capacity * 2;
+        shard_group_t* tmp = realloc(shard->groups, new_capacity * sizeof(shard_group_t));
+        if (!tmp) return SIZE_MAX;
+        shard->groups = tmp;
+        shard->group_capacity = new_capacity;
+    }
+    shard->groups[shard->group_count] = (shard_group_t){ key, shard->tracks->columns.genre[index], 0, 0, 0 };
+    shard->slots[i] = (uint32_t)shard->group_count + 1;
+    return shard->group_count++;
+}
+
+// first pass, groups the shard's tracks by album key reading only the columns
+static void* shard_group_run(void* arg) {
+    graph_shard_t* shard = arg;
+    const track_list_t* tracks = shard->tracks;
+
+    for (size_t i = shard->first; i < shard->last; i++) {
+        if (tracks->columns.removed[i]) {
+            shard->group_of[i] = UINT32_MAX;
+            continue;
+        }
+        size_t g = shard_group(shard, album_key(tracks, i), i);
+        if (g == SIZE_MAX) {
+            shard->failed = true;
+            return NULL;
+        }
+        shard->group_of[i] = (uint32_t)g;
+        shard->groups[g].count++;
+    }
+    return NULL;
+}
+
+// second pass, writes the shard's track handles into the places the merge gave its groups
+static void* shard_fill_run(void* arg) {
+    graph_shard_t* shard = arg;
+    const track_list_t* tracks = shard->tracks;
+
+    for (size_t i = shard->first; i < shard->last; i++) {
+        uint32_t g = shard->group_of[i];
+        if (g == UINT32_MAX) continue;
+        shard_group_t* group = &shard->groups[g];
+        shard->albums[group->album].tracks[group->offset++] = handle_table_at(&tracks->handles, i);
+    }
+    return NULL;
+}
+
+// runs every shard on its own thread, the first one on the calling thread
+static void run_shards(graph_shard_t* shards, size_t count, void* (*run)(void*)) {
+    pthread_t threads[GRAPH_MAX_THREADS];
+    bool started[GRAPH_MAX_THREADS] = {0};
+
+    for (size_t s = 1; s < count; s++) {
+        started[s] = pthread_create(&threads[s], NULL, run, &shards[s]) == 0;
+        if (!started[s]) run(&shards[s]);
+    }
+    run(&shards[0]);
+    for (size_t s = 1; s < count; s++) {
+        if (started[s]) pthread_join(threads[s], NULL);
+    }
+}
+
+// build
+// -----
+
+// grows the artist and genre tables to hold id
+static bool ensure_ids(library_graph_t* graph, uint32_t id) {
+    size_t capacity = graph->id_capacity;
+    if (!grow_zeroed((void**)&graph->artist_by_id, &capacity, id, sizeof(handle_t))) return false;
+    size_t other = graph->id_capacity;
+    if (!grow_zeroed((void**)&graph->genre_by_id, &other, capacity - 1, sizeof(handle_t))) return false;
+    graph->id_capacity = capacity;
+    return true;
+}
+
+// creates the albums of every shard group in order of first appearance
+static bool merge_groups(library_graph_t* graph, graph_shard_t* shards, size_t shard_count) {
+    album_t* albums = NULL;
+    size_t album_count = 0;
+    size_t album_capacity = 0;
+    bool ok = true;
+
+    for (size_t s = 0; ok && s < shard_count; s++) {
+        for (size_t g = 0; ok && g < shards[s].group_count; g++) {
+            shard_group_t* group = &shards[s].groups[g];
+            album_slot_t* slot = map_slot(graph, group->key);
+            if (!slot) {
+                ok = false;
+                break;
+            }
+
+            // while building, the map holds album positions + 1 in null handles
+            if (slot->album.slot == 0) {
+                if (album_count >= album_capacity) {
+                    size_t new_capacity = album_capacity == 0 ? 256 : album_capacity * 2;
+                    album_t* tmp = realloc(albums, new_capacity * sizeof(album_t));
+                    if (!tmp) {
+                        ok = false;
+                        break;
+                    }
+                    albums = tmp;
+                    album_capacity = new_capacity;
+                }
+                const char* title = string_pool_get((uint32_t)group->key);
+                albums[album_count] = (album_t){ .title = strdup(title ? title : "Unknown Album"), .source = graph->tracks };
+                ok = albums[album_count].title != NULL;
+                slot->album.slot = (uint32_t)++album_count;
+                if (!ok) break;
+            }
+
+            album_t* album = &albums[slot->album.slot - 1];
+            group->album = slot->album.slot - 1;
+            group->offset = album->track_count;
+            album->track_count += group->count; // the handles are written by the second pass
+        }
+    }
+
+    for (size_t a = 0; ok && a < album_count; a++) {
+        albums[a].track_capacity = albums[a].track_count;
+        albums[a].tracks = malloc(albums[a].track_count * sizeof(track_handle_t));
+        ok = albums[a].tracks != NULL;
+    }
+    if (ok) ok = album_list_append_many(graph->albums, albums, album_count);
+    if (!ok) {
+        for (size_t a = 0; a < album_count; a++) {
+            free(albums[a].title);
+            free(albums[a].tracks);
+        }
+    }
+    free(albums);
+    return ok;
+}
+
+// fills in the map and album infos once the albums have their handles
+static bool index_albums(library_graph_t* graph, graph_shard_t* shards, size_t shard_count) {
+    for (size_t s = 0; s < shard_count; s++) {
+        for (size_t g = 0; g < shards[s].group_count; g++) {
+            const shard_group_t* group = &shards[s].groups[g];
+            album_slot_t* slot = map_slot(graph, group->key);
+            if (!slot) return false;
+            if (!handle_is_null(slot->album)) continue;
+
+            // the first group of an album decides its genre
+            album_handle_t handle = album_list_handle_at(graph->albums, group->album);
+            slot->album = handle;
+            if (!grow_zeroed((void**)&graph->info, &graph->info_capacity, handle.slot, sizeof(album_info_t))) return false;
+            graph->info[handle.slot] = (album_info_t){ group->key, group->genre_id, HANDLE_NULL, HANDLE_NULL };
+        }
+    }
+    return true;
+}
+
+// groups the albums by artist and genre the same way tracks were grouped by album
+static bool group_albums(library_graph_t* graph, bool by_genre) {
+    size_t album_count = graph->albums->count;
+    size_t* owner_of = malloc(album_count * sizeof(size_t));
+    size_t* owner_ids = malloc(album_count * sizeof(size_t));
+    size_t* sizes = calloc(album_count, sizeof(size_t));
+    size_t id_capacity = string_pool_get_stats().strings + 1;
+    size_t* owner_by_id = malloc(id_capacity * sizeof(size_t));
+    bool ok = owner_of && owner_ids && sizes && owner_by_id;
+    size_t owner_count = 0;
+
+    if (ok) memset(owner_by_id, 0xff, id_capacity * sizeof(size_t));
+    for (size_t a = 0; ok && a < album_count; a++) {
+        const album_info_t* info = &graph->info[album_list_handle_at(graph->albums, a).slot];
+        uint32_t id = by_genre ? info->genre_id : (uint32_t)(info->key >> 32);
+        if (id >= id_capacity) {
+            ok = false;
+            break;
+        }
+        if (owner_by_id[id] == SIZE_MAX) {
+            owner_ids[owner_count] = id;
+            owner_by_id[id] = owner_count++;
+        }
+        owner_of[a] = owner_by_id[id];
+        sizes[owner_of[a]]++;
+    }
+
+    // artists and genres are laid out like albums, one exactly sized handle array each
+    artist_t* artists = NULL;
+    genre_t* genres = NULL;
+    if (ok) {
+        if (by_genre) genres = calloc(owner_count, sizeof(genre_t));
+        else artists = calloc(owner_count, sizeof(artist_t));
+        ok = (by_genre ? (void*)genres : (void*)artists) != NULL || owner_count == 0;
+    }
+    for (size_t o = 0; ok && o < owner_count; o++) {
+        const char* name = string_pool_get((uint32_t)owner_ids[o]);
+        char* copy = strdup(name ? name : (by_genre ? "Unknown" : "Unknown Artist"));
+        album_handle_t* handles = malloc(sizeof(album_handle_t) * sizes[o]);
+        if (by_genre) genres[o] = (genre_t){ .name = copy, .source = graph->albums, .albums = handles, .album_capacity = sizes[o] };
+        else artists[o] = (artist_t){ .name = copy, .source = graph->albums, .albums = handles, .album_capacity = sizes[o] };
+        ok = copy && handles;
+    }
+    for (size_t a = 0; ok && a < album_count; a++) {
+        album_handle_t handle = album_list_handle_at(graph->albums, a);
+        if (by_genre) genres[owner_of[a]].albums[genres[owner_of[a]].album_count++] = handle;
+        else artists[owner_of[a]].albums[artists[owner_of[a]].album_count++] = handle;
+    }
+
+    // once appended the lists own the names and handle arrays
+    bool appended = ok && (by_genre ? genre_list_append_many(graph->genres, genres, owner_count)
+                                    : artist_list_append_many(graph->artists, artists, owner_count));
+    if (!appended && (artists || genres)) {
+        for (size_t o = 0; o < owner_count; o++) {
+            free(by_genre ? genres[o].name : artists[o].name);
+            free(by_genre ? (void*)genres[o].albums : (void*)artists[o].albums);
+        }
+    }
+    ok = appended;
+    for (size_t o = 0; ok && o < owner_count; o++) {
+        ok = ensure_ids(graph, (uint32_t)owner_ids[o]);
+        if (!ok) break;
+        if (by_genre) graph->genre_by_id[owner_ids[o]] = genre_list_handle_at(graph->genres, o);
+        else graph->artist_by_id[owner_ids[o]] = artist_list_handle_at(graph->artists, o);
+    }
+    for (size_t a = 0; ok && a < album_count; a++) {
+        album_info_t* info = &graph->info[album_list_handle_at(graph->albums, a).slot];
+        if (by_genre) info->genre = genre_list_handle_at(graph->genres, owner_of[a]);
+        else info->artist = artist_list_handle_at(graph->artists, owner_of[a]);
+    }
+
+    free(artists);
+    free(genres);
+    free(owner_of);
+    free(owner_ids);
+    free(sizes);
+    free(owner_by_id);
+    return ok;
+}
+
+static bool record_tracks(library_graph_t* graph) {
+    const album_list_t* albums = graph->albums;
+    for (size_t a = 0; a < albums->count; a++) {
+        album_handle_t handle = album_list_handle_at(albums, a);
+        for (size_t t = 0; t < albums->items[a].track_count; t++) {
+            track_handle_t track = albums->items[a].tracks[t];
+            if (!grow_zeroed((void**)&graph->album_of, &graph->album_of_capacity, track.slot, sizeof(album_handle_t))) {
+                return false;
+            }
+            graph->album_of[track.slot] = handle;
+        }
+    }
+    return true;
+}
+
+library_graph_t* library_graph_build(const track_list_t* tracks, size_t thread_count) {
+    if (!tracks) {
+        LOG_ERROR("Couldn't build library graph; tracks is NULL.");
+        return NULL;
+    }
+
+    library_graph_t* graph = calloc(1, sizeof(library_graph_t));
+    if (!graph) {
+        LOG_ERROR("Memory allocation failed; couldn't build library graph.");
+        return NULL;
+    }
+    graph->tracks = tracks;
+    graph->albums = album_list_create();
+    graph->artists = artist_list_create();
+    graph->genres = genre_list_create();
+
+    if (thread_count == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cpus > 0 ? (size_t)cpus : 1;
+    }
+    if (thread_count > GRAPH_MAX_THREADS) thread_count = GRAPH_MAX_THREADS;
+    // small shards cost more in threads than they save
+    size_t per_shard = tracks->count / thread_count;
+    if (per_shard < 4096) thread_count = tracks->count / 4096 > 0 ? tracks->count / 4096 : 1;
+
+    struct timespec start, end;
+    clock_gettime(CLOCK_MONOTONIC, &start);
+    graph_shard_t shards[GRAPH_MAX_THREADS] = {0};
+    uint32_t* group_of = malloc((tracks->count > 0 ? tracks->count : 1) * sizeof(uint32_t));
+    bool ok = graph->albums && graph->artists && graph->genres && group_of;
+
+    for (size_t s = 0; s < thread_count; s++) {
+        shards[s].tracks = tracks;
+        shards[s].first = tracks->count * s / thread_count;
+        shards[s].last = tracks->count * (s + 1) / thread_count;
+        shards[s].group_of = group_of;
+    }
+
+    if (ok) {
+        run_shards(shards, thread_count, shard_group_run);
+        for (size_t s = 0; s < thread_count; s++) ok = ok && !shards[s].failed;
+    }
+    ok = ok && merge_groups(graph, shards, thread_count);
+    if (ok) {
+        for (size_t s = 0; s < thread_count; s++) shards[s].albums = graph->albums->items;
+        run_shards(shards, thread_count, shard_fill_run);
+    }
+    ok = ok && index_albums(graph, shards, thread_count)
+            && group_albums(graph, false)
+            && group_albums(graph, true)
+            && record_tracks(graph);
+
+    for (size_t s = 0; s < thread_count; s++) {
+        free(shards[s].groups);
+        free(shards[s].slots);
+    }
+    free(group_of);
+
+    if (!ok) {
+        LOG_ERROR("Memory allocation failed; couldn't build library graph.");
+        library_graph_free(graph);
+        return NULL;
+    }
+
+    clock_gettime(CLOCK_MONOTONIC, &end);
+    LOG_INFO("Grouped %zu tracks into %zu albums, %zu artists and %zu genres on %zu threads in %.1f ms.",
+             tracks->count, graph->albums->count, graph->artists->count, graph->genres->count, thread_count,
+             (end.tv_sec - start.tv_sec) * 1000.0 + (end.tv_nsec - start.tv_nsec) / 1e6);
+    return graph;
+}
+
+void library_graph_free(library_graph_t* graph) {
+    if (!graph) {
+        LOG_ERROR("Couldn't free library graph; graph is NULL.");
+        return;
+    }
+
+    if (graph->albums) album_list_free(graph->albums);
+    if (graph->artists) artist_list_free(graph->artists);
+    if (graph->genres) genre_list_free(graph->genres);
+    free(graph->album_map);
+    free(graph->artist_by_id);
+    free(graph->genre_by_id);
+    free(graph->album_of);
+    free(graph->info);
+    free(graph);
+}
+
+// incremental changes
+// -------------------
+
+// adds an empty album for the key of the track at index, under its artist and genre
+static album_handle_t create_album(library_graph_t* graph, album_slot_t* slot, size_t index) {
+    const track_list_t* tracks = graph->tracks;
+    uint32_t artist_id = tracks->columns.artist[index];
+    uint32_t genre_id = tracks->columns.genre[index];
+    if (!ensure_ids(graph, artist_id) || !ensure_ids(graph, genre_id)) return HANDLE_NULL;
+
+    const char* title = string_pool_get(tracks->columns.album[index]);
+    album_t album = { .title = strdup(title ? title : "Unknown Album"), .source = tracks };
+    if (!album.title || !album_list_append_many(graph->albums, &album, 1)) {
+        free(album.title);
+        return HANDLE_NULL;
+    }
+    album_handle_t handle = album_list_handle_at(graph->albums, graph->albums->count - 1);
+    if (!grow_zeroed((void**)&graph->info, &graph->info_capacity, handle.slot, sizeof(album_info_t))) return HANDLE_NULL;
+    album_info_t* info = &graph->info[handle.slot];
+    *info = (album_info_t){ slot->key, genre_id, HANDLE_NULL, HANDLE_NULL };
+    slot->album = handle;
+
+    artist_t* artist = artist_list_resolve(graph->artists, graph->artist_by_id[artist_id]);
+    if (!artist) {
+        const char* name = string_pool_get(artist_id);
+        artist_t created = { .name = strdup(name ? name : "Unknown Artist"), .source = graph->albums };
+        if (!created.name || !artist_list_append_many(graph->artists, &created, 1)) {
+            free(created.name);
+            return HANDLE_NULL;
+        }
+        graph->artist_by_id[artist_id] = artist_list_handle_at(graph->artists, graph->artists->count - 1);
+        artist = &graph->artists->items[graph->artists->count - 1];
+    }
+    info->artist = graph->artist_by_id[artist_id];
+    if (!artist_add_albums(artist, &handle, 1)) return HANDLE_NULL;
+
+    genre_t* genre = genre_list_resolve(graph->genres, graph->genre_by_id[genre_id]);
+    if (!genre) {
+        const char* name = string_pool_get(genre_id);
+        genre_t created = { .name = strdup(name ? name : "Unknown"), .source = graph->albums };
+        if (!created.name || !genre_list_append_many(graph->genres, &created, 1)) {
+            free(created.name);
+            return HANDLE_NULL;
+        }
+        graph->genre_by_id[genre_id] = genre_list_handle_at(graph->genres, graph->genres->count - 1);
+        genre = &graph->genres->items[graph->genres->count - 1];
+    }
+    info->genre = graph->genre_by_id[genre_id];
+    if (!genre_add_albums(genre, &handle, 1)) return HANDLE_NULL;
+    return handle;
+}
+
+// removes an album that lost its last track, and its artist or genre if they end up empty
+static void drop_album(library_graph_t* graph, album_handle_t handle) {
+    album_info_t info = graph->info[handle.slot];
+
+    artist_t* artist = artist_list_resolve(graph->artists, info.artist);
+    if (artist) {
+        artist_remove_album(artist, handle);
+        if (artist->album_count == 0) {
+            artist_list_remove(graph->artists, handle_table_resolve(&graph->artists->handles, info.artist));
+            graph->artist_by_id[info.key >> 32] = HANDLE_NULL;
+        }
+    }
+    genre_t* genre = genre_list_resolve(graph->genres, info.genre);
+    if (genre) {
+        genre_remove_album(genre, handle);
+        if (genre->album_count == 0) {
+            genre_list_remove(graph->genres, handle_table_resolve(&graph->genres->handles, info.genre));
+            graph->genre_by_id[info.genre_id] = HANDLE_NULL;
+        }
+    }
+
+    album_slot_t* slot = map_slot(graph, info.key);
+    if (slot) slot->album = HANDLE_NULL;
+    album_list_remove(graph->albums, handle_table_resolve(&graph->albums->handles, handle));
+}
+
+bool library_graph_add_tracks(library_graph_t* graph, size_t first, size_t count) {
+    if (!graph || first + count > graph->tracks->count) {
+        LOG_ERROR("Couldn't add tracks to library graph; graph is NULL or tracks out of bounds.");
+        return false;
+    }
+
+    const track_list_t* tracks = graph->tracks;
+    for (size_t i = first; i < first + count; i++) {
+        if (tracks->columns.removed[i]) continue;
+
+        track_handle_t track = track_list_handle_at(tracks, i);
+        if (!grow_zeroed((void**)&graph->album_of, &graph->album_of_capacity, track.slot, sizeof(album_handle_t))) {
+            LOG_ERROR("Memory allocation failed; couldn't add track to library graph.");
+            return false;
+        }
+        if (!handle_is_null(graph->album_of[track.slot])) continue; // already filed
+
+        album_slot_t* slot = map_slot(graph, album_key(tracks, i));
+        album_handle_t handle = slot ? slot->album : HANDLE_NULL;
+        if (slot && handle_is_null(handle)) handle = create_album(graph, slot, i);
+
+        album_t* album = album_list_resolve(graph->albums, handle);
+        if (!album || !album_add_tracks(album, &track, 1)) {
+            LOG_ERROR("Memory allocation failed; couldn't add track to library graph.");
+            return false;
+        }
+        graph->album_of[track.slot] = handle;
+    }
+    return true;
+}
+
+bool library_graph_remove_track(library_graph_t* graph, size_t index) {
+    if (!graph || index >= graph->tracks->count) {
+        LOG_ERROR("Couldn't remove track from library graph; graph is NULL or index out of bounds.");
+        return false;
+    }
+
+    track_handle_t track = track_list_handle_at(graph->tracks, index);
+    if (track.slot >= graph->album_of_capacity) return true;
+    album_handle_t handle = graph->album_of[track.slot];
+    graph->album_of[track.slot] = HANDLE_NULL;
+
+    album_t* album = album_list_resolve(graph->albums, handle);
+    if (!album) return true;
+    album_remove_track(album, track);
+    if (album->track_count == 0) drop_album(graph, handle);
+    return true;
+}
+
+bool library_graph_update_track(library_graph_t* graph, size_t index) {
+    if (!graph || index >= graph->tracks->count) {
+        LOG_ERROR("Couldn't update track in library graph; graph is NULL or index out of bounds.");
+        return false;
+    }
+
+    // nothing moves when the tags still point at the same album
+    track_handle_t track = track_list_handle_at(graph->tracks, index);
+    if (track.slot < graph->album_of_capacity) {
+        album_handle_t handle = graph->album_of[track.slot];
+        if (album_list_resolve(graph->albums, handle) && graph->info[handle.slot].key == album_key(graph->tracks, index)) {
+            return true;
+        }
+    }
+    return library_graph_remove_track(graph, index) && library_graph_add_tracks(graph, index, 1);
+}
+
+const album_list_t* library_graph_albums(const library_graph_t* graph) {
+    if (!graph) {
+        LOG_ERROR("Couldn't get albums; graph is NULL.");
+        return NULL;
+    }
+    return graph->albums;
+}
+
+const artist_list_t* library_graph_artists(const library_graph_t* graph) {
+    if (!graph) {
+        LOG_ERROR("Couldn't get artists; graph is NULL.");
+        return NULL;
+    }
+    return graph->artists;
+}
+
+const genre_list_t* library_graph_genres(const library_graph_t* graph) {
+    if (!graph) {
+        LOG_ERROR("Couldn't get genres; graph is NULL.");
+        return NULL;
+    }
+    return graph->genres;
+}
+
+album_handle_t library_graph_album_of(const library_graph_t* graph, track_handle_t track) {
+    if (!graph) {
+        LOG_ERROR("Couldn't get album of track; graph is NULL.");
+        return HANDLE_NULL;
+    }
+    if (track.slot >= graph->album_of_capacity) return HANDLE_NULL;
+
+    // the slot may have been reused by another track since
+    album_handle_t handle = graph->album_of[track.slot];
+    if (handle_is_null(handle) || track_list_resolve(graph->tracks, track) == NULL) return HANDLE_NULL;
+    return handle;
+}
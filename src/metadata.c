@@ -0,0 +1,462 @@
+#define _GNU_SOURCE
+#include "metadata.h"
+#include "duration_probe.h"
+#include "logger.h"
+#include "string_pool.h"
+#include <tag_c.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <errno.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define METADATA_MAX_THREADS 32
+#define METADATA_DEFAULT_THREADS 4
+
+// a file waiting to be read
+typedef struct metadata_job {
+    char* path;
+    size_t index;
+    size_t generation;
+    int64_t known_mtime_sec; // file identity the track's tags came from, 0 if none
+    int64_t known_mtime_nsec;
+    uint64_t known_size;
+} metadata_job_t;
+
+struct metadata_pool {
+    pthread_t threads[METADATA_MAX_THREADS];
+    size_t thread_count;
+
+    // bounded ring of queued files, guarded by lock
+    pthread_mutex_t lock;
+    pthread_cond_t has_work;
+    metadata_job_t* jobs;
+    size_t job_capacity;
+    size_t job_head;
+    size_t job_count;
+    size_t busy; // files being read right now
+    bool stopping;
+
+    // finished records, polled with trylock so the render loop never waits
+    pthread_mutex_t done_lock;
+    metadata_record_t* done;
+    size_t done_count;
+    size_t done_capacity;
+    atomic_size_t generation; // bumped by clear, older results are dropped
+
+    // counters, guarded by lock
+    size_t submitted;
+    size_t completed;
+    size_t failed;
+    size_t unchanged;
+    double busy_since; // start of the current stretch of work
+    double elapsed; // finished stretches of work
+    size_t stretch_completed; // completed count when the stretch started
+};
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static pthread_once_t taglib_once = PTHREAD_ONCE_INIT;
+
+// taglib's settings are global, so they're set once before any file is read
+static void taglib_setup() {
+    taglib_set_strings_unicode(true);
+    taglib_set_string_management_enabled(false);
+}
+
+// takes ownership of a taglib string, empty tags become NULL
+static char* take_string(char* tag) {
+    if (!tag) return NULL;
+
+    char* copy = tag[0] != '\0' ? strdup(tag) : NULL;
+    taglib_free(tag);
+    return copy;
+}
+
+// single files
+// ------------
+
+metadata_options_t metadata_default_options() {
+    metadata_options_t options = {0};
+    options.thread_count = 0;
+    options.queue_capacity = 1024;
+    return options;
+}
+
+bool metadata_read(const char* path, metadata_record_t* out) {
+    if (!path || !out) {
+        LOG_ERROR("Couldn't read metadata; path or record is NULL.");
+        return false;
+    }
+    memset(out, 0, sizeof(*out));
+    pthread_once(&taglib_once, taglib_setup);
+
+    struct stat file_stat;
+    if (stat(path, &file_stat) != 0) return false;
+    out->file_mtime_sec = (int64_t)file_stat.st_mtim.tv_sec;
+    out->file_mtime_nsec = (int64_t)file_stat.st_mtim.tv_nsec;
+    out->file_size = (uint64_t)file_stat.st_size;
+
+    // container headers give the length to the sample, taglib only truncated to the second
+    // files taglib can't read still get their length from them
+    duration_probe_t probe;
+    bool probed = duration_probe_file(path, &probe);
+    if (probed) out->duration = duration_probe_seconds(&probe);
+
+    TagLib_File* file = taglib_file_new(path);
+    if (!file) return probed;
+    if (!taglib_file_is_valid(file)) {
+        taglib_file_free(file);
+        return probed;
+    }
+
+    TagLib_Tag* tag = taglib_file_tag(file);
+    if (tag) {
+        out->title = take_string(taglib_tag_title(tag));
+        out->artist = take_string(taglib_tag_artist(tag));
+        out->album = take_string(taglib_tag_album(tag));
+        out->genre = take_string(taglib_tag_genre(tag));
+        out->year = (int)taglib_tag_year(tag);
+        out->track_number = (int)taglib_tag_track(tag);
+    }
+
+    const TagLib_AudioProperties* properties = taglib_file_audioproperties(file);
+    if (!probed && properties) out->duration = taglib_audioproperties_length(properties);
+
+    taglib_file_free(file);
+    return true;
+}
+
+void metadata_record_free(metadata_record_t* record) {
+    if (!record) return;
+
+    free(record->path);
+    free(record->title);
+    free(record->artist);
+    free(record->album);
+    free(record->genre);
+    memset(record, 0, sizeof(*record));
+}
+
+static void replace_interned(const char** field, char** value) {
+    if (!*value) return;
+    const char* shared = string_pool_intern(*value);
+    if (shared) *field = shared;
+    free(*value);
+    *value = NULL;
+}
+
+track_t* metadata_apply(track_list_t* list, metadata_record_t* record) {
+    if (!list || !record || !record->path) {
+        LOG_ERROR("Couldn't apply metadata; list or record is NULL.");
+        return NULL;
+    }
+
+    // the index is right unless tracks were removed in the meantime
+    track_t* track = NULL;
+    if (record->index < list->count && strcmp(list->items[record->index].path, record->path) == 0) {
+        track = &list->items[record->index];
+    } else {
+        track = track_list_find_by_path(list, record->path);
+    }
+    if (!track) return NULL;
+
+    if (record->title) track_list_set_title(list, track, record->title);
+    replace_interned(&track->artist, &record->artist);
+    replace_interned(&track->album, &record->album);
+    replace_interned(&track->genre, &record->genre);
+    if (record->duration > 0) track->duration = record->duration;
+    if (record->year > 0) track->year = record->year;
+    if (record->track_number > 0) track->track_number = record->track_number;
+    track->file_mtime_sec = record->file_mtime_sec;
+    track->file_mtime_nsec = record->file_mtime_nsec;
+    track->file_size = record->file_size;
+    track_list_refresh(list, track);
+    return track;
+}
+
+// pool
+// ----
+
+static void push_record(metadata_pool_t* pool, metadata_record_t* record, size_t generation) {
+    pthread_mutex_lock(&pool->done_lock);
+
+    if (generation != atomic_load(&pool->generation)) {
+        pthread_mutex_unlock(&pool->done_lock);
+        metadata_record_free(record);
+        return;
+    }
+
+    if (pool->done_count >= pool->done_capacity) {
+        size_t new_capacity = pool->done_capacity == 0 ? 64 : pool->done_capacity * 2;
+        metadata_record_t* tmp = realloc(pool->done, new_capacity * sizeof(metadata_record_t));
+        if (!tmp) {
+            pthread_mutex_unlock(&pool->done_lock);
+            LOG_ERROR("Memory allocation failed; dropping metadata: %s", record->path);
+            metadata_record_free(record);
+            return;
+        }
+        pool->done = tmp;
+        pool->done_capacity = new_capacity;
+    }
+    pool->done[pool->done_count++] = *record;
+
+    pthread_mutex_unlock(&pool->done_lock);
+}
+
+static void* metadata_worker(void* arg) {
+    metadata_pool_t* pool = arg;
+
+    for (;;) {
+        pthread_mutex_lock(&pool->lock);
+        while (!pool->stopping && pool->job_count == 0) {
+            pthread_cond_wait(&pool->has_work, &pool->lock);
+        }
+        if (pool->stopping) {
+            pthread_mutex_unlock(&pool->lock);
+            return NULL;
+        }
+
+        metadata_job_t job = pool->jobs[pool->job_head];
+        pool->job_head = (pool->job_head + 1) % pool->job_capacity;
+        pool->job_count--;
+        pool->busy++;
+        pthread_mutex_unlock(&pool->lock);
+
+        // tags that were read from this exact file before don't need taglib
+        // nanoseconds too, a tag editor can rewrite a file within the same second
+        struct stat file_stat;
+        bool unchanged = job.known_mtime_sec != 0 && stat(job.path, &file_stat) == 0 &&
+                         (int64_t)file_stat.st_mtim.tv_sec == job.known_mtime_sec &&
+                         (int64_t)file_stat.st_mtim.tv_nsec == job.known_mtime_nsec &&
+                         (uint64_t)file_stat.st_size == job.known_size;
+
+        metadata_record_t record;
+        bool success = unchanged || metadata_read(job.path, &record);
+        if (success && !unchanged) {
+            record.path = job.path;
+            record.index = job.index;
+            push_record(pool, &record, job.generation);
+        } else {
+            free(job.path);
+        }
+
+        pthread_mutex_lock(&pool->lock);
+        pool->busy--;
+        if (unchanged) pool->unchanged++;
+        else if (success) pool->completed++;
+        else pool->failed++;
+
+        // the queue just ran dry, report how fast this stretch went
+        if (pool->busy == 0 && pool->job_count == 0) {
+            double seconds = now_seconds() - pool->busy_since;
+            size_t count = pool->completed - pool->stretch_completed;
+            pool->elapsed += seconds;
+            LOG_INFO("Read tags of %zu tracks in %.3fs (%.1f tracks/s, %zu threads, %zu unchanged, %zu failed).",
+                     count, seconds, seconds > 0.0 ? count / seconds : 0.0,
+                     pool->thread_count, pool->unchanged, pool->failed);
+        }
+        pthread_mutex_unlock(&pool->lock);
+    }
+}
+
+metadata_pool_t* metadata_pool_create(const metadata_options_t* options) {
+    metadata_options_t opts = options ? *options : metadata_default_options();
+
+    metadata_pool_t* pool = calloc(1, sizeof(metadata_pool_t));
+    if (!pool) {
+        LOG_ERROR("Memory allocation failed; couldn't create metadata pool.");
+        return NULL;
+    }
+
+    pool->job_capacity = opts.queue_capacity > 0 ? opts.queue_capacity : 1024;
+    pool->jobs = malloc(pool->job_capacity * sizeof(metadata_job_t));
+    if (!pool->jobs) {
+        LOG_ERROR("Memory allocation failed; couldn't create metadata pool.");
+        free(pool);
+        return NULL;
+    }
+    pthread_mutex_init(&pool->lock, NULL);
+    pthread_cond_init(&pool->has_work, NULL);
+    pthread_mutex_init(&pool->done_lock, NULL);
+    atomic_init(&pool->generation, 0);
+
+    size_t thread_count = opts.thread_count > 0 ? opts.thread_count : METADATA_DEFAULT_THREADS;
+    if (thread_count > METADATA_MAX_THREADS) thread_count = METADATA_MAX_THREADS;
+
+    pthread_once(&taglib_once, taglib_setup);
+    for (size_t i = 0; i < thread_count; i++) {
+        if (pthread_create(&pool->threads[i], NULL, metadata_worker, pool) != 0) {
+            LOG_WARN("Couldn't start metadata thread %zu.", i);
+            break;
+        }
+        pool->thread_count++;
+    }
+
+    if (pool->thread_count == 0) {
+        LOG_ERROR("Couldn't create metadata pool; no threads started.");
+        metadata_pool_free(pool);
+        return NULL;
+    }
+
+    LOG_INFO("Metadata pool started with %zu threads.", pool->thread_count);
+    return pool;
+}
+
+size_t metadata_pool_submit(metadata_pool_t* pool, const track_list_t* list, size_t first, size_t count) {
+    if (!pool || !list) {
+        LOG_ERROR("Couldn't submit tracks; pool or list is NULL.");
+        return 0;
+    }
+    if (first >= list->count) return 0;
+    if (count > list->count - first) count = list->count - first;
+
+    size_t generation = atomic_load(&pool->generation);
+    size_t queued = 0;
+
+    pthread_mutex_lock(&pool->lock);
+    if (pool->busy == 0 && pool->job_count == 0 && count > 0) {
+        pool->busy_since = now_seconds();
+        pool->stretch_completed = pool->completed;
+    }
+
+    while (queued < count && pool->job_count < pool->job_capacity) {
+        char* path = strdup(list->items[first + queued].path);
+        if (!path) {
+            LOG_ERROR("Memory allocation failed; couldn't submit track.");
+            break;
+        }
+
+        const track_t* track = &list->items[first + queued];
+        size_t tail = (pool->job_head + pool->job_count) % pool->job_capacity;
+        pool->jobs[tail] = (metadata_job_t){
+            path, first + queued, generation, track->file_mtime_sec, track->file_mtime_nsec, track->file_size
+        };
+        pool->job_count++;
+        queued++;
+    }
+    pool->submitted += queued;
+
+    if (queued > 0) pthread_cond_broadcast(&pool->has_work);
+    pthread_mutex_unlock(&pool->lock);
+    return queued;
+}
+
+size_t metadata_pool_poll(metadata_pool_t* pool, metadata_record_t* out, size_t max) {
+    if (!pool || !out) {
+        LOG_ERROR("Couldn't poll metadata pool; pool or output is NULL.");
+        return 0;
+    }
+
+    // a worker is pushing right now, the records will still be there next frame
+    if (pthread_mutex_trylock(&pool->done_lock) != 0) return 0;
+
+    size_t count = pool->done_count < max ? pool->done_count : max;
+    memcpy(out, pool->done, count * sizeof(metadata_record_t));
+    memmove(pool->done, pool->done + count, (pool->done_count - count) * sizeof(metadata_record_t));
+    pool->done_count -= count;
+
+    pthread_mutex_unlock(&pool->done_lock);
+    return count;
+}
+
+void metadata_pool_clear(metadata_pool_t* pool) {
+    if (!pool) {
+        LOG_ERROR("Couldn't clear metadata pool; pool is NULL.");
+        return;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    for (size_t i = 0; i < pool->job_count; i++) {
+        free(pool->jobs[(pool->job_head + i) % pool->job_capacity].path);
+    }
+    pool->job_head = 0;
+    pool->job_count = 0;
+    pthread_mutex_unlock(&pool->lock);
+
+    // files being read now belong to the old generation and get dropped
+    pthread_mutex_lock(&pool->done_lock);
+    atomic_fetch_add(&pool->generation, 1);
+    for (size_t i = 0; i < pool->done_count; i++) {
+        metadata_record_free(&pool->done[i]);
+    }
+    pool->done_count = 0;
+    pthread_mutex_unlock(&pool->done_lock);
+}
+
+bool metadata_pool_is_idle(metadata_pool_t* pool) {
+    if (!pool) {
+        LOG_ERROR("Couldn't check metadata pool; pool is NULL.");
+        return true;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    bool idle = pool->job_count == 0 && pool->busy == 0;
+    pthread_mutex_unlock(&pool->lock);
+    if (!idle) return false;
+
+    pthread_mutex_lock(&pool->done_lock);
+    idle = pool->done_count == 0;
+    pthread_mutex_unlock(&pool->done_lock);
+    return idle;
+}
+
+metadata_stats_t metadata_pool_get_stats(metadata_pool_t* pool) {
+    metadata_stats_t stats = {0};
+    if (!pool) {
+        LOG_ERROR("Couldn't get metadata stats; pool is NULL.");
+        return stats;
+    }
+
+    pthread_mutex_lock(&pool->lock);
+    stats.submitted = pool->submitted;
+    stats.completed = pool->completed;
+    stats.failed = pool->failed;
+    stats.unchanged = pool->unchanged;
+    stats.threads = pool->thread_count;
+    stats.elapsed_seconds = pool->elapsed;
+    if (pool->busy > 0 || pool->job_count > 0) {
+        stats.elapsed_seconds += now_seconds() - pool->busy_since;
+    }
+    pthread_mutex_unlock(&pool->lock);
+
+    if (stats.elapsed_seconds > 0.0) {
+        stats.tracks_per_second = stats.completed / stats.elapsed_seconds;
+    }
+    return stats;
+}
+
+void metadata_pool_free(metadata_pool_t* pool) {
+    if (!pool) {
+        LOG_ERROR("Couldn't free metadata pool; pool is NULL.");
+        return;
+    }
+
+    metadata_pool_clear(pool);
+
+    pthread_mutex_lock(&pool->lock);
+    pool->stopping = true;
+    pthread_cond_broadcast(&pool->has_work);
+    pthread_mutex_unlock(&pool->lock);
+
+    for (size_t i = 0; i < pool->thread_count; i++) {
+        pthread_join(pool->threads[i], NULL);
+    }
+
+    // workers may have finished a file after the clear above
+    for (size_t i = 0; i < pool->done_count; i++) {
+        metadata_record_free(&pool->done[i]);
+    }
+    free(pool->done);
+    free(pool->jobs);
+    pthread_mutex_destroy(&pool->lock);
+    pthread_cond_destroy(&pool->has_work);
+    pthread_mutex_destroy(&pool->done_lock);
+    free(pool);
+}
@@ -0,0 +1,458 @@
+#define _GNU_SOURCE
+#include "offline_render.h"
+#include "audio_device.h"
+#include "flac_writer.h"
+#include "logger.h"
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <time.h>
+#include <unistd.h>
+
+#define RENDER_MAX_THREADS 64
+// frames a worker renders at a time
+#define RENDER_PERIOD_FRAMES 4096
+// frames the stitcher writes at a time at least
+#define RENDER_CHUNK_FRAMES 65536
+// tracks rendered past the one being stitched per thread, bounds what waits in the spools
+#define RENDER_AHEAD_PER_THREAD 2
+
+// frames of one rendered track on their way to the stitcher, in an unlinked temporary file
+// the stitcher reads them while the worker is still adding to it
+typedef struct render_spool {
+    FILE* file;
+    uint64_t frames; // written so far
+    bool done;
+    bool failed; // the track couldn't be opened
+} render_spool_t;
+
+typedef struct render_job {
+    const playlist_t* list;
+    size_t first;
+    size_t count;
+    uint32_t channels;
+    render_spool_t* spools;
+
+    pthread_mutex_t lock;
+    pthread_cond_t changed; // a spool grew or is done, or the stitcher moved on
+    size_t next; // track the next free worker takes
+    size_t stitched; // tracks the stitcher is done with
+    size_t ahead; // tracks taken past stitched at most
+    bool cancelled; // writing failed, workers stop
+    double render_seconds;
+} render_job_t;
+
+// a thread with a device of its own, it renders whole tracks one after another
+typedef struct render_worker {
+    render_job_t* job;
+    audio_device_t dev;
+    float* buffer;
+    pthread_t thread;
+    bool started;
+} render_worker_t;
+
+// the file being written, frames are converted to 16 bits the way miniaudio does for a device
+typedef struct render_sink {
+    offline_render_format_t format;
+    ma_encoder encoder;
+    flac_writer_t* flac;
+    int16_t* pcm;
+    uint32_t channels;
+    uint64_t frames;
+} render_sink_t;
+
+static double now_seconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+offline_render_options_t offline_render_default_options(void) {
+    return (offline_render_options_t){ .format = OFFLINE_RENDER_WAV, .volume = 1.0f, .map_files = true };
+}
+
+offline_render_format_t offline_render_format_for_path(const char* path) {
+    const char* dot = path ? strrchr(path, '.') : NULL;
+    return dot && strcasecmp(dot, ".flac") == 0 ? OFFLINE_RENDER_FLAC : OFFLINE_RENDER_WAV;
+}
+
+// rendering
+// ---------
+
+static bool spool_append(render_job_t* job, render_spool_t* spool, const float* frames, size_t count) {
+    size_t samples = count * job->channels;
+    // flushed, so the stitcher can read the frames from the file right away
+    bool written = fwrite(frames, sizeof(float), samples, spool->file) == samples && fflush(spool->file) == 0;
+
+    pthread_mutex_lock(&job->lock);
+    if (written) spool->frames += count;
+    else job->cancelled = true;
+    bool cancelled = job->cancelled;
+    pthread_cond_broadcast(&job->changed);
+    pthread_mutex_unlock(&job->lock);
+
+    if (!written) LOG_ERROR("Couldn't write rendered frames to a temporary file.");
+    return !cancelled;
+}
+
+// plays one track to its end on the worker's device, returns false if it couldn't be opened
+static bool render_track(render_worker_t* worker, const char* path, render_spool_t* spool) {
+    render_job_t* job = worker->job;
+    audio_device_t* dev = &worker->dev;
+    if (!audio_device_play_file(dev, path)) return false;
+
+    while (true) {
+        size_t rendered = audio_device_render(dev, worker->buffer, RENDER_PERIOD_FRAMES);
+        if (rendered > 0 && !spool_append(job, spool, worker->buffer, rendered)) return true;
+
+        // a file that fails to open plays silence, the stitcher leaves out what was spooled
+        audio_device_poll_transition(dev);
+        if (!dev->sound_loaded) return false;
+        if (rendered == RENDER_PERIOD_FRAMES) continue;
+
+        // renders only come up short once the track ended or nothing is coming at all
+        if (audio_device_is_finished(dev)) return true;
+        if (rendered == 0) {
+            LOG_ERROR("Couldn't render track; playback stopped before its end: %s", path);
+            return false;
+        }
+    }
+}
+
+static void* render_worker_run(void* arg) {
+    render_worker_t* worker = arg;
+    render_job_t* job = worker->job;
+
+    pthread_mutex_lock(&job->lock);
+    while (true) {
+        while (!job->cancelled && job->next < job->count && job->next >= job->stitched + job->ahead) {
+            pthread_cond_wait(&job->changed, &job->lock);
+        }
+        if (job->cancelled || job->next >= job->count) break;
+        size_t index = job->next++;
+        render_spool_t* spool = &job->spools[index];
+        pthread_mutex_unlock(&job->lock);
+
+        // spooled through a temporary file, a long track doesn't have to fit in memory
+        // it's created once the track is taken, so only the tracks in flight hold one open
+        // the stitcher only touches it after this thread took the lock to add frames or finish
+        spool->file = tmpfile();
+        if (!spool->file) LOG_ERROR("Couldn't create a temporary file to render into.");
+
+        double start = now_seconds();
+        const char* path = job->list->tracks->items[job->first + index];
+        bool played = spool->file && render_track(worker, path, spool);
+        double seconds = now_seconds() - start;
+
+        pthread_mutex_lock(&job->lock);
+        if (!spool->file) job->cancelled = true;
+        spool->done = true;
+        spool->failed = !played;
+        job->render_seconds += seconds;
+        pthread_cond_broadcast(&job->changed);
+    }
+    pthread_mutex_unlock(&job->lock);
+    return NULL;
+}
+
+// stitching
+// ---------
+
+static bool sink_open(render_sink_t* sink, const char* path, offline_render_format_t format, uint32_t sample_rate, uint32_t channels) {
+    sink->format = format;
+    sink->channels = channels;
+    sink->pcm = malloc((size_t)RENDER_CHUNK_FRAMES * channels * sizeof(int16_t));
+    if (!sink->pcm) {
+        LOG_ERROR("Memory allocation failed; couldn't render.");
+        return false;
+    }
+
+    if (format == OFFLINE_RENDER_FLAC) {
+        sink->flac = flac_writer_open(path, sample_rate, channels);
+        if (sink->flac) return true;
+    } else {
+        ma_encoder_config config = ma_encoder_config_init(ma_encoding_format_wav, ma_format_s16, channels, sample_rate);
+        ma_result result = ma_encoder_init_file(path, &config, &sink->encoder);
+        if (result == MA_SUCCESS) return true;
+        LOG_ERROR("Couldn't create wav file %s; %s", path, ma_result_description(result));
+    }
+    free(sink->pcm);
+    sink->pcm = NULL;
+    return false;
+}
+
+// converted RENDER_CHUNK_FRAMES at a time, crossfades and the last tail hold a whole fade
+static bool sink_write(render_sink_t* sink, const float* frames, size_t count) {
+    while (count > 0) {
+        size_t part = count < RENDER_CHUNK_FRAMES ? count : RENDER_CHUNK_FRAMES;
+        ma_pcm_f32_to_s16(sink->pcm, frames, part * sink->channels, ma_dither_mode_none);
+        sink->frames += part;
+
+        if (sink->format == OFFLINE_RENDER_FLAC) {
+            if (!flac_writer_write(sink->flac, sink->pcm, part)) return false;
+        } else {
+            ma_uint64 written = 0;
+            ma_result result = ma_encoder_write_pcm_frames(&sink->encoder, sink->pcm, part, &written);
+            if (result != MA_SUCCESS || written != part) return false;
+        }
+        frames += part * sink->channels;
+        count -= part;
+    }
+    return true;
+}
+
+static bool sink_close(render_sink_t* sink) {
+    bool success = true;
+    if (sink->format == OFFLINE_RENDER_FLAC) success = flac_writer_close(sink->flac);
+    else ma_encoder_uninit(&sink->encoder);
+    free(sink->pcm);
+    return success;
+}
+
+// waits until a spool holds wanted frames past offset or is done, returns how many it holds up to wanted
+static uint64_t spool_wait(render_job_t* job, render_spool_t* spool, uint64_t offset, uint64_t wanted) {
+    pthread_mutex_lock(&job->lock);
+    while (!spool->done && !job->cancelled && spool->frames < offset + wanted) {
+        pthread_cond_wait(&job->changed, &job->lock);
+    }
+    uint64_t available = spool->frames > offset ? spool->frames - offset : 0;
+    pthread_mutex_unlock(&job->lock);
+    return available < wanted ? available : wanted;
+}
+
+static bool spool_read(render_job_t* job, render_spool_t* spool, uint64_t offset, float* out, uint64_t count) {
+    size_t frame_bytes = job->channels * sizeof(float);
+    uint8_t* bytes = (uint8_t*)out;
+    size_t left = (size_t)count * frame_bytes;
+    off_t position = (off_t)(offset * frame_bytes);
+    while (left > 0) {
+        ssize_t got = pread(fileno(spool->file), bytes, left, position);
+        if (got <= 0) return false;
+        bytes += got;
+        left -= (size_t)got;
+        position += got;
+    }
+    return true;
+}
+
+static bool spool_is_done(render_job_t* job, render_spool_t* spool, uint64_t offset) {
+    pthread_mutex_lock(&job->lock);
+    bool done = spool->done && spool->frames <= offset;
+    pthread_mutex_unlock(&job->lock);
+    return done;
+}
+
+// closes a spool once its worker is done writing it and lets the workers take more tracks
+// cancel stops them first, so a failed stitch doesn't wait for the whole track
+// returns false once the job is cancelled
+static bool spool_release(render_job_t* job, size_t index, bool cancel) {
+    render_spool_t* spool = &job->spools[index];
+    pthread_mutex_lock(&job->lock);
+    if (cancel) job->cancelled = true;
+    pthread_cond_broadcast(&job->changed);
+    // a track no worker took has no file, and none takes it once the job is cancelled
+    while (index < job->next && !spool->done) pthread_cond_wait(&job->changed, &job->lock);
+    FILE* file = spool->file;
+    spool->file = NULL;
+    job->stitched = index + 1;
+    bool cancelled = job->cancelled;
+    pthread_cond_broadcast(&job->changed);
+    pthread_mutex_unlock(&job->lock);
+
+    if (file) fclose(file);
+    return !cancelled;
+}
+
+// writes the spools to the sink in order as they fill, the last fade frames of every track
+// are held back until the next track's start is there to mix them with
+static bool stitch(render_job_t* job, render_sink_t* sink, uint64_t fade, offline_render_stats_t* stats) {
+    uint32_t channels = job->channels;
+    uint64_t chunk = RENDER_CHUNK_FRAMES;
+    float* hold = malloc((size_t)(fade + chunk) * channels * sizeof(float));
+    float* incoming = fade > 0 ? malloc((size_t)fade * channels * sizeof(float)) : NULL;
+    if (!hold || (fade > 0 && !incoming)) {
+        LOG_ERROR("Memory allocation failed; couldn't render.");
+        free(hold);
+        free(incoming);
+        return false;
+    }
+
+    bool success = true;
+    uint64_t held = 0;
+    for (size_t i = 0; success && i < job->count; i++) {
+        render_spool_t* spool = &job->spools[i];
+        uint64_t offset = 0;
+        spool_wait(job, spool, 0, 1);
+
+        pthread_mutex_lock(&job->lock);
+        bool failed = spool->done && spool->failed;
+        success = !job->cancelled;
+        pthread_mutex_unlock(&job->lock);
+
+        if (success && !failed && held > 0) {
+            uint64_t count = spool_wait(job, spool, 0, held);
+            if (count > 0) {
+                success = spool_read(job, spool, 0, incoming, count);
+                // the fade lasts the tail or the track if it's shorter, like the chain cuts it off then
+                audio_device_mix_crossfade(incoming, hold, count, count, 0, count, channels);
+                success = success && sink_write(sink, incoming, count);
+                offset = count;
+                held = 0;
+            }
+        }
+
+        while (success && !failed && !spool_is_done(job, spool, offset)) {
+            uint64_t count = spool_wait(job, spool, offset, chunk);
+            // nothing new without the track being done only happens once a worker cancelled
+            if (count == 0) {
+                success = false;
+                break;
+            }
+            success = spool_read(job, spool, offset, hold + held * channels, count);
+            offset += count;
+            held += count;
+            if (success && held > fade) {
+                success = sink_write(sink, hold, held - fade);
+                memmove(hold, hold + (held - fade) * channels, (size_t)fade * channels * sizeof(float));
+                held = fade;
+            }
+        }
+
+        if (failed) stats->failed++;
+        else if (success) stats->tracks++;
+        success = spool_release(job, i, !success) && success;
+    }
+    // nothing follows the last track, its tail plays out on its own
+    if (success) success = sink_write(sink, hold, held);
+
+    free(hold);
+    free(incoming);
+    return success;
+}
+
+// public
+// ------
+
+bool offline_render_playlist(const playlist_t* list, size_t first, size_t count, const char* path,
+                             const offline_render_options_t* options, offline_render_stats_t* stats) {
+    if (!list || !list->tracks || !path) {
+        LOG_ERROR("Couldn't render playlist; list or path is NULL.");
+        return false;
+    }
+    if (count == 0 || first >= list->tracks->count || count > list->tracks->count - first) {
+        LOG_ERROR("Couldn't render playlist; tracks %zu to %zu aren't in it.", first, first + count);
+        return false;
+    }
+    offline_render_options_t defaults = offline_render_default_options();
+    if (!options) options = &defaults;
+    offline_render_stats_t ignored;
+    if (!stats) stats = &ignored;
+    memset(stats, 0, sizeof(*stats));
+
+    size_t thread_count = options->thread_count;
+    if (thread_count == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cpus > 0 ? (size_t)cpus : 1;
+    }
+    if (thread_count > RENDER_MAX_THREADS) thread_count = RENDER_MAX_THREADS;
+    if (thread_count > count) thread_count = count;
+
+    double start = now_seconds();
+    render_job_t job = {
+        .list = list,
+        .first = first,
+        .count = count,
+        .ahead = thread_count * RENDER_AHEAD_PER_THREAD,
+    };
+    job.spools = calloc(count, sizeof(render_spool_t));
+    render_worker_t* workers = calloc(thread_count, sizeof(render_worker_t));
+    if (!job.spools || !workers) {
+        LOG_ERROR("Memory allocation failed; couldn't render playlist.");
+        free(job.spools);
+        free(workers);
+        return false;
+    }
+
+    // the devices have no output, they're only pulled by render calls
+    audio_device_options_t device_options = audio_device_default_options();
+    device_options.output = AUDIO_DEVICE_OUTPUT_NONE;
+    device_options.sample_rate = options->sample_rate;
+    device_options.volume = options->volume;
+    device_options.map_files = options->map_files;
+
+    bool success = true;
+    size_t ready = 0;
+    for (; success && ready < thread_count; ready++) {
+        render_worker_t* worker = &workers[ready];
+        worker->job = &job;
+        success = audio_device_init(&worker->dev, &device_options);
+        if (!success) break;
+        worker->buffer = malloc(RENDER_PERIOD_FRAMES * ma_engine_get_channels(&worker->dev.engine) * sizeof(float));
+        success = worker->buffer != NULL;
+        if (!success) LOG_ERROR("Memory allocation failed; couldn't render playlist.");
+    }
+    if (success) {
+        job.channels = ma_engine_get_channels(&workers[0].dev.engine);
+        stats->sample_rate = ma_engine_get_sample_rate(&workers[0].dev.engine);
+        stats->threads = thread_count;
+    }
+
+    render_sink_t sink = {0};
+    bool sink_ready = success &&
+        sink_open(&sink, path, options->format, stats->sample_rate, job.channels);
+    success = sink_ready;
+
+    if (success) {
+        pthread_mutex_init(&job.lock, NULL);
+        pthread_cond_init(&job.changed, NULL);
+        for (size_t i = 0; i < thread_count; i++) {
+            workers[i].started = pthread_create(&workers[i].thread, NULL, render_worker_run, &workers[i]) == 0;
+        }
+        // a worker that didn't start leaves its tracks to the others, none at all can't go on
+        bool any = false;
+        for (size_t i = 0; i < thread_count; i++) any = any || workers[i].started;
+        if (!any) {
+            LOG_ERROR("Couldn't start render threads.");
+            success = false;
+        }
+
+        float crossfade = options->crossfade > 0.0f ? options->crossfade : 0.0f;
+        uint64_t fade = (uint64_t)(crossfade * (float)stats->sample_rate);
+        if (success) success = stitch(&job, &sink, fade, stats);
+
+        pthread_mutex_lock(&job.lock);
+        if (!success) job.cancelled = true;
+        pthread_cond_broadcast(&job.changed);
+        pthread_mutex_unlock(&job.lock);
+        for (size_t i = 0; i < thread_count; i++) {
+            if (workers[i].started) pthread_join(workers[i].thread, NULL);
+        }
+        pthread_cond_destroy(&job.changed);
+        pthread_mutex_destroy(&job.lock);
+    }
+
+    stats->frames = sink.frames;
+    if (sink_ready) success = sink_close(&sink) && success;
+
+    for (size_t i = 0; i < count; i++) {
+        if (job.spools[i].file) fclose(job.spools[i].file);
+    }
+    for (size_t i = 0; i < ready; i++) {
+        audio_device_free(&workers[i].dev);
+        free(workers[i].buffer);
+    }
+    free(workers);
+    free(job.spools);
+
+    stats->render_seconds = job.render_seconds;
+    stats->seconds = now_seconds() - start;
+    if (success) {
+        double audio = stats->sample_rate ? (double)stats->frames / stats->sample_rate : 0.0;
+        LOG_INFO("Rendered %zu tracks (%.1f s of audio) to %s in %.2f s, %.0fx real time on %zu threads.",
+                 stats->tracks, audio, path, stats->seconds,
+                 stats->seconds > 0.0 ? audio / stats->seconds : 0.0, stats->threads);
+    }
+    return success;
+}
@@ -1,30 +1,40 @@
 #include "playlist.h"
 #include "logger.h"
+#include "scanner.h"
 #include <stdlib.h>
 #include <string.h>
-#include <strings.h>
-#include <dirent.h>
-#include <sys/stat.h>
 #include <stdint.h>
 
-// helper to check if a file is an audio file
-bool is_audio_file(const char* path) {
-    const char* ext = strrchr(path, '.');
-    if (!ext) return false;
-
-    ext++; // to skip the dot
-    return (strcasecmp(ext, "mp3") == 0 ||
-            strcasecmp(ext, "flac") == 0 ||
-            strcasecmp(ext, "wav") == 0 ||
-            strcasecmp(ext, "ogg") == 0 ||
-            strcasecmp(ext, "m4a") == 0 ||
-            strcasecmp(ext, "opus") == 0 ||
-            strcasecmp(ext, "aac") == 0);
+static int compare_path_pointers(const void* a, const void* b) {
+    return playlist_compare_paths(*(const char* const*)a, *(const char* const*)b);
 }
 
-// helper for comparing strings for qsort
-int compare_strings(const void* a, const void* b) {
-    return strcmp(*(const char**)a, *(const char**)b);
+// copies the live paths into a fresh arena once removals left enough dead space
+static void compact_strings(tracks_t* tracks) {
+    if (!string_arena_wants_compaction(&tracks->strings)) return;
+    if (tracks->count == 0) {
+        string_arena_reset(&tracks->strings);
+        return;
+    }
+
+    string_arena_t fresh = {0};
+    char** items = malloc(tracks->count * sizeof(*items));
+    bool ok = items != NULL;
+    for (size_t i = 0; ok && i < tracks->count; i++) {
+        items[i] = string_arena_copy(&fresh, tracks->items[i]);
+        ok = items[i] != NULL;
+    }
+    if (!ok) {
+        // not fatal, the dead space just stays around a little longer
+        string_arena_free(&fresh);
+        free(items);
+        return;
+    }
+
+    memcpy(tracks->items, items, tracks->count * sizeof(*items));
+    string_arena_free(&tracks->strings);
+    tracks->strings = fresh;
+    free(items);
 }
 
 bool tracks_append(tracks_t* tracks, const char* path) {   
@@ -44,11 +54,8 @@ bool tracks_append(tracks_t* tracks, const char* path) {
         tracks->capacity = new_capacity;
     }
     
-    char* copy = strdup(path);
-    if (!copy) {
-        LOG_ERROR("Memory allocation failed; couldn't copy track path.");
-        return false;
-    }
+    char* copy = string_arena_copy(&tracks->strings, path);
+    if (!copy) return false;
     
     tracks->items[tracks->count++] = copy;
     return true;
@@ -60,11 +67,12 @@ bool tracks_remove(tracks_t* tracks, size_t index) {
         return false;
     }
 
-    free(tracks->items[index]);
+    string_arena_release(&tracks->strings, tracks->items[index]);
     for (size_t i = index; i < tracks->count - 1; i++) {
         tracks->items[i] = tracks->items[i + 1];
     }
     tracks->count--;
+    compact_strings(tracks);
     return true;
 }
 
@@ -74,9 +82,7 @@ bool tracks_clear(tracks_t* tracks) {
         return false;
     }
 
-    for (size_t i = 0; i < tracks->count; i++) {
-        free(tracks->items[i]);
-    }
+    string_arena_reset(&tracks->strings);
     tracks->count = 0;
     return true;
 }
@@ -88,6 +94,7 @@ bool tracks_free(tracks_t* tracks) {
     }
 
     tracks_clear(tracks);
+    string_arena_free(&tracks->strings);
     free(tracks->items);
     tracks->items = NULL;
     tracks->capacity = 0;
@@ -110,6 +117,7 @@ bool playlist_init(playlist_t* list) {
     list->tracks->items = NULL;
     list->tracks->count = 0;
     list->tracks->capacity = 0;
+    list->tracks->strings = (string_arena_t){0};
     list->current = 0;
 
     LOG_INFO("Playlist initialized successfully.");
@@ -169,64 +177,117 @@ bool playlist_clear(playlist_t* list) {
 }
 
 void playlist_scan_dir_recursive(playlist_t* list, const char* dir_path) {
-    DIR* dir = opendir(dir_path);
-    if (!dir) {
-        LOG_ERROR("Failed to open directory: %s", dir_path);
+    if (!list || !list->tracks || !dir_path) {
+        LOG_ERROR("Couldn't scan directory; list, tracks or path is NULL.");
         return;
     }
 
-    // get all entries in the folder first
-    // so we can sort alphabetically (good enough for this)
-    char** entries = NULL;
-    size_t entry_count = 0;
-    size_t entry_capacity = 0;
+    scanner_options_t options = scanner_default_options();
+    scanner_result_t result;
+    if (!scanner_scan(dir_path, &options, &result)) return;
+
+    for (size_t i = 0; i < result.count; i++) {
+        if (!playlist_append(list, result.paths[i])) break;
+    }
+    scanner_result_free(&result);
+}
+
+bool playlist_merge_sorted(playlist_t* list, const char* paths[], size_t count) {
+    if (!list || !list->tracks || (!paths && count > 0)) {
+        LOG_ERROR("Couldn't merge tracks; list, tracks or paths is NULL.");
+        return false;
+    }
+    if (count == 0) return true;
+
+    const char** sorted = malloc(count * sizeof(*sorted));
+    char** items = malloc((list->tracks->count + count) * sizeof(*items));
+    if (!sorted || !items) {
+        LOG_ERROR("Memory allocation failed; couldn't merge tracks.");
+        free(sorted);
+        free(items);
+        return false;
+    }
+    memcpy(sorted, paths, count * sizeof(*sorted));
+    qsort(sorted, count, sizeof(*sorted), compare_path_pointers);
+
+    tracks_t* tracks = list->tracks;
+    size_t old_index = 0, new_index = 0, merged = 0;
+    size_t current = list->current;
+    bool success = true;
+
+    while (old_index < tracks->count || new_index < count) {
+        int cmp = old_index >= tracks->count ? 1
+                : new_index >= count ? -1
+                : playlist_compare_paths(tracks->items[old_index], sorted[new_index]);
+
+        if (cmp <= 0) {
+            if (old_index == list->current) current = merged;
+            items[merged++] = tracks->items[old_index++];
+            if (cmp == 0) new_index++; // already in the playlist
+            continue;
+        }
 
-    struct dirent* entry;
-    while ((entry = readdir(dir)) != NULL) {
-        // skip . and ..
-        if (strcmp(entry->d_name, ".") == 0 ||
-            strcmp(entry->d_name, "..") == 0) {
-            continue;        
+        // skip duplicates within the new paths as well
+        if (merged > 0 && strcmp(items[merged - 1], sorted[new_index]) == 0) {
+            new_index++;
+            continue;
         }
 
-        // grow array if it no longer fits
-        if (entry_count >= entry_capacity) {
-            size_t new_capacity = entry_capacity == 0 ? 16 : entry_capacity * 2;
-            char** tmp = realloc(entries, new_capacity * sizeof(char*));
-            if (!tmp) {
-                LOG_ERROR("Memory allocation failed");
-                break;
-            }
-            entries = tmp;
-            entry_capacity = new_capacity;
+        char* copy = string_arena_copy(&tracks->strings, sorted[new_index++]);
+        if (!copy) {
+            success = false;
+            continue;
         }
+        items[merged++] = copy;
+    }
+
+    free(sorted);
+    free(tracks->items);
+    tracks->items = items;
+    tracks->capacity = tracks->count + count;
+    tracks->count = merged;
+    list->current = current;
+    return success;
+}
+
+size_t playlist_remove_if(playlist_t* list, bool (*predicate)(const char* path, void* ctx), void* ctx) {
+    if (!list || !list->tracks || !predicate) {
+        LOG_ERROR("Couldn't remove tracks; list, tracks or predicate is NULL.");
+        return 0;
+    }
+
+    tracks_t* tracks = list->tracks;
+    size_t kept = 0;
+    size_t current = list->current;
+
+    for (size_t i = 0; i < tracks->count; i++) {
+        // a removed current track hands over to the one after it
+        if (i == list->current) current = kept;
 
-        entries[entry_count++] = strdup(entry->d_name);
-    }
-    closedir(dir);
-
-    // sort entries alphabetically
-    qsort(entries, entry_count, sizeof(char*), compare_strings);
-
-    for (size_t i = 0; i < entry_count; i++) {
-        // build the full path for the entry
-        char full_path[4096];
-        snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, entries[i]);
-
-        struct stat path_stat;
-        if (stat(full_path, &path_stat) == 0) {
-            if (S_ISDIR(path_stat.st_mode)) {
-                // recursively scan subdirectories
-                playlist_scan_dir_recursive(list, full_path);
-            } else if (S_ISREG(path_stat.st_mode)) {
-                // only add audio files using helper function
-                if (is_audio_file(full_path)) {
-                    playlist_append(list, full_path);
-                    LOG_INFO("Added: %s", full_path);
-                }
-            }
+        if (predicate(tracks->items[i], ctx)) {
+            string_arena_release(&tracks->strings, tracks->items[i]);
+            continue;
         }
+        tracks->items[kept++] = tracks->items[i];
+    }
+
+    size_t removed = tracks->count - kept;
+    tracks->count = kept;
+    list->current = current < kept ? current : (kept > 0 ? kept - 1 : 0);
+    compact_strings(tracks);
+    return removed;
+}
+
+int playlist_compare_paths(const char* a, const char* b) {
+    while (*a && *a == *b) {
+        a++;
+        b++;
     }
+
+    // a separator ends a name, so it sorts before any other character
+    int x = *a == '\0' ? 0 : (*a == '/' ? 1 : (unsigned char)*a + 1);
+    int y = *b == '\0' ? 0 : (*b == '/' ? 1 : (unsigned char)*b + 1);
+    return (x > y) - (x < y);
 }
 
 bool playlist_play_current(playlist_t* list, audio_device_t* dev) {
@@ -309,6 +370,19 @@ char* playlist_get_current_track_path(const playlist_t* list) {
     return list->tracks->items[list->current];
 }
 
+char* playlist_get_next_track_path(const playlist_t* list) {
+    if (!list || !list->tracks) {
+        LOG_ERROR("Couldn't get next track path; list or tracks is NULL.");
+        return NULL;
+    }
+    if (list->tracks->count == 0) {
+        LOG_ERROR("Couldn't get next track path; no tracks loaded in list.");
+        return NULL;
+    }
+
+    return list->tracks->items[playlist_has_next(list) ? list->current + 1 : 0];
+}
+
 bool playlist_set_current_track(playlist_t* list, size_t index) {
     if (!list || !list->tracks || index >= list->tracks->count) {
         LOG_ERROR("Couldn't set current track; list, tracks is NULL or index out of bounds.");
@@ -0,0 +1,356 @@
+#define _GNU_SOURCE
+#include "scan_cache.h"
+#include "cache_path.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// file layout (host byte order, it never leaves this machine):
+//   header: magic[8], u32 version, u32 reserved, u64 dir_count
+//   per directory: u64 ino, i64 mtime_sec, i64 mtime_nsec,
+//                  u32 rel_len, u32 entry_count, rel_path + '\0'
+//   per entry:     u8 is_dir, u32 name_len, name + '\0'
+#define SCAN_CACHE_MAGIC "SMPSCAN\0"
+#define SCAN_CACHE_VERSION 1
+
+struct scan_cache {
+    char* blob; // the whole file, strings point into it
+    scan_cache_dir_t* dirs;
+    size_t dir_count;
+    scan_cache_entry_t* entries;
+
+    // open addressing table of dir index + 1 keyed by rel_path, 0 is empty
+    uint32_t* slots;
+    size_t slot_count;
+};
+
+struct scan_cache_writer {
+    FILE* file;
+    char* path;
+    char* tmp_path;
+    uint64_t dir_count;
+    bool failed;
+};
+
+char* scan_cache_default_path(const char* dir_path) {
+    if (!dir_path) {
+        LOG_ERROR("Couldn't get scan cache path; directory path is NULL.");
+        return NULL;
+    }
+
+    return cache_path_build("scan", dir_path, ".bin");
+}
+
+// loading
+// -------
+
+typedef struct reader {
+    char* data;
+    size_t size;
+    size_t pos;
+} reader_t;
+
+static bool read_bytes(reader_t* r, void* out, size_t n) {
+    if (r->size - r->pos < n) return false;
+    memcpy(out, r->data + r->pos, n);
+    r->pos += n;
+    return true;
+}
+
+// returns a pointer to a NUL terminated string of len bytes inside the blob
+static const char* read_string(reader_t* r, uint32_t len) {
+    if (r->size - r->pos < (size_t)len + 1) return NULL;
+    const char* s = r->data + r->pos;
+    if (s[len] != '\0') return NULL;
+    r->pos += (size_t)len + 1;
+    return s;
+}
+
+// walks all directories once, either just counting or filling the cache
+static bool parse_dirs(reader_t* r, scan_cache_t* cache, size_t* total_entries) {
+    size_t entry_index = 0;
+
+    for (size_t i = 0; i < cache->dir_count; i++) {
+        uint64_t ino;
+        int64_t mtime_sec, mtime_nsec;
+        uint32_t rel_len, entry_count;
+        if (!read_bytes(r, &ino, sizeof(ino)) ||
+            !read_bytes(r, &mtime_sec, sizeof(mtime_sec)) ||
+            !read_bytes(r, &mtime_nsec, sizeof(mtime_nsec)) ||
+            !read_bytes(r, &rel_len, sizeof(rel_len)) ||
+            !read_bytes(r, &entry_count, sizeof(entry_count))) {
+            return false;
+        }
+
+        const char* rel_path = read_string(r, rel_len);
+        if (!rel_path) return false;
+
+        if (cache->dirs) {
+            scan_cache_dir_t* dir = &cache->dirs[i];
+            dir->rel_path = rel_path;
+            dir->ino = ino;
+            dir->mtime_sec = mtime_sec;
+            dir->mtime_nsec = mtime_nsec;
+            dir->entries = &cache->entries[entry_index];
+            dir->entry_count = entry_count;
+        }
+
+        for (uint32_t j = 0; j < entry_count; j++) {
+            uint8_t is_dir;
+            uint32_t name_len;
+            if (!read_bytes(r, &is_dir, sizeof(is_dir)) ||
+                !read_bytes(r, &name_len, sizeof(name_len))) {
+                return false;
+            }
+            const char* name = read_string(r, name_len);
+            if (!name) return false;
+
+            if (cache->entries) {
+                cache->entries[entry_index].name = name;
+                cache->entries[entry_index].is_dir = is_dir != 0;
+            }
+            entry_index++;
+        }
+    }
+
+    if (total_entries) *total_entries = entry_index;
+    return r->pos == r->size;
+}
+
+static bool build_index(scan_cache_t* cache) {
+    size_t slot_count = 16;
+    while (slot_count < cache->dir_count * 2) slot_count *= 2;
+
+    cache->slots = calloc(slot_count, sizeof(uint32_t));
+    if (!cache->slots) return false;
+    cache->slot_count = slot_count;
+
+    for (size_t i = 0; i < cache->dir_count; i++) {
+        size_t slot = cache_path_hash(cache->dirs[i].rel_path) & (slot_count - 1);
+        while (cache->slots[slot] != 0) slot = (slot + 1) & (slot_count - 1);
+        cache->slots[slot] = (uint32_t)(i + 1);
+    }
+    return true;
+}
+
+scan_cache_t* scan_cache_load(const char* cache_path) {
+    if (!cache_path) {
+        LOG_ERROR("Couldn't load scan cache; path is NULL.");
+        return NULL;
+    }
+
+    FILE* file = fopen(cache_path, "rb");
+    if (!file) return NULL; // no cache yet, nothing to report
+
+    scan_cache_t* cache = calloc(1, sizeof(scan_cache_t));
+    if (!cache) {
+        LOG_ERROR("Memory allocation failed; couldn't load scan cache.");
+        fclose(file);
+        return NULL;
+    }
+
+    struct stat file_stat;
+    reader_t r = {0};
+    if (fstat(fileno(file), &file_stat) == 0 && file_stat.st_size > 0) {
+        r.size = (size_t)file_stat.st_size;
+        r.data = malloc(r.size);
+    }
+    bool success = r.data && fread(r.data, 1, r.size, file) == r.size;
+    fclose(file);
+    cache->blob = r.data;
+
+    char magic[8];
+    uint32_t version, reserved;
+    uint64_t dir_count;
+    success = success &&
+        read_bytes(&r, magic, sizeof(magic)) &&
+        memcmp(magic, SCAN_CACHE_MAGIC, sizeof(magic)) == 0 &&
+        read_bytes(&r, &version, sizeof(version)) &&
+        version == SCAN_CACHE_VERSION &&
+        read_bytes(&r, &reserved, sizeof(reserved)) &&
+        read_bytes(&r, &dir_count, sizeof(dir_count)) &&
+        dir_count < UINT32_MAX;
+
+    // count first so the entry array can be allocated in one go
+    size_t header_end = r.pos;
+    size_t total_entries = 0;
+    if (success) {
+        cache->dir_count = (size_t)dir_count;
+        success = parse_dirs(&r, cache, &total_entries);
+    }
+    if (success) {
+        cache->dirs = calloc(cache->dir_count ? cache->dir_count : 1, sizeof(scan_cache_dir_t));
+        cache->entries = calloc(total_entries ? total_entries : 1, sizeof(scan_cache_entry_t));
+        r.pos = header_end;
+        success = cache->dirs && cache->entries &&
+                  parse_dirs(&r, cache, NULL) &&
+                  build_index(cache);
+    }
+
+    if (!success) {
+        LOG_WARN("Ignoring invalid scan cache: %s", cache_path);
+        scan_cache_free(cache);
+        return NULL;
+    }
+
+    LOG_INFO("Scan cache loaded: %zu directories, %zu entries.", cache->dir_count, total_entries);
+    return cache;
+}
+
+void scan_cache_free(scan_cache_t* cache) {
+    if (!cache) return;
+
+    free(cache->blob);
+    free(cache->dirs);
+    free(cache->entries);
+    free(cache->slots);
+    free(cache);
+}
+
+const scan_cache_dir_t* scan_cache_find(const scan_cache_t* cache, const char* rel_path) {
+    if (!cache || !rel_path || cache->slot_count == 0) return NULL;
+
+    size_t slot = cache_path_hash(rel_path) & (cache->slot_count - 1);
+    while (cache->slots[slot] != 0) {
+        const scan_cache_dir_t* dir = &cache->dirs[cache->slots[slot] - 1];
+        if (strcmp(dir->rel_path, rel_path) == 0) return dir;
+        slot = (slot + 1) & (cache->slot_count - 1);
+    }
+    return NULL;
+}
+
+size_t scan_cache_dir_count(const scan_cache_t* cache) {
+    return cache ? cache->dir_count : 0;
+}
+
+const scan_cache_dir_t* scan_cache_get(const scan_cache_t* cache, size_t index) {
+    if (!cache || index >= cache->dir_count) return NULL;
+    return &cache->dirs[index];
+}
+
+// writing
+// -------
+
+static void write_bytes(scan_cache_writer_t* writer, const void* data, size_t n) {
+    if (writer->failed) return;
+    if (fwrite(data, 1, n, writer->file) != n) writer->failed = true;
+}
+
+static void write_string(scan_cache_writer_t* writer, const char* s) {
+    size_t len = strlen(s);
+    uint32_t len32 = (uint32_t)len;
+    write_bytes(writer, &len32, sizeof(len32));
+    write_bytes(writer, s, len + 1);
+}
+
+scan_cache_writer_t* scan_cache_writer_open(const char* cache_path) {
+    if (!cache_path) {
+        LOG_ERROR("Couldn't write scan cache; path is NULL.");
+        return NULL;
+    }
+
+    scan_cache_writer_t* writer = calloc(1, sizeof(scan_cache_writer_t));
+    size_t tmp_size = strlen(cache_path) + 32;
+    char* tmp_path = malloc(tmp_size);
+    char* path = strdup(cache_path);
+    if (!writer || !tmp_path || !path) {
+        LOG_ERROR("Memory allocation failed; couldn't write scan cache.");
+        free(writer);
+        free(tmp_path);
+        free(path);
+        return NULL;
+    }
+    snprintf(tmp_path, tmp_size, "%s.tmp.%ld", cache_path, (long)getpid());
+    writer->path = path;
+    writer->tmp_path = tmp_path;
+
+    if (!cache_path_make_dirs(tmp_path) || !(writer->file = fopen(tmp_path, "wb"))) {
+        LOG_WARN("Couldn't create scan cache: %s", tmp_path);
+        free(writer->path);
+        free(writer->tmp_path);
+        free(writer);
+        return NULL;
+    }
+
+    // the directory count is patched in on commit
+    uint32_t version = SCAN_CACHE_VERSION, reserved = 0;
+    uint64_t dir_count = 0;
+    write_bytes(writer, SCAN_CACHE_MAGIC, 8);
+    write_bytes(writer, &version, sizeof(version));
+    write_bytes(writer, &reserved, sizeof(reserved));
+    write_bytes(writer, &dir_count, sizeof(dir_count));
+    return writer;
+}
+
+bool scan_cache_writer_add(scan_cache_writer_t* writer, const scan_cache_dir_t* dir) {
+    if (!writer || !dir) {
+        LOG_ERROR("Couldn't add directory to scan cache; writer or directory is NULL.");
+        return false;
+    }
+
+    uint32_t entry_count = (uint32_t)dir->entry_count;
+    uint32_t rel_len = (uint32_t)strlen(dir->rel_path);
+    write_bytes(writer, &dir->ino, sizeof(dir->ino));
+    write_bytes(writer, &dir->mtime_sec, sizeof(dir->mtime_sec));
+    write_bytes(writer, &dir->mtime_nsec, sizeof(dir->mtime_nsec));
+    write_bytes(writer, &rel_len, sizeof(rel_len));
+    write_bytes(writer, &entry_count, sizeof(entry_count));
+    write_bytes(writer, dir->rel_path, (size_t)rel_len + 1);
+
+    for (size_t i = 0; i < dir->entry_count; i++) {
+        uint8_t is_dir = dir->entries[i].is_dir ? 1 : 0;
+        write_bytes(writer, &is_dir, sizeof(is_dir));
+        write_string(writer, dir->entries[i].name);
+    }
+
+    writer->dir_count++;
+    return !writer->failed;
+}
+
+static void writer_destroy(scan_cache_writer_t* writer) {
+    free(writer->path);
+    free(writer->tmp_path);
+    free(writer);
+}
+
+bool scan_cache_writer_commit(scan_cache_writer_t* writer) {
+    if (!writer) {
+        LOG_ERROR("Couldn't commit scan cache; writer is NULL.");
+        return false;
+    }
+
+    // patch the directory count into the header
+    if (!writer->failed && fseek(writer->file, 16, SEEK_SET) == 0) {
+        write_bytes(writer, &writer->dir_count, sizeof(writer->dir_count));
+    } else {
+        writer->failed = true;
+    }
+
+    bool success = !writer->failed &&
+                   fflush(writer->file) == 0 &&
+                   fsync(fileno(writer->file)) == 0;
+    success = fclose(writer->file) == 0 && success;
+    success = success && rename(writer->tmp_path, writer->path) == 0;
+
+    if (!success) {
+        LOG_WARN("Couldn't write scan cache: %s", writer->path);
+        unlink(writer->tmp_path);
+    } else {
+        LOG_INFO("Scan cache written: %s (%llu directories)",
+                 writer->path, (unsigned long long)writer->dir_count);
+    }
+
+    writer_destroy(writer);
+    return success;
+}
+
+void scan_cache_writer_abort(scan_cache_writer_t* writer) {
+    if (!writer) return;
+
+    fclose(writer->file);
+    unlink(writer->tmp_path);
+    writer_destroy(writer);
+}
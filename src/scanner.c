@@ -0,0 +1,1067 @@
+#define _GNU_SOURCE
+#include "scanner.h"
+#include "scan_cache.h"
+#include "logger.h"
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <dirent.h>
+#include <time.h>
+#include <sys/stat.h>
+
+#define SCANNER_MAX_THREADS 32
+#define SCANNER_CHANNEL_SLOTS 64
+#define SCANNER_BATCH_SIZE 512
+
+// a directory in the scanned tree
+// entries are sorted by name, subdirectories point to their own node
+typedef struct scan_node scan_node_t;
+
+typedef struct scan_entry {
+    char* name;
+    scan_node_t* child; // NULL for audio files
+} scan_entry_t;
+
+struct scan_node {
+    char* rel_path; // relative to the scan root, "" for the root itself
+    scan_entry_t* entries;
+    size_t entry_count;
+    atomic_bool ready; // set once a worker has filled the entries
+
+    // identity of the directory when it was read, for the scan cache
+    bool cacheable;
+    uint64_t ino;
+    int64_t mtime_sec;
+    int64_t mtime_nsec;
+};
+
+// double ended queue of directories waiting to be read
+// the owning worker pushes and pops at the tail, thieves take from the head
+typedef struct scan_deque {
+    pthread_mutex_t lock;
+    scan_node_t** items;
+    size_t head;
+    size_t tail;
+    size_t capacity;
+} scan_deque_t;
+
+typedef struct scan_shared scan_shared_t;
+
+typedef struct scan_worker {
+    scan_shared_t* shared;
+    scan_deque_t deque;
+    size_t id;
+    size_t stat_calls;
+    size_t stat_calls_saved;
+    size_t steals;
+    size_t cache_hits;
+} scan_worker_t;
+
+struct scan_shared {
+    int root_fd;
+    bool trust_d_type;
+    bool record_identity; // remember inode and mtime of every directory read
+    const scan_cache_t* cache; // NULL when there is no usable cache
+    scan_worker_t* workers;
+    size_t worker_count;
+
+    atomic_size_t pending; // directories queued or being read
+    atomic_size_t queued;  // directories sitting in a deque
+    atomic_size_t idle;    // workers waiting for work
+    atomic_bool cancelled;
+
+    // progress counters, readable while the scan runs
+    atomic_size_t dirs_visited;
+    atomic_size_t files_matched;
+    atomic_size_t bytes_read; // directory entry data returned by readdir
+
+    pthread_mutex_t idle_lock;
+    pthread_cond_t idle_cond;
+
+    // lets the flattener sleep until the directory it needs next is read
+    _Atomic(scan_node_t*) waiting_for;
+    pthread_mutex_t ready_lock;
+    pthread_cond_t ready_cond;
+};
+
+// everything one scan needs, shared by the blocking and background paths
+typedef struct scan_engine {
+    scan_shared_t shared;
+    scan_worker_t* workers;
+    pthread_t* threads;
+    size_t started;
+    scan_node_t* root;
+    char* dir_path;
+    double start;
+    scan_cache_t* cache;
+    char* cache_path; // NULL when caching is off
+} scan_engine_t;
+
+// receives flattened paths in playlist order
+typedef struct scan_emitter {
+    bool (*emit)(void* ctx, char* path); // takes ownership of path
+    void (*flush)(void* ctx); // called before the flattener blocks
+    void* ctx;
+} scan_emitter_t;
+
+struct scanner_job {
+    scan_engine_t engine;
+    pthread_t thread;
+
+    // single producer single consumer ring of finished batches
+    scanner_batch_t slots[SCANNER_CHANNEL_SLOTS];
+    atomic_size_t head; // next slot the consumer reads
+    atomic_size_t tail; // next slot the producer writes
+
+    scanner_batch_t batch; // batch being filled by the producer
+    size_t batch_capacity;
+
+    atomic_bool finished;
+    scanner_stats_t stats; // valid once finished is set
+};
+
+bool is_audio_file(const char* path) {
+    const char* ext = strrchr(path, '.');
+    if (!ext) return false;
+
+    ext++; // to skip the dot
+    return (strcasecmp(ext, "mp3") == 0 ||
+            strcasecmp(ext, "flac") == 0 ||
+            strcasecmp(ext, "wav") == 0 ||
+            strcasecmp(ext, "ogg") == 0 ||
+            strcasecmp(ext, "m4a") == 0 ||
+            strcasecmp(ext, "opus") == 0 ||
+            strcasecmp(ext, "aac") == 0);
+}
+
+// helper for comparing entries by name for qsort
+static int compare_entries(const void* a, const void* b) {
+    return strcmp(((const scan_entry_t*)a)->name, ((const scan_entry_t*)b)->name);
+}
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+// deque helpers
+// -------------
+
+static bool deque_push(scan_deque_t* dq, scan_node_t* node) {
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail >= dq->capacity) {
+        if (dq->head > 0) {
+            // reclaim the space thieves left at the front
+            memmove(dq->items, dq->items + dq->head, (dq->tail - dq->head) * sizeof(*dq->items));
+            dq->tail -= dq->head;
+            dq->head = 0;
+        } else {
+            size_t new_capacity = dq->capacity == 0 ? 64 : dq->capacity * 2;
+            scan_node_t** tmp = realloc(dq->items, new_capacity * sizeof(*dq->items));
+            if (!tmp) {
+                pthread_mutex_unlock(&dq->lock);
+                LOG_ERROR("Memory allocation failed; couldn't queue directory.");
+                return false;
+            }
+            dq->items = tmp;
+            dq->capacity = new_capacity;
+        }
+    }
+    dq->items[dq->tail++] = node;
+    pthread_mutex_unlock(&dq->lock);
+    return true;
+}
+
+static scan_node_t* deque_pop(scan_deque_t* dq) {
+    scan_node_t* node = NULL;
+    pthread_mutex_lock(&dq->lock);
+    if (dq->tail > dq->head) node = dq->items[--dq->tail];
+    pthread_mutex_unlock(&dq->lock);
+    return node;
+}
+
+static scan_node_t* deque_steal(scan_deque_t* dq) {
+    scan_node_t* node = NULL;
+    // don't wait on a busy victim, just try the next one
+    if (pthread_mutex_trylock(&dq->lock) != 0) return NULL;
+    if (dq->tail > dq->head) node = dq->items[dq->head++];
+    pthread_mutex_unlock(&dq->lock);
+    return node;
+}
+
+// node helpers
+// ------------
+
+static scan_node_t* node_create(const char* parent_rel, const char* name) {
+    scan_node_t* node = calloc(1, sizeof(scan_node_t));
+    if (!node) return NULL;
+
+    if (!parent_rel) {
+        node->rel_path = strdup("");
+    } else if (parent_rel[0] == '\0') {
+        node->rel_path = strdup(name);
+    } else {
+        size_t parent_len = strlen(parent_rel);
+        size_t name_len = strlen(name);
+        node->rel_path = malloc(parent_len + name_len + 2);
+        if (node->rel_path) {
+            memcpy(node->rel_path, parent_rel, parent_len);
+            node->rel_path[parent_len] = '/';
+            memcpy(node->rel_path + parent_len + 1, name, name_len + 1);
+        }
+    }
+
+    if (!node->rel_path) {
+        free(node);
+        return NULL;
+    }
+    return node;
+}
+
+static void node_free_tree(scan_node_t* root) {
+    if (!root) return;
+
+    // iterative so deep trees can't blow the stack
+    scan_node_t** stack = malloc(sizeof(*stack));
+    size_t count = 0, capacity = 1;
+    if (!stack) return;
+    stack[count++] = root;
+
+    while (count > 0) {
+        scan_node_t* node = stack[--count];
+        for (size_t i = 0; i < node->entry_count; i++) {
+            scan_node_t* child = node->entries[i].child;
+            if (child) {
+                if (count >= capacity) {
+                    scan_node_t** tmp = realloc(stack, capacity * 2 * sizeof(*stack));
+                    if (!tmp) continue; // leak the subtree rather than crash
+                    stack = tmp;
+                    capacity *= 2;
+                }
+                stack[count++] = child;
+            }
+            free(node->entries[i].name);
+        }
+        free(node->entries);
+        free(node->rel_path);
+        free(node);
+    }
+    free(stack);
+}
+
+static bool node_add_entry(scan_node_t* node, size_t* capacity, const char* name, scan_node_t* child) {
+    if (node->entry_count >= *capacity) {
+        size_t new_capacity = *capacity == 0 ? 16 : *capacity * 2;
+        scan_entry_t* tmp = realloc(node->entries, new_capacity * sizeof(scan_entry_t));
+        if (!tmp) return false;
+        node->entries = tmp;
+        *capacity = new_capacity;
+    }
+
+    char* copy = strdup(name);
+    if (!copy) return false;
+
+    node->entries[node->entry_count].name = copy;
+    node->entries[node->entry_count].child = child;
+    node->entry_count++;
+    return true;
+}
+
+// worker
+// ------
+
+static void mark_ready(scan_shared_t* shared, scan_node_t* node) {
+    atomic_store(&node->ready, true);
+    if (atomic_load(&shared->waiting_for) == node) {
+        pthread_mutex_lock(&shared->ready_lock);
+        pthread_cond_broadcast(&shared->ready_cond);
+        pthread_mutex_unlock(&shared->ready_lock);
+    }
+}
+
+static void queue_node(scan_worker_t* worker, scan_node_t* node) {
+    scan_shared_t* shared = worker->shared;
+    if (!deque_push(&worker->deque, node)) {
+        // the node stays in the tree empty, the caller still holds pending
+        atomic_fetch_sub(&shared->pending, 1);
+        mark_ready(shared, node);
+        return;
+    }
+
+    atomic_fetch_add(&shared->queued, 1);
+    if (atomic_load(&shared->idle) > 0) {
+        pthread_mutex_lock(&shared->idle_lock);
+        pthread_cond_broadcast(&shared->idle_cond);
+        pthread_mutex_unlock(&shared->idle_lock);
+    }
+}
+
+typedef enum entry_kind {
+    ENTRY_SKIP,
+    ENTRY_DIR,
+    ENTRY_AUDIO
+} entry_kind_t;
+
+// decides what a directory entry is, calling fstatat only when needed
+// with trust_d_type the extension is checked first and d_type is used as is,
+// only DT_UNKNOWN (some network filesystems) and symlinks still need a stat
+static entry_kind_t classify_entry(scan_worker_t* worker, int dir_fd, const struct dirent* entry) {
+    bool audio = is_audio_file(entry->d_name);
+
+    if (worker->shared->trust_d_type) {
+        switch (entry->d_type) {
+            case DT_DIR:
+                worker->stat_calls_saved++;
+                return ENTRY_DIR;
+            case DT_REG:
+                worker->stat_calls_saved++;
+                return audio ? ENTRY_AUDIO : ENTRY_SKIP;
+            case DT_UNKNOWN:
+            case DT_LNK:
+                break; // symlinks may point at directories, so follow them
+            default:
+                // fifos, sockets and devices are never audio files
+                worker->stat_calls_saved++;
+                return ENTRY_SKIP;
+        }
+    }
+
+    struct stat path_stat;
+    worker->stat_calls++;
+    if (fstatat(dir_fd, entry->d_name, &path_stat, 0) != 0) return ENTRY_SKIP;
+
+    if (S_ISDIR(path_stat.st_mode)) return ENTRY_DIR;
+    if (S_ISREG(path_stat.st_mode) && audio) return ENTRY_AUDIO;
+    return ENTRY_SKIP;
+}
+
+static void set_identity(scan_node_t* node, const struct stat* dir_stat) {
+    node->cacheable = true;
+    node->ino = (uint64_t)dir_stat->st_ino;
+    node->mtime_sec = (int64_t)dir_stat->st_mtim.tv_sec;
+    node->mtime_nsec = (int64_t)dir_stat->st_mtim.tv_nsec;
+}
+
+// fills the node from the scan cache if the directory hasn't changed since
+// then only one fstatat is needed instead of reading the whole directory
+static bool read_node_cached(scan_worker_t* worker, scan_node_t* node, const char* rel) {
+    scan_shared_t* shared = worker->shared;
+
+    const scan_cache_dir_t* cached = scan_cache_find(shared->cache, node->rel_path);
+    if (!cached) return false;
+
+    struct stat dir_stat;
+    worker->stat_calls++;
+    if (fstatat(shared->root_fd, rel, &dir_stat, 0) != 0 ||
+        cached->ino != (uint64_t)dir_stat.st_ino ||
+        cached->mtime_sec != (int64_t)dir_stat.st_mtim.tv_sec ||
+        cached->mtime_nsec != (int64_t)dir_stat.st_mtim.tv_nsec) {
+        return false;
+    }
+
+    size_t capacity = 0;
+    size_t files_matched = 0;
+    for (size_t i = 0; i < cached->entry_count; i++) {
+        const scan_cache_entry_t* entry = &cached->entries[i];
+        scan_node_t* child = NULL;
+        if (entry->is_dir) {
+            child = node_create(node->rel_path, entry->name);
+            if (!child) continue;
+        }
+        if (!node_add_entry(node, &capacity, entry->name, child)) {
+            node_free_tree(child);
+            LOG_ERROR("Memory allocation failed; skipping: %s", entry->name);
+            continue;
+        }
+        if (!child) files_matched++;
+    }
+
+    set_identity(node, &dir_stat);
+    worker->cache_hits++;
+    atomic_fetch_add_explicit(&shared->dirs_visited, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shared->files_matched, files_matched, memory_order_relaxed);
+    return true;
+}
+
+static void read_node_from_disk(scan_worker_t* worker, scan_node_t* node, const char* rel) {
+    scan_shared_t* shared = worker->shared;
+
+    int fd = openat(shared->root_fd, rel, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (fd < 0) {
+        LOG_WARN("Failed to open directory: %s", node->rel_path);
+        return;
+    }
+
+    // taken before reading, so a change during the read invalidates the entry
+    struct stat dir_stat;
+    bool identified = false;
+    if (shared->record_identity) {
+        worker->stat_calls++;
+        identified = fstat(fd, &dir_stat) == 0;
+    }
+
+    DIR* dir = fdopendir(fd);
+    if (!dir) {
+        LOG_WARN("Failed to read directory: %s", node->rel_path);
+        close(fd);
+        return;
+    }
+
+    size_t capacity = 0;
+    size_t files_matched = 0;
+    size_t bytes_read = 0;
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        bytes_read += entry->d_reclen;
+
+        // skip . and ..
+        if (strcmp(entry->d_name, ".") == 0 ||
+            strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        entry_kind_t kind = classify_entry(worker, dirfd(dir), entry);
+        if (kind == ENTRY_DIR) {
+            scan_node_t* child = node_create(node->rel_path, entry->d_name);
+            if (!child || !node_add_entry(node, &capacity, entry->d_name, child)) {
+                node_free_tree(child);
+                LOG_ERROR("Memory allocation failed; skipping: %s", entry->d_name);
+            }
+        } else if (kind == ENTRY_AUDIO) {
+            if (!node_add_entry(node, &capacity, entry->d_name, NULL)) {
+                LOG_ERROR("Memory allocation failed; skipping: %s", entry->d_name);
+            } else {
+                files_matched++;
+            }
+        }
+    }
+    closedir(dir);
+
+    if (identified) set_identity(node, &dir_stat);
+    atomic_fetch_add_explicit(&shared->dirs_visited, 1, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shared->files_matched, files_matched, memory_order_relaxed);
+    atomic_fetch_add_explicit(&shared->bytes_read, bytes_read, memory_order_relaxed);
+
+    // sort entries alphabetically (good enough for this)
+    qsort(node->entries, node->entry_count, sizeof(scan_entry_t), compare_entries);
+}
+
+// reads one directory, fills its entries and queues its subdirectories
+static void read_node(scan_worker_t* worker, scan_node_t* node) {
+    scan_shared_t* shared = worker->shared;
+    if (atomic_load(&shared->cancelled)) return;
+
+    const char* rel = node->rel_path[0] ? node->rel_path : ".";
+    if (!shared->cache || !read_node_cached(worker, node, rel)) {
+        read_node_from_disk(worker, node, rel);
+    }
+
+    // push in reverse so the owner pops the alphabetically first subdirectory
+    // next, while thieves take the last ones from the other end
+    for (size_t i = node->entry_count; i-- > 0;) {
+        if (!node->entries[i].child) continue;
+        atomic_fetch_add(&shared->pending, 1);
+        queue_node(worker, node->entries[i].child);
+    }
+}
+
+static scan_node_t* find_work(scan_worker_t* worker) {
+    scan_shared_t* shared = worker->shared;
+
+    scan_node_t* node = deque_pop(&worker->deque);
+    if (node) {
+        atomic_fetch_sub(&shared->queued, 1);
+        return node;
+    }
+
+    for (size_t i = 1; i < shared->worker_count; i++) {
+        scan_worker_t* victim = &shared->workers[(worker->id + i) % shared->worker_count];
+        node = deque_steal(&victim->deque);
+        if (node) {
+            atomic_fetch_sub(&shared->queued, 1);
+            worker->steals++;
+            return node;
+        }
+    }
+    return NULL;
+}
+
+static void* worker_run(void* arg) {
+    scan_worker_t* worker = arg;
+    scan_shared_t* shared = worker->shared;
+
+    for (;;) {
+        scan_node_t* node = find_work(worker);
+        if (node) {
+            read_node(worker, node);
+            mark_ready(shared, node);
+            if (atomic_fetch_sub(&shared->pending, 1) == 1) {
+                // that was the last directory, wake everyone up so they exit
+                pthread_mutex_lock(&shared->idle_lock);
+                pthread_cond_broadcast(&shared->idle_cond);
+                pthread_mutex_unlock(&shared->idle_lock);
+            }
+            continue;
+        }
+
+        if (atomic_load(&shared->pending) == 0) break;
+
+        pthread_mutex_lock(&shared->idle_lock);
+        atomic_fetch_add(&shared->idle, 1);
+        while (atomic_load(&shared->queued) == 0 &&
+               atomic_load(&shared->pending) > 0) {
+            pthread_cond_wait(&shared->idle_cond, &shared->idle_lock);
+        }
+        atomic_fetch_sub(&shared->idle, 1);
+        pthread_mutex_unlock(&shared->idle_lock);
+    }
+    return NULL;
+}
+
+// engine
+// ------
+
+static bool engine_init(scan_engine_t* engine, const char* dir_path, const scanner_options_t* options) {
+    memset(engine, 0, sizeof(*engine));
+    engine->start = now_seconds();
+    scanner_options_t opts = options ? *options : scanner_default_options();
+
+    size_t thread_count = opts.thread_count;
+    if (thread_count == 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN);
+        thread_count = cpus > 0 ? (size_t)cpus : 1;
+    }
+    if (thread_count > SCANNER_MAX_THREADS) thread_count = SCANNER_MAX_THREADS;
+
+    int root_fd = open(dir_path, O_RDONLY | O_DIRECTORY | O_CLOEXEC);
+    if (root_fd < 0) {
+        LOG_ERROR("Failed to open directory: %s", dir_path);
+        return false;
+    }
+
+    engine->root = node_create(NULL, NULL);
+    engine->dir_path = strdup(dir_path);
+    engine->workers = calloc(thread_count, sizeof(scan_worker_t));
+    engine->threads = calloc(thread_count, sizeof(pthread_t));
+    if (!engine->root || !engine->dir_path || !engine->workers || !engine->threads) {
+        LOG_ERROR("Memory allocation failed; couldn't scan directory.");
+        node_free_tree(engine->root);
+        free(engine->dir_path);
+        free(engine->workers);
+        free(engine->threads);
+        close(root_fd);
+        return false;
+    }
+
+    scan_shared_t* shared = &engine->shared;
+    shared->root_fd = root_fd;
+    shared->workers = engine->workers;
+    shared->worker_count = thread_count;
+    shared->trust_d_type = opts.trust_d_type;
+
+    if (opts.use_cache) {
+        engine->cache_path = scan_cache_default_path(dir_path);
+        engine->cache = engine->cache_path ? scan_cache_load(engine->cache_path) : NULL;
+        shared->cache = engine->cache;
+        shared->record_identity = engine->cache_path != NULL;
+    }
+    atomic_init(&shared->pending, 1);
+    atomic_init(&shared->queued, 1);
+    atomic_init(&shared->idle, 0);
+    atomic_init(&shared->cancelled, false);
+    atomic_init(&shared->dirs_visited, 0);
+    atomic_init(&shared->files_matched, 0);
+    atomic_init(&shared->bytes_read, 0);
+    atomic_init(&shared->waiting_for, NULL);
+    pthread_mutex_init(&shared->idle_lock, NULL);
+    pthread_cond_init(&shared->idle_cond, NULL);
+    pthread_mutex_init(&shared->ready_lock, NULL);
+    pthread_cond_init(&shared->ready_cond, NULL);
+
+    for (size_t i = 0; i < thread_count; i++) {
+        engine->workers[i].shared = shared;
+        engine->workers[i].id = i;
+        pthread_mutex_init(&engine->workers[i].deque.lock, NULL);
+    }
+    deque_push(&engine->workers[0].deque, engine->root);
+    return true;
+}
+
+// starts worker threads from the given index on
+static void engine_start_workers(scan_engine_t* engine, size_t first) {
+    for (size_t i = first; i < engine->shared.worker_count; i++) {
+        if (pthread_create(&engine->threads[i], NULL, worker_run, &engine->workers[i]) != 0) {
+            LOG_WARN("Couldn't start scan worker %zu; continuing with fewer.", i);
+            break;
+        }
+        engine->started = i + 1;
+    }
+}
+
+static void engine_join_workers(scan_engine_t* engine, size_t first) {
+    for (size_t i = first; i < engine->started; i++) {
+        pthread_join(engine->threads[i], NULL);
+    }
+}
+
+static void engine_collect_stats(scan_engine_t* engine, scanner_stats_t* stats) {
+    scan_shared_t* shared = &engine->shared;
+    memset(stats, 0, sizeof(*stats));
+    stats->dirs_visited = atomic_load(&shared->dirs_visited);
+    stats->files_matched = atomic_load(&shared->files_matched);
+    stats->bytes_read = atomic_load(&shared->bytes_read);
+    for (size_t i = 0; i < shared->worker_count; i++) {
+        stats->stat_calls += engine->workers[i].stat_calls;
+        stats->stat_calls_saved += engine->workers[i].stat_calls_saved;
+        stats->steals += engine->workers[i].steals;
+        stats->cache_hits += engine->workers[i].cache_hits;
+    }
+    stats->threads = engine->started;
+    stats->elapsed_seconds = now_seconds() - engine->start;
+
+    LOG_INFO(
+        "Scanned %zu directories, matched %zu files in %.3fs "
+        "(%zu threads, %zu steals, %zu stat calls, %zu stat calls saved, %zu cache hits).",
+        stats->dirs_visited, stats->files_matched, stats->elapsed_seconds,
+        stats->threads, stats->steals, stats->stat_calls, stats->stat_calls_saved,
+        stats->cache_hits
+    );
+}
+
+// only call once all workers have been joined
+static void engine_destroy(scan_engine_t* engine) {
+    scan_shared_t* shared = &engine->shared;
+    for (size_t i = 0; i < shared->worker_count; i++) {
+        free(engine->workers[i].deque.items);
+        pthread_mutex_destroy(&engine->workers[i].deque.lock);
+    }
+    pthread_mutex_destroy(&shared->idle_lock);
+    pthread_cond_destroy(&shared->idle_cond);
+    pthread_mutex_destroy(&shared->ready_lock);
+    pthread_cond_destroy(&shared->ready_cond);
+    close(shared->root_fd);
+
+    node_free_tree(engine->root);
+    scan_cache_free(engine->cache);
+    free(engine->cache_path);
+    free(engine->dir_path);
+    free(engine->workers);
+    free(engine->threads);
+    memset(engine, 0, sizeof(*engine));
+}
+
+// writes every directory of the finished tree to the scan cache
+static void engine_save_cache(scan_engine_t* engine) {
+    if (!engine->cache_path || atomic_load(&engine->shared.cancelled)) return;
+
+    scan_cache_writer_t* writer = scan_cache_writer_open(engine->cache_path);
+    if (!writer) return;
+
+    size_t count = 0, capacity = 64;
+    scan_node_t** stack = malloc(capacity * sizeof(*stack));
+    scan_cache_entry_t* entries = NULL;
+    size_t entries_capacity = 0;
+    bool success = stack != NULL;
+    if (success) stack[count++] = engine->root;
+
+    while (success && count > 0) {
+        scan_node_t* node = stack[--count];
+        if (!node->cacheable) continue; // unreadable, its subtree is empty anyway
+
+        if (node->entry_count > entries_capacity) {
+            scan_cache_entry_t* tmp = realloc(entries, node->entry_count * sizeof(*entries));
+            if (!tmp) {
+                success = false;
+                break;
+            }
+            entries = tmp;
+            entries_capacity = node->entry_count;
+        }
+
+        for (size_t i = 0; i < node->entry_count; i++) {
+            entries[i].name = node->entries[i].name;
+            entries[i].is_dir = node->entries[i].child != NULL;
+
+            if (!node->entries[i].child) continue;
+            if (count >= capacity) {
+                scan_node_t** tmp = realloc(stack, capacity * 2 * sizeof(*stack));
+                if (!tmp) {
+                    success = false;
+                    break;
+                }
+                stack = tmp;
+                capacity *= 2;
+            }
+            stack[count++] = node->entries[i].child;
+        }
+
+        scan_cache_dir_t dir = {
+            .rel_path = node->rel_path,
+            .ino = node->ino,
+            .mtime_sec = node->mtime_sec,
+            .mtime_nsec = node->mtime_nsec,
+            .entries = entries,
+            .entry_count = node->entry_count,
+        };
+        success = success && scan_cache_writer_add(writer, &dir);
+    }
+
+    free(stack);
+    free(entries);
+    if (success) {
+        scan_cache_writer_commit(writer);
+    } else {
+        scan_cache_writer_abort(writer);
+    }
+}
+
+// flattening
+// ----------
+
+static char* make_path(const char* dir_path, const char* rel_path, const char* name) {
+    // same shape as the old "%s/%s" join so paths match the recursive walk
+    size_t dir_len = strlen(dir_path);
+    size_t rel_len = strlen(rel_path);
+    size_t name_len = strlen(name);
+    char* path = malloc(dir_len + rel_len + name_len + 3);
+    if (!path) return NULL;
+
+    char* p = path;
+    memcpy(p, dir_path, dir_len); p += dir_len;
+    *p++ = '/';
+    if (rel_len > 0) {
+        memcpy(p, rel_path, rel_len); p += rel_len;
+        *p++ = '/';
+    }
+    memcpy(p, name, name_len + 1);
+    return path;
+}
+
+// blocks until a worker has read the node, returns false if cancelled
+static bool wait_ready(scan_shared_t* shared, scan_node_t* node, const scan_emitter_t* emitter) {
+    if (atomic_load(&node->ready)) return true;
+
+    // hand out what we have before sleeping so the consumer isn't starved
+    if (emitter->flush) emitter->flush(emitter->ctx);
+
+    atomic_store(&shared->waiting_for, node);
+    pthread_mutex_lock(&shared->ready_lock);
+    while (!atomic_load(&node->ready)) {
+        pthread_cond_wait(&shared->ready_cond, &shared->ready_lock);
+    }
+    pthread_mutex_unlock(&shared->ready_lock);
+    atomic_store(&shared->waiting_for, NULL);
+
+    return !atomic_load(&shared->cancelled);
+}
+
+// walks the tree depth first and emits the audio file paths in order
+// directories that aren't read yet are waited for, so this can run
+// while the workers are still busy
+static bool flatten_tree(scan_engine_t* engine, const scan_emitter_t* emitter) {
+    typedef struct { scan_node_t* node; size_t next; } frame_t;
+    scan_shared_t* shared = &engine->shared;
+
+    size_t depth = 0, depth_capacity = 16;
+    frame_t* stack = malloc(depth_capacity * sizeof(frame_t));
+    if (!stack) return false;
+
+    bool success = wait_ready(shared, engine->root, emitter);
+    stack[depth++] = (frame_t){ engine->root, 0 };
+
+    while (success && depth > 0) {
+        frame_t* top = &stack[depth - 1];
+        if (top->next >= top->node->entry_count) {
+            depth--;
+            continue;
+        }
+
+        scan_entry_t* entry = &top->node->entries[top->next++];
+        if (entry->child) {
+            if (depth >= depth_capacity) {
+                frame_t* tmp = realloc(stack, depth_capacity * 2 * sizeof(frame_t));
+                if (!tmp) {
+                    success = false;
+                    break;
+                }
+                stack = tmp;
+                depth_capacity *= 2;
+            }
+            success = wait_ready(shared, entry->child, emitter);
+            stack[depth++] = (frame_t){ entry->child, 0 };
+        } else {
+            char* path = make_path(engine->dir_path, top->node->rel_path, entry->name);
+            success = path && emitter->emit(emitter->ctx, path);
+        }
+    }
+
+    free(stack);
+    if (emitter->flush) emitter->flush(emitter->ctx);
+    return success;
+}
+
+// blocking scan
+// -------------
+
+typedef struct result_ctx {
+    scanner_result_t* out;
+    size_t capacity;
+} result_ctx_t;
+
+static bool result_emit(void* ctx, char* path) {
+    result_ctx_t* rc = ctx;
+    scanner_result_t* out = rc->out;
+
+    if (out->count >= rc->capacity) {
+        size_t new_capacity = rc->capacity == 0 ? 256 : rc->capacity * 2;
+        char** tmp = realloc(out->paths, new_capacity * sizeof(char*));
+        if (!tmp) {
+            free(path);
+            return false;
+        }
+        out->paths = tmp;
+        rc->capacity = new_capacity;
+    }
+
+    out->paths[out->count++] = path;
+    return true;
+}
+
+scanner_options_t scanner_default_options() {
+    scanner_options_t options = {0};
+    options.thread_count = 0;
+    options.trust_d_type = true;
+    options.use_cache = true;
+    return options;
+}
+
+bool scanner_scan(const char* dir_path, const scanner_options_t* options, scanner_result_t* out) {
+    if (!dir_path || !out) {
+        LOG_ERROR("Couldn't scan directory; path or result is NULL.");
+        return false;
+    }
+    memset(out, 0, sizeof(*out));
+
+    scan_engine_t engine;
+    if (!engine_init(&engine, dir_path, options)) return false;
+
+    // the calling thread works as worker 0, the rest get their own thread
+    engine.started = 1;
+    engine_start_workers(&engine, 1);
+    worker_run(&engine.workers[0]);
+    engine_join_workers(&engine, 1);
+
+    result_ctx_t ctx = { out, 0 };
+    scan_emitter_t emitter = { result_emit, NULL, &ctx };
+    bool success = flatten_tree(&engine, &emitter);
+
+    engine_collect_stats(&engine, &out->stats);
+    if (success) engine_save_cache(&engine);
+    engine_destroy(&engine);
+
+    if (!success) {
+        LOG_ERROR("Memory allocation failed; couldn't collect scan results.");
+        scanner_result_free(out);
+        return false;
+    }
+    return true;
+}
+
+void scanner_result_free(scanner_result_t* result) {
+    if (!result) {
+        LOG_ERROR("Couldn't free scan result; result is NULL.");
+        return;
+    }
+
+    for (size_t i = 0; i < result->count; i++) {
+        free(result->paths[i]);
+    }
+    free(result->paths);
+    result->paths = NULL;
+    result->count = 0;
+}
+
+// background scan
+// ---------------
+
+// moves the batch being filled into the channel, waiting if it is full
+static void job_flush(void* ctx) {
+    scanner_job_t* job = ctx;
+    if (job->batch.count == 0) return;
+
+    size_t tail = atomic_load_explicit(&job->tail, memory_order_relaxed);
+    while (tail - atomic_load_explicit(&job->head, memory_order_acquire) >= SCANNER_CHANNEL_SLOTS) {
+        if (atomic_load(&job->engine.shared.cancelled)) {
+            scanner_batch_free(&job->batch);
+            job->batch_capacity = 0;
+            return;
+        }
+        struct timespec ts = { 0, 1000000 };
+        nanosleep(&ts, NULL);
+    }
+
+    job->slots[tail % SCANNER_CHANNEL_SLOTS] = job->batch;
+    atomic_store_explicit(&job->tail, tail + 1, memory_order_release);
+
+    job->batch.paths = NULL;
+    job->batch.count = 0;
+    job->batch_capacity = 0;
+}
+
+static bool job_emit(void* ctx, char* path) {
+    scanner_job_t* job = ctx;
+
+    if (job->batch.count >= job->batch_capacity) {
+        size_t new_capacity = job->batch_capacity == 0 ? 64 : job->batch_capacity * 2;
+        char** tmp = realloc(job->batch.paths, new_capacity * sizeof(char*));
+        if (!tmp) {
+            free(path);
+            return false;
+        }
+        job->batch.paths = tmp;
+        job->batch_capacity = new_capacity;
+    }
+    job->batch.paths[job->batch.count++] = path;
+
+    // the very first track goes out alone so playback can start right away
+    if (job->batch.count >= SCANNER_BATCH_SIZE ||
+        atomic_load_explicit(&job->tail, memory_order_relaxed) == 0) {
+        job_flush(job);
+    }
+    return true;
+}
+
+static void* job_run(void* arg) {
+    scanner_job_t* job = arg;
+
+    engine_start_workers(&job->engine, 0);
+    if (job->engine.started == 0) {
+        // no thread could be started, read everything from here instead
+        job->engine.started = 1;
+        worker_run(&job->engine.workers[0]);
+    }
+
+    scan_emitter_t emitter = { job_emit, job_flush, job };
+    if (!flatten_tree(&job->engine, &emitter) &&
+        !atomic_load(&job->engine.shared.cancelled)) {
+        LOG_ERROR("Memory allocation failed; background scan stopped early.");
+        atomic_store(&job->engine.shared.cancelled, true);
+    }
+    scanner_batch_free(&job->batch);
+
+    engine_join_workers(&job->engine, 0);
+    engine_collect_stats(&job->engine, &job->stats);
+    engine_save_cache(&job->engine);
+    atomic_store(&job->finished, true);
+    return NULL;
+}
+
+scanner_job_t* scanner_job_start(const char* dir_path, const scanner_options_t* options) {
+    if (!dir_path) {
+        LOG_ERROR("Couldn't start scan; path is NULL.");
+        return NULL;
+    }
+
+    scanner_job_t* job = calloc(1, sizeof(scanner_job_t));
+    if (!job) {
+        LOG_ERROR("Memory allocation failed; couldn't start scan.");
+        return NULL;
+    }
+    atomic_init(&job->head, 0);
+    atomic_init(&job->tail, 0);
+    atomic_init(&job->finished, false);
+
+    if (!engine_init(&job->engine, dir_path, options)) {
+        free(job);
+        return NULL;
+    }
+
+    if (pthread_create(&job->thread, NULL, job_run, job) != 0) {
+        LOG_ERROR("Couldn't start scan thread.");
+        engine_destroy(&job->engine);
+        free(job);
+        return NULL;
+    }
+
+    LOG_INFO("Background scan started: %s", dir_path);
+    return job;
+}
+
+bool scanner_job_poll(scanner_job_t* job, scanner_batch_t* out) {
+    if (!job || !out) {
+        LOG_ERROR("Couldn't poll scan; job or batch is NULL.");
+        return false;
+    }
+
+    size_t head = atomic_load_explicit(&job->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&job->tail, memory_order_acquire)) return false;
+
+    *out = job->slots[head % SCANNER_CHANNEL_SLOTS];
+    atomic_store_explicit(&job->head, head + 1, memory_order_release);
+    return true;
+}
+
+void scanner_batch_free(scanner_batch_t* batch) {
+    if (!batch) return;
+
+    for (size_t i = 0; i < batch->count; i++) {
+        free(batch->paths[i]);
+    }
+    free(batch->paths);
+    batch->paths = NULL;
+    batch->count = 0;
+}
+
+scanner_progress_t scanner_job_get_progress(scanner_job_t* job) {
+    scanner_progress_t progress = {0};
+    if (!job) {
+        LOG_ERROR("Couldn't get scan progress; job is NULL.");
+        return progress;
+    }
+
+    scan_shared_t* shared = &job->engine.shared;
+    progress.dirs_visited = atomic_load_explicit(&shared->dirs_visited, memory_order_relaxed);
+    progress.files_matched = atomic_load_explicit(&shared->files_matched, memory_order_relaxed);
+    progress.bytes_read = atomic_load_explicit(&shared->bytes_read, memory_order_relaxed);
+
+    progress.done = scanner_job_is_done(job);
+    progress.elapsed_seconds = atomic_load(&job->finished)
+        ? job->stats.elapsed_seconds
+        : now_seconds() - job->engine.start;
+    progress.bytes_per_second = progress.elapsed_seconds > 0.0
+        ? (double)progress.bytes_read / progress.elapsed_seconds
+        : 0.0;
+    return progress;
+}
+
+bool scanner_job_is_done(scanner_job_t* job) {
+    if (!job) return true;
+    return atomic_load(&job->finished) &&
+           atomic_load(&job->head) == atomic_load(&job->tail);
+}
+
+void scanner_job_free(scanner_job_t* job) {
+    if (!job) {
+        LOG_ERROR("Couldn't free scan; job is NULL.");
+        return;
+    }
+
+    if (!atomic_load(&job->finished)) {
+        LOG_INFO("Cancelling background scan: %s", job->engine.dir_path);
+    }
+    atomic_store(&job->engine.shared.cancelled, true);
+    pthread_join(job->thread, NULL);
+
+    scanner_batch_t batch;
+    while (scanner_job_poll(job, &batch)) {
+        scanner_batch_free(&batch);
+    }
+
+    engine_destroy(&job->engine);
+    free(job);
+}
@@ -0,0 +1,163 @@
+#define _GNU_SOURCE
+#include "seek_index.h"
+#include "cache_path.h"
+#include "logger.h"
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/stat.h>
+
+// file layout (host byte order, it never leaves this machine):
+//   header:    magic[8], u32 version, u32 reserved, u64 file_size,
+//              i64 mtime_sec, i64 mtime_nsec, u64 count
+//   per point: u64 byte_offset, u64 frame, u16 discard_packets, u16 discard_frames
+#define SEEK_INDEX_MAGIC "SMPSEEK\0"
+#define SEEK_INDEX_VERSION 1
+#define SEEK_INDEX_HEADER_SIZE 48
+#define SEEK_INDEX_POINT_SIZE 20
+
+char* seek_index_default_path(const char* file_path) {
+    if (!file_path) {
+        LOG_ERROR("Couldn't get seek index path; file path is NULL.");
+        return NULL;
+    }
+
+    return cache_path_build("seek/seek", file_path, ".bin");
+}
+
+// loading
+// -------
+
+static bool read_bytes(FILE* file, void* out, size_t n) {
+    return fread(out, 1, n, file) == n;
+}
+
+seek_index_t* seek_index_load(const char* index_path, uint64_t file_size, int64_t mtime_sec, int64_t mtime_nsec) {
+    if (!index_path) {
+        LOG_ERROR("Couldn't load seek index; path is NULL.");
+        return NULL;
+    }
+
+    FILE* file = fopen(index_path, "rb");
+    if (!file) return NULL; // not built yet, nothing to report
+
+    seek_index_t* index = calloc(1, sizeof(seek_index_t));
+    if (!index) {
+        LOG_ERROR("Memory allocation failed; couldn't load seek index.");
+        fclose(file);
+        return NULL;
+    }
+
+    struct stat index_stat;
+    char magic[8];
+    uint32_t version, reserved;
+    uint64_t count;
+    bool success =
+        fstat(fileno(file), &index_stat) == 0 &&
+        read_bytes(file, magic, sizeof(magic)) &&
+        memcmp(magic, SEEK_INDEX_MAGIC, sizeof(magic)) == 0 &&
+        read_bytes(file, &version, sizeof(version)) &&
+        version == SEEK_INDEX_VERSION &&
+        read_bytes(file, &reserved, sizeof(reserved)) &&
+        read_bytes(file, &index->file_size, sizeof(index->file_size)) &&
+        read_bytes(file, &index->mtime_sec, sizeof(index->mtime_sec)) &&
+        read_bytes(file, &index->mtime_nsec, sizeof(index->mtime_nsec)) &&
+        read_bytes(file, &count, sizeof(count)) &&
+        count > 0 &&
+        (uint64_t)index_stat.st_size == SEEK_INDEX_HEADER_SIZE + count * SEEK_INDEX_POINT_SIZE;
+
+    // an index of an older version of the file points into the wrong bytes, it's rebuilt
+    bool stale = success &&
+        (index->file_size != file_size || index->mtime_sec != mtime_sec || index->mtime_nsec != mtime_nsec);
+
+    if (success && !stale) {
+        index->points = malloc((size_t)count * sizeof(seek_point_t));
+        index->count = (size_t)count;
+        success = index->points != NULL;
+        for (size_t i = 0; success && i < index->count; i++) {
+            seek_point_t* point = &index->points[i];
+            success = read_bytes(file, &point->byte_offset, sizeof(point->byte_offset)) &&
+                      read_bytes(file, &point->frame, sizeof(point->frame)) &&
+                      read_bytes(file, &point->discard_packets, sizeof(point->discard_packets)) &&
+                      read_bytes(file, &point->discard_frames, sizeof(point->discard_frames)) &&
+                      (i == 0 || point->frame >= index->points[i - 1].frame);
+        }
+    }
+    fclose(file);
+
+    if (!success || stale) {
+        if (!success) LOG_WARN("Ignoring invalid seek index: %s", index_path);
+        seek_index_free(index);
+        return NULL;
+    }
+    return index;
+}
+
+void seek_index_free(seek_index_t* index) {
+    if (!index) return;
+
+    free(index->points);
+    free(index);
+}
+
+// writing
+// -------
+
+static void write_bytes(FILE* file, const void* data, size_t n, bool* failed) {
+    if (*failed) return;
+    if (fwrite(data, 1, n, file) != n) *failed = true;
+}
+
+bool seek_index_save(const char* index_path, const seek_index_t* index) {
+    if (!index_path || !index) {
+        LOG_ERROR("Couldn't write seek index; path or index is NULL.");
+        return false;
+    }
+
+    // the thread id keeps two loaders indexing the same file from sharing a temporary file
+    size_t tmp_size = strlen(index_path) + 48;
+    char* tmp_path = malloc(tmp_size);
+    if (!tmp_path) {
+        LOG_ERROR("Memory allocation failed; couldn't write seek index.");
+        return false;
+    }
+    snprintf(tmp_path, tmp_size, "%s.tmp.%ld.%ld", index_path, (long)getpid(), (long)gettid());
+
+    FILE* file = NULL;
+    if (!cache_path_make_dirs(tmp_path) || !(file = fopen(tmp_path, "wb"))) {
+        LOG_WARN("Couldn't create seek index: %s", tmp_path);
+        free(tmp_path);
+        return false;
+    }
+
+    bool failed = false;
+    uint32_t version = SEEK_INDEX_VERSION, reserved = 0;
+    uint64_t count = index->count;
+    write_bytes(file, SEEK_INDEX_MAGIC, 8, &failed);
+    write_bytes(file, &version, sizeof(version), &failed);
+    write_bytes(file, &reserved, sizeof(reserved), &failed);
+    write_bytes(file, &index->file_size, sizeof(index->file_size), &failed);
+    write_bytes(file, &index->mtime_sec, sizeof(index->mtime_sec), &failed);
+    write_bytes(file, &index->mtime_nsec, sizeof(index->mtime_nsec), &failed);
+    write_bytes(file, &count, sizeof(count), &failed);
+    for (size_t i = 0; i < index->count; i++) {
+        const seek_point_t* point = &index->points[i];
+        write_bytes(file, &point->byte_offset, sizeof(point->byte_offset), &failed);
+        write_bytes(file, &point->frame, sizeof(point->frame), &failed);
+        write_bytes(file, &point->discard_packets, sizeof(point->discard_packets), &failed);
+        write_bytes(file, &point->discard_frames, sizeof(point->discard_frames), &failed);
+    }
+
+    // not synced, an index lost in a crash is just built again
+    bool success = !failed && fflush(file) == 0;
+    success = fclose(file) == 0 && success;
+    success = success && rename(tmp_path, index_path) == 0;
+
+    if (!success) {
+        LOG_WARN("Couldn't write seek index: %s", index_path);
+        unlink(tmp_path);
+    }
+    free(tmp_path);
+    return success;
+}
@@ -0,0 +1,99 @@
+#include "string_arena.h"
+#include "logger.h"
+#include <stdlib.h>
+#include <string.h>
+
+#define STRING_ARENA_CHUNK_SIZE 65536
+
+struct string_arena_chunk {
+    struct string_arena_chunk* next;
+    size_t used;
+    size_t size;
+    char data[];
+};
+
+// moves to a chunk with room for len bytes, reusing spare chunks after a reset
+static bool make_room(string_arena_t* arena, size_t len) {
+    string_arena_chunk_t* current = arena->current;
+    if (current && current->size - current->used >= len) return true;
+
+    string_arena_chunk_t* next = current ? current->next : arena->first;
+    if (next && next->size >= len) {
+        arena->current = next;
+        return true;
+    }
+
+    size_t size = len > STRING_ARENA_CHUNK_SIZE ? len : STRING_ARENA_CHUNK_SIZE;
+    string_arena_chunk_t* chunk = malloc(sizeof(string_arena_chunk_t) + size);
+    if (!chunk) return false;
+    chunk->next = next;
+    chunk->used = 0;
+    chunk->size = size;
+
+    if (current) current->next = chunk;
+    else arena->first = chunk;
+    arena->current = chunk;
+    arena->chunk_count++;
+    return true;
+}
+
+char* string_arena_copy(string_arena_t* arena, const char* s) {
+    if (!arena || !s) {
+        LOG_ERROR("Couldn't copy string into arena; arena or string is NULL.");
+        return NULL;
+    }
+
+    size_t len = strlen(s) + 1;
+    if (!make_room(arena, len)) {
+        LOG_ERROR("Memory allocation failed; couldn't copy string into arena.");
+        return NULL;
+    }
+
+    char* copy = arena->current->data + arena->current->used;
+    memcpy(copy, s, len);
+    arena->current->used += len;
+    arena->live_bytes += len;
+    return copy;
+}
+
+void string_arena_release(string_arena_t* arena, const char* s) {
+    if (!arena || !s) return;
+
+    size_t len = strlen(s) + 1;
+    arena->live_bytes -= len;
+    arena->dead_bytes += len;
+}
+
+bool string_arena_wants_compaction(const string_arena_t* arena) {
+    if (!arena) return false;
+    return arena->dead_bytes >= STRING_ARENA_CHUNK_SIZE && arena->dead_bytes > arena->live_bytes;
+}
+
+void string_arena_reset(string_arena_t* arena) {
+    if (!arena) {
+        LOG_ERROR("Couldn't reset arena; arena is NULL.");
+        return;
+    }
+
+    for (string_arena_chunk_t* chunk = arena->first; chunk; chunk = chunk->next) {
+        chunk->used = 0;
+    }
+    arena->current = arena->first;
+    arena->live_bytes = 0;
+    arena->dead_bytes = 0;
+}
+
+void string_arena_free(string_arena_t* arena) {
+    if (!arena) {
+        LOG_ERROR("Couldn't free arena; arena is NULL.");
+        return;
+    }
+
+    string_arena_chunk_t* chunk = arena->first;
+    while (chunk) {
+        string_arena_chunk_t* next = chunk->next;
+        free(chunk);
+        chunk = next;
+    }
+    *arena = (string_arena_t){0};
+}
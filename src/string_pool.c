@@ -0,0 +1,167 @@
+#include "string_pool.h"
+#include "cache_path.h"
+#include "logger.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <pthread.h>
+
+#define STRING_POOL_CHUNK_SIZE 65536
+
+// strings are packed into large chunks instead of one allocation each
+typedef struct pool_chunk {
+    struct pool_chunk* next;
+    size_t used;
+    size_t size;
+    char data[];
+} pool_chunk_t;
+
+typedef struct pool_slot {
+    const char* string;
+    uint64_t hash;
+} pool_slot_t;
+
+static pthread_mutex_t pool_lock = PTHREAD_MUTEX_INITIALIZER;
+static pool_chunk_t* chunks = NULL;
+static pool_slot_t* slots = NULL; // open addressing, string is NULL when empty
+static size_t slot_count = 0;
+static const char** by_id = NULL; // by_id[id - 1] is the string with that id
+static size_t by_id_capacity = 0;
+static string_pool_stats_t stats = {0};
+
+static bool grow_slots() {
+    size_t new_count = slot_count == 0 ? 1024 : slot_count * 2;
+    pool_slot_t* new_slots = calloc(new_count, sizeof(pool_slot_t));
+    if (!new_slots) return false;
+
+    size_t mask = new_count - 1;
+    for (size_t n = 0; n < slot_count; n++) {
+        if (!slots[n].string) continue;
+        size_t i = slots[n].hash & mask;
+        while (new_slots[i].string) i = (i + 1) & mask;
+        new_slots[i] = slots[n];
+    }
+    free(slots);
+    slots = new_slots;
+    slot_count = new_count;
+    return true;
+}
+
+// every string is stored right after its id, so the id of a pointer is one read away
+static char* store(const char* s, size_t len, uint32_t id) {
+    size_t needed = sizeof(uint32_t) + len;
+    if (!chunks || chunks->size - chunks->used < needed) {
+        size_t size = needed > STRING_POOL_CHUNK_SIZE ? needed : STRING_POOL_CHUNK_SIZE;
+        pool_chunk_t* chunk = malloc(sizeof(pool_chunk_t) + size);
+        if (!chunk) return NULL;
+        chunk->next = chunks;
+        chunk->used = 0;
+        chunk->size = size;
+        chunks = chunk;
+    }
+
+    char* copy = chunks->data + chunks->used + sizeof(uint32_t);
+    memcpy(copy - sizeof(uint32_t), &id, sizeof(uint32_t));
+    memcpy(copy, s, len);
+    chunks->used += needed;
+    return copy;
+}
+
+const char* string_pool_intern(const char* s) {
+    if (!s) {
+        LOG_ERROR("Couldn't intern string; string is NULL.");
+        return NULL;
+    }
+
+    uint64_t hash = cache_path_hash(s);
+    pthread_mutex_lock(&pool_lock);
+    stats.lookups++;
+
+    // keep the table at most half full
+    if ((stats.strings + 1) * 2 > slot_count && !grow_slots()) {
+        pthread_mutex_unlock(&pool_lock);
+        LOG_ERROR("Memory allocation failed; couldn't intern string.");
+        return NULL;
+    }
+
+    size_t mask = slot_count - 1;
+    size_t i = hash & mask;
+    for (; slots[i].string; i = (i + 1) & mask) {
+        if (slots[i].hash == hash && strcmp(slots[i].string, s) == 0) {
+            stats.hits++;
+            const char* found = slots[i].string;
+            pthread_mutex_unlock(&pool_lock);
+            return found;
+        }
+    }
+
+    if (stats.strings >= by_id_capacity) {
+        size_t new_capacity = by_id_capacity == 0 ? 1024 : by_id_capacity * 2;
+        const char** tmp = realloc(by_id, new_capacity * sizeof(const char*));
+        if (!tmp) {
+            pthread_mutex_unlock(&pool_lock);
+            LOG_ERROR("Memory allocation failed; couldn't intern string.");
+            return NULL;
+        }
+        by_id = tmp;
+        by_id_capacity = new_capacity;
+    }
+
+    size_t len = strlen(s) + 1;
+    char* copy = store(s, len, (uint32_t)stats.strings + 1);
+    if (copy) {
+        slots[i] = (pool_slot_t){ copy, hash };
+        by_id[stats.strings] = copy;
+        stats.strings++;
+        stats.bytes += len;
+    }
+    pthread_mutex_unlock(&pool_lock);
+
+    if (!copy) LOG_ERROR("Memory allocation failed; couldn't intern string.");
+    return copy;
+}
+
+uint32_t string_pool_id(const char* interned) {
+    if (!interned) return 0;
+
+    uint32_t id;
+    memcpy(&id, interned - sizeof(uint32_t), sizeof(uint32_t));
+    return id;
+}
+
+const char* string_pool_get(uint32_t id) {
+    pthread_mutex_lock(&pool_lock);
+    const char* s = id > 0 && id <= stats.strings ? by_id[id - 1] : NULL;
+    pthread_mutex_unlock(&pool_lock);
+    return s;
+}
+
+string_pool_stats_t string_pool_get_stats() {
+    pthread_mutex_lock(&pool_lock);
+    string_pool_stats_t copy = stats;
+    pthread_mutex_unlock(&pool_lock);
+    return copy;
+}
+
+void string_pool_log_stats() {
+    string_pool_stats_t s = string_pool_get_stats();
+    LOG_INFO("String pool: %zu strings in %zu bytes, %zu of %zu lookups shared an existing copy.",
+             s.strings, s.bytes, s.hits, s.lookups);
+}
+
+void string_pool_clear() {
+    pthread_mutex_lock(&pool_lock);
+    while (chunks) {
+        pool_chunk_t* next = chunks->next;
+        free(chunks);
+        chunks = next;
+    }
+    free(slots);
+    slots = NULL;
+    slot_count = 0;
+    free(by_id);
+    by_id = NULL;
+    by_id_capacity = 0;
+    stats = (string_pool_stats_t){0};
+    pthread_mutex_unlock(&pool_lock);
+}
@@ -0,0 +1,646 @@
+#define _GNU_SOURCE
+#include "watcher.h"
+#include "scan_cache.h"
+#include "scanner.h"
+#include "logger.h"
+#include <stdlib.h>
+#include <string.h>
+#include <stdio.h>
+#include <stdalign.h>
+#include <stdatomic.h>
+#include <pthread.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <time.h>
+#include <unistd.h>
+#include <dirent.h>
+#include <sys/stat.h>
+#include <sys/inotify.h>
+
+#define WATCHER_CHANNEL_SLOTS 32
+#define WATCHER_EVENT_BUFFER 65536
+#define WATCHER_MASK (IN_CREATE | IN_DELETE | IN_CLOSE_WRITE | \
+                      IN_MOVED_FROM | IN_MOVED_TO | IN_DELETE_SELF | IN_MOVE_SELF | IN_ONLYDIR)
+
+// a change waiting to be coalesced, seq keeps the order events arrived in
+typedef struct pending_op {
+    watcher_op_kind_t kind;
+    char* path;
+    size_t seq;
+} pending_op_t;
+
+struct watcher {
+    pthread_t thread;
+    int inotify_fd;
+    int wake_pipe[2]; // written to on shutdown to interrupt poll()
+    char* root;
+    watcher_options_t options;
+
+    // watch descriptors map straight to the watched directory's path
+    char** wd_paths;
+    size_t wd_capacity;
+    size_t watch_count;
+    size_t budget;
+    size_t unwatched;
+
+    pending_op_t* pending;
+    size_t pending_count;
+    size_t pending_capacity;
+    size_t seq;
+    double first_pending; // when the oldest pending change came in
+    double last_event;
+
+    // single producer single consumer ring of finished batches
+    watcher_batch_t slots[WATCHER_CHANNEL_SLOTS];
+    atomic_size_t head;
+    atomic_size_t tail;
+
+    alignas(struct inotify_event) char buffer[WATCHER_EVENT_BUFFER];
+};
+
+static double now_seconds() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (double)ts.tv_sec + (double)ts.tv_nsec / 1e9;
+}
+
+static char* join_path(const char* dir, const char* name) {
+    size_t dir_len = strlen(dir);
+    size_t name_len = strlen(name);
+    char* path = malloc(dir_len + name_len + 2);
+    if (!path) return NULL;
+
+    memcpy(path, dir, dir_len);
+    path[dir_len] = '/';
+    memcpy(path + dir_len + 1, name, name_len + 1);
+    return path;
+}
+
+// true if path is prefix itself or lies below it
+static bool is_under(const char* path, const char* prefix) {
+    size_t len = strlen(prefix);
+    return strncmp(path, prefix, len) == 0 && (path[len] == '\0' || path[len] == '/');
+}
+
+// reads the kernel's per user watch limit, 8192 is the historical default
+static size_t kernel_watch_limit() {
+    size_t limit = 8192;
+    FILE* file = fopen("/proc/sys/fs/inotify/max_user_watches", "r");
+    if (file) {
+        unsigned long value;
+        if (fscanf(file, "%lu", &value) == 1 && value > 0) limit = value;
+        fclose(file);
+    }
+    return limit;
+}
+
+// pending changes
+// ---------------
+
+static void queue_op(watcher_t* w, watcher_op_kind_t kind, char* path) {
+    if (!path) return;
+
+    if (w->pending_count >= w->pending_capacity) {
+        size_t new_capacity = w->pending_capacity == 0 ? 64 : w->pending_capacity * 2;
+        pending_op_t* tmp = realloc(w->pending, new_capacity * sizeof(pending_op_t));
+        if (!tmp) {
+            LOG_ERROR("Memory allocation failed; dropping change: %s", path);
+            free(path);
+            return;
+        }
+        w->pending = tmp;
+        w->pending_capacity = new_capacity;
+    }
+
+    if (w->pending_count == 0) w->first_pending = now_seconds();
+    w->pending[w->pending_count++] = (pending_op_t){ kind, path, w->seq++ };
+}
+
+// orders pending changes by path, changes to one path in arrival order
+static int compare_pending(const void* a, const void* b) {
+    const pending_op_t* x = a;
+    const pending_op_t* y = b;
+
+    int cmp = strcmp(x->path, y->path);
+    if (cmp != 0) return cmp;
+    return x->seq < y->seq ? -1 : (x->seq > y->seq ? 1 : 0);
+}
+
+static bool is_dir_op(const pending_op_t* op) {
+    return op->kind == WATCHER_REMOVE_DIR;
+}
+
+// turns the pending changes into one batch where every path appears once
+// e.g. a file written and deleted again within the window only shows up as a removal
+static bool coalesce(watcher_t* w, watcher_batch_t* out) {
+    out->ops = NULL;
+    out->count = 0;
+
+    // a lost event means nothing else in the window can be trusted
+    for (size_t i = 0; i < w->pending_count; i++) {
+        if (w->pending[i].kind != WATCHER_RESCAN) continue;
+
+        out->ops = malloc(sizeof(watcher_op_t));
+        if (!out->ops) return false;
+        out->ops[0] = (watcher_op_t){ WATCHER_RESCAN, w->pending[i].path };
+        out->count = 1;
+        w->pending[i].path = NULL;
+        return true;
+    }
+
+    // a removed directory cancels every earlier change below it
+    for (size_t i = 0; i < w->pending_count; i++) {
+        const pending_op_t* dir = &w->pending[i];
+        if (!dir->path || !is_dir_op(dir)) continue;
+
+        for (size_t j = 0; j < w->pending_count; j++) {
+            pending_op_t* op = &w->pending[j];
+            if (op->path && op->seq < dir->seq && is_under(op->path, dir->path)) {
+                free(op->path);
+                op->path = NULL;
+            }
+        }
+    }
+
+    // drop the cancelled ones, then group the rest by path
+    size_t kept = 0;
+    for (size_t i = 0; i < w->pending_count; i++) {
+        if (w->pending[i].path) w->pending[kept++] = w->pending[i];
+    }
+    w->pending_count = kept;
+    qsort(w->pending, w->pending_count, sizeof(pending_op_t), compare_pending);
+
+    // the last change to a path wins, files and directories are kept apart
+    for (size_t i = 0; i < w->pending_count; i++) {
+        pending_op_t* op = &w->pending[i];
+        for (size_t j = i + 1; j < w->pending_count && strcmp(w->pending[j].path, op->path) == 0; j++) {
+            if (is_dir_op(&w->pending[j]) == is_dir_op(op)) {
+                free(op->path);
+                op->path = NULL;
+                break;
+            }
+        }
+    }
+
+    out->ops = malloc((w->pending_count ? w->pending_count : 1) * sizeof(watcher_op_t));
+    if (!out->ops) return false;
+
+    // removals go first so a directory that was replaced comes back afterwards
+    const watcher_op_kind_t order[] = { WATCHER_REMOVE_DIR, WATCHER_REMOVE, WATCHER_ADD };
+    for (size_t k = 0; k < sizeof(order) / sizeof(order[0]); k++) {
+        for (size_t i = 0; i < w->pending_count; i++) {
+            pending_op_t* op = &w->pending[i];
+            if (!op->path || op->kind != order[k]) continue;
+
+            out->ops[out->count++] = (watcher_op_t){ op->kind, op->path };
+            op->path = NULL;
+        }
+    }
+    return true;
+}
+
+static void clear_pending(watcher_t* w) {
+    for (size_t i = 0; i < w->pending_count; i++) {
+        free(w->pending[i].path);
+    }
+    w->pending_count = 0;
+}
+
+// hands the pending changes to the consumer, false if the channel is full
+static bool flush_pending(watcher_t* w) {
+    if (w->pending_count == 0) return true;
+
+    size_t tail = atomic_load_explicit(&w->tail, memory_order_relaxed);
+    if (tail - atomic_load_explicit(&w->head, memory_order_acquire) >= WATCHER_CHANNEL_SLOTS) {
+        return false; // keep collecting, try again later
+    }
+
+    watcher_batch_t batch;
+    if (!coalesce(w, &batch)) {
+        LOG_ERROR("Memory allocation failed; dropping %zu library changes.", w->pending_count);
+        clear_pending(w);
+        return true;
+    }
+    clear_pending(w);
+    if (batch.count == 0) {
+        watcher_batch_free(&batch);
+        return true;
+    }
+
+    w->slots[tail % WATCHER_CHANNEL_SLOTS] = batch;
+    atomic_store_explicit(&w->tail, tail + 1, memory_order_release);
+    LOG_INFO("Library changed; %zu updates queued.", batch.count);
+    return true;
+}
+
+// watches
+// -------
+
+// seen is set when the directory was already watched, it keeps its first path then, so a
+// symlink back up the tree doesn't rename it, with seen NULL the new path replaces the old one
+static bool add_watch(watcher_t* w, const char* path, bool* seen) {
+    if (seen) *seen = false;
+    if (w->watch_count >= w->budget) {
+        w->unwatched++;
+        return false;
+    }
+
+    int wd = inotify_add_watch(w->inotify_fd, path, WATCHER_MASK);
+    if (wd < 0) {
+        if (errno == ENOSPC) {
+            // the kernel limit is shared with other programs, stop here
+            w->budget = w->watch_count;
+            w->unwatched++;
+        } else if (errno != ENOENT) {
+            LOG_WARN("Couldn't watch directory: %s", path);
+        }
+        return false;
+    }
+
+    if ((size_t)wd >= w->wd_capacity) {
+        size_t new_capacity = w->wd_capacity == 0 ? 256 : w->wd_capacity;
+        while (new_capacity <= (size_t)wd) new_capacity *= 2;
+        char** tmp = realloc(w->wd_paths, new_capacity * sizeof(char*));
+        if (!tmp) {
+            LOG_ERROR("Memory allocation failed; couldn't watch: %s", path);
+            inotify_rm_watch(w->inotify_fd, wd);
+            return false;
+        }
+        memset(tmp + w->wd_capacity, 0, (new_capacity - w->wd_capacity) * sizeof(char*));
+        w->wd_paths = tmp;
+        w->wd_capacity = new_capacity;
+    }
+
+    // the same directory reached twice gives back the same descriptor
+    if (seen && w->wd_paths[wd]) {
+        *seen = true;
+        return true;
+    }
+
+    char* copy = strdup(path);
+    if (!copy) {
+        inotify_rm_watch(w->inotify_fd, wd);
+        return false;
+    }
+
+    if (w->wd_paths[wd]) {
+        free(w->wd_paths[wd]);
+    } else {
+        w->watch_count++;
+    }
+    w->wd_paths[wd] = copy;
+    return true;
+}
+
+static void forget_watch(watcher_t* w, int wd) {
+    if (wd < 0 || (size_t)wd >= w->wd_capacity || !w->wd_paths[wd]) return;
+    free(w->wd_paths[wd]);
+    w->wd_paths[wd] = NULL;
+    w->watch_count--;
+}
+
+// drops the watches of a directory that moved away, its paths are stale now
+static void remove_watches_under(watcher_t* w, const char* prefix) {
+    for (size_t wd = 0; wd < w->wd_capacity; wd++) {
+        if (w->wd_paths[wd] && is_under(w->wd_paths[wd], prefix)) {
+            inotify_rm_watch(w->inotify_fd, (int)wd);
+            forget_watch(w, (int)wd);
+        }
+    }
+}
+
+// watches a directory tree that showed up after the initial scan
+// its audio files are queued as additions when emit_files is set
+// symlinks are followed like the scanner does, a directory reached twice is only read once
+static void watch_tree(watcher_t* w, const char* path, bool emit_files) {
+    size_t count = 0, capacity = 16;
+    char** stack = malloc(capacity * sizeof(char*));
+    char* first = strdup(path);
+    if (!stack || !first) {
+        free(stack);
+        free(first);
+        return;
+    }
+    stack[count++] = first;
+
+    while (count > 0) {
+        char* dir_path = stack[--count];
+        bool seen;
+        add_watch(w, dir_path, &seen);
+        if (seen) {
+            free(dir_path);
+            continue;
+        }
+
+        DIR* dir = opendir(dir_path);
+        if (!dir) {
+            free(dir_path);
+            continue;
+        }
+
+        struct dirent* entry;
+        while ((entry = readdir(dir)) != NULL) {
+            if (strcmp(entry->d_name, ".") == 0 ||
+                strcmp(entry->d_name, "..") == 0) {
+                continue;
+            }
+
+            unsigned char type = entry->d_type;
+            if (type == DT_UNKNOWN || type == DT_LNK) {
+                struct stat path_stat;
+                if (fstatat(dirfd(dir), entry->d_name, &path_stat, 0) != 0) continue;
+                type = S_ISDIR(path_stat.st_mode) ? DT_DIR : (S_ISREG(path_stat.st_mode) ? DT_REG : DT_UNKNOWN);
+            }
+
+            if (type == DT_DIR) {
+                if (count >= capacity) {
+                    char** tmp = realloc(stack, capacity * 2 * sizeof(char*));
+                    if (!tmp) continue;
+                    stack = tmp;
+                    capacity *= 2;
+                }
+                char* child = join_path(dir_path, entry->d_name);
+                if (child) stack[count++] = child;
+            } else if (type == DT_REG && emit_files && is_audio_file(entry->d_name)) {
+                queue_op(w, WATCHER_ADD, join_path(dir_path, entry->d_name));
+            }
+        }
+        closedir(dir);
+        free(dir_path);
+    }
+    free(stack);
+}
+
+static size_t path_depth(const char* rel_path) {
+    if (rel_path[0] == '\0') return 0;
+    size_t depth = 1;
+    for (; *rel_path; rel_path++) {
+        if (*rel_path == '/') depth++;
+    }
+    return depth;
+}
+
+static int compare_by_depth(const void* a, const void* b) {
+    const scan_cache_dir_t* x = *(const scan_cache_dir_t* const*)a;
+    const scan_cache_dir_t* y = *(const scan_cache_dir_t* const*)b;
+    size_t dx = path_depth(x->rel_path);
+    size_t dy = path_depth(y->rel_path);
+    if (dx != dy) return dx < dy ? -1 : 1;
+    return strcmp(x->rel_path, y->rel_path);
+}
+
+// watches every directory the last scan saw without reading any of them
+// shallow directories go first, so a tight budget still covers the top
+static bool watch_from_cache(watcher_t* w) {
+    char* cache_path = scan_cache_default_path(w->root);
+    scan_cache_t* cache = cache_path ? scan_cache_load(cache_path) : NULL;
+    free(cache_path);
+    if (!cache) return false;
+
+    size_t count = scan_cache_dir_count(cache);
+    const scan_cache_dir_t** dirs = malloc((count ? count : 1) * sizeof(*dirs));
+    if (!dirs) {
+        scan_cache_free(cache);
+        return false;
+    }
+    for (size_t i = 0; i < count; i++) {
+        dirs[i] = scan_cache_get(cache, i);
+    }
+    qsort(dirs, count, sizeof(*dirs), compare_by_depth);
+
+    for (size_t i = 0; i < count; i++) {
+        if (dirs[i]->rel_path[0] == '\0') {
+            add_watch(w, w->root, NULL);
+            continue;
+        }
+        char* path = join_path(w->root, dirs[i]->rel_path);
+        if (path) add_watch(w, path, NULL);
+        free(path);
+    }
+
+    free(dirs);
+    scan_cache_free(cache);
+    return true;
+}
+
+// events
+// ------
+
+static void handle_event(watcher_t* w, const struct inotify_event* ev) {
+    if (ev->mask & IN_Q_OVERFLOW) {
+        LOG_WARN("Watcher event queue overflowed; folder needs a rescan.");
+        queue_op(w, WATCHER_RESCAN, strdup(w->root));
+        return;
+    }
+    if (ev->mask & IN_IGNORED) {
+        forget_watch(w, ev->wd);
+        return;
+    }
+    // the watched folder itself went away, every path below it is stale
+    // other directories also report this, but their parent's event already covered them
+    if ((ev->mask & (IN_DELETE_SELF | IN_MOVE_SELF)) && ev->wd >= 0 && (size_t)ev->wd < w->wd_capacity &&
+        w->wd_paths[ev->wd] && strcmp(w->wd_paths[ev->wd], w->root) == 0) {
+        LOG_WARN("Watched folder was deleted or moved; folder needs a rescan.");
+        remove_watches_under(w, w->root);
+        queue_op(w, WATCHER_RESCAN, strdup(w->root));
+        return;
+    }
+    if (ev->len == 0 || ev->wd < 0 || (size_t)ev->wd >= w->wd_capacity) return;
+
+    const char* dir = w->wd_paths[ev->wd];
+    if (!dir) return;
+
+    if (ev->mask & IN_ISDIR) {
+        char* path = join_path(dir, ev->name);
+        if (!path) return;
+
+        if (ev->mask & (IN_CREATE | IN_MOVED_TO)) {
+            // files may already be inside before the watch is in place
+            watch_tree(w, path, true);
+            free(path);
+        } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+            remove_watches_under(w, path);
+            queue_op(w, WATCHER_REMOVE_DIR, path);
+        } else {
+            free(path);
+        }
+        return;
+    }
+
+    if (!is_audio_file(ev->name)) return;
+
+    if (ev->mask & (IN_CREATE | IN_CLOSE_WRITE | IN_MOVED_TO)) {
+        queue_op(w, WATCHER_ADD, join_path(dir, ev->name));
+    } else if (ev->mask & (IN_DELETE | IN_MOVED_FROM)) {
+        queue_op(w, WATCHER_REMOVE, join_path(dir, ev->name));
+    }
+}
+
+static void read_events(watcher_t* w) {
+    for (;;) {
+        ssize_t length = read(w->inotify_fd, w->buffer, sizeof(w->buffer));
+        if (length <= 0) return; // EAGAIN, nothing left
+
+        w->last_event = now_seconds();
+        for (char* p = w->buffer; p < w->buffer + length;) {
+            const struct inotify_event* ev = (const struct inotify_event*)p;
+            handle_event(w, ev);
+            p += sizeof(struct inotify_event) + ev->len;
+        }
+    }
+}
+
+// milliseconds until pending changes should go out, -1 if there are none
+static int flush_timeout(watcher_t* w) {
+    if (w->pending_count == 0) return -1;
+
+    double now = now_seconds();
+    double quiet = w->last_event + w->options.debounce_ms / 1000.0 - now;
+    double latest = w->first_pending + w->options.max_latency_ms / 1000.0 - now;
+    double wait = quiet < latest ? quiet : latest;
+    return wait <= 0.0 ? 0 : (int)(wait * 1000.0) + 1;
+}
+
+static void* watcher_run(void* arg) {
+    watcher_t* w = arg;
+
+    double start = now_seconds();
+    if (!watch_from_cache(w)) {
+        watch_tree(w, w->root, false);
+    }
+    LOG_INFO("Watching %zu directories in %.3fs: %s", w->watch_count, now_seconds() - start, w->root);
+    if (w->unwatched > 0) {
+        LOG_WARN("Watch limit reached; %zu directories aren't watched for changes.", w->unwatched);
+    }
+
+    struct pollfd fds[2] = {
+        { .fd = w->inotify_fd, .events = POLLIN },
+        { .fd = w->wake_pipe[0], .events = POLLIN },
+    };
+
+    for (;;) {
+        int ready = poll(fds, 2, flush_timeout(w));
+        if (ready < 0 && errno != EINTR) {
+            LOG_ERROR("Watcher poll failed; stopping.");
+            break;
+        }
+        if (fds[1].revents & POLLIN) break;
+        if (fds[0].revents & POLLIN) read_events(w);
+
+        if (w->pending_count > 0 && flush_timeout(w) == 0 && !flush_pending(w)) {
+            // the consumer is behind, hold on to the changes a bit longer
+            w->last_event = now_seconds();
+        }
+    }
+    return NULL;
+}
+
+// public api
+// ----------
+
+watcher_options_t watcher_default_options() {
+    watcher_options_t options = {0};
+    options.max_watches = 0;
+    options.debounce_ms = 300;
+    options.max_latency_ms = 2000;
+    return options;
+}
+
+watcher_t* watcher_start(const char* dir_path, const watcher_options_t* options) {
+    if (!dir_path) {
+        LOG_ERROR("Couldn't start watcher; path is NULL.");
+        return NULL;
+    }
+
+    watcher_t* w = calloc(1, sizeof(watcher_t));
+    if (!w) {
+        LOG_ERROR("Memory allocation failed; couldn't start watcher.");
+        return NULL;
+    }
+    w->options = options ? *options : watcher_default_options();
+    w->inotify_fd = -1;
+    w->wake_pipe[0] = w->wake_pipe[1] = -1;
+    atomic_init(&w->head, 0);
+    atomic_init(&w->tail, 0);
+
+    size_t limit = kernel_watch_limit() / 2;
+    w->budget = w->options.max_watches == 0 || w->options.max_watches > limit
+        ? limit
+        : w->options.max_watches;
+
+    w->root = strdup(dir_path);
+    w->inotify_fd = inotify_init1(IN_NONBLOCK | IN_CLOEXEC);
+    if (!w->root || w->inotify_fd < 0 || pipe2(w->wake_pipe, O_CLOEXEC) != 0) {
+        LOG_ERROR("Couldn't start watcher; inotify is unavailable.");
+        watcher_free(w);
+        return NULL;
+    }
+
+    if (pthread_create(&w->thread, NULL, watcher_run, w) != 0) {
+        LOG_ERROR("Couldn't start watcher thread.");
+        close(w->wake_pipe[1]);
+        w->wake_pipe[1] = -1; // so watcher_free doesn't try to join
+        watcher_free(w);
+        return NULL;
+    }
+
+    return w;
+}
+
+bool watcher_poll(watcher_t* watcher, watcher_batch_t* out) {
+    if (!watcher || !out) {
+        LOG_ERROR("Couldn't poll watcher; watcher or batch is NULL.");
+        return false;
+    }
+
+    size_t head = atomic_load_explicit(&watcher->head, memory_order_relaxed);
+    if (head == atomic_load_explicit(&watcher->tail, memory_order_acquire)) return false;
+
+    *out = watcher->slots[head % WATCHER_CHANNEL_SLOTS];
+    atomic_store_explicit(&watcher->head, head + 1, memory_order_release);
+    return true;
+}
+
+void watcher_batch_free(watcher_batch_t* batch) {
+    if (!batch) return;
+
+    for (size_t i = 0; i < batch->count; i++) {
+        free(batch->ops[i].path);
+    }
+    free(batch->ops);
+    batch->ops = NULL;
+    batch->count = 0;
+}
+
+void watcher_free(watcher_t* watcher) {
+    if (!watcher) {
+        LOG_ERROR("Couldn't free watcher; watcher is NULL.");
+        return;
+    }
+
+    // a running thread always has the write end of the pipe open
+    if (watcher->wake_pipe[1] >= 0) {
+        if (write(watcher->wake_pipe[1], "x", 1) < 0) {
+            LOG_WARN("Couldn't wake watcher thread.");
+        }
+        if (watcher->thread) pthread_join(watcher->thread, NULL);
+        close(watcher->wake_pipe[1]);
+    }
+    if (watcher->wake_pipe[0] >= 0) close(watcher->wake_pipe[0]);
+    if (watcher->inotify_fd >= 0) close(watcher->inotify_fd);
+
+    watcher_batch_t batch;
+    while (watcher_poll(watcher, &batch)) {
+        watcher_batch_free(&batch);
+    }
+    clear_pending(watcher);
+    free(watcher->pending);
+
+    for (size_t wd = 0; wd < watcher->wd_capacity; wd++) {
+        free(watcher->wd_paths[wd]);
+    }
+    free(watcher->wd_paths);
+    free(watcher->root);
+    free(watcher);
+}
@@ -0,0 +1,2289 @@
+#define _GNU_SOURCE
+#include "audio_device.h"
+#include "domain_models.h"
+#include "duration_probe.h"
+#include "flac_writer.h"
+#include "library_db.h"
+#include "library_graph.h"
+#include "logger.h"
+#include "playlist.h"
+#include "scanner.h"
+#include "seek_index.h"
+#include "string_arena.h"
+#include "string_pool.h"
+#include <dirent.h>
+#include <fcntl.h>
+#include <ftw.h>
+#include <linux/perf_event.h>
+#include <malloc.h>
+#include <math.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <sys/ioctl.h>
+#include <sys/stat.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// benchmarks of the library and playback code against the approaches they replaced
+// every subcommand prints what it measured as json lines on stdout, logs go to stderr
+
+static double now_seconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+// allocations made by the player code and the benchmarks, the linker sends every call to
+// malloc, calloc, realloc and strdup through these (see BENCH_LDFLAGS in the makefile)
+static atomic_size_t allocation_count;
+
+void* __real_malloc(size_t size);
+void* __real_calloc(size_t count, size_t size);
+void* __real_realloc(void* pointer, size_t size);
+char* __real_strdup(const char* s);
+
+void* __wrap_malloc(size_t size) {
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+    return __real_malloc(size);
+}
+
+void* __wrap_calloc(size_t count, size_t size) {
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+    return __real_calloc(count, size);
+}
+
+void* __wrap_realloc(void* pointer, size_t size) {
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+    return __real_realloc(pointer, size);
+}
+
+char* __wrap_strdup(const char* s) {
+    atomic_fetch_add_explicit(&allocation_count, 1, memory_order_relaxed);
+    return __real_strdup(s);
+}
+
+// resident memory of the process, from the second field of statm
+static size_t resident_bytes(void) {
+    FILE* file = fopen("/proc/self/statm", "r");
+    if (!file) return 0;
+    size_t pages = 0, resident = 0;
+    bool read_ok = fscanf(file, "%zu %zu", &pages, &resident) == 2;
+    fclose(file);
+    return read_ok ? resident * (size_t)sysconf(_SC_PAGESIZE) : 0;
+}
+
+// bytes handed out by malloc and not freed yet
+static size_t live_heap_bytes(void) {
+    struct mallinfo2 info = mallinfo2();
+    return info.uordblks + info.hblkhd;
+}
+
+// paths can hold anything but a nul, so quotes, backslashes and control characters are escaped
+static void print_json_string(const char* s) {
+    putchar('"');
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') printf("\\%c", c);
+        else if (c < 0x20) printf("\\u%04x", c);
+        else putchar(c);
+    }
+    putchar('"');
+}
+
+// returns the value of option name at argv[*i] and moves past it, NULL if it's another argument
+static const char* option_value(int argc, char** argv, int* i, const char* name) {
+    if (strcmp(argv[*i], name) != 0 || *i + 1 >= argc) return NULL;
+    *i += 1;
+    return argv[*i];
+}
+
+static int remove_entry(const char* path, const struct stat* path_stat, int type, struct FTW* ftw) {
+    (void)path_stat;
+    (void)type;
+    (void)ftw;
+    return remove(path);
+}
+
+// removes a generated tree, the tree is the benchmark's own so symlinks aren't expected
+static void remove_tree(const char* path) {
+    nftw(path, remove_entry, 16, FTW_DEPTH | FTW_PHYS);
+}
+
+// counts the cache misses of this thread, -1 where perf events aren't allowed
+static int cache_counter_open(void) {
+    struct perf_event_attr attr = {0};
+    attr.type = PERF_TYPE_HARDWARE;
+    attr.size = sizeof(attr);
+    attr.config = PERF_COUNT_HW_CACHE_MISSES;
+    attr.disabled = 1;
+    attr.exclude_kernel = 1;
+    attr.exclude_hv = 1;
+    return (int)syscall(SYS_perf_event_open, &attr, 0, -1, -1, 0);
+}
+
+static void cache_counter_start(int counter) {
+    if (counter < 0) return;
+    ioctl(counter, PERF_EVENT_IOC_RESET, 0);
+    ioctl(counter, PERF_EVENT_IOC_ENABLE, 0);
+}
+
+// returns the misses since cache_counter_start, -1 without a counter
+static long long cache_counter_stop(int counter) {
+    if (counter < 0) return -1;
+    ioctl(counter, PERF_EVENT_IOC_DISABLE, 0);
+    long long misses = 0;
+    if (read(counter, &misses, sizeof(misses)) != (ssize_t)sizeof(misses)) return -1;
+    return misses;
+}
+
+// scan
+// ----
+
+// the recursive walker playlist_scan_dir_recursive was before the scanner, its per file log
+// line left out since it would dominate the timing
+static int legacy_compare_strings(const void* a, const void* b) {
+    return strcmp(*(const char**)a, *(const char**)b);
+}
+
+static void legacy_scan(playlist_t* list, const char* dir_path) {
+    DIR* dir = opendir(dir_path);
+    if (!dir) {
+        LOG_ERROR("Failed to open directory: %s", dir_path);
+        return;
+    }
+
+    char** entries = NULL;
+    size_t entry_count = 0;
+    size_t entry_capacity = 0;
+
+    struct dirent* entry;
+    while ((entry = readdir(dir)) != NULL) {
+        if (strcmp(entry->d_name, ".") == 0 ||
+            strcmp(entry->d_name, "..") == 0) {
+            continue;
+        }
+
+        if (entry_count >= entry_capacity) {
+            size_t new_capacity = entry_capacity == 0 ? 16 : entry_capacity * 2;
+            char** tmp = realloc(entries, new_capacity * sizeof(char*));
+            if (!tmp) {
+                LOG_ERROR("Memory allocation failed");
+                break;
+            }
+            entries = tmp;
+            entry_capacity = new_capacity;
+        }
+
+        entries[entry_count++] = strdup(entry->d_name);
+    }
+    closedir(dir);
+
+    qsort(entries, entry_count, sizeof(char*), legacy_compare_strings);
+
+    for (size_t i = 0; i < entry_count; i++) {
+        char full_path[4096];
+        snprintf(full_path, sizeof(full_path), "%s/%s", dir_path, entries[i]);
+
+        struct stat path_stat;
+        if (stat(full_path, &path_stat) == 0) {
+            if (S_ISDIR(path_stat.st_mode)) {
+                legacy_scan(list, full_path);
+            } else if (S_ISREG(path_stat.st_mode)) {
+                if (is_audio_file(full_path)) {
+                    playlist_append(list, full_path);
+                }
+            }
+        }
+        free(entries[i]);
+    }
+    free(entries);
+}
+
+// extensions of the generated files, the ones that aren't audio are skipped by both walkers
+static const char* scan_extensions[] = { "mp3", "flac", "FLAC", "ogg", "m4a", "opus", "jpg", "txt", "cue" };
+#define SCAN_EXTENSION_COUNT (sizeof(scan_extensions) / sizeof(scan_extensions[0]))
+
+// writes fanout subdirectories per level down to depth, each with files empty files
+static bool write_scan_tree(const char* path, size_t depth, size_t fanout, size_t files) {
+    char child[4096];
+    for (size_t i = 0; i < files; i++) {
+        snprintf(child, sizeof(child), "%s/track %03zu.%s", path, i, scan_extensions[i % SCAN_EXTENSION_COUNT]);
+        FILE* file = fopen(child, "w");
+        if (!file) return false;
+        fclose(file);
+    }
+    if (depth == 0) return true;
+    for (size_t i = 0; i < fanout; i++) {
+        snprintf(child, sizeof(child), "%s/Folder %02zu", path, i);
+        if (mkdir(child, 0755) != 0 || !write_scan_tree(child, depth - 1, fanout, files)) return false;
+    }
+    return true;
+}
+
+static void print_scan(const char* walker, size_t files, double seconds, const scanner_stats_t* stats) {
+    printf("{\"event\":\"scan\",\"walker\":\"%s\",\"files\":%zu,\"seconds\":%.6f", walker, files, seconds);
+    if (stats) {
+        printf(",\"threads\":%zu,\"dirs\":%zu,\"stat_calls\":%zu,\"steals\":%zu",
+               stats->threads, stats->dirs_visited, stats->stat_calls, stats->steals);
+    }
+    printf("}\n");
+    fflush(stdout);
+}
+
+static void print_scan_cache(const char* pass, size_t files, double seconds, const scanner_stats_t* stats) {
+    printf("{\"event\":\"scan_cache\",\"pass\":\"%s\",\"files\":%zu,\"seconds\":%.6f,\"dirs\":%zu,"
+           "\"dirs_opened\":%zu,\"cache_hits\":%zu,\"stat_calls\":%zu}\n",
+           pass, files, seconds, stats->dirs_visited, stats->dirs_visited - stats->cache_hits,
+           stats->cache_hits, stats->stat_calls);
+    fflush(stdout);
+}
+
+static bool same_paths(const scanner_result_t* a, const scanner_result_t* b) {
+    if (a->count != b->count) return false;
+    for (size_t i = 0; i < a->count; i++) {
+        if (strcmp(a->paths[i], b->paths[i]) != 0) return false;
+    }
+    return true;
+}
+
+// scans once without a scan cache and then with the cache that scan wrote, from a cache dir
+// of its own, the warm scan only stats the directories and opens none that didn't change
+static bool bench_scan_cache(const char* dir, const scanner_options_t* walk_options, size_t runs,
+                             const scanner_result_t* walked) {
+    char cache[] = "/tmp/bench-scan-cache-XXXXXX";
+    if (!mkdtemp(cache)) {
+        LOG_ERROR("Couldn't create a directory for the scan cache.");
+        return false;
+    }
+    setenv("XDG_CACHE_HOME", cache, 1);
+    scanner_options_t options = *walk_options;
+    options.use_cache = true;
+
+    scanner_result_t cold = {0}, warm = {0};
+    double start = now_seconds();
+    bool scanned = scanner_scan(dir, &options, &cold);
+    double cold_seconds = now_seconds() - start;
+    if (scanned) print_scan_cache("cold", cold.count, cold_seconds, &cold.stats);
+
+    double warm_seconds = 0.0;
+    for (size_t run = 0; scanned && run < runs; run++) {
+        scanner_result_free(&warm);
+        start = now_seconds();
+        scanned = scanner_scan(dir, &options, &warm);
+        double seconds = now_seconds() - start;
+        if (run == 0 || seconds < warm_seconds) warm_seconds = seconds;
+    }
+    if (scanned) print_scan_cache("warm", warm.count, warm_seconds, &warm.stats);
+
+    bool same = scanned && same_paths(&cold, walked) && same_paths(&warm, walked);
+    printf("{\"event\":\"scan_cache_summary\",\"same_order\":%s,\"stat_calls_ratio\":%.2f,\"speedup\":%.2f}\n",
+           same ? "true" : "false",
+           warm.stats.stat_calls > 0 ? (double)cold.stats.stat_calls / (double)warm.stats.stat_calls : 0.0,
+           warm_seconds > 0.0 ? cold_seconds / warm_seconds : 0.0);
+    fflush(stdout);
+
+    scanner_result_free(&cold);
+    scanner_result_free(&warm);
+    remove_tree(cache);
+    return same;
+}
+
+// walks a tree with the old recursive walker and the scanner, best of every run each, and
+// checks that both come up with the same playlist, then times the scanner with its cache
+static int bench_scan(int argc, char** argv) {
+    size_t depth = 3;
+    size_t fanout = 6;
+    size_t files = 30;
+    size_t runs = 3;
+    scanner_options_t options = scanner_default_options();
+    options.use_cache = false; // the walk itself is measured, not the cache
+    const char* dir = NULL;
+    for (int i = 0; i < argc; i++) {
+        const char* value;
+        if ((value = option_value(argc, argv, &i, "--depth"))) depth = strtoul(value, NULL, 10);
+        else if ((value = option_value(argc, argv, &i, "--fanout"))) fanout = strtoul(value, NULL, 10);
+        else if ((value = option_value(argc, argv, &i, "--files"))) files = strtoul(value, NULL, 10);
+        else if ((value = option_value(argc, argv, &i, "--threads"))) options.thread_count = strtoul(value, NULL, 10);
+        else if ((value = option_value(argc, argv, &i, "--runs"))) runs = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "--stat") == 0) options.trust_d_type = false;
+        else if (argv[i][0] != '-' && !dir) dir = argv[i];
+        else return 2;
+    }
+    if (runs == 0) return 2;
+
+    // a synthetic tree unless one is given
+    char tree[] = "/tmp/bench-scan-XXXXXX";
+    if (!dir) {
+        if (!mkdtemp(tree)) {
+            LOG_ERROR("Couldn't create a directory for the synthetic tree.");
+            return 1;
+        }
+        if (!write_scan_tree(tree, depth, fanout, files)) {
+            LOG_ERROR("Couldn't write the synthetic tree.");
+            remove_tree(tree);
+            return 1;
+        }
+        dir = tree;
+    }
+
+    playlist_t legacy = {0};
+    playlist_init(&legacy);
+    double legacy_seconds = 0.0;
+    for (size_t run = 0; run < runs; run++) {
+        playlist_clear(&legacy);
+        double start = now_seconds();
+        legacy_scan(&legacy, dir);
+        double seconds = now_seconds() - start;
+        if (run == 0 || seconds < legacy_seconds) legacy_seconds = seconds;
+    }
+    print_scan("recursive", playlist_count(&legacy), legacy_seconds, NULL);
+
+    scanner_result_t result = {0};
+    double scanner_seconds = 0.0;
+    bool scanned = true;
+    for (size_t run = 0; scanned && run < runs; run++) {
+        scanner_result_free(&result);
+        double start = now_seconds();
+        scanned = scanner_scan(dir, &options, &result);
+        double seconds = now_seconds() - start;
+        if (run == 0 || seconds < scanner_seconds) scanner_seconds = seconds;
+    }
+
+    bool same = scanned && result.count == playlist_count(&legacy);
+    for (size_t i = 0; same && i < result.count; i++) {
+        same = strcmp(result.paths[i], legacy.tracks->items[i]) == 0;
+    }
+    if (scanned) print_scan("scanner", result.count, scanner_seconds, &result.stats);
+
+    printf("{\"event\":\"scan_summary\",\"path\":");
+    print_json_string(dir);
+    printf(",\"runs\":%zu,\"same_order\":%s,\"speedup\":%.2f}\n",
+           runs, same ? "true" : "false", scanner_seconds > 0.0 ? legacy_seconds / scanner_seconds : 0.0);
+    fflush(stdout);
+
+    if (same && !bench_scan_cache(dir, &options, runs, &result)) same = false;
+
+    scanner_result_free(&result);
+    playlist_free(&legacy);
+    if (dir == tree) remove_tree(tree);
+    return same ? 0 : 1;
+}
+
+// columns
+// -------
+
+#define COLUMNS_GENRES 40
+#define COLUMNS_MIN_YEAR 1990
+#define COLUMNS_MAX_YEAR 1999
+
+// buffers every pass writes into
+typedef struct columns_run {
+    track_list_t* list;
+    size_t* out; // list->count indices
+    size_t* counts; // id_count counts
+    size_t id_count;
+} columns_run_t;
+
+// a pass returns what it computed boiled down to one number, so the two sides can be compared
+typedef uint64_t (*columns_pass_fn)(const columns_run_t* run);
+
+// count and positions of the matches
+static uint64_t filter_checksum(const columns_run_t* run, size_t n) {
+    uint64_t checksum = n;
+    for (size_t i = 0; i < n; i++) checksum += run->out[i] * (i + 1);
+    return checksum;
+}
+
+// the row loops are what filters and totals did before the columns, one track_t read per track
+static uint64_t rows_filter_year(const columns_run_t* run) {
+    size_t n = 0;
+    for (size_t i = 0; i < run->list->count; i++) {
+        const track_t* track = &run->list->items[i];
+        if (track->year >= COLUMNS_MIN_YEAR && track->year <= COLUMNS_MAX_YEAR) run->out[n++] = i;
+    }
+    return filter_checksum(run, n);
+}
+
+static uint64_t columns_filter_year(const columns_run_t* run) {
+    return filter_checksum(run, track_list_filter_year(run->list, COLUMNS_MIN_YEAR, COLUMNS_MAX_YEAR, run->out));
+}
+
+static uint64_t rows_sum_duration(const columns_run_t* run) {
+    int64_t total = 0;
+    for (size_t i = 0; i < run->list->count; i++) total += run->list->items[i].duration;
+    return (uint64_t)total;
+}
+
+static uint64_t columns_sum_duration(const columns_run_t* run) {
+    return (uint64_t)track_list_sum_duration(run->list);
+}
+
+static uint64_t genre_checksum(const columns_run_t* run) {
+    uint64_t checksum = 0;
+    for (size_t id = 0; id < run->id_count; id++) checksum += run->counts[id] * (id + 1);
+    return checksum;
+}
+
+static uint64_t rows_count_by_genre(const columns_run_t* run) {
+    memset(run->counts, 0, run->id_count * sizeof(size_t));
+    for (size_t i = 0; i < run->list->count; i++) run->counts[string_pool_id(run->list->items[i].genre)]++;
+    return genre_checksum(run);
+}
+
+static uint64_t columns_count_by_genre(const columns_run_t* run) {
+    track_list_count_by_genre(run->list, run->counts, run->id_count);
+    return genre_checksum(run);
+}
+
+typedef struct columns_pass {
+    const char* name;
+    columns_pass_fn rows;
+    columns_pass_fn columns;
+} columns_pass_t;
+
+static const columns_pass_t columns_passes[] = {
+    { "filter_year", rows_filter_year, columns_filter_year },
+    { "sum_duration", rows_sum_duration, columns_sum_duration },
+    { "count_by_genre", rows_count_by_genre, columns_count_by_genre },
+};
+#define COLUMNS_PASS_COUNT (sizeof(columns_passes) / sizeof(columns_passes[0]))
+
+// runs a pass runs times, keeps the fastest run and the cache misses of that run
+static uint64_t time_columns_pass(columns_pass_fn pass, const columns_run_t* run, size_t runs, int counter,
+                                  double* seconds, long long* misses) {
+    uint64_t result = 0;
+    for (size_t i = 0; i < runs; i++) {
+        cache_counter_start(counter);
+        double start = now_seconds();
+        result = pass(run);
+        double elapsed = now_seconds() - start;
+        long long run_misses = cache_counter_stop(counter);
+        if (i == 0 || elapsed < *seconds) {
+            *seconds = elapsed;
+            *misses = run_misses;
+        }
+    }
+    return result;
+}
+
+static void print_columns(const char* pass, const char* layout, size_t tracks, double seconds, long long misses) {
+    printf("{\"event\":\"columns\",\"pass\":\"%s\",\"layout\":\"%s\",\"tracks\":%zu,\"seconds\":%.6f,\"cache_misses\":",
+           pass, layout, tracks, seconds);
+    if (misses < 0) printf("null}\n");
+    else printf("%lld}\n", misses);
+    fflush(stdout);
+}
+
+// filters and totals a synthetic library with loops over the track records against the
+// column kernels, checking that both compute the same
+static int bench_columns(int argc, char** argv) {
+    size_t tracks = 1000000;
+    size_t runs = 5;
+    for (int i = 0; i < argc; i++) {
+        const char* value;
+        if ((value = option_value(argc, argv, &i, "--tracks"))) tracks = strtoul(value, NULL, 10);
+        else if ((value = option_value(argc, argv, &i, "--runs"))) runs = strtoul(value, NULL, 10);
+        else return 2;
+    }
+    if (tracks == 0 || runs == 0) return 2;
+
+    const char* genres[COLUMNS_GENRES];
+    char text[96];
+    for (size_t g = 0; g < COLUMNS_GENRES; g++) {
+        snprintf(text, sizeof(text), "Genre %zu", g);
+        genres[g] = string_pool_intern(text);
+    }
+
+    columns_run_t run = {0};
+    run.list = track_list_create();
+    run.id_count = string_pool_get_stats().strings + 1;
+    run.out = malloc(tracks * sizeof(size_t));
+    run.counts = malloc(run.id_count * sizeof(size_t));
+    bool built = run.list && run.out && run.counts;
+    const char* paths[1] = { text };
+    for (size_t i = 0; built && i < tracks; i++) {
+        snprintf(text, sizeof(text), "/music/Artist %zu/Album %zu/%zu.flac", i / 300, i / 12, i);
+        built = track_list_append_paths(run.list, paths, 1);
+        if (!built) break;
+        track_t* track = &run.list->items[i];
+        track->year = 1950 + (int)((i * 7919) % 75);
+        track->duration = 120 + (int)(i % 300);
+        track->genre = genres[(i * 31) % COLUMNS_GENRES];
+        track_list_refresh(run.list, track);
+    }
+    if (!built) {
+        LOG_ERROR("Couldn't build a library of %zu tracks.", tracks);
+        track_list_free(run.list);
+        free(run.out);
+        free(run.counts);
+        return 1;
+    }
+
+    int counter = cache_counter_open();
+    if (counter < 0) LOG_INFO("Perf events aren't available, cache misses aren't counted.");
+
+    bool same = true;
+    for (size_t p = 0; p < COLUMNS_PASS_COUNT; p++) {
+        double row_seconds = 0.0, column_seconds = 0.0;
+        long long row_misses = -1, column_misses = -1;
+        uint64_t rows = time_columns_pass(columns_passes[p].rows, &run, runs, counter, &row_seconds, &row_misses);
+        uint64_t columns = time_columns_pass(columns_passes[p].columns, &run, runs, counter, &column_seconds, &column_misses);
+        print_columns(columns_passes[p].name, "rows", tracks, row_seconds, row_misses);
+        print_columns(columns_passes[p].name, "columns", tracks, column_seconds, column_misses);
+        if (rows != columns) {
+            LOG_ERROR("The %s kernel disagrees with the row loop.", columns_passes[p].name);
+            same = false;
+        }
+        printf("{\"event\":\"columns_summary\",\"pass\":\"%s\",\"runs\":%zu,\"same_result\":%s,\"speedup\":%.2f}\n",
+               columns_passes[p].name, runs, rows == columns ? "true" : "false",
+               column_seconds > 0.0 ? row_seconds / column_seconds : 0.0);
+        fflush(stdout);
+    }
+
+    if (counter >= 0) close(counter);
+    track_list_free(run.list);
+    free(run.out);
+    free(run.counts);
+    return same ? 0 : 1;
+}
+
+// remove
+// ------
+
+#define REMOVE_FOLDER_TRACKS 100
+#define REMOVE_EVERY_FOLDER 40 // every 40th folder goes, tracks spread over the whole list
+
+static track_list_t* make_remove_list(size_t tracks) {
+    track_list_t* list = track_list_create();
+    if (!list) return NULL;
+    char path[96];
+    const char* paths[1] = { path };
+    for (size_t i = 0; i < tracks; i++) {
+        snprintf(path, sizeof(path), "/music/Folder %06zu/track %06zu.flac", i / REMOVE_FOLDER_TRACKS, i);
+        if (!track_list_append_paths(list, paths, 1)) {
+            track_list_free(list);
+            return NULL;
+        }
+    }
+    return list;
+}
+
+static bool in_removed_folder(const track_t* track, void* ctx) {
+    (void)ctx;
+    return strtoul(track->path + strlen("/music/Folder "), NULL, 10) % REMOVE_EVERY_FOLDER == 0;
+}
+
+static bool same_tracks(const track_list_t* a, const track_list_t* b) {
+    if (a->count != b->count) return false;
+    for (size_t i = 0; i < a->count; i++) {
+        if (strcmp(a->items[i].path, b->items[i].path) != 0) return false;
+    }
+    return true;
+}
+
+static void print_remove(const char* pass, const char* method, size_t tracks, size_t removed, double seconds) {
+    printf("{\"event\":\"remove\",\"pass\":\"%s\",\"method\":\"%s\",\"tracks\":%zu,\"removed\":%zu,\"seconds\":%.6f}\n",
+           pass, method, tracks, removed, seconds);
+    fflush(stdout);
+}
+
+// removes the first track over and over with the shifting remove and with swap-remove, then
+// whole folders spread over the list one track at a time against marking and one sweep
+static int bench_remove(int argc, char** argv) {
+    size_t tracks = 50000;
+    size_t firsts = 20;
+    for (int i = 0; i < argc; i++) {
+        const char* value;
+        if ((value = option_value(argc, argv, &i, "--tracks"))) tracks = strtoul(value, NULL, 10);
+        else if ((value = option_value(argc, argv, &i, "--firsts"))) firsts = strtoul(value, NULL, 10);
+        else return 2;
+    }
+    if (tracks == 0 || firsts == 0 || firsts > tracks / 2) return 2;
+
+    track_list_t* lists[3] = {0};
+    for (size_t i = 0; i < 3; i++) {
+        if (!(lists[i] = make_remove_list(tracks))) {
+            LOG_ERROR("Couldn't build a list of %zu tracks.", tracks);
+            for (size_t j = 0; j < i; j++) track_list_free(lists[j]);
+            return 1;
+        }
+    }
+
+    // the first track, the shifting remove moves every other one
+    double start = now_seconds();
+    for (size_t i = 0; i < firsts; i++) track_list_remove(lists[0], 0);
+    print_remove("first", "shift", tracks, firsts, now_seconds() - start);
+    start = now_seconds();
+    for (size_t i = 0; i < firsts; i++) track_list_swap_remove(lists[1], 0);
+    print_remove("first", "swap", tracks, firsts, now_seconds() - start);
+
+    for (size_t i = 0; i < 2; i++) {
+        track_list_free(lists[i]);
+        if (!(lists[i] = make_remove_list(tracks))) {
+            LOG_ERROR("Couldn't build a list of %zu tracks.", tracks);
+            for (size_t j = 0; j < 3; j++) if (j != i) track_list_free(lists[j]);
+            return 1;
+        }
+    }
+
+    // folders, back to front so the indices still to visit don't move
+    start = now_seconds();
+    for (size_t i = tracks; i-- > 0;) {
+        if (in_removed_folder(&lists[0]->items[i], NULL)) track_list_remove(lists[0], i);
+    }
+    double loop_seconds = now_seconds() - start;
+    print_remove("folders", "loop", tracks, tracks - lists[0]->count, loop_seconds);
+
+    start = now_seconds();
+    for (size_t i = 0; i < lists[1]->count; i++) {
+        if (in_removed_folder(&lists[1]->items[i], NULL)) track_list_mark_removed(lists[1], i);
+    }
+    track_list_sweep(lists[1]);
+    double sweep_seconds = now_seconds() - start;
+    print_remove("folders", "mark_sweep", tracks, tracks - lists[1]->count, sweep_seconds);
+
+    start = now_seconds();
+    track_list_remove_if(lists[2], in_removed_folder, NULL);
+    print_remove("folders", "remove_if", tracks, tracks - lists[2]->count, now_seconds() - start);
+
+    bool same = same_tracks(lists[0], lists[1]) && same_tracks(lists[0], lists[2]);
+    printf("{\"event\":\"remove_summary\",\"same_tracks\":%s,\"speedup\":%.2f}\n",
+           same ? "true" : "false", sweep_seconds > 0.0 ? loop_seconds / sweep_seconds : 0.0);
+    fflush(stdout);
+
+    for (size_t i = 0; i < 3; i++) track_list_free(lists[i]);
+    return same ? 0 : 1;
+}
+
+// crossfade
+// ---------
+
+#define CROSSFADE_RATE 48000 // of the engine, the tracks are 44100 so both decoders resample
+#define CROSSFADE_TRACK_RATE 44100
+#define CROSSFADE_LEVEL 12000 // of the constant tracks, an equal-power fade never dips below it
+
+// writes a track that holds one level, so any dip during the fade shows in the output
+static bool write_level_track(const char* path, double seconds) {
+    ma_encoder_config config = ma_encoder_config_init(ma_encoding_format_wav, ma_format_s16, 2, CROSSFADE_TRACK_RATE);
+    ma_encoder encoder;
+    if (ma_encoder_init_file(path, &config, &encoder) != MA_SUCCESS) {
+        LOG_ERROR("Couldn't create test track %s.", path);
+        return false;
+    }
+
+    size_t frames = (size_t)(seconds * CROSSFADE_TRACK_RATE);
+    int16_t block[1024 * 2];
+    for (size_t i = 0; i < 1024 * 2; i++) block[i] = CROSSFADE_LEVEL;
+    bool success = true;
+    for (size_t done = 0; success && done < frames; done += 1024) {
+        size_t count = frames - done < 1024 ? frames - done : 1024;
+        ma_uint64 written = 0;
+        success = ma_encoder_write_pcm_frames(&encoder, block, count, &written) == MA_SUCCESS && written == count;
+    }
+    ma_encoder_uninit(&encoder);
+    return success;
+}
+
+// blocks inside the fade window against the rest, the window is where the fade plays when on
+typedef struct crossfade_run {
+    double inside_seconds;
+    size_t inside_blocks;
+    double outside_seconds;
+    size_t outside_blocks;
+    float inside_level_min;
+    size_t transitions;
+} crossfade_run_t;
+
+// plays first then second without a device and times every block the engine renders
+// the decode thread reads at most buffer_ms ahead, so a block's time is the decoding behind it
+static bool run_crossfade(const char* first, const char* second, double seconds, float fade,
+                          size_t block, unsigned int buffer_ms, crossfade_run_t* run) {
+    audio_device_options_t options = audio_device_default_options();
+    options.output = AUDIO_DEVICE_OUTPUT_NONE;
+    options.sample_rate = CROSSFADE_RATE;
+    options.buffer_ms = buffer_ms;
+    audio_device_t dev = {0};
+    if (!audio_device_init(&dev, &options)) return false;
+    float* buffer = malloc(block * ma_engine_get_channels(&dev.engine) * sizeof(float));
+    if (!buffer) {
+        LOG_ERROR("Memory allocation failed; couldn't render.");
+        audio_device_free(&dev);
+        return false;
+    }
+
+    audio_device_set_crossfade(&dev, fade);
+    bool success = audio_device_play_file(&dev, first);
+    while (success && audio_device_get_state(&dev).loading) {
+        if (!dev.sound_loaded) success = false;
+        else audio_device_render(&dev, buffer, block);
+    }
+    if (success) success = audio_device_queue_next(&dev, second);
+
+    // the first track's last fade seconds, counted from its first frame heard
+    size_t window_start = (size_t)((seconds - (double)fade) * CROSSFADE_RATE);
+    size_t window_end = (size_t)(seconds * CROSSFADE_RATE);
+    if (fade == 0.0f) window_end = window_start + CROSSFADE_RATE; // the second after the gapless transition
+    *run = (crossfade_run_t){ .inside_level_min = 1.0f };
+    size_t frame = 0;
+    while (success && !audio_device_is_finished(&dev)) {
+        double start = now_seconds();
+        size_t rendered = audio_device_render(&dev, buffer, block);
+        double elapsed = now_seconds() - start;
+        if (audio_device_poll_transition(&dev)) run->transitions++;
+        if (rendered == 0) break;
+        if (frame >= window_start && frame + rendered <= window_end) {
+            run->inside_seconds += elapsed;
+            run->inside_blocks++;
+            for (size_t i = 0; i < rendered; i++) {
+                if (buffer[i * 2] < run->inside_level_min) run->inside_level_min = buffer[i * 2];
+            }
+        } else if (frame + rendered <= window_start || frame >= window_end) {
+            run->outside_seconds += elapsed;
+            run->outside_blocks++;
+        }
+        frame += rendered;
+    }
+
+    free(buffer);
+    audio_device_free(&dev);
+    if (!success) LOG_ERROR("Couldn't play %s then %s.", first, second);
+    return success;
+}
+
+static void print_crossfade(const char* mode, float fade, const crossfade_run_t* run, size_t block) {
+    printf("{\"event\":\"crossfade\",\"mode\":\"%s\",\"fade_seconds\":%.2f,\"block_frames\":%zu,"
+           "\"inside_us\":%.2f,\"outside_us\":%.2f,\"inside_level_min\":%.4f,\"transitions\":%zu}\n",
+           mode, fade, block,
+           run->inside_blocks ? run->inside_seconds * 1e6 / (double)run->inside_blocks : 0.0,
+           run->outside_blocks ? run->outside_seconds * 1e6 / (double)run->outside_blocks : 0.0,
+           run->inside_level_min, run->transitions);
+    fflush(stdout);
+}
+
+// plays two constant tracks gapless and crossfaded, compares the cost of a block while two
+// tracks decode and mix to one track decoding, and checks the fade keeps the level up
+static int bench_crossfade(int argc, char** argv) {
+    double seconds = 20.0;
+    float fade = 8.0f;
+    size_t block = 480;
+    unsigned int buffer_ms = 20;
+    for (int i = 0; i < argc; i++) {
+        const char* value;
+        if ((value = option_value(argc, argv, &i, "--seconds"))) seconds = strtod(value, NULL);
+        else if ((value = option_value(argc, argv, &i, "--fade"))) fade = strtof(value, NULL);
+        else if ((value = option_value(argc, argv, &i, "--block"))) block = strtoul(value, NULL, 10);
+        else if ((value = option_value(argc, argv, &i, "--buffer-ms"))) buffer_ms = (unsigned int)strtoul(value, NULL, 10);
+        else return 2;
+    }
+    if (fade <= 0.0f || seconds <= (double)fade + 1.0 || block == 0 || buffer_ms == 0) return 2;
+
+    char dir[] = "/tmp/bench-crossfade-XXXXXX";
+    if (!mkdtemp(dir)) {
+        LOG_ERROR("Couldn't create a directory for the test tracks.");
+        return 1;
+    }
+    char first[64], second[64];
+    snprintf(first, sizeof(first), "%s/first.wav", dir);
+    snprintf(second, sizeof(second), "%s/second.wav", dir);
+
+    crossfade_run_t gapless = {0}, faded = {0};
+    bool success = write_level_track(first, seconds) && write_level_track(second, seconds) &&
+                   run_crossfade(first, second, seconds, 0.0f, block, buffer_ms, &gapless) &&
+                   run_crossfade(first, second, seconds, fade, block, buffer_ms, &faded);
+    remove_tree(dir);
+    if (!success) return 1;
+
+    print_crossfade("gapless", 0.0f, &gapless, block);
+    print_crossfade("crossfade", fade, &faded, block);
+    double one = faded.outside_blocks ? faded.outside_seconds / (double)faded.outside_blocks : 0.0;
+    double two = faded.inside_blocks ? faded.inside_seconds / (double)faded.inside_blocks : 0.0;
+    // a little under the level for the resampler's rounding
+    bool level_held = faded.inside_blocks > 0 && faded.inside_level_min >= CROSSFADE_LEVEL / 32768.0f * 0.99f;
+    bool one_transition = gapless.transitions == 1 && faded.transitions == 1;
+    printf("{\"event\":\"crossfade_summary\",\"cost_ratio\":%.2f,\"level_held\":%s,\"one_transition\":%s}\n",
+           one > 0.0 ? two / one : 0.0, level_held ? "true" : "false", one_transition ? "true" : "false");
+    fflush(stdout);
+    return level_held && one_transition ? 0 : 1;
+}
+
+// decode
+// ------
+
+#define DECODE_RATE 44100
+#define DECODE_BLOCK 4096
+
+// writes the same noisy tone as wav and flac, noise keeps the flac from compressing to nothing
+static bool write_decode_tracks(const char* wav_path, const char* flac_path, double seconds) {
+    ma_encoder_config config = ma_encoder_config_init(ma_encoding_format_wav, ma_format_s16, 2, DECODE_RATE);
+    ma_encoder encoder;
+    if (ma_encoder_init_file(wav_path, &config, &encoder) != MA_SUCCESS) {
+        LOG_ERROR("Couldn't create test track %s.", wav_path);
+        return false;
+    }
+    flac_writer_t* flac = flac_writer_open(flac_path, DECODE_RATE, 2);
+    if (!flac) {
+        LOG_ERROR("Couldn't create test track %s.", flac_path);
+        ma_encoder_uninit(&encoder);
+        return false;
+    }
+
+    size_t frames = (size_t)(seconds * DECODE_RATE);
+    int16_t block[1024 * 2];
+    uint32_t noise = 1;
+    bool success = true;
+    for (size_t done = 0; success && done < frames; done += 1024) {
+        size_t count = frames - done < 1024 ? frames - done : 1024;
+        for (size_t i = 0; i < count; i++) {
+            double tone = 0.3 * sin(2.0 * M_PI * 220.0 * (double)(done + i) / DECODE_RATE);
+            for (size_t c = 0; c < 2; c++) {
+                noise = noise * 1664525u + 1013904223u;
+                block[i * 2 + c] = (int16_t)(tone * 32767.0) + (int16_t)((noise >> 16) % 2048) - 1024;
+            }
+        }
+        ma_uint64 written = 0;
+        success = ma_encoder_write_pcm_frames(&encoder, block, count, &written) == MA_SUCCESS && written == count &&
+                  flac_writer_write(flac, block, count);
+    }
+    ma_encoder_uninit(&encoder);
+    return flac_writer_close(flac) && success;
+}
+
+// drops the file from the page cache, so the next read comes from the disk
+static void drop_cached_pages(const char* path) {
+    int fd = open(path, O_RDONLY);
+    if (fd < 0) return;
+    fdatasync(fd);
+    posix_fadvise(fd, 0, 0, POSIX_FADV_DONTNEED);
+    close(fd);
+}
+
+// plays a file from start to end as fast as the decode thread goes, at the file's own rate so
+// no resampling is timed, sums the samples to compare what both readers decoded
+static bool run_decode(const char* path, uint32_t sample_rate, bool map_files, bool cold,
+                       double* seconds, double* checksum) {
+    audio_device_options_t options = audio_device_default_options();
+    options.output = AUDIO_DEVICE_OUTPUT_NONE;
+    options.sample_rate = sample_rate;
+    options.map_files = map_files;
+    audio_device_t dev = {0};
+    if (!audio_device_init(&dev, &options)) return false;
+    float* buffer = malloc(DECODE_BLOCK * ma_engine_get_channels(&dev.engine) * sizeof(float));
+    if (!buffer) {
+        LOG_ERROR("Memory allocation failed; couldn't render.");
+        audio_device_free(&dev);
+        return false;
+    }
+
+    if (cold) drop_cached_pages(path);
+    double sum = 0.0;
+    double start = now_seconds();
+    bool success = audio_device_play_file(&dev, path);
+    while (success && !audio_device_is_finished(&dev)) {
+        size_t rendered = audio_device_render(&dev, buffer, DECODE_BLOCK);
+        if (!dev.sound_loaded) success = false;
+        for (size_t i = 0; i < rendered * 2; i++) sum += buffer[i];
+    }
+    *seconds = now_seconds() - start;
+    *checksum = sum;
+
+    free(buffer);
+    audio_device_free(&dev);
+    if (!success) LOG_ERROR("Couldn't decode %s.", path);
+    return success;
+}
+
+static uint32_t file_sample_rate(const char* path) {
+    ma_decoder decoder;
+    if (ma_decoder_init_file(path, NULL, &decoder) != MA_SUCCESS) return 0;
+    uint32_t sample_rate = decoder.outputSampleRate;
+    ma_decoder_uninit(&decoder);
+    return sample_rate;
+}
+
+// decodes every file with stdio reads and from a memory mapping, best of every run each
+static bool bench_decode_file(const char* path, size_t runs, bool cold) {
+    struct stat file_stat;
+    uint32_t sample_rate = file_sample_rate(path);
+    if (stat(path, &file_stat) != 0 || sample_rate == 0) {
+        LOG_ERROR("Couldn't open %s as audio.", path);
+        return false;
+    }
+
+    double best[2] = {0.0, 0.0};
+    double checksums[2] = {0.0, 0.0};
+    for (size_t map = 0; map < 2; map++) {
+        for (size_t run = 0; run < runs; run++) {
+            double seconds;
+            if (!run_decode(path, sample_rate, map == 1, cold, &seconds, &checksums[map])) return false;
+            if (run == 0 || seconds < best[map]) best[map] = seconds;
+        }
+        printf("{\"event\":\"decode\",\"path\":");
+        print_json_string(path);
+        printf(",\"reader\":\"%s\",\"cache\":\"%s\",\"bytes\":%lld,\"seconds\":%.6f,\"mb_per_second\":%.1f}\n",
+               map ? "mmap" : "stdio", cold ? "cold" : "warm", (long long)file_stat.st_size, best[map],
+               best[map] > 0.0 ? (double)file_stat.st_size / best[map] / 1e6 : 0.0);
+        fflush(stdout);
+    }
+
+    bool same = checksums[0] == checksums[1];
+    printf("{\"event\":\"decode_summary\",\"path\":");
+    print_json_string(path);
+    printf(",\"runs\":%zu,\"same_samples\":%s,\"speedup\":%.3f}\n",
+           runs, same ? "true" : "false", best[1] > 0.0 ? best[0] / best[1] : 0.0);
+    fflush(stdout);
+    return same;
+}
+
+// generated wav and flac files unless files are given, mp3 only from files since there's
+// no encoder for it here
+static int bench_decode(int argc, char** argv) {
+    double seconds = 180.0;
+    size_t runs = 5;
+    bool cold = false;
+    int first_file = argc;
+    for (int i = 0; i < argc; i++) {
+        const char* value;
+        if ((value = option_value(argc, argv, &i, "--seconds"))) seconds = strtod(value, NULL);
+        else if ((value = option_value(argc, argv, &i, "--runs"))) runs = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "--cold") == 0) cold = true;
+        else if (argv[i][0] != '-') {
+            first_file = i;
+            break;
+        } else return 2;
+    }
+    if (runs == 0 || seconds <= 0.0) return 2;
+
+    char dir[] = "/tmp/bench-decode-XXXXXX";
+    char wav[64], flac[64];
+    const char* generated[] = { wav, flac };
+    const char* const* files = (const char* const*)argv + first_file;
+    size_t file_count = (size_t)(argc - first_file);
+    if (file_count == 0) {
+        if (!mkdtemp(dir)) {
+            LOG_ERROR("Couldn't create a directory for the test tracks.");
+            return 1;
+        }
+        snprintf(wav, sizeof(wav), "%s/track.wav", dir);
+        snprintf(flac, sizeof(flac), "%s/track.flac", dir);
+        if (!write_decode_tracks(wav, flac, seconds)) {
+            remove_tree(dir);
+            return 1;
+        }
+        files = generated;
+        file_count = 2;
+    }
+
+    bool same = true;
+    for (size_t i = 0; i < file_count; i++) {
+        if (!bench_decode_file(files[i], runs, cold)) same = false;
+    }
+    if (files == generated) remove_tree(dir);
+    return same ? 0 : 1;
+}
+
+// seek
+// ----
+
+#define SEEK_RATE 48000
+#define SEEK_BLOCK 960 // 20 ms, what a seek is heard within
+#define SEEK_TIMEOUT 60.0
+
+static const float seek_positions[] = { 0.1f, 0.5f, 0.9f };
+#define SEEK_POSITION_COUNT (sizeof(seek_positions) / sizeof(seek_positions[0]))
+
+// writes a vbr mpeg-1 layer iii file of silent frames without a xing header, the bitrate
+// changes every frame, so neither the decoder nor a seek can compute where a frame starts
+static bool write_seek_track(const char* path, double minutes) {
+    static const int bitrates[] = { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 };
+    FILE* file = fopen(path, "wb");
+    if (!file) {
+        LOG_ERROR("Couldn't create test track %s.", path);
+        return false;
+    }
+
+    size_t frames = (size_t)(minutes * 60.0 * 44100.0 / 1152.0);
+    unsigned char frame[1500] = {0};
+    uint32_t seed = 7;
+    bool success = true;
+    for (size_t i = 0; success && i < frames; i++) {
+        seed = seed * 1103515245u + 12345u;
+        unsigned int index = 5 + (seed >> 16) % 8;
+        size_t length = (size_t)(144 * bitrates[index] * 1000 / 44100);
+        frame[0] = 0xFF; // sync, mpeg-1 layer iii without crc
+        frame[1] = 0xFB;
+        frame[2] = (unsigned char)(index << 4); // 44100 hz, no padding
+        success = fwrite(frame, 1, length, file) == length;
+    }
+    return fclose(file) == 0 && success;
+}
+
+// plays a file on a fresh device, seeks once it's heard and returns how long until the seek is heard
+static bool run_seek(const char* path, float progress, double* seconds) {
+    audio_device_options_t options = audio_device_default_options();
+    options.output = AUDIO_DEVICE_OUTPUT_NONE;
+    options.sample_rate = SEEK_RATE;
+    audio_device_t dev = {0};
+    if (!audio_device_init(&dev, &options)) return false;
+    float* buffer = malloc(SEEK_BLOCK * ma_engine_get_channels(&dev.engine) * sizeof(float));
+    if (!buffer) {
+        LOG_ERROR("Memory allocation failed; couldn't render.");
+        audio_device_free(&dev);
+        return false;
+    }
+
+    bool success = audio_device_play_file(&dev, path);
+    audio_device_state_t state = audio_device_get_state(&dev);
+    while (success && state.loading) {
+        audio_device_render(&dev, buffer, SEEK_BLOCK);
+        success = dev.sound_loaded;
+        state = audio_device_get_state(&dev);
+    }
+    success = success && state.duration > 0.0f;
+
+    float target = progress * state.duration;
+    double start = now_seconds();
+    if (success) success = audio_device_set_progress(&dev, progress);
+    bool heard = false;
+    while (success && !heard && now_seconds() - start < SEEK_TIMEOUT) {
+        audio_device_render(&dev, buffer, SEEK_BLOCK);
+        state = audio_device_get_state(&dev);
+        heard = state.position >= target - 0.05f && state.position < target + 1.0f;
+    }
+    *seconds = now_seconds() - start;
+
+    free(buffer);
+    audio_device_free(&dev);
+    if (!heard) LOG_ERROR("Couldn't seek to %.0f%% of %s.", progress * 100.0f, path);
+    return heard;
+}
+
+static void print_seek(const char* index, float progress, size_t runs, double best, double worst) {
+    printf("{\"event\":\"seek\",\"index\":\"%s\",\"progress\":%.2f,\"runs\":%zu,\"ms_min\":%.1f,\"ms_max\":%.1f}\n",
+           index, progress, runs, best * 1000.0, worst * 1000.0);
+    fflush(stdout);
+}
+
+// seeks into a large mp3 before its seek index exists, the index build running alongside
+// like on a first play, then again with the index loaded from its sidecar file
+static int bench_seek(int argc, char** argv) {
+    double minutes = 120.0;
+    size_t runs = 3;
+    const char* file = NULL;
+    for (int i = 0; i < argc; i++) {
+        const char* value;
+        if ((value = option_value(argc, argv, &i, "--minutes"))) minutes = strtod(value, NULL);
+        else if ((value = option_value(argc, argv, &i, "--runs"))) runs = strtoul(value, NULL, 10);
+        else if (argv[i][0] != '-' && !file) file = argv[i];
+        else return 2;
+    }
+    if (runs == 0 || minutes <= 0.0) return 2;
+
+    // sidecar files go to a cache of the benchmark's own, the user's stays untouched
+    char dir[] = "/tmp/bench-seek-XXXXXX";
+    if (!mkdtemp(dir)) {
+        LOG_ERROR("Couldn't create a directory for the test track and cache.");
+        return 1;
+    }
+    char cache[64], track[64];
+    snprintf(cache, sizeof(cache), "%s/cache", dir);
+    snprintf(track, sizeof(track), "%s/track.mp3", dir);
+    setenv("XDG_CACHE_HOME", cache, 1);
+    if (!file) {
+        if (!write_seek_track(track, minutes)) {
+            remove_tree(dir);
+            return 1;
+        }
+        file = track;
+    }
+    char* index_path = seek_index_default_path(file);
+    bool success = index_path != NULL;
+
+    double speedups[SEEK_POSITION_COUNT] = {0};
+    for (size_t with_index = 0; success && with_index < 2; with_index++) {
+        for (size_t p = 0; success && p < SEEK_POSITION_COUNT; p++) {
+            double best = 0.0, worst = 0.0;
+            for (size_t run = 0; success && run < runs; run++) {
+                if (!with_index) unlink(index_path);
+                double seconds;
+                success = run_seek(file, seek_positions[p], &seconds);
+                if (run == 0 || seconds < best) best = seconds;
+                if (seconds > worst) worst = seconds;
+            }
+            if (!success) break;
+            print_seek(with_index ? "sidecar" : "none", seek_positions[p], runs, best, worst);
+            speedups[p] = with_index ? (best > 0.0 ? speedups[p] / best : 0.0) : best;
+        }
+        // the loaders finished the build before the last device was freed
+        if (success && !with_index && access(index_path, F_OK) != 0) {
+            LOG_ERROR("No seek index was built for %s, it may be smaller than the index threshold or not an mp3.", file);
+            success = false;
+        }
+    }
+    if (success) {
+        printf("{\"event\":\"seek_summary\",\"speedup_10\":%.1f,\"speedup_50\":%.1f,\"speedup_90\":%.1f}\n",
+               speedups[0], speedups[1], speedups[2]);
+        fflush(stdout);
+    }
+
+    free(index_path);
+    remove_tree(dir);
+    return success ? 0 : 1;
+}
+
+// durations
+// ---------
+
+#define DURATIONS_KIND_COUNT 8
+#define DURATIONS_MP3_FRAMES 60 // short files, the probe reads headers and the end of ogg files only
+
+// a file in memory while its bytes are put together
+typedef struct byte_buffer {
+    uint8_t* data;
+    size_t size;
+    size_t capacity;
+    bool failed;
+} byte_buffer_t;
+
+static void buffer_put(byte_buffer_t* buffer, const void* data, size_t size) {
+    if (buffer->failed) return;
+    if (buffer->size + size > buffer->capacity) {
+        size_t capacity = buffer->capacity ? buffer->capacity : 4096;
+        while (capacity < buffer->size + size) capacity *= 2;
+        uint8_t* grown = realloc(buffer->data, capacity);
+        if (!grown) {
+            buffer->failed = true;
+            return;
+        }
+        buffer->data = grown;
+        buffer->capacity = capacity;
+    }
+    if (data) memcpy(buffer->data + buffer->size, data, size);
+    else memset(buffer->data + buffer->size, 0, size);
+    buffer->size += size;
+}
+
+static void buffer_put_byte(byte_buffer_t* buffer, uint8_t value) {
+    buffer_put(buffer, &value, 1);
+}
+
+static void buffer_put_be(byte_buffer_t* buffer, uint64_t value, size_t size) {
+    for (size_t i = size; i > 0; i--) buffer_put_byte(buffer, (uint8_t)(value >> ((i - 1) * 8)));
+}
+
+static void buffer_put_le(byte_buffer_t* buffer, uint64_t value, size_t size) {
+    for (size_t i = 0; i < size; i++) buffer_put_byte(buffer, (uint8_t)(value >> (i * 8)));
+}
+
+// overwrites bytes already put, for headers inside a frame and sizes known at the end
+static void buffer_patch(byte_buffer_t* buffer, size_t position, const void* data, size_t size) {
+    if (!buffer->failed && position + size <= buffer->size) memcpy(buffer->data + position, data, size);
+}
+
+static const uint16_t mp3_bitrates[] = { 0, 32, 40, 48, 56, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320 };
+
+// mpeg-1 layer iii frame at 44100 Hz of silence, returns where the frame starts
+static size_t put_mp3_frame(byte_buffer_t* buffer, size_t bitrate_index, bool padding) {
+    size_t start = buffer->size;
+    size_t length = 144 * mp3_bitrates[bitrate_index] * 1000 / 44100 + (padding ? 1 : 0);
+    uint8_t header[4] = { 0xFF, 0xFB, (uint8_t)((bitrate_index << 4) | (padding ? 2 : 0)), 0x00 };
+    buffer_put(buffer, header, sizeof(header));
+    buffer_put(buffer, NULL, length - sizeof(header));
+    return start;
+}
+
+// vbr mp3 behind an id3v2 tag, its length in a xing header with the lame encoder delay and padding
+static void put_xing_mp3(byte_buffer_t* buffer, uint32_t frames) {
+    size_t tag_size = 10000;
+    uint8_t tag[10] = { 'I', 'D', '3', 3, 0, 0,
+                        (uint8_t)((tag_size >> 21) & 0x7F), (uint8_t)((tag_size >> 14) & 0x7F),
+                        (uint8_t)((tag_size >> 7) & 0x7F), (uint8_t)(tag_size & 0x7F) };
+    buffer_put(buffer, tag, sizeof(tag));
+    buffer_put(buffer, NULL, tag_size);
+
+    size_t frame = put_mp3_frame(buffer, 9, false);
+    byte_buffer_t xing = {0};
+    buffer_put(&xing, "Xing", 4);
+    buffer_put_be(&xing, 0xF, 4);
+    buffer_put_be(&xing, frames, 4);
+    buffer_put_be(&xing, 0, 4);
+    buffer_put(&xing, NULL, 100); // seek table
+    buffer_put_be(&xing, 50, 4);
+    uint8_t lame[36] = { 'L', 'A', 'M', 'E', '3', '.', '1', '0', '0' };
+    uint16_t delay = 576, padding = 1000;
+    lame[21] = (uint8_t)(delay >> 4);
+    lame[22] = (uint8_t)(((delay & 15) << 4) | (padding >> 8));
+    lame[23] = (uint8_t)(padding & 255);
+    buffer_put(&xing, lame, sizeof(lame));
+    if (xing.failed) buffer->failed = true;
+    else buffer_patch(buffer, frame + 36, xing.data, xing.size);
+    free(xing.data);
+
+    for (uint32_t i = 0; i < frames; i++) put_mp3_frame(buffer, 5 + (i * 7) % 8, false);
+}
+
+// vbr mp3 with its length in a vbri header
+static void put_vbri_mp3(byte_buffer_t* buffer, uint32_t frames) {
+    size_t frame = put_mp3_frame(buffer, 9, false);
+    byte_buffer_t vbri = {0};
+    buffer_put(&vbri, "VBRI", 4);
+    buffer_put_be(&vbri, 1, 2);
+    buffer_put_be(&vbri, 576, 2);
+    buffer_put_be(&vbri, 75, 2);
+    buffer_put_be(&vbri, 0, 4);
+    buffer_put_be(&vbri, frames, 4);
+    if (vbri.failed) buffer->failed = true;
+    else buffer_patch(buffer, frame + 36, vbri.data, vbri.size);
+    free(vbri.data);
+
+    for (uint32_t i = 0; i < frames; i++) put_mp3_frame(buffer, 5 + (i * 3) % 8, false);
+}
+
+// cbr mp3 without a length header, an id3v1 tag at the end
+static void put_cbr_mp3(byte_buffer_t* buffer, uint32_t frames) {
+    for (uint32_t i = 0; i < frames; i++) put_mp3_frame(buffer, 9, i % 3 != 0);
+    buffer_put(buffer, "TAG", 3);
+    buffer_put(buffer, NULL, 125);
+}
+
+static void put_ogg_page(byte_buffer_t* buffer, uint8_t type, uint64_t granule, uint32_t sequence,
+                         const void* packet, size_t size) {
+    buffer_put(buffer, "OggS", 4);
+    buffer_put_byte(buffer, 0);
+    buffer_put_byte(buffer, type);
+    buffer_put_le(buffer, granule, 8);
+    buffer_put_le(buffer, 1, 4); // serial
+    buffer_put_le(buffer, sequence, 4);
+    buffer_put_le(buffer, 0, 4); // crc, the probe doesn't check it
+    size_t segments = size / 255 + 1;
+    buffer_put_byte(buffer, (uint8_t)segments);
+    for (size_t i = 0; i + 1 < segments; i++) buffer_put_byte(buffer, 255);
+    buffer_put_byte(buffer, (uint8_t)(size % 255));
+    buffer_put(buffer, packet, size);
+}
+
+// ogg file of an id header page, a page without a granule and a last page holding the length
+static void put_ogg(byte_buffer_t* buffer, const void* id_packet, size_t id_size, uint64_t granule) {
+    put_ogg_page(buffer, 2, 0, 0, id_packet, id_size);
+    put_ogg_page(buffer, 0, UINT64_MAX, 1, NULL, 4000);
+    put_ogg_page(buffer, 4, granule, 2, NULL, 3000);
+}
+
+static void put_vorbis(byte_buffer_t* buffer) {
+    byte_buffer_t id = {0};
+    buffer_put(&id, "\x01vorbis", 7);
+    buffer_put_le(&id, 0, 4); // version
+    buffer_put_byte(&id, 2);
+    buffer_put_le(&id, 44100, 4);
+    buffer_put_le(&id, 0, 4);
+    buffer_put_le(&id, 128000, 4);
+    buffer_put_le(&id, 0, 4);
+    buffer_put(&id, "\xb8\x01", 2);
+    if (id.failed) buffer->failed = true;
+    else put_ogg(buffer, id.data, id.size, 1234567);
+    free(id.data);
+}
+
+static void put_opus(byte_buffer_t* buffer) {
+    byte_buffer_t id = {0};
+    buffer_put(&id, "OpusHead", 8);
+    buffer_put_byte(&id, 1);
+    buffer_put_byte(&id, 2);
+    buffer_put_le(&id, 312, 2); // pre-skip
+    buffer_put_le(&id, 44100, 4);
+    buffer_put_le(&id, 0, 2);
+    buffer_put_byte(&id, 0);
+    if (id.failed) buffer->failed = true;
+    else put_ogg(buffer, id.data, id.size, 48000 * 61 + 312);
+    free(id.data);
+}
+
+// starts an mp4 box, mp4_box_end fills in its size once its contents are put
+static size_t mp4_box_start(byte_buffer_t* buffer, const char* type) {
+    size_t start = buffer->size;
+    buffer_put_be(buffer, 0, 4);
+    buffer_put(buffer, type, 4);
+    return start;
+}
+
+static void mp4_box_end(byte_buffer_t* buffer, size_t start) {
+    uint8_t size[4];
+    size_t length = buffer->size - start;
+    for (size_t i = 0; i < 4; i++) size[i] = (uint8_t)(length >> ((3 - i) * 8));
+    buffer_patch(buffer, start, size, sizeof(size));
+}
+
+static void put_mp4_track(byte_buffer_t* buffer, const char* handler, uint32_t timescale, uint64_t duration) {
+    size_t trak = mp4_box_start(buffer, "trak");
+    size_t tkhd = mp4_box_start(buffer, "tkhd");
+    buffer_put(buffer, NULL, 84);
+    mp4_box_end(buffer, tkhd);
+    size_t mdia = mp4_box_start(buffer, "mdia");
+    size_t mdhd = mp4_box_start(buffer, "mdhd");
+    buffer_put_be(buffer, 0x01000000, 4); // version 1 with 64 bit times
+    buffer_put(buffer, NULL, 16);
+    buffer_put_be(buffer, timescale, 4);
+    buffer_put_be(buffer, duration, 8);
+    buffer_put(buffer, NULL, 4);
+    mp4_box_end(buffer, mdhd);
+    size_t hdlr = mp4_box_start(buffer, "hdlr");
+    buffer_put(buffer, NULL, 8);
+    buffer_put(buffer, handler, 4);
+    buffer_put(buffer, NULL, 13);
+    mp4_box_end(buffer, hdlr);
+    size_t minf = mp4_box_start(buffer, "minf");
+    buffer_put(buffer, NULL, 40);
+    mp4_box_end(buffer, minf);
+    mp4_box_end(buffer, mdia);
+    mp4_box_end(buffer, trak);
+}
+
+// m4a with the audio after a video track, so the probe has to pick the sound handler
+static void put_m4a(byte_buffer_t* buffer) {
+    size_t ftyp = mp4_box_start(buffer, "ftyp");
+    buffer_put(buffer, "M4A \0\0\0\0M4A isom", 16);
+    mp4_box_end(buffer, ftyp);
+    size_t mdat = mp4_box_start(buffer, "mdat");
+    buffer_put(buffer, NULL, 2000);
+    mp4_box_end(buffer, mdat);
+    size_t moov = mp4_box_start(buffer, "moov");
+    size_t mvhd = mp4_box_start(buffer, "mvhd");
+    buffer_put(buffer, NULL, 100);
+    mp4_box_end(buffer, mvhd);
+    put_mp4_track(buffer, "vide", 600, 12345);
+    put_mp4_track(buffer, "soun", 44100, 44100ull * 200 + 17);
+    mp4_box_end(buffer, moov);
+}
+
+static bool read_whole_file(const char* path, byte_buffer_t* buffer) {
+    FILE* file = fopen(path, "rb");
+    if (!file) return false;
+    uint8_t block[65536];
+    size_t read_size;
+    while ((read_size = fread(block, 1, sizeof(block), file)) > 0) buffer_put(buffer, block, read_size);
+    bool success = !ferror(file) && !buffer->failed;
+    fclose(file);
+    return success;
+}
+
+static const char* const durations_kinds[DURATIONS_KIND_COUNT] = {
+    "xing.mp3", "vbri.mp3", "cbr.mp3", "vorbis.ogg", "opus.opus", "track.m4a", "track.flac", "track.wav"
+};
+
+// one file of every kind, flac and wav from the decode benchmark's writer cut down to a second
+static bool make_durations_kinds(const char* dir, byte_buffer_t* kinds) {
+    put_xing_mp3(&kinds[0], DURATIONS_MP3_FRAMES);
+    put_vbri_mp3(&kinds[1], DURATIONS_MP3_FRAMES);
+    put_cbr_mp3(&kinds[2], DURATIONS_MP3_FRAMES);
+    put_vorbis(&kinds[3]);
+    put_opus(&kinds[4]);
+    put_m4a(&kinds[5]);
+
+    char wav[64], flac[64];
+    snprintf(wav, sizeof(wav), "%s/kind.wav", dir);
+    snprintf(flac, sizeof(flac), "%s/kind.flac", dir);
+    bool success = write_decode_tracks(wav, flac, 1.0) &&
+                   read_whole_file(flac, &kinds[6]) && read_whole_file(wav, &kinds[7]);
+    remove(wav);
+    remove(flac);
+    for (size_t k = 0; k < DURATIONS_KIND_COUNT; k++) {
+        if (kinds[k].failed) success = false;
+    }
+    return success;
+}
+
+// writes files files cycling through the kinds into folders of 100, appending them to list
+static bool write_durations_library(const char* dir, const byte_buffer_t* kinds, size_t files, track_list_t* list) {
+    char path[128];
+    const char* paths[1] = { path };
+    for (size_t i = 0; i < files; i++) {
+        if (i % 100 == 0) {
+            snprintf(path, sizeof(path), "%s/%04zu", dir, i / 100);
+            if (mkdir(path, 0755) != 0) return false;
+        }
+        const byte_buffer_t* kind = &kinds[i % DURATIONS_KIND_COUNT];
+        snprintf(path, sizeof(path), "%s/%04zu/%06zu-%s", dir, i / 100, i, durations_kinds[i % DURATIONS_KIND_COUNT]);
+        FILE* file = fopen(path, "wb");
+        if (!file) return false;
+        bool written = fwrite(kind->data, 1, kind->size, file) == kind->size;
+        if (fclose(file) != 0 || !written) return false;
+        if (!track_list_append_paths(list, paths, 1)) return false;
+    }
+    return true;
+}
+
+// what the probe replaced for the formats miniaudio opens, a decoder per file for its length
+static size_t decoder_lengths(const track_list_t* list, int64_t* total) {
+    size_t found = 0;
+    *total = 0;
+    for (size_t i = 0; i < list->count; i++) {
+        ma_decoder decoder;
+        if (ma_decoder_init_file(list->items[i].path, NULL, &decoder) != MA_SUCCESS) continue;
+        ma_uint64 frames = 0;
+        if (ma_decoder_get_length_in_pcm_frames(&decoder, &frames) == MA_SUCCESS && frames > 0) {
+            *total += (int64_t)(frames / decoder.outputSampleRate);
+            found++;
+        }
+        ma_decoder_uninit(&decoder);
+    }
+    return found;
+}
+
+static void print_durations(const char* method, size_t files, size_t found, size_t threads, double seconds) {
+    printf("{\"event\":\"durations\",\"method\":\"%s\",\"files\":%zu,\"found\":%zu,\"threads\":%zu,"
+           "\"seconds\":%.6f,\"files_per_second\":%.0f}\n",
+           method, files, found, threads, seconds, seconds > 0.0 ? (double)files / seconds : 0.0);
+    fflush(stdout);
+}
+
+// probes the lengths of a generated library of every format the probe knows, with the page
+// cache warm after writing it, against opening a decoder per file where miniaudio can
+static int bench_durations(int argc, char** argv) {
+    size_t files = 10000;
+    size_t threads = 1;
+    size_t runs = 3;
+    bool decoder = false;
+    for (int i = 0; i < argc; i++) {
+        const char* value;
+        if ((value = option_value(argc, argv, &i, "--files"))) files = strtoul(value, NULL, 10);
+        else if ((value = option_value(argc, argv, &i, "--threads"))) threads = strtoul(value, NULL, 10);
+        else if ((value = option_value(argc, argv, &i, "--runs"))) runs = strtoul(value, NULL, 10);
+        else if (strcmp(argv[i], "--decoder") == 0) decoder = true;
+        else return 2;
+    }
+    if (files == 0 || runs == 0) return 2;
+
+    char dir[] = "/tmp/bench-durations-XXXXXX";
+    if (!mkdtemp(dir)) {
+        LOG_ERROR("Couldn't create a directory for the test library.");
+        return 1;
+    }
+    byte_buffer_t kinds[DURATIONS_KIND_COUNT] = {0};
+    track_list_t* list = track_list_create();
+    bool success = list && make_durations_kinds(dir, kinds) && write_durations_library(dir, kinds, files, list);
+    for (size_t k = 0; k < DURATIONS_KIND_COUNT; k++) free(kinds[k].data);
+    if (!success) {
+        LOG_ERROR("Couldn't write the test library to %s.", dir);
+        track_list_free(list);
+        remove_tree(dir);
+        return 1;
+    }
+
+    double best = 0.0;
+    size_t found = 0;
+    for (size_t run = 0; run < runs; run++) {
+        for (size_t i = 0; i < list->count; i++) {
+            list->items[i].duration = 0;
+            track_list_refresh(list, &list->items[i]);
+        }
+        double start = now_seconds();
+        found = duration_probe_list(list, threads, NULL);
+        double seconds = now_seconds() - start;
+        if (run == 0 || seconds < best) best = seconds;
+    }
+    print_durations("probe", files, found, threads, best);
+    int64_t probed_total = track_list_sum_duration(list);
+
+    if (decoder) {
+        double start = now_seconds();
+        int64_t decoder_total;
+        size_t decoder_found = decoder_lengths(list, &decoder_total);
+        print_durations("decoder", files, decoder_found, 1, now_seconds() - start);
+    }
+
+    double files_per_second = best > 0.0 ? (double)files / best : 0.0;
+    printf("{\"event\":\"durations_summary\",\"files\":%zu,\"found\":%zu,\"total_seconds\":%lld,"
+           "\"files_per_second\":%.0f,\"target\":10000,\"meets_target\":%s}\n",
+           files, found, (long long)probed_total, files_per_second, files_per_second >= 10000.0 ? "true" : "false");
+    fflush(stdout);
+
+    track_list_free(list);
+    remove_tree(dir);
+    return found == files ? 0 : 1;
+}
+
+// dedup
+// -----
+
+#define DEDUP_REPEAT_EVERY 10 // every 10th import is a path already in the list
+
+// the path of import i, repeats pick an earlier unique path spread over the whole list
+static void dedup_path(char* path, size_t size, size_t i) {
+    size_t unique = i - i / DEDUP_REPEAT_EVERY;
+    size_t id = i % DEDUP_REPEAT_EVERY == DEDUP_REPEAT_EVERY - 1 ? (i * 7919) % unique : unique;
+    snprintf(path, size, "/music/Artist %zu/Album %zu/track %07zu.flac", id / 300, id / 12, id);
+}
+
+// what track_list_contains did before the path index, one compare per track in the list
+static bool linear_contains(const track_list_t* list, const char* path) {
+    for (size_t i = 0; i < list->count; i++) {
+        if (strcmp(list->items[i].path, path) == 0) return true;
+    }
+    return false;
+}
+
+// imports every path that isn't in the list yet, looking each one up first
+static bool run_dedup(track_list_t* list, size_t imports, bool indexed, double* seconds) {
+    char path[128];
+    const char* paths[1] = { path };
+    double start = now_seconds();
+    for (size_t i = 0; i < imports; i++) {
+        dedup_path(path, sizeof(path), i);
+        bool known = indexed ? track_list_index_of_path(list, path) != SIZE_MAX : linear_contains(list, path);
+        if (!known && !track_list_append_paths(list, paths, 1)) return false;
+    }
+    *seconds = now_seconds() - start;
+    return true;
+}
+
+static void print_dedup(const char* method, size_t imports, size_t tracks, double seconds) {
+    printf("{\"event\":\"dedup\",\"method\":\"%s\",\"imports\":%zu,\"tracks\":%zu,\"seconds\":%.6f}\n",
+           method, imports, tracks, seconds);
+    fflush(stdout);
+}
+
+// imports paths with a tenth of them repeats into an empty list, checking for each one if it's
+// there already with a scan of the list and with the path index
+static int bench_dedup(int argc, char** argv) {
+    size_t imports = 100000;
+    for (int i = 0; i < argc; i++) {
+        const char* value;
+        if ((value = option_value(argc, argv, &i, "--paths"))) imports = strtoul(value, NULL, 10);
+        else return 2;
+    }
+    if (imports == 0) return 2;
+
+    track_list_t* linear = track_list_create();
+    track_list_t* indexed = track_list_create();
+    double linear_seconds = 0.0, indexed_seconds = 0.0;
+    bool success = linear && indexed &&
+                   run_dedup(indexed, imports, true, &indexed_seconds) &&
+                   run_dedup(linear, imports, false, &linear_seconds);
+    if (!success) {
+        LOG_ERROR("Couldn't import the paths.");
+        track_list_free(linear);
+        track_list_free(indexed);
+        return 1;
+    }
+    print_dedup("linear", imports, linear->count, linear_seconds);
+    print_dedup("index", imports, indexed->count, indexed_seconds);
+
+    size_t expected = imports - imports / DEDUP_REPEAT_EVERY;
+    bool same = same_tracks(linear, indexed) && indexed->count == expected;
+    printf("{\"event\":\"dedup_summary\",\"imports\":%zu,\"same_tracks\":%s,\"speedup\":%.1f}\n",
+           imports, same ? "true" : "false", indexed_seconds > 0.0 ? linear_seconds / indexed_seconds : 0.0);
+    fflush(stdout);
+
+    track_list_free(linear);
+    track_list_free(indexed);
+    return same ? 0 : 1;
+}
+
+// members
+// -------
+
+// the album, artist and genre functions before their handle sets, a scan of the whole handle
+// array per call, with the same log lines as the functions they're timed against
+static size_t scan_handles(const handle_t* items, size_t count, handle_t handle) {
+    for (size_t i = 0; i < count; i++) {
+        if (handle_equals(items[i], handle)) return i;
+    }
+    return SIZE_MAX;
+}
+
+static bool scanned_genre_add_album(genre_t* genre, album_handle_t album) {
+    const album_t* resolved = album_list_resolve(genre->source, album);
+    if (!resolved || scan_handles(genre->albums, genre->album_count, album) != SIZE_MAX) return false;
+    if (!genre_add_albums(genre, &album, 1)) return false;
+    LOG_INFO("Album added to genre '%s': %s", genre->name, resolved->title);
+    return true;
+}
+
+static bool scanned_genre_remove_album(genre_t* genre, album_handle_t album) {
+    size_t i = scan_handles(genre->albums, genre->album_count, album);
+    if (i == SIZE_MAX) return false;
+    genre->albums[i] = genre->albums[--genre->album_count];
+    LOG_INFO("Album removed from genre '%s'.", genre->name);
+    return true;
+}
+
+static bool scanned_album_add_track(album_t* album, track_handle_t track) {
+    const track_t* resolved = track_list_resolve(album->source, track);
+    if (!resolved || scan_handles(album->tracks, album->track_count, track) != SIZE_MAX) return false;
+    if (!album_add_tracks(album, &track, 1)) return false;
+    LOG_INFO("Track added to album '%s': %s", album->title, resolved->path);
+    return true;
+}
+
+// every operation on a genre and an album of members members, scanned or through the set
+typedef struct members_run {
+    genre_t* genre;
+    album_t* album;
+    const album_list_t* albums;
+    const track_list_t* tracks;
+    size_t members;
+    double seconds[4]; // add albums, has album, remove albums, add tracks
+} members_run_t;
+
+static const char* const members_operations[] = {
+    "genre_add_album", "genre_has_album", "genre_remove_album", "album_add_track"
+};
+
+static bool run_members(members_run_t* run, bool hashed) {
+    size_t done = 0;
+    double start = now_seconds();
+    for (size_t i = 0; i < run->members; i++) {
+        album_handle_t album = album_list_handle_at(run->albums, i);
+        done += hashed ? genre_add_album(run->genre, album) : scanned_genre_add_album(run->genre, album);
+    }
+    run->seconds[0] = now_seconds() - start;
+    bool success = done == run->members;
+
+    done = 0;
+    start = now_seconds();
+    for (size_t i = 0; i < run->members; i++) {
+        album_handle_t album = album_list_handle_at(run->albums, (i * 7919) % run->members);
+        done += hashed ? genre_has_album(run->genre, album)
+                       : scan_handles(run->genre->albums, run->genre->album_count, album) != SIZE_MAX;
+    }
+    run->seconds[1] = now_seconds() - start;
+    success = success && done == run->members;
+
+    done = 0;
+    start = now_seconds();
+    for (size_t i = 0; i < run->members; i += 3) {
+        album_handle_t album = album_list_handle_at(run->albums, i);
+        done += hashed ? genre_remove_album(run->genre, album) : scanned_genre_remove_album(run->genre, album);
+    }
+    run->seconds[2] = now_seconds() - start;
+    success = success && done == (run->members + 2) / 3;
+
+    done = 0;
+    start = now_seconds();
+    for (size_t i = 0; i < run->members; i++) {
+        track_handle_t track = track_list_handle_at(run->tracks, i);
+        done += hashed ? album_add_track(run->album, track) : scanned_album_add_track(run->album, track);
+    }
+    run->seconds[3] = now_seconds() - start;
+    return success && done == run->members;
+}
+
+// grows a genre and an album to members entries one add at a time, looks every member up and
+// removes every third one, scanning the handle arrays against the handle sets
+static int bench_members(int argc, char** argv) {
+    size_t members = 20000;
+    for (int i = 0; i < argc; i++) {
+        const char* value;
+        if ((value = option_value(argc, argv, &i, "--members"))) members = strtoul(value, NULL, 10);
+        else return 2;
+    }
+    if (members == 0) return 2;
+
+    track_list_t* tracks = track_list_create();
+    album_list_t* albums = album_list_create();
+    bool built = tracks && albums;
+    char path[96], title[32];
+    const char* paths[1] = { path };
+    for (size_t i = 0; built && i < members; i++) {
+        snprintf(path, sizeof(path), "/music/Various/Compilation/%07zu.flac", i);
+        snprintf(title, sizeof(title), "Album %zu", i);
+        album_t album = { .title = strdup(title), .source = tracks };
+        built = album.title && track_list_append_paths(tracks, paths, 1) && album_list_append_many(albums, &album, 1);
+        if (!built) free(album.title);
+    }
+
+    members_run_t runs[2] = {0};
+    for (size_t hashed = 0; built && hashed < 2; hashed++) {
+        runs[hashed] = (members_run_t){ .albums = albums, .tracks = tracks, .members = members };
+        runs[hashed].genre = genre_create("Compilations", albums);
+        runs[hashed].album = album_create("Compilation", tracks);
+        built = runs[hashed].genre && runs[hashed].album && run_members(&runs[hashed], hashed == 1);
+    }
+    if (!built) LOG_ERROR("Couldn't build the genre and album.");
+
+    bool same = built && runs[0].genre->album_count == runs[1].genre->album_count &&
+                memcmp(runs[0].genre->albums, runs[1].genre->albums, runs[0].genre->album_count * sizeof(handle_t)) == 0 &&
+                runs[0].album->track_count == runs[1].album->track_count;
+    for (size_t op = 0; built && op < sizeof(members_operations) / sizeof(members_operations[0]); op++) {
+        printf("{\"event\":\"members\",\"operation\":\"%s\",\"members\":%zu,\"calls\":%zu,"
+               "\"scan_seconds\":%.6f,\"set_seconds\":%.6f,\"speedup\":%.1f}\n",
+               members_operations[op], members, op == 2 ? (members + 2) / 3 : members,
+               runs[0].seconds[op], runs[1].seconds[op],
+               runs[1].seconds[op] > 0.0 ? runs[0].seconds[op] / runs[1].seconds[op] : 0.0);
+    }
+    printf("{\"event\":\"members_summary\",\"members\":%zu,\"same_members\":%s}\n",
+           members, same ? "true" : "false");
+    fflush(stdout);
+
+    for (size_t i = 0; i < 2; i++) {
+        if (runs[i].genre) genre_free(runs[i].genre);
+        if (runs[i].album) album_free(runs[i].album);
+    }
+    if (albums) album_list_free(albums);
+    if (tracks) track_list_free(tracks);
+    return same ? 0 : 1;
+}
+
+// graph
+// -----
+
+#define GRAPH_GENRES 40
+
+// a tagged library of tracks tracks, 12 per album and 10 albums per artist
+static track_list_t* make_graph_library(size_t tracks) {
+    const char* genres[GRAPH_GENRES];
+    char text[96];
+    for (size_t g = 0; g < GRAPH_GENRES; g++) {
+        snprintf(text, sizeof(text), "Genre %zu", g);
+        genres[g] = string_pool_intern(text);
+    }
+
+    track_list_t* list = track_list_create();
+    const char* paths[1] = { text };
+    for (size_t i = 0; list && i < tracks; i++) {
+        snprintf(text, sizeof(text), "/music/Artist %zu/Album %zu/%zu.flac", i / 120, i / 12, i);
+        if (!track_list_append_paths(list, paths, 1)) {
+            track_list_free(list);
+            return NULL;
+        }
+        track_t* track = &list->items[i];
+        snprintf(text, sizeof(text), "Artist %zu", i / 120);
+        track->artist = string_pool_intern(text);
+        snprintf(text, sizeof(text), "Album %zu", i / 12);
+        track->album = string_pool_intern(text);
+        track->genre = genres[(i / 12 * 31) % GRAPH_GENRES];
+        track_list_refresh(list, track);
+    }
+    return list;
+}
+
+// what grouping looked like before the graph, a title search over every album per track
+// returns the albums, NULL on failure
+static album_list_t* find_and_add_albums(const track_list_t* list) {
+    album_list_t* albums = album_list_create();
+    for (size_t i = 0; albums && i < list->count; i++) {
+        album_t* album = album_list_find_by_title(albums, list->items[i].album);
+        if (!album) {
+            album_t* created = album_create(list->items[i].album, list);
+            if (!created || !album_list_append(albums, created)) {
+                if (created) album_free(created);
+                album_list_free(albums);
+                return NULL;
+            }
+            free(created); // the list took its title
+            album = &albums->items[albums->count - 1];
+        }
+        if (!album_add_track(album, track_list_handle_at(list, i))) {
+            album_list_free(albums);
+            return NULL;
+        }
+    }
+    return albums;
+}
+
+static size_t album_track_total(const album_list_t* albums) {
+    size_t total = 0;
+    for (size_t i = 0; i < albums->count; i++) total += albums->items[i].track_count;
+    return total;
+}
+
+// builds the graph of a large library, best of every run, against grouping a part of it with
+// find_by_title and add_track, which goes quadratic long before the whole library
+static int bench_graph(int argc, char** argv) {
+    size_t tracks = 1000000;
+    size_t naive_tracks = 20000;
+    size_t threads = 1;
+    size_t runs = 3;
+    for (int i = 0; i < argc; i++) {
+        const char* value;
+        if ((value = option_value(argc, argv, &i, "--tracks"))) tracks = strtoul(value, NULL, 10);
+        else if ((value = option_value(argc, argv, &i, "--naive-tracks"))) naive_tracks = strtoul(value, NULL, 10);
+        else if ((value = option_value(argc, argv, &i, "--threads"))) threads = strtoul(value, NULL, 10);
+        else if ((value = option_value(argc, argv, &i, "--runs"))) runs = strtoul(value, NULL, 10);
+        else return 2;
+    }
+    if (tracks == 0 || runs == 0) return 2;
+    if (naive_tracks > tracks) naive_tracks = tracks;
+
+    track_list_t* list = make_graph_library(tracks);
+    track_list_t* part = naive_tracks > 0 ? make_graph_library(naive_tracks) : NULL;
+    if (!list || (naive_tracks > 0 && !part)) {
+        LOG_ERROR("Couldn't build a library of %zu tracks.", tracks);
+        if (list) track_list_free(list);
+        if (part) track_list_free(part);
+        return 1;
+    }
+
+    double best = 0.0;
+    library_graph_t* graph = NULL;
+    for (size_t run = 0; run < runs; run++) {
+        if (graph) library_graph_free(graph);
+        double start = now_seconds();
+        graph = library_graph_build(list, threads);
+        double seconds = now_seconds() - start;
+        if (!graph) break;
+        if (run == 0 || seconds < best) best = seconds;
+    }
+    bool same = graph != NULL;
+    if (graph) {
+        printf("{\"event\":\"graph\",\"method\":\"graph\",\"tracks\":%zu,\"threads\":%zu,\"albums\":%zu,"
+               "\"artists\":%zu,\"genres\":%zu,\"seconds\":%.6f}\n",
+               tracks, threads, library_graph_albums(graph)->count, library_graph_artists(graph)->count,
+               library_graph_genres(graph)->count, best);
+        same = album_track_total(library_graph_albums(graph)) == tracks;
+    }
+
+    // both groupings of the part have to agree
+    if (same && part) {
+        library_graph_t* part_graph = library_graph_build(part, threads);
+        double start = now_seconds();
+        album_list_t* albums = find_and_add_albums(part);
+        double seconds = now_seconds() - start;
+        same = part_graph && albums && albums->count == library_graph_albums(part_graph)->count &&
+               album_track_total(albums) == naive_tracks;
+        if (albums) {
+            printf("{\"event\":\"graph\",\"method\":\"find_by_title\",\"tracks\":%zu,\"threads\":1,"
+                   "\"albums\":%zu,\"seconds\":%.6f}\n", naive_tracks, albums->count, seconds);
+            album_list_free(albums);
+        }
+        if (part_graph) library_graph_free(part_graph);
+    }
+
+    printf("{\"event\":\"graph_summary\",\"tracks\":%zu,\"runs\":%zu,\"same_albums\":%s,\"tracks_per_second\":%.0f}\n",
+           tracks, runs, same ? "true" : "false", best > 0.0 ? (double)tracks / best : 0.0);
+    fflush(stdout);
+
+    if (graph) library_graph_free(graph);
+    if (part) track_list_free(part);
+    track_list_free(list);
+    return same ? 0 : 1;
+}
+
+// arena
+// -----
+
+// the strings a load copies per track, its path and title in the track list and its path in
+// the playlist, as a heap allocation each the way they were before the arenas, or copied into
+// one arena for the list and one for the playlist
+typedef struct load_strings {
+    char** strings;
+    size_t count;
+    string_arena_t list_arena;
+    string_arena_t playlist_arena;
+} load_strings_t;
+
+static void arena_path(char* path, size_t size, size_t i) {
+    snprintf(path, size, "/music/Artist %zu/Album %zu/%02zu - Track %zu.flac", i / 120, i / 12, i % 12 + 1, i);
+}
+
+static bool load_strings(load_strings_t* load, size_t tracks, bool arena) {
+    char path[128];
+    for (size_t i = 0; i < tracks; i++) {
+        arena_path(path, sizeof(path), i);
+        char** out = &load->strings[load->count];
+        out[0] = arena ? string_arena_copy(&load->list_arena, path) : strdup(path);
+        out[1] = arena ? string_arena_copy(&load->list_arena, "Unknown") : strdup("Unknown");
+        out[2] = arena ? string_arena_copy(&load->playlist_arena, path) : strdup(path);
+        load->count += 3;
+        if (!out[0] || !out[1] || !out[2]) return false;
+    }
+    return true;
+}
+
+static void clear_strings(load_strings_t* load, bool arena) {
+    if (arena) {
+        string_arena_reset(&load->list_arena);
+        string_arena_reset(&load->playlist_arena);
+    } else {
+        for (size_t i = 0; i < load->count; i++) free(load->strings[i]);
+    }
+    load->count = 0;
+}
+
+// the same loads through the track list and the playlist, the way a folder opens
+static bool load_containers(track_list_t* list, playlist_t* playlist, size_t tracks) {
+    char path[128];
+    const char* paths[1] = { path };
+    for (size_t i = 0; i < tracks; i++) {
+        arena_path(path, sizeof(path), i);
+        if (!track_list_append_paths(list, paths, 1) || !playlist_append(playlist, path)) return false;
+    }
+    return true;
+}
+
+static void print_arena(const char* strings, size_t tracks, size_t cycles, double load, double clear) {
+    printf("{\"event\":\"arena\",\"strings\":\"%s\",\"tracks\":%zu,\"cycles\":%zu,"
+           "\"load_ms\":%.3f,\"clear_ms\":%.3f}\n",
+           strings, tracks, cycles, load * 1000.0 / (double)cycles, clear * 1000.0 / (double)cycles);
+    fflush(stdout);
+}
+
+// loads and clears a folder's worth of strings over and over, a heap allocation per string
+// against the arenas, averaged over the cycles, then the same cycles through the containers
+static int bench_arena(int argc, char** argv) {
+    size_t tracks = 200000;
+    size_t cycles = 10;
+    for (int i = 0; i < argc; i++) {
+        const char* value;
+        if ((value = option_value(argc, argv, &i, "--tracks"))) tracks = strtoul(value, NULL, 10);
+        else if ((value = option_value(argc, argv, &i, "--cycles"))) cycles = strtoul(value, NULL, 10);
+        else return 2;
+    }
+    if (tracks == 0 || cycles == 0) return 2;
+
+    load_strings_t heap = { .strings = malloc(tracks * 3 * sizeof(char*)) };
+    load_strings_t arena = { .strings = malloc(tracks * 3 * sizeof(char*)) };
+    bool success = heap.strings && arena.strings;
+    bool same = success;
+    double load[2] = {0.0, 0.0}, clear[2] = {0.0, 0.0};
+    for (size_t cycle = 0; success && cycle < cycles; cycle++) {
+        for (size_t a = 0; success && a < 2; a++) {
+            double start = now_seconds();
+            success = load_strings(a ? &arena : &heap, tracks, a == 1);
+            load[a] += now_seconds() - start;
+        }
+        for (size_t i = 0; success && same && i < heap.count; i++) {
+            same = strcmp(heap.strings[i], arena.strings[i]) == 0;
+        }
+        for (size_t a = 0; a < 2; a++) {
+            double start = now_seconds();
+            clear_strings(a ? &arena : &heap, a == 1);
+            clear[a] += now_seconds() - start;
+        }
+    }
+    if (success) {
+        print_arena("heap", tracks, cycles, load[0], clear[0]);
+        print_arena("arena", tracks, cycles, load[1], clear[1]);
+    }
+    size_t chunks = arena.list_arena.chunk_count + arena.playlist_arena.chunk_count;
+    clear_strings(&heap, false);
+    free(heap.strings);
+    free(arena.strings);
+    string_arena_free(&arena.list_arena);
+    string_arena_free(&arena.playlist_arena);
+
+    track_list_t* list = track_list_create();
+    playlist_t playlist = {0};
+    success = success && list && playlist_init(&playlist);
+    double container_load = 0.0, container_clear = 0.0;
+    for (size_t cycle = 0; success && cycle < cycles; cycle++) {
+        double start = now_seconds();
+        success = load_containers(list, &playlist, tracks);
+        container_load += now_seconds() - start;
+        start = now_seconds();
+        track_list_clear(list);
+        playlist_clear(&playlist);
+        container_clear += now_seconds() - start;
+    }
+    if (success) print_arena("containers", tracks, cycles, container_load, container_clear);
+    else LOG_ERROR("Couldn't load %zu tracks.", tracks);
+
+    printf("{\"event\":\"arena_summary\",\"tracks\":%zu,\"same_strings\":%s,\"chunks\":%zu,"
+           "\"load_speedup\":%.2f,\"clear_speedup\":%.1f}\n",
+           tracks, same && success ? "true" : "false", chunks,
+           load[1] > 0.0 ? load[0] / load[1] : 0.0, clear[1] > 0.0 ? clear[0] / clear[1] : 0.0);
+    fflush(stdout);
+
+    if (playlist.tracks) playlist_free(&playlist);
+    if (list) track_list_free(list);
+    return same && success ? 0 : 1;
+}
+
+// pool
+// ----
+
+#define POOL_ARTISTS 1000
+#define POOL_ALBUMS 10000
+#define POOL_GENRES 2
+
+// artist, album and genre of a track, the tags of the library in the pool's commit
+typedef struct tag_strings {
+    const char* artist;
+    const char* album;
+    const char* genre;
+} tag_strings_t;
+
+// tags of the tagged track number tagged, every other track of the library
+static void pool_tags(size_t tagged, char* artist, char* album, char* genre, size_t size) {
+    snprintf(artist, size, "Artist %zu", (tagged * 7) % POOL_ARTISTS);
+    snprintf(album, size, "Album %zu", (tagged * 13) % POOL_ALBUMS);
+    snprintf(genre, size, "Genre %zu", tagged % POOL_GENRES);
+}
+
+static const char* copy_tag(const char* s) {
+    return strdup(s);
+}
+
+// what a load does to the tags, placeholders for every track and tags read for every other
+// one, with a copy per string the way tracks owned them or through the string pool
+static bool load_tags(tag_strings_t* tags, size_t tracks, bool pooled) {
+    const char* (*copy)(const char*) = pooled ? string_pool_intern : copy_tag;
+    char artist[32], album[32], genre[32];
+    for (size_t i = 0; i < tracks; i++) {
+        tags[i] = (tag_strings_t){ copy("Unknown Artist"), copy("Unknown Album"), copy("Unknown") };
+        if (!tags[i].artist || !tags[i].album || !tags[i].genre) return false;
+    }
+    for (size_t i = 0; i < tracks; i += 2) {
+        pool_tags(i / 2, artist, album, genre, sizeof(artist));
+        if (!pooled) {
+            free((char*)tags[i].artist);
+            free((char*)tags[i].album);
+            free((char*)tags[i].genre);
+        }
+        tags[i] = (tag_strings_t){ copy(artist), copy(album), copy(genre) };
+        if (!tags[i].artist || !tags[i].album || !tags[i].genre) return false;
+    }
+    return true;
+}
+
+static bool check_tags(const tag_strings_t* tags, size_t tracks) {
+    char artist[32], album[32], genre[32];
+    for (size_t i = 0; i < tracks; i++) {
+        if (i % 2 == 0) pool_tags(i / 2, artist, album, genre, sizeof(artist));
+        else {
+            snprintf(artist, sizeof(artist), "Unknown Artist");
+            snprintf(album, sizeof(album), "Unknown Album");
+            snprintf(genre, sizeof(genre), "Unknown");
+        }
+        if (strcmp(tags[i].artist, artist) != 0 || strcmp(tags[i].album, album) != 0 ||
+            strcmp(tags[i].genre, genre) != 0) return false;
+    }
+    return true;
+}
+
+// loads the tags of a synthetic library with a heap copy per tag against the string pool, and
+// counts the allocations, resident memory and live heap each one adds
+// the pool goes first, so the owned copies can't reuse memory it freed
+static int bench_pool(int argc, char** argv) {
+    size_t tracks = 300000;
+    for (int i = 0; i < argc; i++) {
+        const char* value;
+        if ((value = option_value(argc, argv, &i, "--tracks"))) tracks = strtoul(value, NULL, 10);
+        else return 2;
+    }
+    if (tracks == 0) return 2;
+
+    tag_strings_t* tags = calloc(tracks, sizeof(tag_strings_t));
+    if (!tags) {
+        LOG_ERROR("Memory allocation failed; couldn't hold the tags.");
+        return 1;
+    }
+    string_pool_clear();
+
+    bool same = true;
+    bool owned = false;
+    for (size_t pooled = 2; same && pooled-- > 0;) {
+        memset(tags, 0, tracks * sizeof(tag_strings_t));
+        owned = pooled == 0;
+        size_t resident = resident_bytes();
+        size_t heap = live_heap_bytes();
+        size_t allocations = atomic_load(&allocation_count);
+        double start = now_seconds();
+        same = load_tags(tags, tracks, pooled == 1);
+        double seconds = now_seconds() - start;
+        allocations = atomic_load(&allocation_count) - allocations;
+        same = same && check_tags(tags, tracks);
+
+        printf("{\"event\":\"pool\",\"strings\":\"%s\",\"tracks\":%zu,\"allocations\":%zu,"
+               "\"resident_bytes\":%lld,\"heap_bytes\":%lld,\"seconds\":%.6f",
+               pooled ? "pool" : "owned", tracks, allocations,
+               (long long)resident_bytes() - (long long)resident, (long long)live_heap_bytes() - (long long)heap, seconds);
+        if (pooled) {
+            string_pool_stats_t stats = string_pool_get_stats();
+            printf(",\"pool_strings\":%zu,\"pool_bytes\":%zu,\"lookups\":%zu,\"hits\":%zu",
+                   stats.strings, stats.bytes, stats.lookups, stats.hits);
+        }
+        printf("}\n");
+        fflush(stdout);
+    }
+
+    // the owned copies went last, the pool's strings stay until it's cleared like in the player
+    for (size_t i = 0; owned && i < tracks; i++) {
+        free((char*)tags[i].artist);
+        free((char*)tags[i].album);
+        free((char*)tags[i].genre);
+    }
+    free(tags);
+    string_pool_clear();
+
+    printf("{\"event\":\"pool_summary\",\"tracks\":%zu,\"same_tags\":%s}\n", tracks, same ? "true" : "false");
+    fflush(stdout);
+    return same ? 0 : 1;
+}
+
+// db
+// --
+
+// stores tracks tagged tracks in a new database and compacts them into its file
+static bool write_library_db(const char* db_path, size_t tracks) {
+    library_db_t* db = library_db_open(db_path);
+    if (!db) return false;
+
+    char path[128], title[64], artist[32], album[32];
+    track_t track = { .path = path, .title = title, .artist = artist, .album = album, .genre = "Genre" };
+    bool success = true;
+    for (size_t i = 0; success && i < tracks; i++) {
+        snprintf(path, sizeof(path), "/music/Artist %zu/Album %zu/%02zu - Track %zu.flac", i / 120, i / 12, i % 12 + 1, i);
+        snprintf(title, sizeof(title), "Track %zu", i);
+        snprintf(artist, sizeof(artist), "Artist %zu", i / 120);
+        snprintf(album, sizeof(album), "Album %zu", i / 12);
+        track.duration = 120 + (int)(i % 300);
+        track.year = 1950 + (int)(i % 75);
+        track.track_number = (int)(i % 12) + 1;
+        track.file_size = 1000000 + i;
+        success = library_db_put(db, &track);
+    }
+
+    // the compaction runs on its own thread, the swap happens on a poll once it's done
+    success = success && library_db_compact(db);
+    while (success && !library_db_poll(db)) {
+        struct timespec wait = { 0, 1000000 };
+        nanosleep(&wait, NULL);
+    }
+    library_db_close(db);
+    return success;
+}
+
+// opens the database of a large library over and over, warm and with the file dropped from
+// the page cache, then checks lookups into the mapping
+static int bench_db(int argc, char** argv) {
+    size_t tracks = 500000;
+    size_t runs = 5;
+    for (int i = 0; i < argc; i++) {
+        const char* value;
+        if ((value = option_value(argc, argv, &i, "--tracks"))) tracks = strtoul(value, NULL, 10);
+        else if ((value = option_value(argc, argv, &i, "--runs"))) runs = strtoul(value, NULL, 10);
+        else return 2;
+    }
+    if (tracks == 0 || runs == 0) return 2;
+
+    char dir[] = "/tmp/bench-db-XXXXXX";
+    if (!mkdtemp(dir)) {
+        LOG_ERROR("Couldn't create a directory for the database.");
+        return 1;
+    }
+    char db_path[64];
+    snprintf(db_path, sizeof(db_path), "%s/library.db", dir);
+    double start = now_seconds();
+    if (!write_library_db(db_path, tracks)) {
+        LOG_ERROR("Couldn't write a database of %zu tracks.", tracks);
+        remove_tree(dir);
+        return 1;
+    }
+    double write_seconds = now_seconds() - start;
+    struct stat db_stat;
+    long long bytes = stat(db_path, &db_stat) == 0 ? (long long)db_stat.st_size : 0;
+
+    bool same = true;
+    for (size_t cold = 0; same && cold < 2; cold++) {
+        double best = 0.0;
+        for (size_t run = 0; same && run < runs; run++) {
+            if (cold) drop_cached_pages(db_path);
+            start = now_seconds();
+            library_db_t* db = library_db_open(db_path);
+            double seconds = now_seconds() - start;
+            same = db && library_db_count(db) == tracks;
+            if (db) library_db_close(db);
+            if (run == 0 || seconds < best) best = seconds;
+        }
+        printf("{\"event\":\"db_open\",\"cache\":\"%s\",\"tracks\":%zu,\"bytes\":%lld,\"write_seconds\":%.3f,"
+               "\"open_ms\":%.3f}\n", cold ? "cold" : "warm", tracks, bytes, write_seconds, best * 1000.0);
+        fflush(stdout);
+    }
+
+    // lookups binary search the mapping, spread over the whole file
+    library_db_t* db = same ? library_db_open(db_path) : NULL;
+    size_t lookups = 0;
+    start = now_seconds();
+    for (size_t i = 0; db && same && i < tracks; i += 97) {
+        char path[128];
+        snprintf(path, sizeof(path), "/music/Artist %zu/Album %zu/%02zu - Track %zu.flac", i / 120, i / 12, i % 12 + 1, i);
+        library_db_track_t stored;
+        same = library_db_find(db, path, &stored) && stored.duration == 120 + (int)(i % 300) &&
+               stored.file_size == 1000000 + i;
+        lookups++;
+    }
+    double lookup_seconds = now_seconds() - start;
+    if (db) library_db_close(db);
+
+    printf("{\"event\":\"db_summary\",\"tracks\":%zu,\"lookups\":%zu,\"lookup_us\":%.3f,\"same_tracks\":%s}\n",
+           tracks, lookups, lookups ? lookup_seconds * 1e6 / (double)lookups : 0.0, same ? "true" : "false");
+    fflush(stdout);
+    remove_tree(dir);
+    return same ? 0 : 1;
+}
+
+// main
+// ----
+
+typedef struct bench_command {
+    const char* name;
+    const char* usage;
+    int (*run)(int argc, char** argv); // returns the exit status, 2 for bad arguments
+} bench_command_t;
+
+static const bench_command_t commands[] = {
+    { "scan", "[--depth N] [--fanout N] [--files N] [--threads N] [--runs N] [--stat] [dir]\n"
+              "      old recursive walker against the scanner, then the scanner without and with its cache,\n"
+              "      on a synthetic tree (3, 6, 30) or dir, --stat classifies entries by stat instead of d_type",
+      bench_scan },
+    { "columns", "[--tracks N] [--runs N]\n"
+                 "      loops over track records against the column kernels on a synthetic library (1000000)",
+      bench_columns },
+    { "remove", "[--tracks N] [--firsts N]\n"
+                "      shifting removes against swap-remove and mark and sweep on a synthetic list (50000, 20)",
+      bench_remove },
+    { "crossfade", "[--seconds S] [--fade S] [--block N] [--buffer-ms N]\n"
+                   "      cost of a block while two tracks decode and mix against one, on two tracks (20, 8, 480, 20)",
+      bench_crossfade },
+    { "decode", "[--seconds S] [--runs N] [--cold] [file...]\n"
+                "      stdio reads against memory mapped decoding, of generated wav and flac files (180 s) or files",
+      bench_decode },
+    { "seek", "[--minutes M] [--runs N] [file]\n"
+              "      seeks at 10, 50 and 90% of a large mp3 without and with its seek index (generated, 120 minutes)",
+      bench_seek },
+    { "durations", "[--files N] [--threads N] [--runs N] [--decoder]\n"
+                   "      probes the lengths of a generated library of mp3, ogg, opus, m4a, flac and wav (10000)",
+      bench_durations },
+    { "dedup", "[--paths N]\n"
+               "      imports paths, a tenth of them repeats, looking each up by a scan against the path index (100000)",
+      bench_dedup },
+    { "members", "[--members N]\n"
+                 "      genre and album membership by scanning the handle arrays against the handle sets (20000)",
+      bench_members },
+    { "graph", "[--tracks N] [--threads N] [--runs N] [--naive-tracks N]\n"
+               "      builds the album graph of a synthetic library (1000000, 1 thread) against find_by_title\n"
+               "      and add_track on the first naive-tracks of it (20000)",
+      bench_graph },
+    { "arena", "[--tracks N] [--cycles N]\n"
+               "      load and clear cycles with a heap string per path and title against the arenas, then\n"
+               "      through the track list and playlist (200000, 10)",
+      bench_arena },
+    { "pool", "[--tracks N]\n"
+              "      allocations and memory of a library's tags as owned copies against the string pool (300000)",
+      bench_pool },
+    { "db", "[--tracks N] [--runs N]\n"
+            "      writes a library database and times opening it warm and cold, and lookups into it (500000)",
+      bench_db },
+};
+#define COMMAND_COUNT (sizeof(commands) / sizeof(commands[0]))
+
+static void print_usage(const char* program) {
+    fprintf(stderr, "usage: %s <benchmark> [options]\n", program);
+    for (size_t i = 0; i < COMMAND_COUNT; i++) {
+        fprintf(stderr, "  %s %s\n", commands[i].name, commands[i].usage);
+    }
+}
+
+int main(int argc, char** argv) {
+    for (size_t i = 0; argc > 1 && i < COMMAND_COUNT; i++) {
+        if (strcmp(argv[1], commands[i].name) != 0) continue;
+        int status = commands[i].run(argc - 2, argv + 2);
+        if (status == 2) print_usage(argv[0]);
+        return status;
+    }
+    print_usage(argv[0]);
+    return 2;
+}
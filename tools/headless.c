@@ -0,0 +1,630 @@
+#define _GNU_SOURCE
+#include "audio_device.h"
+#include "logger.h"
+#include "offline_render.h"
+#include "playlist.h"
+#include <math.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <time.h>
+#include <unistd.h>
+
+// plays a playlist through the same playlist and audio device code as the app, without a
+// window or a sound card, and prints what it measured as json lines on stdout
+// logs go to stderr, so stdout can be piped straight into a file or another tool
+
+typedef struct options {
+    audio_device_output_t output;
+    bool output_given; // --output was passed, --measure-gap plays on the null backend otherwise
+    double seconds; // of every track before skipping to the next one, 0 plays them to the end
+    bool gapless;
+    float crossfade;
+    unsigned int buffer_ms;
+    unsigned int sample_rate;
+    size_t period; // frames per render without a device, the app's device period is about this long
+    bool map_files;
+    const char* render; // file the tracks are rendered into instead of played, NULL plays them
+    size_t first; // of the tracks rendered
+    size_t count; // 0 renders to the end
+    size_t threads;
+    float volume;
+    bool measure_gap; // play generated tracks and fail on any silence between them
+    unsigned int open_delay_ms; // every open waits this long, like a sleeping disk
+    size_t rapid_skip; // presses of next on generated tracks, 0 plays the playlist instead
+    double press_ms; // between those presses
+    double fps; // of the ui loop the presses are made from
+} options_t;
+
+// what one pass over the playlist measured
+typedef struct run {
+    size_t frames; // rendered without a device
+    size_t renders;
+    double render_seconds;
+    double render_seconds_max;
+    size_t transitions; // track changes heard, starts and skips included
+    double transition_seconds;
+    double transition_seconds_max;
+    size_t failed;
+    size_t underruns; // at the last event, so events report their own
+} run_t;
+
+static double now_seconds(void) {
+    struct timespec time;
+    clock_gettime(CLOCK_MONOTONIC, &time);
+    return (double)time.tv_sec + (double)time.tv_nsec / 1e9;
+}
+
+static void sleep_seconds(double seconds) {
+    struct timespec time = { .tv_sec = (time_t)seconds, .tv_nsec = (long)((seconds - (time_t)seconds) * 1e9) };
+    nanosleep(&time, NULL);
+}
+
+// paths can hold anything but a nul, so quotes, backslashes and control characters are escaped
+static void print_json_string(const char* s) {
+    putchar('"');
+    for (; *s; s++) {
+        unsigned char c = (unsigned char)*s;
+        if (c == '"' || c == '\\') printf("\\%c", c);
+        else if (c < 0x20) printf("\\u%04x", c);
+        else putchar(c);
+    }
+    putchar('"');
+}
+
+static const char* output_name(audio_device_output_t output) {
+    switch (output) {
+        case AUDIO_DEVICE_OUTPUT_DEFAULT: return "default";
+        case AUDIO_DEVICE_OUTPUT_NULL: return "null";
+        case AUDIO_DEVICE_OUTPUT_NONE: return "none";
+    }
+    return "unknown";
+}
+
+static void print_usage(const char* program) {
+    fprintf(stderr,
+        "usage: %s [options] <file or folder>...\n"
+        "  --output none|null|default  where audio goes, none renders as fast as it decodes (none)\n"
+        "  --seconds N                 play N seconds of every track then skip to the next (0, the whole track)\n"
+        "  --no-gapless                start every track after the last one finished\n"
+        "  --crossfade N               overlap tracks for N seconds\n"
+        "  --buffer-ms N               decode read ahead (400)\n"
+        "  --rate N                    engine sample rate, 0 takes the device's (0)\n"
+        "  --period N                  frames per render without a device (480)\n"
+        "  --no-map                    decode with stdio reads instead of memory mappings\n"
+        "  --render FILE               render the tracks into a .wav or .flac file as fast as the cpu goes\n"
+        "  --first N                   first track rendered, from 0 (0)\n"
+        "  --count N                   tracks rendered, 0 for the rest (0)\n"
+        "  --threads N                 tracks rendered at once, 0 for one per core (0)\n"
+        "  --volume N                  volume from 0 to 1 (1)\n"
+        "  --measure-gap               play generated tracks (null output unless set) and fail on any gap between them\n"
+        "  --open-delay-ms N           every track open waits N ms first, like a sleeping disk or a network share (0)\n"
+        "  --rapid-skip N              press next N times on generated tracks (null output unless set) and time the presses\n"
+        "  --press-ms N                between those presses (50)\n"
+        "  --fps N                     of the ui loop the presses are made from (144)\n",
+        program
+    );
+}
+
+// returns false on a bad argument, paths are appended to the playlist in the given order
+static bool parse_args(int argc, char** argv, options_t* options, playlist_t* list) {
+    for (int i = 1; i < argc; i++) {
+        const char* arg = argv[i];
+        const char* value = i + 1 < argc ? argv[i + 1] : NULL;
+        bool takes_value = true;
+
+        if (strcmp(arg, "--output") == 0 && value) {
+            if (strcmp(value, "none") == 0) options->output = AUDIO_DEVICE_OUTPUT_NONE;
+            else if (strcmp(value, "null") == 0) options->output = AUDIO_DEVICE_OUTPUT_NULL;
+            else if (strcmp(value, "default") == 0) options->output = AUDIO_DEVICE_OUTPUT_DEFAULT;
+            else return false;
+            options->output_given = true;
+        } else if (strcmp(arg, "--seconds") == 0 && value) {
+            options->seconds = strtod(value, NULL);
+        } else if (strcmp(arg, "--crossfade") == 0 && value) {
+            options->crossfade = strtof(value, NULL);
+        } else if (strcmp(arg, "--buffer-ms") == 0 && value) {
+            options->buffer_ms = (unsigned int)strtoul(value, NULL, 10);
+        } else if (strcmp(arg, "--rate") == 0 && value) {
+            options->sample_rate = (unsigned int)strtoul(value, NULL, 10);
+        } else if (strcmp(arg, "--period") == 0 && value) {
+            options->period = strtoul(value, NULL, 10);
+            if (options->period == 0) return false;
+        } else if (strcmp(arg, "--render") == 0 && value) {
+            options->render = value;
+        } else if (strcmp(arg, "--first") == 0 && value) {
+            options->first = strtoul(value, NULL, 10);
+        } else if (strcmp(arg, "--count") == 0 && value) {
+            options->count = strtoul(value, NULL, 10);
+        } else if (strcmp(arg, "--threads") == 0 && value) {
+            options->threads = strtoul(value, NULL, 10);
+        } else if (strcmp(arg, "--volume") == 0 && value) {
+            options->volume = strtof(value, NULL);
+        } else if (strcmp(arg, "--open-delay-ms") == 0 && value) {
+            options->open_delay_ms = (unsigned int)strtoul(value, NULL, 10);
+        } else if (strcmp(arg, "--rapid-skip") == 0 && value) {
+            options->rapid_skip = strtoul(value, NULL, 10);
+            if (options->rapid_skip == 0) return false;
+        } else if (strcmp(arg, "--press-ms") == 0 && value) {
+            options->press_ms = strtod(value, NULL);
+        } else if (strcmp(arg, "--fps") == 0 && value) {
+            options->fps = strtod(value, NULL);
+            if (options->fps <= 0.0) return false;
+        } else {
+            takes_value = false;
+            if (strcmp(arg, "--no-gapless") == 0) {
+                options->gapless = false;
+            } else if (strcmp(arg, "--no-map") == 0) {
+                options->map_files = false;
+            } else if (strcmp(arg, "--measure-gap") == 0) {
+                options->measure_gap = true;
+            } else if (strncmp(arg, "--", 2) == 0) {
+                return false;
+            } else {
+                struct stat path_stat;
+                if (stat(arg, &path_stat) == 0 && S_ISDIR(path_stat.st_mode)) {
+                    playlist_scan_dir_recursive(list, arg);
+                } else {
+                    playlist_append(list, arg);
+                }
+            }
+        }
+        if (takes_value) i++;
+    }
+    return true;
+}
+
+// events
+// ------
+
+static void print_event(const char* event, const playlist_t* list, audio_device_t* dev, run_t* run, double seconds) {
+    audio_device_stats_t stats = audio_device_get_stats(dev);
+    printf("{\"event\":\"%s\",\"track\":%zu,\"path\":", event, playlist_get_current_track(list));
+    print_json_string(playlist_get_current_track_path(list));
+    if (seconds >= 0.0) printf(",\"ms\":%.3f", seconds * 1000.0);
+    printf(",\"underruns\":%zu}\n", stats.underruns - run->underruns);
+    fflush(stdout);
+    run->underruns = stats.underruns;
+}
+
+// a play or skip is over once the audio thread plays the new track, without a device
+// the wait shows up in the render that waited for the decode thread
+static void finish_transition(const playlist_t* list, audio_device_t* dev, run_t* run, double requested, const char* event) {
+    double seconds = now_seconds() - requested;
+    run->transitions++;
+    run->transition_seconds += seconds;
+    if (seconds > run->transition_seconds_max) run->transition_seconds_max = seconds;
+    print_event(event, list, dev, run, seconds);
+}
+
+static void print_summary(const options_t* options, const playlist_t* list, audio_device_t* dev, const run_t* run, double wall) {
+    audio_device_stats_t stats = audio_device_get_stats(dev);
+    double rate = (double)ma_engine_get_sample_rate(&dev->engine);
+    // with a device the clock is the device's, so audio and wall time are the same
+    double audio = options->output == AUDIO_DEVICE_OUTPUT_NONE ? (double)run->frames / rate : wall;
+
+    printf("{\"event\":\"summary\",\"output\":\"%s\",\"tracks\":%zu,\"failed\":%zu,"
+           "\"sample_rate\":%.0f,\"frames\":%zu,\"audio_seconds\":%.3f,\"wall_seconds\":%.3f,"
+           "\"realtime_factor\":%.2f,",
+           output_name(options->output), playlist_count(list), run->failed,
+           rate, run->frames, audio, wall, wall > 0.0 ? audio / wall : 0.0);
+    printf("\"renders\":%zu,\"render_mean_ms\":%.4f,\"render_max_ms\":%.4f,",
+           run->renders, run->renders ? run->render_seconds * 1000.0 / (double)run->renders : 0.0,
+           run->render_seconds_max * 1000.0);
+    printf("\"reads\":%zu,\"read_mean_ms\":%.4f,\"read_max_ms\":%.4f,",
+           stats.reads, stats.reads ? stats.read_seconds * 1000.0 / (double)stats.reads : 0.0,
+           stats.read_seconds_max * 1000.0);
+    printf("\"underruns\":%zu,\"underrun_frames\":%zu,\"transitions\":%zu,"
+           "\"transition_mean_ms\":%.3f,\"transition_max_ms\":%.3f}\n",
+           stats.underruns, stats.underrun_frames, run->transitions,
+           run->transitions ? run->transition_seconds * 1000.0 / (double)run->transitions : 0.0,
+           run->transition_seconds_max * 1000.0);
+    fflush(stdout);
+}
+
+// playback
+// --------
+
+// renders or waits one period
+static void step(const options_t* options, audio_device_t* dev, float* buffer, run_t* run) {
+    if (options->output != AUDIO_DEVICE_OUTPUT_NONE) {
+        // the device pulls on its own clock, this only paces the polling like the app's frames
+        sleep_seconds((double)options->period / (double)ma_engine_get_sample_rate(&dev->engine));
+        return;
+    }
+
+    double start = now_seconds();
+    size_t rendered = audio_device_render(dev, buffer, options->period);
+    double seconds = now_seconds() - start;
+    run->frames += rendered;
+    run->renders++;
+    run->render_seconds += seconds;
+    if (seconds > run->render_seconds_max) run->render_seconds_max = seconds;
+}
+
+// plays every track once in order, queued ahead like the app does
+static void play(const options_t* options, playlist_t* list, audio_device_t* dev, run_t* run) {
+    float* buffer = NULL;
+    if (options->output == AUDIO_DEVICE_OUTPUT_NONE) {
+        buffer = malloc(options->period * ma_engine_get_channels(&dev->engine) * sizeof(float));
+        if (!buffer) {
+            LOG_ERROR("Memory allocation failed; couldn't render.");
+            return;
+        }
+    }
+
+    double requested = now_seconds();
+    const char* waiting = "start"; // event of a play not heard yet, NULL once it is
+    playlist_play_current(list, dev);
+
+    while (true) {
+        bool last = !playlist_has_next(list);
+
+        if (audio_device_poll_transition(dev)) {
+            playlist_set_current_track(list, playlist_get_current_track(list) + 1);
+            print_event(options->crossfade > 0.0f ? "crossfade" : "gapless", list, dev, run, -1.0);
+            last = !playlist_has_next(list);
+        } else if (!dev->sound_loaded) {
+            // the file failed to open
+            run->failed++;
+            print_event("failed", list, dev, run, -1.0);
+            waiting = NULL;
+            if (last) break;
+            requested = now_seconds();
+            waiting = "start";
+            playlist_play_next(list, dev);
+            continue;
+        }
+
+        audio_device_state_t state = audio_device_get_state(dev);
+        if (waiting && !state.loading) {
+            finish_transition(list, dev, run, requested, waiting);
+            waiting = NULL;
+        }
+
+        // never queued past the last track, the pass ends there instead of wrapping around
+        if (!last && audio_device_is_playing(dev)) {
+            const char* next = playlist_get_next_track_path(list);
+            const char* queued = dev->queued_path;
+            if (!queued || strcmp(queued, next) != 0) audio_device_queue_next(dev, next);
+        }
+
+        bool skip = options->seconds > 0.0 && !waiting && state.position >= options->seconds;
+        if (skip || audio_device_is_finished(dev)) {
+            if (last) break;
+            requested = now_seconds();
+            waiting = skip ? "skip" : "next";
+            playlist_play_next(list, dev);
+        }
+
+        step(options, dev, buffer, run);
+    }
+    free(buffer);
+}
+
+// gap measurement
+// ---------------
+
+// quieter than this on every channel counts as silence, the test tone never is
+#define GAP_SILENCE 0.01f
+
+// generated tracks, rates other than the engine's go through the decoder's resampler
+typedef struct gap_track {
+    uint32_t sample_rate;
+    double seconds;
+} gap_track_t;
+
+static const gap_track_t gap_tracks[] = {
+    { 48000, 0.6 },
+    { 44100, 0.45 },
+    { 48000, 0.3 },
+    { 22050, 0.5 },
+    { 48000, 0.4 },
+};
+#define GAP_TRACK_COUNT (sizeof(gap_tracks) / sizeof(gap_tracks[0]))
+
+// what the tap heard, only touched on the audio thread until the device is freed
+typedef struct gap_probe {
+    ma_engine* engine;
+    bool started; // the first track was heard
+    uint64_t silent; // frames of silence since the last sound
+    size_t gaps;
+    uint64_t gap_frames;
+    uint64_t gap_frames_max;
+} gap_probe_t;
+
+static void gap_tap(void* user_data, float* frames, ma_uint64 frame_count) {
+    gap_probe_t* probe = user_data;
+    ma_uint32 channels = ma_engine_get_channels(probe->engine);
+    for (ma_uint64 i = 0; i < frame_count; i++) {
+        bool silent = true;
+        for (ma_uint32 c = 0; c < channels; c++) {
+            if (fabsf(frames[i * channels + c]) >= GAP_SILENCE) silent = false;
+        }
+        if (silent) {
+            if (probe->started) probe->silent++;
+            continue;
+        }
+        // silence with sound after it was a gap, the silence after the last track isn't
+        if (probe->silent > 0) {
+            probe->gaps++;
+            probe->gap_frames += probe->silent;
+            if (probe->silent > probe->gap_frames_max) probe->gap_frames_max = probe->silent;
+        }
+        probe->started = true;
+        probe->silent = 0;
+    }
+}
+
+// a tone offset from zero, so any silence heard between tracks is a gap
+static bool write_tone(const char* path, uint32_t sample_rate, double seconds) {
+    ma_encoder_config config = ma_encoder_config_init(ma_encoding_format_wav, ma_format_s16, 2, sample_rate);
+    ma_encoder encoder;
+    if (ma_encoder_init_file(path, &config, &encoder) != MA_SUCCESS) {
+        LOG_ERROR("Couldn't create test track %s.", path);
+        return false;
+    }
+
+    size_t frames = (size_t)(seconds * sample_rate);
+    int16_t block[1024 * 2];
+    bool success = true;
+    for (size_t done = 0; success && done < frames;) {
+        size_t count = frames - done < 1024 ? frames - done : 1024;
+        for (size_t i = 0; i < count; i++) {
+            double tone = 0.25 + 0.2 * sin(2.0 * M_PI * 220.0 * (double)(done + i) / sample_rate);
+            block[i * 2] = (int16_t)(tone * 32767.0);
+            block[i * 2 + 1] = (int16_t)(-tone * 32767.0);
+        }
+        ma_uint64 written = 0;
+        success = ma_encoder_write_pcm_frames(&encoder, block, count, &written) == MA_SUCCESS && written == count;
+        done += count;
+    }
+    ma_encoder_uninit(&encoder);
+    return success;
+}
+
+// writes the generated tracks into dir and appends them to the playlist
+static bool write_gap_tracks(const char* dir, playlist_t* list) {
+    char path[256];
+    for (size_t i = 0; i < GAP_TRACK_COUNT; i++) {
+        snprintf(path, sizeof(path), "%s/track-%zu.wav", dir, i);
+        if (!write_tone(path, gap_tracks[i].sample_rate, gap_tracks[i].seconds)) return false;
+        playlist_append(list, path);
+    }
+    return true;
+}
+
+static void remove_gap_tracks(const char* dir) {
+    char path[256];
+    for (size_t i = 0; i < GAP_TRACK_COUNT; i++) {
+        snprintf(path, sizeof(path), "%s/track-%zu.wav", dir, i);
+        unlink(path);
+    }
+    rmdir(dir);
+}
+
+static void print_gaps(const options_t* options, const gap_probe_t* probe) {
+    printf("{\"event\":\"gaps\",\"output\":\"%s\",\"tracks\":%zu,\"gaps\":%zu,"
+           "\"gap_frames\":%llu,\"gap_frames_max\":%llu}\n",
+           output_name(options->output), GAP_TRACK_COUNT, probe->gaps,
+           (unsigned long long)probe->gap_frames, (unsigned long long)probe->gap_frames_max);
+    fflush(stdout);
+}
+
+// rapid skip
+// ----------
+
+#define SKIP_TRACK_SECONDS 5.0 // longer than any run of presses, so no track ends on its own
+#define SKIP_SETTLE_SECONDS 0.2 // the first track plays this long before the first press
+#define SKIP_TIMEOUT 30.0
+
+// writes a generated track per press and one to start on into dir
+static bool write_skip_tracks(const char* dir, size_t presses, playlist_t* list) {
+    char path[256];
+    for (size_t i = 0; i <= presses; i++) {
+        snprintf(path, sizeof(path), "%s/skip-%zu.wav", dir, i);
+        if (!write_tone(path, 48000, SKIP_TRACK_SECONDS)) return false;
+        playlist_append(list, path);
+    }
+    return true;
+}
+
+static void remove_skip_tracks(const char* dir, size_t presses) {
+    char path[256];
+    for (size_t i = 0; i <= presses; i++) {
+        snprintf(path, sizeof(path), "%s/skip-%zu.wav", dir, i);
+        unlink(path);
+    }
+    rmdir(dir);
+}
+
+// presses next from a loop paced like the app's frames once the first track is heard, and
+// times how long each press holds the loop, every frame, and how long until the last press
+// is heard, nothing is queued ahead so every press opens its file
+static bool rapid_skip(const options_t* options, playlist_t* list, audio_device_t* dev) {
+    double budget = 1.0 / options->fps;
+    double start = now_seconds();
+    playlist_play_current(list, dev);
+
+    size_t pressed = 0;
+    double first_press = 0.0, last_press = 0.0, next_press = 0.0, heard = 0.0;
+    bool started = false;
+    size_t frames = 0, over_budget = 0;
+    double frame_max = 0.0;
+    double frame_start = now_seconds();
+    while (frame_start - start < SKIP_TIMEOUT) {
+        audio_device_poll_transition(dev);
+        audio_device_state_t state = audio_device_get_state(dev);
+        if (!dev->sound_loaded) break; // a generated track failed to open
+        if (!started && !state.loading) {
+            started = true;
+            next_press = frame_start + SKIP_SETTLE_SECONDS;
+        } else if (started && pressed < options->rapid_skip && frame_start >= next_press) {
+            double before = now_seconds();
+            playlist_play_next(list, dev);
+            double call = now_seconds() - before;
+            if (pressed == 0) first_press = before;
+            last_press = before;
+            next_press += options->press_ms / 1000.0;
+            printf("{\"event\":\"press\",\"press\":%zu,\"track\":%zu,\"call_ms\":%.3f}\n",
+                   pressed, playlist_get_current_track(list), call * 1000.0);
+            fflush(stdout);
+            pressed++;
+        } else if (pressed == options->rapid_skip && !state.loading) {
+            heard = now_seconds();
+            break;
+        }
+
+        double elapsed = now_seconds() - frame_start;
+        if (elapsed < budget) sleep_seconds(budget - elapsed);
+        double frame_end = now_seconds();
+        double frame = frame_end - frame_start;
+        frames++;
+        if (frame > frame_max) frame_max = frame;
+        if (frame > 2.0 * budget) over_budget++;
+        frame_start = frame_end;
+    }
+
+    bool success = heard > 0.0;
+    printf("{\"event\":\"rapid_skip\",\"presses\":%zu,\"press_ms\":%.1f,\"open_delay_ms\":%u,\"fps\":%.0f,"
+           "\"frames\":%zu,\"frame_max_ms\":%.3f,\"frames_over_2x_budget\":%zu,",
+           pressed, options->press_ms, options->open_delay_ms, options->fps, frames, frame_max * 1000.0, over_budget);
+    if (success) {
+        printf("\"heard_after_last_press_ms\":%.3f,\"heard_after_first_press_ms\":%.3f,",
+               (heard - last_press) * 1000.0, (heard - first_press) * 1000.0);
+    }
+    printf("\"heard\":%s}\n", success ? "true" : "false");
+    fflush(stdout);
+    return success;
+}
+
+// rendering
+// ---------
+
+// renders the tracks into a file with the offline renderer instead of playing them
+static bool render(const options_t* options, const playlist_t* list) {
+    size_t count = options->count;
+    if (count == 0 && options->first < playlist_count(list)) count = playlist_count(list) - options->first;
+
+    offline_render_options_t render_options = offline_render_default_options();
+    render_options.format = offline_render_format_for_path(options->render);
+    render_options.sample_rate = options->sample_rate;
+    render_options.volume = options->volume;
+    render_options.crossfade = options->gapless ? options->crossfade : 0.0f;
+    render_options.thread_count = options->threads;
+    render_options.map_files = options->map_files;
+
+    offline_render_stats_t stats = {0};
+    if (!offline_render_playlist(list, options->first, count, options->render, &render_options, &stats)) return false;
+
+    double audio = stats.sample_rate ? (double)stats.frames / (double)stats.sample_rate : 0.0;
+    printf("{\"event\":\"render\",\"path\":");
+    print_json_string(options->render);
+    printf(",\"format\":\"%s\",\"tracks\":%zu,\"failed\":%zu,\"sample_rate\":%u,\"frames\":%llu,"
+           "\"audio_seconds\":%.3f,\"wall_seconds\":%.3f,\"realtime_factor\":%.2f,"
+           "\"threads\":%zu,\"render_seconds\":%.3f}\n",
+           render_options.format == OFFLINE_RENDER_FLAC ? "flac" : "wav", stats.tracks, stats.failed,
+           stats.sample_rate, (unsigned long long)stats.frames, audio, stats.seconds,
+           stats.seconds > 0.0 ? audio / stats.seconds : 0.0, stats.threads, stats.render_seconds);
+    fflush(stdout);
+    return true;
+}
+
+int main(int argc, char** argv) {
+    options_t options = {
+        .output = AUDIO_DEVICE_OUTPUT_NONE,
+        .gapless = true,
+        .buffer_ms = 400,
+        .period = 480,
+        .map_files = true,
+        .volume = 1.0f,
+        .press_ms = 50.0,
+        .fps = 144.0
+    };
+    playlist_t list = {0};
+    playlist_init(&list);
+
+    // the gap measurement and the rapid skip bring their own tracks
+    bool valid = parse_args(argc, argv, &options, &list);
+    bool generated = options.measure_gap || options.rapid_skip > 0;
+    if (!valid || generated != playlist_is_empty(&list) || (generated && options.render) ||
+        (options.measure_gap && options.rapid_skip > 0)) {
+        print_usage(argv[0]);
+        playlist_free(&list);
+        return 2;
+    }
+
+    char gap_dir[] = "/tmp/headless-gap-XXXXXX";
+    if (options.measure_gap) {
+        if (!options.output_given) options.output = AUDIO_DEVICE_OUTPUT_NULL;
+        if (!mkdtemp(gap_dir) || !write_gap_tracks(gap_dir, &list)) {
+            LOG_ERROR("Couldn't write the tracks to measure gaps with.");
+            remove_gap_tracks(gap_dir);
+            playlist_free(&list);
+            return 1;
+        }
+    }
+    char skip_dir[] = "/tmp/headless-skip-XXXXXX";
+    if (options.rapid_skip > 0) {
+        if (!options.output_given) options.output = AUDIO_DEVICE_OUTPUT_NULL;
+        if (!mkdtemp(skip_dir) || !write_skip_tracks(skip_dir, options.rapid_skip, &list)) {
+            LOG_ERROR("Couldn't write the tracks to skip through.");
+            remove_skip_tracks(skip_dir, options.rapid_skip);
+            playlist_free(&list);
+            return 1;
+        }
+    }
+
+    if (options.render) {
+        bool rendered = render(&options, &list);
+        playlist_free(&list);
+        return rendered ? 0 : 1;
+    }
+
+    audio_device_options_t device_options = audio_device_default_options();
+    device_options.output = options.output;
+    device_options.buffer_ms = options.buffer_ms;
+    device_options.sample_rate = options.sample_rate;
+    device_options.map_files = options.map_files;
+    device_options.volume = options.volume;
+    device_options.open_delay_ms = options.open_delay_ms;
+
+    audio_device_t dev = {0};
+    gap_probe_t probe = { .engine = &dev.engine };
+    if (options.measure_gap) {
+        device_options.tap = gap_tap;
+        device_options.tap_data = &probe;
+    }
+    if (!audio_device_init(&dev, &device_options)) {
+        if (options.measure_gap) remove_gap_tracks(gap_dir);
+        if (options.rapid_skip > 0) remove_skip_tracks(skip_dir, options.rapid_skip);
+        playlist_free(&list);
+        return 1;
+    }
+    audio_device_set_gapless(&dev, options.gapless);
+    if (options.crossfade > 0.0f) audio_device_set_crossfade(&dev, options.crossfade);
+
+    if (options.rapid_skip > 0) {
+        bool heard = rapid_skip(&options, &list, &dev);
+        audio_device_free(&dev);
+        remove_skip_tracks(skip_dir, options.rapid_skip);
+        playlist_free(&list);
+        return heard ? 0 : 1;
+    }
+
+    run_t run = {0};
+    double start = now_seconds();
+    play(&options, &list, &dev, &run);
+    print_summary(&options, &list, &dev, &run, now_seconds() - start);
+
+    audio_device_free(&dev);
+    // the device is stopped, the probe is this thread's again
+    int status = 0;
+    if (options.measure_gap) {
+        print_gaps(&options, &probe);
+        remove_gap_tracks(gap_dir);
+        status = probe.gaps == 0 ? 0 : 1;
+    }
+    playlist_free(&list);
+    return status;
+}